@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef byteorder_h
+#define byteorder_h
+
+#include "ucm/types.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+// Integers stored in files with a fixed byte order, independent of the host
+
+inline uint readLE16(const byte* p) { return p[0] | (p[1] << 8); }
+inline uint readLE32(const byte* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint)p[3] << 24); }
+inline unsigned long long readLE64(const byte* p) {
+	return readLE32(p) | ((unsigned long long)readLE32(p + 4) << 32);
+}
+
+inline uint readBE16(const byte* p) { return (p[0] << 8) | p[1]; }
+inline uint readBE32(const byte* p) { return ((uint)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+inline void writeLE16(byte* p, const uint v) { p[0] = (byte)v; p[1] = (byte)(v >> 8); }
+inline void writeLE32(byte* p, const uint v) {
+	p[0] = (byte)v; p[1] = (byte)(v >> 8); p[2] = (byte)(v >> 16); p[3] = (byte)(v >> 24);
+}
+inline void writeLE64(byte* p, const unsigned long long v) {
+	writeLE32(p, (uint)v);
+	writeLE32(p + 4, (uint)(v >> 32));
+}
+
+}
+
+#endif /* byteorder_h */
@@ -127,10 +127,61 @@ public:
 
 typedef Image Image4f, Image3f, Image4b, Image3b;
 
+// Whether createEmpty can hold width x height pixels of pixelByteLength bytes, row and
+// buffer sizes are computed in 32 bits. Decoders check header sizes with it before
+// allocating, so a crafted size cannot wrap the buffer smaller than the rows written.
+inline bool isImageSizeSupported(const unsigned long long width, const unsigned long long height,
+																 const uint pixelByteLength) {
+	return width > 0 && height > 0 && width <= 0x7fffffff && height <= 0x7fffffff
+		&& width * height * pixelByteLength <= 0xffffffffull;
+}
+
 class NotSupportPixelColorTypeException : public Exception {
 	
 };
 
+// Typed read/write of one pixel of 8-bit or float images with 3 or 4 components,
+// used by the filters which walk the buffer directly instead of getPixel/setPixel.
+template<typename T, int C>
+struct PixelAccessor;
+
+template<int C>
+struct PixelAccessor<byte, C> {
+	static inline color4f read(const byte* p) {
+		return color4f(p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f, C == 4 ? p[3] / 255.0f : 1.0f);
+	}
+	
+	static inline void write(byte* p, const color4f& c) {
+		// rounded, so that a read and write round trip keeps the value
+		p[0] = (byte)(clamp(c.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+		p[1] = (byte)(clamp(c.g, 0.0f, 1.0f) * 255.0f + 0.5f);
+		p[2] = (byte)(clamp(c.b, 0.0f, 1.0f) * 255.0f + 0.5f);
+		if (C == 4) p[C - 1] = (byte)(clamp(c.a, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+};
+
+template<int C>
+struct PixelAccessor<float, C> {
+	static inline color4f read(const float* p) {
+		return color4f(p[0], p[1], p[2], C == 4 ? p[3] : 1.0f);
+	}
+	
+	static inline void write(float* p, const color4f& c) {
+		p[0] = c.r; p[1] = c.g; p[2] = c.b;
+		if (C == 4) p[C - 1] = c.a;
+	}
+};
+
+// Call func<T, C>(...) with the component type and count of image
+#define DISPATCH_IMAGE_PIXEL_TYPE(image, func, ...) \
+	switch ((image).getBitDepth() * 8 + (image).getColorComponents()) { \
+		case 8 * 8 + 3: func<byte, 3>(__VA_ARGS__); break; \
+		case 8 * 8 + 4: func<byte, 4>(__VA_ARGS__); break; \
+		case 32 * 8 + 3: func<float, 3>(__VA_ARGS__); break; \
+		case 32 * 8 + 4: func<float, 4>(__VA_ARGS__); break; \
+		default: throw NotSupportPixelColorTypeException(); \
+	}
+
 }
 
 #endif /* __IMAGE_H_ */
@@ -0,0 +1,312 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "imgasync.h"
+#include "ucm/stream.h"
+
+#include <algorithm>
+
+namespace ugm {
+
+ImageSaveQueue::ImageSaveQueue(const uint capacity, ThreadPool* pool)
+: pool(pool != NULL ? *pool : ThreadPool::shared()), capacity(std::max(capacity, 1u)) {
+}
+
+ImageSaveQueue::~ImageSaveQueue() {
+	this->waitAll();
+}
+
+void ImageSaveQueue::acquire() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->released.wait(lock, [this]() { return this->pending < this->capacity; });
+	this->pending++;
+	this->active++;
+}
+
+// Notified under the lock, a waiter woken by it may destroy the queue right after
+void ImageSaveQueue::release() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->pending--;
+	this->released.notify_all();
+}
+
+// The last access of a save task to the queue
+void ImageSaveQueue::finish() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->active--;
+	this->released.notify_all();
+}
+
+std::future<void> ImageSaveQueue::enqueue(const std::shared_ptr<const Image>& image,
+																					const std::function<void(const Image&)>& writer, const Callback& callback) {
+	this->acquire();
+	
+	try {
+		return this->pool.enqueue([this, image, writer, callback]() {
+			std::exception_ptr error;
+			
+			try {
+				writer(*image);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			
+			// the slot is free before the callback runs, so it may queue the next save,
+			// waitAll and the destructor wait for the callback through finish
+			this->release();
+			
+			if (callback) {
+				try {
+					callback(error);
+				} catch (...) {
+					if (!error) error = std::current_exception();
+				}
+			}
+			
+			this->finish();
+			if (error) std::rethrow_exception(error);
+		});
+	} catch (...) {
+		this->release();
+		this->finish();
+		throw;
+	}
+}
+
+std::future<void> ImageSaveQueue::save(const std::shared_ptr<const Image>& image, const string& path,
+																			 const ImageCodecFormat format, const Callback& callback) {
+	return this->enqueue(image, [path, format](const Image& image) {
+		saveImage(image, path, format);
+	}, callback);
+}
+
+std::future<void> ImageSaveQueue::saveCopy(const Image& image, const string& path,
+																					 const ImageCodecFormat format, const Callback& callback) {
+	std::shared_ptr<Image> copy = std::make_shared<Image>(image.getPixelDataFormat(), image.getBitDepth());
+	Image::clone(image, *copy);
+	
+	return this->save(copy, path, format, callback);
+}
+
+uint ImageSaveQueue::getPendingCount() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->active;
+}
+
+void ImageSaveQueue::waitAll() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->released.wait(lock, [this]() { return this->active == 0; });
+}
+
+
+ImageBatchLoader::ImageBatchLoader(const Callback& callback, ThreadPool* pool, const size_t maxBufferedBytes)
+: pool(pool != NULL ? *pool : ThreadPool::shared()), maxBufferedBytes(maxBufferedBytes), callback(callback) {
+	this->reader = std::thread(&ImageBatchLoader::run, this);
+}
+
+ImageBatchLoader::~ImageBatchLoader() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+		this->outstanding -= (uint)this->requests.size();
+		this->requests.clear();
+		this->order.clear();
+	}
+	
+	this->changed.notify_all();
+	this->reader.join();
+	
+	// decodes still running deliver into this loader
+	this->wait();
+}
+
+uint ImageBatchLoader::add(const Request& request) {
+	uint id;
+	
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		id = this->nextId++;
+		this->requests[id] = request;
+		this->order.insert(std::make_pair(-request.priority, id));
+		this->outstanding++;
+	}
+	
+	this->changed.notify_all();
+	return id;
+}
+
+uint ImageBatchLoader::add(const string& path, const int priority, const ImageCodecFormat format) {
+	Request request = { path, NULL, 0, format, priority };
+	
+	if (format == ImageCodecFormat::ICF_AUTO) {
+		getImageFormatByExtension(path, &request.format);
+	}
+	
+	return this->add(request);
+}
+
+uint ImageBatchLoader::add(Archive& archive, const uint uid, const int priority, const ImageCodecFormat format) {
+	Request request = { string(), &archive, uid, format, priority };
+	return this->add(request);
+}
+
+std::vector<uint> ImageBatchLoader::add(const std::vector<string>& paths, const int priority) {
+	std::vector<uint> ids;
+	ids.reserve(paths.size());
+	
+	for (size_t i = 0; i < paths.size(); i++) {
+		ids.push_back(this->add(paths[i], priority));
+	}
+	
+	return ids;
+}
+
+bool ImageBatchLoader::setPriority(const uint id, const int priority) {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		
+		std::map<uint, Request>::iterator it = this->requests.find(id);
+		if (it == this->requests.end()) return false;
+		
+		this->order.erase(std::make_pair(-it->second.priority, id));
+		it->second.priority = priority;
+		this->order.insert(std::make_pair(-priority, id));
+	}
+	
+	return true;
+}
+
+static void readWhole(Stream& stream, std::vector<byte>& data) {
+	const size_t start = stream.getPosition();
+	data.resize(stream.getLength() - start);
+	
+	if (!data.empty() && stream.read(data.data(), (uint)data.size()) != (int)data.size()) {
+		throw ImageCodecException();
+	}
+}
+
+void ImageBatchLoader::run() {
+	for (;;) {
+		uint id;
+		Request request;
+		
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->changed.wait(lock, [this]() {
+				return this->stopping || (!this->order.empty() && this->bufferedBytes < this->maxBufferedBytes);
+			});
+			
+			if (this->stopping) return;
+			
+			id = this->order.begin()->second;
+			this->order.erase(this->order.begin());
+			request = this->requests[id];
+			this->requests.erase(id);
+		}
+		
+		std::shared_ptr<std::vector<byte> > data = std::make_shared<std::vector<byte> >();
+		ImageLoadResult result;
+		result.id = id;
+		
+		// all reads happen on this thread, one after the other, archives need no locking
+		try {
+			if (request.archive != NULL) {
+				ChunkEntry* entry = openImageChunk(*request.archive, request.uid, request.format);
+				if (entry == NULL) throw ImageCodecException();
+				
+				try {
+					readWhole(*entry->stream, *data);
+				} catch (...) {
+					request.archive->closeChunk(entry);
+					throw;
+				}
+				
+				request.archive->closeChunk(entry);
+			} else {
+				FileStream fs(request.path);
+				fs.openRead();
+				readWhole(fs, *data);
+				fs.close();
+			}
+		} catch (...) {
+			result.error = std::current_exception();
+			this->deliver(result, 0);
+			continue;
+		}
+		
+		const size_t bytes = data->size();
+		
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->bufferedBytes += bytes;
+		}
+		
+		const bool fromArchive = request.archive != NULL;
+		const ImageCodecFormat format = request.format;
+		
+		this->pool.enqueue([this, result, data, bytes, fromArchive, format]() mutable {
+			try {
+				ReadonlyMemoryStream stream(data->data(), data->size());
+				ImageCodecFormat contentFormat = fromArchive ? detectImageFormat(stream) : format;
+				
+				// targa has no signature, trust the requested format
+				if (contentFormat == ImageCodecFormat::ICF_AUTO) contentFormat = format;
+				
+				result.image = std::make_shared<Image>();
+				loadImage(*result.image, stream, contentFormat);
+			} catch (...) {
+				result.image.reset();
+				result.error = std::current_exception();
+			}
+			
+			data.reset();
+			this->deliver(result, bytes);
+		});
+	}
+}
+
+void ImageBatchLoader::deliver(ImageLoadResult& result, const size_t bytes) {
+	if (this->callback) {
+		// a throwing callback must not stall the rest of the batch
+		try {
+			this->callback(result);
+		} catch (...) {
+		}
+	}
+	
+	// notified under the lock, a waiter woken by the last delivery may destroy the loader
+	std::lock_guard<std::mutex> lock(this->mutex);
+	
+	if (!this->callback) this->results.push(result);
+	this->bufferedBytes -= bytes;
+	this->outstanding--;
+	this->changed.notify_all();
+}
+
+bool ImageBatchLoader::next(ImageLoadResult& result) {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->changed.wait(lock, [this]() { return !this->results.empty() || this->outstanding == 0; });
+	
+	if (this->results.empty()) return false;
+	
+	result = this->results.front();
+	this->results.pop();
+	return true;
+}
+
+void ImageBatchLoader::wait() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->changed.wait(lock, [this]() { return this->outstanding == 0; });
+}
+
+uint ImageBatchLoader::getPendingCount() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->outstanding;
+}
+
+}
@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef imgasync_h
+#define imgasync_h
+
+#include <memory>
+#include <future>
+#include <functional>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <map>
+#include <set>
+
+#include "ucm/string.h"
+#include "ucm/archive.h"
+#include "image.h"
+#include "imgcodec.h"
+#include "parallel.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+// Saves images in the background so the caller can go on with the next frame while
+// conversion, encoding and file I/O run on the pool. At most capacity saves are queued
+// or running, save() blocks until one finishes when the queue is full.
+class ImageSaveQueue {
+public:
+	// Called on the worker when a save finished, error is empty on success. It may queue
+	// further saves but not wait for them. What it throws is passed on to the future.
+	typedef std::function<void(std::exception_ptr error)> Callback;
+
+private:
+	ThreadPool& pool;
+	const uint capacity;
+	uint pending = 0;			// saves holding a slot of the capacity
+	uint active = 0;			// saves whose task has not returned yet, callbacks included
+	std::mutex mutex;
+	std::condition_variable released;
+	
+	void acquire();
+	void release();
+	void finish();
+
+public:
+	// pool is ThreadPool::shared() when NULL, do not call save() from tasks of a pool
+	// with a single worker, a full queue would wait on that worker forever
+	ImageSaveQueue(const uint capacity = 4, ThreadPool* pool = NULL);
+	// Waits for the queued saves and their callbacks
+	~ImageSaveQueue();
+	
+	// The queue holds the image until it is written, it must not be modified meanwhile.
+	// The future rethrows the error of the save on get().
+	std::future<void> save(const std::shared_ptr<const Image>& image, const string& path,
+												 const ImageCodecFormat format = ICF_AUTO, const Callback& callback = Callback());
+	
+	// Copies the image, so the caller may reuse it as soon as this returns
+	std::future<void> saveCopy(const Image& image, const string& path,
+														 const ImageCodecFormat format = ICF_AUTO, const Callback& callback = Callback());
+	
+	// Run writer with the image on the pool, e.g. to save with encoder options or into a stream
+	std::future<void> enqueue(const std::shared_ptr<const Image>& image,
+														const std::function<void(const Image&)>& writer, const Callback& callback = Callback());
+	
+	// Number of saves queued or running
+	uint getPendingCount();
+	// Block until every queued save and its callback finished
+	void waitAll();
+};
+
+struct ImageLoadResult {
+	uint id = 0;										// returned by ImageBatchLoader::add
+	std::shared_ptr<Image> image;		// empty when loading failed
+	std::exception_ptr error;
+};
+
+// Loads a batch of images, highest priority first and in the order added otherwise.
+// A reader thread reads each file or archive chunk whole into memory in one sequential
+// read, the pool decodes them concurrently and every image is delivered as soon as it
+// is decoded. Reading pauses while maxBufferedBytes are read but not yet decoded.
+class ImageBatchLoader {
+public:
+	// Called on the decoding worker, without a callback the results are taken with next()
+	typedef std::function<void(ImageLoadResult& result)> Callback;
+	
+private:
+	struct Request {
+		string path;
+		Archive* archive;
+		uint uid;
+		ImageCodecFormat format;
+		int priority;
+	};
+	
+	ThreadPool& pool;
+	const size_t maxBufferedBytes;
+	const Callback callback;
+	
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::map<uint, Request> requests;
+	std::set<std::pair<int, uint> > order;		// (-priority, id) of the requests not read yet
+	std::queue<ImageLoadResult> results;
+	std::thread reader;
+	uint nextId = 1;
+	uint outstanding = 0;
+	size_t bufferedBytes = 0;
+	bool stopping = false;
+	
+	uint add(const Request& request);
+	void run();
+	void deliver(ImageLoadResult& result, const size_t bytes);
+	
+public:
+	// pool is ThreadPool::shared() when NULL
+	ImageBatchLoader(const Callback& callback = Callback(), ThreadPool* pool = NULL,
+									 const size_t maxBufferedBytes = 256 * 1024 * 1024);
+	// Requests not read yet are dropped, the ones being decoded are waited for
+	~ImageBatchLoader();
+	
+	// Queue an image, returns the id its result is delivered with
+	uint add(const string& path, const int priority = 0, const ImageCodecFormat format = ICF_AUTO);
+	uint add(Archive& archive, const uint uid, const int priority = 0, const ImageCodecFormat format = ICF_AUTO);
+	std::vector<uint> add(const std::vector<string>& paths, const int priority = 0);
+	
+	// Reorder a request not read yet, e.g. to prefetch what becomes visible first
+	bool setPriority(const uint id, const int priority);
+	
+	// Without a callback, wait for the next result, false when nothing is left to deliver
+	bool next(ImageLoadResult& result);
+	// Wait until every added image is delivered
+	void wait();
+	// Number of images added and not delivered yet
+	uint getPendingCount();
+};
+
+}
+
+#endif /* imgasync_h */
@@ -0,0 +1,1273 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "imgbccodec.h"
+#include "imgcodec.h"
+#include "byteorder.h"
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+namespace ugm {
+
+#define DDS_HEADER_SIZE 128
+#define DDS_DX10_HEADER_SIZE 20
+#define DDS_SIZE_MAX 16384
+#define BC_TASK_BLOCK_ROWS 4
+
+void CompressedImage::createEmpty(const BlockCompressionFormat format, const uint width, const uint height) {
+	this->format = format;
+	this->imageWidth = width;
+	this->imageHeight = height;
+	this->blocks.assign((size_t)this->getBlockColumns() * this->getBlockRows() * this->getBlockByteLength(), 0);
+}
+
+// 16 pixels of a block in 0..255, one array per channel so that four pixels are processed at once
+struct BlockPixels {
+	float c[4][16];
+};
+
+static void readBlock(const Image& image, const uint bx, const uint by, BlockPixels& block) {
+	const uint width = image.width(), height = image.height();
+	const uint components = image.getColorComponents();
+	const bool swap = image.getPixelDataFormat() == PixelDataFormat::PDF_BGR
+		|| image.getPixelDataFormat() == PixelDataFormat::PDF_BGRA;
+	const size_t pixelBytes = image.getPixelByteLength(), rowBytes = image.getPixelRowByteLength();
+	const bool floatImage = image.getBitDepth() == 32;
+	
+	for (uint i = 0; i < 16; i++) {
+		const uint x = std::min(bx * 4 + (i & 3), width - 1), y = std::min(by * 4 + (i >> 2), height - 1);
+		const byte* pixel = image.getBuffer() + y * rowBytes + x * pixelBytes;
+		
+		for (uint c = 0; c < 4; c++) {
+			const uint k = c < 3 && swap ? 2 - c : c;
+			float value = 255.0f;
+			
+			if (c < components) {
+				value = floatImage ? std::min(std::max(((const float*)pixel)[k], 0.0f), 1.0f) * 255.0f : pixel[k];
+			}
+			
+			block.c[c][i] = value;
+		}
+	}
+}
+
+// Nearest palette entry of every pixel over the first channels, with its squared error
+static void fitPalette(const BlockPixels& block, const uint channels, const float (*palette)[4], const uint size,
+											 byte* indices, float* errors) {
+#if defined(__SSE2__) || defined(_M_X64)
+	for (uint g = 0; g < 16; g += 4) {
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+		
+		for (uint k = 0; k < size; k++) {
+			__m128 distance = _mm_setzero_ps();
+			
+			for (uint c = 0; c < channels; c++) {
+				const __m128 d = _mm_sub_ps(_mm_loadu_ps(&block.c[c][g]), _mm_set1_ps(palette[k][c]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+			}
+			
+			const __m128i less = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+			best = _mm_min_ps(distance, best);
+			bestIndex = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi32((int)k)), _mm_andnot_si128(less, bestIndex));
+		}
+		
+		int found[4];
+		_mm_storeu_si128((__m128i*)found, bestIndex);
+		_mm_storeu_ps(errors + g, best);
+		
+		for (uint j = 0; j < 4; j++) indices[g + j] = (byte)found[j];
+	}
+#else
+	for (uint i = 0; i < 16; i++) {
+		float best = FLT_MAX;
+		
+		for (uint k = 0; k < size; k++) {
+			float distance = 0;
+			
+			for (uint c = 0; c < channels; c++) {
+				const float d = block.c[c][i] - palette[k][c];
+				distance += d * d;
+			}
+			
+			if (distance < best) {
+				best = distance;
+				indices[i] = (byte)k;
+			}
+		}
+		
+		errors[i] = best;
+	}
+#endif /* __SSE2__ */
+}
+
+static inline float sumErrors(const float* errors, const uint mask) {
+	float sum = 0;
+	for (uint i = 0; i < 16; i++) {
+		if (mask & (1 << i)) sum += errors[i];
+	}
+	return sum;
+}
+
+// Dot products of the pixels minus mean with axis
+static void projectPixels(const BlockPixels& block, const uint channels, const float* mean, const float* axis, float* t) {
+#if defined(__SSE2__) || defined(_M_X64)
+	for (uint g = 0; g < 16; g += 4) {
+		__m128 dot = _mm_setzero_ps();
+		
+		for (uint c = 0; c < channels; c++) {
+			const __m128 d = _mm_sub_ps(_mm_loadu_ps(&block.c[c][g]), _mm_set1_ps(mean[c]));
+			dot = _mm_add_ps(dot, _mm_mul_ps(d, _mm_set1_ps(axis[c])));
+		}
+		
+		_mm_storeu_ps(t + g, dot);
+	}
+#else
+	for (uint i = 0; i < 16; i++) {
+		t[i] = 0;
+		for (uint c = 0; c < channels; c++) t[i] += (block.c[c][i] - mean[c]) * axis[c];
+	}
+#endif /* __SSE2__ */
+}
+
+// Mean and covariance of the masked pixels, returns the pixel count
+static uint computeCovariance(const BlockPixels& block, const uint channels, const uint mask,
+															float* mean, float (*covariance)[4]) {
+	uint count = 0;
+	for (uint c = 0; c < channels; c++) mean[c] = 0;
+	
+	for (uint i = 0; i < 16; i++) {
+		if (mask & (1 << i)) {
+			for (uint c = 0; c < channels; c++) mean[c] += block.c[c][i];
+			count++;
+		}
+	}
+	
+	if (count == 0) return 0;
+	for (uint c = 0; c < channels; c++) mean[c] /= count;
+	
+	for (uint a = 0; a < channels; a++) {
+		for (uint b = a; b < channels; b++) {
+			float sum = 0;
+			
+			for (uint i = 0; i < 16; i++) {
+				if (mask & (1 << i)) sum += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+			}
+			
+			covariance[a][b] = covariance[b][a] = sum;
+		}
+	}
+	
+	return count;
+}
+
+// Principal eigenvector by power iteration, returns its eigenvalue
+static float computePrincipalAxis(const float (*covariance)[4], const uint channels, float* axis) {
+	// start from the channel with the largest variance
+	uint largest = 0;
+	for (uint c = 1; c < channels; c++) {
+		if (covariance[c][c] > covariance[largest][largest]) largest = c;
+	}
+	
+	for (uint c = 0; c < channels; c++) axis[c] = covariance[largest][c];
+	
+	float length = 0;
+	
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = { 0, 0, 0, 0 };
+		
+		for (uint a = 0; a < channels; a++) {
+			for (uint b = 0; b < channels; b++) next[a] += covariance[a][b] * axis[b];
+		}
+		
+		length = 0;
+		for (uint c = 0; c < channels; c++) length += next[c] * next[c];
+		if (length < 1e-12f) break;
+		
+		length = std::sqrt(length);
+		for (uint c = 0; c < channels; c++) axis[c] = next[c] / length;
+	}
+	
+	if (length < 1e-12f) {
+		for (uint c = 0; c < channels; c++) axis[c] = 0;
+		return 0;
+	}
+	
+	return length;
+}
+
+// Endpoints at the extremes of the masked pixels along their principal axis
+static void findEndpoints(const BlockPixels& block, const uint channels, const uint mask, float* e0, float* e1) {
+	float mean[4], covariance[4][4], axis[4], t[16];
+	
+	computeCovariance(block, channels, mask, mean, covariance);
+	computePrincipalAxis(covariance, channels, axis);
+	projectPixels(block, channels, mean, axis, t);
+	
+	float tmin = FLT_MAX, tmax = -FLT_MAX;
+	for (uint i = 0; i < 16; i++) {
+		if (mask & (1 << i)) {
+			tmin = std::min(tmin, t[i]);
+			tmax = std::max(tmax, t[i]);
+		}
+	}
+	
+	if (tmin > tmax) tmin = tmax = 0;
+	
+	for (uint c = 0; c < channels; c++) {
+		e0[c] = std::min(std::max(mean[c] + axis[c] * tmin, 0.0f), 255.0f);
+		e1[c] = std::min(std::max(mean[c] + axis[c] * tmax, 0.0f), 255.0f);
+	}
+}
+
+// Least squares endpoints for the interpolation weights of the masked pixels
+static bool refineEndpoints(const BlockPixels& block, const uint channels, const uint mask, const float* weights,
+														float* e0, float* e1) {
+	float aa = 0, ab = 0, bb = 0;
+	float pa[4] = { 0, 0, 0, 0 }, pb[4] = { 0, 0, 0, 0 };
+	
+	for (uint i = 0; i < 16; i++) {
+		if (mask & (1 << i)) {
+			const float w = weights[i], v = 1.0f - w;
+			aa += v * v;
+			ab += v * w;
+			bb += w * w;
+			
+			for (uint c = 0; c < channels; c++) {
+				pa[c] += v * block.c[c][i];
+				pb[c] += w * block.c[c][i];
+			}
+		}
+	}
+	
+	const float det = aa * bb - ab * ab;
+	if (std::abs(det) < 1e-6f) return false;
+	
+	for (uint c = 0; c < channels; c++) {
+		e0[c] = std::min(std::max((pa[c] * bb - pb[c] * ab) / det, 0.0f), 255.0f);
+		e1[c] = std::min(std::max((pb[c] * aa - pa[c] * ab) / det, 0.0f), 255.0f);
+	}
+	
+	return true;
+}
+
+static inline int roundToInt(const float value) {
+	return (int)(value + 0.5f);
+}
+
+// BC1
+
+static inline uint packRGB565(const float* c) {
+	return (roundToInt(c[0] * 31 / 255) << 11) | (roundToInt(c[1] * 63 / 255) << 5) | roundToInt(c[2] * 31 / 255);
+}
+
+static inline void unpackRGB565(const uint v, int* c) {
+	const int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 decodes three colors and transparent black when c0 <= c1, BC3 always decodes four colors
+static void getBC1Palette(const uint c0, const uint c1, const bool fourColors, int (*palette)[4]) {
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+	
+	for (uint c = 0; c < 3; c++) {
+		if (fourColors) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	
+	if (!fourColors) palette[3][3] = 0;
+}
+
+struct BC1Candidate {
+	uint c0, c1;
+	byte indices[16];
+	float error;
+};
+
+// Quantize the endpoints and fit the pixels in four or three color mode
+static void evaluateBC1(const BlockPixels& block, const float* e0, const float* e1, const bool fourColors,
+												const uint opaqueMask, BC1Candidate& candidate) {
+	uint c0 = packRGB565(e0), c1 = packRGB565(e1);
+	
+	// the endpoint order selects the mode
+	if (fourColors ? c0 < c1 : c0 > c1) std::swap(c0, c1);
+	
+	int palette[4][4];
+	getBC1Palette(c0, c1, fourColors || c0 > c1, palette);
+	
+	float colors[4][4];
+	for (uint k = 0; k < 4; k++) {
+		for (uint c = 0; c < 3; c++) colors[k][c] = (float)palette[k][c];
+	}
+	
+	float errors[16];
+	fitPalette(block, 3, colors, fourColors ? 4 : 3, candidate.indices, errors);
+	
+	for (uint i = 0; i < 16; i++) {
+		if (!(opaqueMask & (1 << i))) candidate.indices[i] = 3;
+	}
+	
+	candidate.c0 = c0;
+	candidate.c1 = c1;
+	candidate.error = sumErrors(errors, opaqueMask);
+}
+
+static void refineBC1(const BlockPixels& block, const bool fourColors, const uint opaqueMask,
+											const int iterations, BC1Candidate& best) {
+	static const float fourWeights[4] = { 0, 1, 1.0f / 3, 2.0f / 3 };
+	static const float threeWeights[4] = { 0, 1, 0.5f, 0 };
+	
+	for (int i = 0; i < iterations; i++) {
+		float weights[16], e0[4], e1[4];
+		for (uint k = 0; k < 16; k++) weights[k] = (fourColors ? fourWeights : threeWeights)[best.indices[k]];
+		
+		if (!refineEndpoints(block, 3, opaqueMask, weights, e0, e1)) break;
+		
+		BC1Candidate candidate;
+		evaluateBC1(block, e0, e1, fourColors, opaqueMask, candidate);
+		
+		if (candidate.error >= best.error) break;
+		best = candidate;
+	}
+}
+
+static float encodeBC1Block(const BlockPixels& block, const BlockEncodeOptions& options, const bool allowTransparent,
+														byte* out) {
+	uint opaqueMask = 0xffff;
+	
+	if (allowTransparent) {
+		for (uint i = 0; i < 16; i++) {
+			if (block.c[3][i] < options.alphaThreshold) opaqueMask &= ~(1 << i);
+		}
+	}
+	
+	BC1Candidate best;
+	
+	if (opaqueMask == 0) {
+		best.c0 = best.c1 = 0;
+		memset(best.indices, 3, 16);
+		best.error = 0;
+	} else {
+		float e0[4], e1[4];
+		findEndpoints(block, 3, opaqueMask, e0, e1);
+		
+		// transparent pixels need the three color mode
+		const bool fourColors = opaqueMask == 0xffff;
+		const int iterations = options.quality == BEQ_FAST ? 0 : options.quality == BEQ_NORMAL ? 1 : 3;
+		
+		evaluateBC1(block, e1, e0, fourColors, opaqueMask, best);
+		refineBC1(block, fourColors, opaqueMask, iterations, best);
+		
+		if (options.quality == BEQ_HIGH && fourColors && allowTransparent) {
+			BC1Candidate three;
+			evaluateBC1(block, e1, e0, false, opaqueMask, three);
+			refineBC1(block, false, opaqueMask, iterations, three);
+			if (three.error < best.error) best = three;
+		}
+	}
+	
+	out[0] = (byte)best.c0;
+	out[1] = (byte)(best.c0 >> 8);
+	out[2] = (byte)best.c1;
+	out[3] = (byte)(best.c1 >> 8);
+	
+	uint bits = 0;
+	for (uint i = 0; i < 16; i++) bits |= (uint)best.indices[i] << (i * 2);
+	writeLE32(out + 4, bits);
+	
+	return best.error;
+}
+
+static void decodeBC1Block(const byte* in, const bool alwaysFourColors, byte (*pixels)[4]) {
+	const uint c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+	
+	int palette[4][4];
+	getBC1Palette(c0, c1, alwaysFourColors || c0 > c1, palette);
+	
+	const uint bits = readLE32(in + 4);
+	
+	for (uint i = 0; i < 16; i++) {
+		const int* color = palette[(bits >> (i * 2)) & 3];
+		for (uint c = 0; c < 4; c++) pixels[i][c] = (byte)color[c];
+	}
+}
+
+// BC4
+
+// eight values when r0 > r1, otherwise six values with 0 and 255
+static void getBC4Palette(const uint r0, const uint r1, int* palette) {
+	palette[0] = r0;
+	palette[1] = r1;
+	
+	if (r0 > r1) {
+		for (uint i = 2; i < 8; i++) palette[i] = ((8 - i) * r0 + (i - 1) * r1 + 3) / 7;
+	} else {
+		for (uint i = 2; i < 6; i++) palette[i] = ((6 - i) * r0 + (i - 1) * r1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+struct BC4Candidate {
+	uint r0, r1;
+	byte indices[16];
+	float error;
+};
+
+static void evaluateBC4(const BlockPixels& values, const int r0, const int r1, BC4Candidate& candidate) {
+	int palette[8];
+	candidate.r0 = std::min(std::max(r0, 0), 255);
+	candidate.r1 = std::min(std::max(r1, 0), 255);
+	getBC4Palette(candidate.r0, candidate.r1, palette);
+	
+	float levels[8][4];
+	for (uint k = 0; k < 8; k++) levels[k][0] = (float)palette[k];
+	
+	float errors[16];
+	fitPalette(values, 1, levels, 8, candidate.indices, errors);
+	candidate.error = sumErrors(errors, 0xffff);
+}
+
+static float encodeBC4Block(const float* values, const BlockEncodeQuality quality, byte* out) {
+	BlockPixels block;
+	memcpy(block.c[0], values, sizeof(block.c[0]));
+	
+	float low = 255, high = 0, innerLow = 255, innerHigh = 0;
+	
+	for (uint i = 0; i < 16; i++) {
+		low = std::min(low, values[i]);
+		high = std::max(high, values[i]);
+		
+		if (values[i] > 0.5f && values[i] < 254.5f) {
+			innerLow = std::min(innerLow, values[i]);
+			innerHigh = std::max(innerHigh, values[i]);
+		}
+	}
+	
+	BC4Candidate best, candidate;
+	evaluateBC4(block, roundToInt(high), roundToInt(low), best);
+	
+	if (quality != BEQ_FAST && innerLow <= innerHigh && (low < 0.5f || high > 254.5f)) {
+		evaluateBC4(block, roundToInt(innerLow), roundToInt(innerHigh), candidate);
+		if (candidate.error < best.error) best = candidate;
+	}
+	
+	if (quality == BEQ_HIGH && best.r0 > best.r1) {
+		const int r0 = best.r0, r1 = best.r1;
+		
+		for (int d0 = -2; d0 <= 2; d0++) {
+			for (int d1 = -2; d1 <= 2; d1++) {
+				if (r0 + d0 > r1 + d1) {
+					evaluateBC4(block, r0 + d0, r1 + d1, candidate);
+					if (candidate.error < best.error) best = candidate;
+				}
+			}
+		}
+	}
+	
+	out[0] = (byte)best.r0;
+	out[1] = (byte)best.r1;
+	
+	unsigned long long bits = 0;
+	for (uint i = 0; i < 16; i++) bits |= (unsigned long long)best.indices[i] << (i * 3);
+	for (uint i = 0; i < 6; i++) out[2 + i] = (byte)(bits >> (i * 8));
+	
+	return best.error;
+}
+
+static void decodeBC4Block(const byte* in, byte (*pixels)[4], const uint channel) {
+	int palette[8];
+	getBC4Palette(in[0], in[1], palette);
+	
+	unsigned long long bits = 0;
+	for (uint i = 0; i < 6; i++) bits |= (unsigned long long)in[2 + i] << (i * 8);
+	
+	for (uint i = 0; i < 16; i++) {
+		pixels[i][channel] = (byte)palette[(bits >> (i * 3)) & 7];
+	}
+}
+
+// BC7
+
+static const byte bc7Weights2[4] = { 0, 21, 43, 64 };
+static const byte bc7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const byte bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// pixel i belongs to the second subset when bit i is set
+static const unsigned short bc7Partitions2[64] = {
+	0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+	0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+	0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+	0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+	0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+	0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+	0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+	0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+static const byte bc7Partitions3[64][16] = {
+	{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 }, { 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 }, { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 }, { 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+	{ 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 }, { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 }, { 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+	{ 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 }, { 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+	{ 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, { 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+	{ 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 }, { 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+	{ 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 }, { 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+	{ 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 }, { 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 }, { 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+	{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 }, { 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+	{ 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 }, { 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+	{ 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 }, { 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+	{ 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 }, { 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+	{ 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 }, { 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 }, { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+	{ 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 }, { 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+	{ 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 }, { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 }, { 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+	{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 }, { 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+	{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 }, { 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 }, { 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+	{ 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 }, { 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+	{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 }, { 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+	{ 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 }, { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+	{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+	{ 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 }, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+	{ 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 }, { 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+	{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 },
+};
+
+// index of the pixel whose index omits its top bit, for the second and third subsets
+static const byte bc7Anchors2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+	15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+	6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+};
+
+static const byte bc7Anchors3a[64] = {
+	3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+	3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+	8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+	3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3,
+};
+
+static const byte bc7Anchors3b[64] = {
+	15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+	15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+	15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+	15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8,
+};
+
+struct BC7ModeInfo {
+	byte subsets, partitionBits, rotationBits, indexSelectionBits;
+	byte colorBits, alphaBits, endpointPBits, sharedPBits;
+	byte indexBits, secondaryIndexBits;
+};
+
+static const BC7ModeInfo bc7Modes[8] = {
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+struct BlockBitWriter {
+	byte* data;
+	uint position;
+	
+	BlockBitWriter(byte* data) : data(data), position(0) {
+		memset(data, 0, 16);
+	}
+	
+	void write(const uint value, const uint bits) {
+		for (uint i = 0; i < bits; i++, this->position++) {
+			if ((value >> i) & 1) this->data[this->position >> 3] |= 1 << (this->position & 7);
+		}
+	}
+};
+
+struct BlockBitReader {
+	const byte* data;
+	uint position;
+	
+	BlockBitReader(const byte* data) : data(data), position(0) { }
+	
+	uint read(const uint bits) {
+		uint value = 0;
+		for (uint i = 0; i < bits; i++, this->position++) {
+			value |= ((this->data[this->position >> 3] >> (this->position & 7)) & 1) << i;
+		}
+		return value;
+	}
+};
+
+static inline int interpolateBC7(const int a, const int b, const int weight) {
+	return (a * (64 - weight) + b * weight + 32) >> 6;
+}
+
+static inline int expandBC7(const uint value, const uint bits) {
+	const uint v = value << (8 - bits);
+	return v | (v >> bits);
+}
+
+static inline uint getBC7Subset(const uint subsets, const uint partition, const uint i) {
+	if (subsets == 2) return (bc7Partitions2[partition] >> i) & 1;
+	if (subsets == 3) return bc7Partitions3[partition][i];
+	return 0;
+}
+
+static inline bool isBC7Anchor(const uint subsets, const uint partition, const uint i) {
+	if (i == 0) return true;
+	if (subsets == 2) return i == bc7Anchors2[partition];
+	if (subsets == 3) return i == bc7Anchors3a[partition] || i == bc7Anchors3b[partition];
+	return false;
+}
+
+static void decodeBC7Block(const byte* in, byte (*pixels)[4]) {
+	uint mode = 0;
+	while (mode < 8 && !(in[0] & (1 << mode))) mode++;
+	
+	// reserved mode decodes to transparent black
+	if (mode == 8) {
+		memset(pixels, 0, 64);
+		return;
+	}
+	
+	const BC7ModeInfo& info = bc7Modes[mode];
+	BlockBitReader reader(in);
+	reader.position = mode + 1;
+	
+	const uint partition = reader.read(info.partitionBits);
+	const uint rotation = reader.read(info.rotationBits);
+	const uint indexSelection = reader.read(info.indexSelectionBits);
+	
+	int endpoints[6][4];
+	const uint count = info.subsets * 2;
+	
+	for (uint c = 0; c < 3; c++) {
+		for (uint e = 0; e < count; e++) endpoints[e][c] = reader.read(info.colorBits);
+	}
+	
+	for (uint e = 0; e < count; e++) endpoints[e][3] = info.alphaBits > 0 ? reader.read(info.alphaBits) : 255;
+	
+	uint colorBits = info.colorBits, alphaBits = info.alphaBits;
+	
+	if (info.endpointPBits || info.sharedPBits) {
+		uint pbits[6];
+		
+		if (info.endpointPBits) {
+			for (uint e = 0; e < count; e++) pbits[e] = reader.read(1);
+		} else {
+			for (uint s = 0; s < info.subsets; s++) pbits[s * 2] = pbits[s * 2 + 1] = reader.read(1);
+		}
+		
+		for (uint e = 0; e < count; e++) {
+			for (uint c = 0; c < 3; c++) endpoints[e][c] = (endpoints[e][c] << 1) | pbits[e];
+			if (alphaBits > 0) endpoints[e][3] = (endpoints[e][3] << 1) | pbits[e];
+		}
+		
+		colorBits++;
+		if (alphaBits > 0) alphaBits++;
+	}
+	
+	for (uint e = 0; e < count; e++) {
+		for (uint c = 0; c < 3; c++) endpoints[e][c] = expandBC7(endpoints[e][c], colorBits);
+		if (alphaBits > 0) endpoints[e][3] = expandBC7(endpoints[e][3], alphaBits);
+	}
+	
+	byte indices[16], secondary[16];
+	
+	for (uint i = 0; i < 16; i++) {
+		indices[i] = (byte)reader.read(info.indexBits - (isBC7Anchor(info.subsets, partition, i) ? 1 : 0));
+	}
+	
+	if (info.secondaryIndexBits > 0) {
+		for (uint i = 0; i < 16; i++) secondary[i] = (byte)reader.read(info.secondaryIndexBits - (i == 0 ? 1 : 0));
+	}
+	
+	const byte* weights = info.indexBits == 2 ? bc7Weights2 : info.indexBits == 3 ? bc7Weights3 : bc7Weights4;
+	const byte* secondaryWeights = info.secondaryIndexBits == 3 ? bc7Weights3 : bc7Weights2;
+	
+	for (uint i = 0; i < 16; i++) {
+		const uint s = getBC7Subset(info.subsets, partition, i);
+		const int* e0 = endpoints[s * 2];
+		const int* e1 = endpoints[s * 2 + 1];
+		
+		int colorWeight = weights[indices[i]], alphaWeight = colorWeight;
+		
+		if (info.secondaryIndexBits > 0) {
+			alphaWeight = secondaryWeights[secondary[i]];
+			if (indexSelection) std::swap(colorWeight, alphaWeight);
+		}
+		
+		for (uint c = 0; c < 3; c++) pixels[i][c] = (byte)interpolateBC7(e0[c], e1[c], colorWeight);
+		pixels[i][3] = (byte)interpolateBC7(e0[3], e1[3], alphaWeight);
+		
+		if (rotation > 0) std::swap(pixels[i][3], pixels[i][rotation - 1]);
+	}
+}
+
+struct BC7Candidate {
+	int endpoints[4][4];		// quantized, without p-bits
+	uint pbits[4];
+	byte indices[16];
+	float error;
+};
+
+// Mode 6: one subset RGBA, 7-bit endpoints with a p-bit each and 4-bit indices
+static void evaluateBC7Mode6(const BlockPixels& block, const float* e0, const float* e1, const bool searchPBits,
+														 BC7Candidate& best) {
+	best.error = FLT_MAX;
+	
+	for (uint combination = 0; combination < 4; combination++) {
+		uint pbits[2] = { combination & 1, combination >> 1 };
+		
+		// without the search, each endpoint takes the p-bit that rounds it best
+		if (!searchPBits) {
+			if (combination > 0) break;
+			
+			const float* ends[2] = { e0, e1 };
+			for (uint e = 0; e < 2; e++) {
+				float errors[2] = { 0, 0 };
+				
+				for (uint p = 0; p < 2; p++) {
+					for (uint c = 0; c < 4; c++) {
+						const int q = std::min(std::max(roundToInt((ends[e][c] - p) / 2), 0), 127);
+						const float d = ends[e][c] - (q * 2 + p);
+						errors[p] += d * d;
+					}
+				}
+				
+				pbits[e] = errors[1] < errors[0] ? 1 : 0;
+			}
+		}
+		
+		BC7Candidate candidate;
+		int values[2][4];
+		const float* ends[2] = { e0, e1 };
+		
+		for (uint e = 0; e < 2; e++) {
+			for (uint c = 0; c < 4; c++) {
+				candidate.endpoints[e][c] = std::min(std::max(roundToInt((ends[e][c] - pbits[e]) / 2), 0), 127);
+				values[e][c] = candidate.endpoints[e][c] * 2 + pbits[e];
+			}
+			candidate.pbits[e] = pbits[e];
+		}
+		
+		float palette[16][4];
+		for (uint k = 0; k < 16; k++) {
+			for (uint c = 0; c < 4; c++) palette[k][c] = (float)interpolateBC7(values[0][c], values[1][c], bc7Weights4[k]);
+		}
+		
+		float errors[16];
+		fitPalette(block, 4, palette, 16, candidate.indices, errors);
+		candidate.error = sumErrors(errors, 0xffff);
+		
+		if (candidate.error < best.error) best = candidate;
+	}
+}
+
+static float encodeBC7Mode6(const BlockPixels& block, const BlockEncodeQuality quality, BC7Candidate& best) {
+	float e0[4], e1[4];
+	findEndpoints(block, 4, 0xffff, e0, e1);
+	
+	evaluateBC7Mode6(block, e0, e1, quality != BEQ_FAST, best);
+	
+	const int iterations = quality == BEQ_FAST ? 0 : quality == BEQ_NORMAL ? 1 : 2;
+	
+	for (int i = 0; i < iterations; i++) {
+		float weights[16];
+		for (uint k = 0; k < 16; k++) weights[k] = bc7Weights4[best.indices[k]] / 64.0f;
+		
+		if (!refineEndpoints(block, 4, 0xffff, weights, e0, e1)) break;
+		
+		BC7Candidate candidate;
+		evaluateBC7Mode6(block, e0, e1, quality != BEQ_FAST, candidate);
+		
+		if (candidate.error >= best.error) break;
+		best = candidate;
+	}
+	
+	return best.error;
+}
+
+static void packBC7Mode6(BC7Candidate& candidate, byte* out) {
+	// the anchor index is stored without its top bit
+	if (candidate.indices[0] >= 8) {
+		std::swap(candidate.endpoints[0], candidate.endpoints[1]);
+		std::swap(candidate.pbits[0], candidate.pbits[1]);
+		for (uint i = 0; i < 16; i++) candidate.indices[i] = 15 - candidate.indices[i];
+	}
+	
+	BlockBitWriter writer(out);
+	writer.write(1 << 6, 7);
+	
+	for (uint c = 0; c < 4; c++) {
+		writer.write(candidate.endpoints[0][c], 7);
+		writer.write(candidate.endpoints[1][c], 7);
+	}
+	
+	writer.write(candidate.pbits[0], 1);
+	writer.write(candidate.pbits[1], 1);
+	
+	for (uint i = 0; i < 16; i++) writer.write(candidate.indices[i], i == 0 ? 3 : 4);
+}
+
+// Mode 1: two RGB subsets, 6-bit endpoints with a p-bit shared per subset and 3-bit indices
+static void evaluateBC7Mode1Subset(const BlockPixels& block, const uint mask, const float* e0, const float* e1,
+																	 const uint subset, BC7Candidate& candidate, float* errors) {
+	float best = FLT_MAX;
+	byte indices[16];
+	float pixelErrors[16];
+	
+	for (uint p = 0; p < 2; p++) {
+		int quantized[2][4], values[2][4];
+		const float* ends[2] = { e0, e1 };
+		
+		for (uint e = 0; e < 2; e++) {
+			for (uint c = 0; c < 3; c++) {
+				const int q = std::min(std::max(roundToInt((ends[e][c] * 127 / 255 - p) / 2), 0), 63);
+				quantized[e][c] = q;
+				values[e][c] = expandBC7((q << 1) | p, 7);
+			}
+		}
+		
+		float palette[8][4];
+		for (uint k = 0; k < 8; k++) {
+			for (uint c = 0; c < 3; c++) palette[k][c] = (float)interpolateBC7(values[0][c], values[1][c], bc7Weights3[k]);
+		}
+		
+		fitPalette(block, 3, palette, 8, indices, pixelErrors);
+		const float error = sumErrors(pixelErrors, mask);
+		
+		if (error < best) {
+			best = error;
+			candidate.pbits[subset] = p;
+			
+			for (uint e = 0; e < 2; e++) {
+				for (uint c = 0; c < 3; c++) candidate.endpoints[subset * 2 + e][c] = quantized[e][c];
+			}
+			
+			for (uint i = 0; i < 16; i++) {
+				if (mask & (1 << i)) {
+					candidate.indices[i] = indices[i];
+					errors[i] = pixelErrors[i];
+				}
+			}
+		}
+	}
+}
+
+static float encodeBC7Mode1(const BlockPixels& block, const uint partition, BC7Candidate& candidate) {
+	const uint masks[2] = { (uint)(~bc7Partitions2[partition] & 0xffff), bc7Partitions2[partition] };
+	float errors[16];
+	
+	for (uint s = 0; s < 2; s++) {
+		float e0[4], e1[4];
+		findEndpoints(block, 3, masks[s], e0, e1);
+		evaluateBC7Mode1Subset(block, masks[s], e0, e1, s, candidate, errors);
+		
+		float weights[16];
+		for (uint i = 0; i < 16; i++) {
+			weights[i] = masks[s] & (1 << i) ? bc7Weights3[candidate.indices[i]] / 64.0f : 0.0f;
+		}
+		
+		const float before = sumErrors(errors, masks[s]);
+		
+		if (refineEndpoints(block, 3, masks[s], weights, e0, e1)) {
+			BC7Candidate refined = candidate;
+			float refinedErrors[16];
+			memcpy(refinedErrors, errors, sizeof(errors));
+			
+			evaluateBC7Mode1Subset(block, masks[s], e0, e1, s, refined, refinedErrors);
+			
+			if (sumErrors(refinedErrors, masks[s]) < before) {
+				candidate = refined;
+				memcpy(errors, refinedErrors, sizeof(errors));
+			}
+		}
+	}
+	
+	candidate.error = sumErrors(errors, 0xffff);
+	return candidate.error;
+}
+
+static void packBC7Mode1(BC7Candidate& candidate, const uint partition, byte* out) {
+	const uint anchors[2] = { 0, bc7Anchors2[partition] };
+	
+	for (uint s = 0; s < 2; s++) {
+		if (candidate.indices[anchors[s]] >= 4) {
+			std::swap(candidate.endpoints[s * 2], candidate.endpoints[s * 2 + 1]);
+			
+			for (uint i = 0; i < 16; i++) {
+				if (getBC7Subset(2, partition, i) == s) candidate.indices[i] = 7 - candidate.indices[i];
+			}
+		}
+	}
+	
+	BlockBitWriter writer(out);
+	writer.write(1 << 1, 2);
+	writer.write(partition, 6);
+	
+	for (uint c = 0; c < 3; c++) {
+		for (uint e = 0; e < 4; e++) writer.write(candidate.endpoints[e][c], 6);
+	}
+	
+	writer.write(candidate.pbits[0], 1);
+	writer.write(candidate.pbits[1], 1);
+	
+	for (uint i = 0; i < 16; i++) writer.write(candidate.indices[i], isBC7Anchor(2, partition, i) ? 2 : 3);
+}
+
+// Residual of a line fit per subset, to rank the partitions before encoding them
+static float estimatePartitionError(const BlockPixels& block, const uint partition) {
+	const uint masks[2] = { (uint)(~bc7Partitions2[partition] & 0xffff), bc7Partitions2[partition] };
+	float error = 0;
+	
+	for (uint s = 0; s < 2; s++) {
+		float mean[4], covariance[4][4], axis[4];
+		if (computeCovariance(block, 3, masks[s], mean, covariance) < 2) continue;
+		
+		const float largest = computePrincipalAxis(covariance, 3, axis);
+		error += covariance[0][0] + covariance[1][1] + covariance[2][2] - largest;
+	}
+	
+	return error;
+}
+
+static float encodeBC7Block(const BlockPixels& block, const BlockEncodeQuality quality, byte* out) {
+	BC7Candidate best;
+	encodeBC7Mode6(block, quality, best);
+	
+	bool opaque = true;
+	for (uint i = 0; i < 16 && opaque; i++) opaque = block.c[3][i] >= 254.5f;
+	
+	// opaque blocks with more than one color gradient may fit two subsets better
+	if (quality == BEQ_HIGH && opaque && best.error > 16.0f) {
+		uint partitions[2] = { 0, 0 };
+		float estimates[2] = { FLT_MAX, FLT_MAX };
+		
+		for (uint p = 0; p < 64; p++) {
+			const float estimate = estimatePartitionError(block, p);
+			
+			if (estimate < estimates[1]) {
+				if (estimate < estimates[0]) {
+					partitions[1] = partitions[0];
+					estimates[1] = estimates[0];
+					partitions[0] = p;
+					estimates[0] = estimate;
+				} else {
+					partitions[1] = p;
+					estimates[1] = estimate;
+				}
+			}
+		}
+		
+		uint bestPartition = 0;
+		BC7Candidate twoSubsets;
+		twoSubsets.error = FLT_MAX;
+		
+		for (uint k = 0; k < 2; k++) {
+			// subsets fill in only their own indices, the first one reads a partly set candidate
+			BC7Candidate candidate = BC7Candidate();
+			if (encodeBC7Mode1(block, partitions[k], candidate) < twoSubsets.error) {
+				twoSubsets = candidate;
+				bestPartition = partitions[k];
+			}
+		}
+		
+		if (twoSubsets.error < best.error) {
+			packBC7Mode1(twoSubsets, bestPartition, out);
+			return twoSubsets.error;
+		}
+	}
+	
+	packBC7Mode6(best, out);
+	return best.error;
+}
+
+// Image
+
+static void encodeBlock(const BlockPixels& block, const BlockCompressionFormat format,
+												const BlockEncodeOptions& options, byte* out) {
+	switch (format) {
+		case BCF_BC1:
+			encodeBC1Block(block, options, true, out);
+			break;
+		
+		case BCF_BC3:
+			encodeBC4Block(block.c[3], options.quality, out);
+			encodeBC1Block(block, options, false, out + 8);
+			break;
+		
+		case BCF_BC4:
+			encodeBC4Block(block.c[0], options.quality, out);
+			break;
+		
+		case BCF_BC5:
+			encodeBC4Block(block.c[0], options.quality, out);
+			encodeBC4Block(block.c[1], options.quality, out + 8);
+			break;
+		
+		case BCF_BC7:
+			encodeBC7Block(block, options.quality, out);
+			break;
+	}
+}
+
+static void decodeBlock(const byte* in, const BlockCompressionFormat format, byte (*pixels)[4]) {
+	switch (format) {
+		case BCF_BC1:
+			decodeBC1Block(in, false, pixels);
+			break;
+		
+		case BCF_BC3:
+			decodeBC1Block(in + 8, true, pixels);
+			decodeBC4Block(in, pixels, 3);
+			break;
+		
+		case BCF_BC4:
+			decodeBC4Block(in, pixels, 0);
+			for (uint i = 0; i < 16; i++) {
+				pixels[i][1] = pixels[i][2] = pixels[i][0];
+				pixels[i][3] = 255;
+			}
+			break;
+		
+		case BCF_BC5:
+			decodeBC4Block(in, pixels, 0);
+			decodeBC4Block(in + 8, pixels, 1);
+			for (uint i = 0; i < 16; i++) {
+				pixels[i][2] = 0;
+				pixels[i][3] = 255;
+			}
+			break;
+		
+		case BCF_BC7:
+			decodeBC7Block(in, pixels);
+			break;
+	}
+}
+
+void compressImage(const Image& image, CompressedImage& compressed, const BlockCompressionFormat format,
+									 const BlockEncodeOptions& options, ThreadPool* pool) {
+	if (image.width() <= 0 || image.height() <= 0 || (image.getBitDepth() != 8 && image.getBitDepth() != 32)) {
+		throw NotSupportImageCodecException();
+	}
+	
+	compressed.createEmpty(format, image.width(), image.height());
+	
+	const uint columns = compressed.getBlockColumns(), rows = compressed.getBlockRows();
+	const uint blockBytes = compressed.getBlockByteLength();
+	const uint tasks = (rows + BC_TASK_BLOCK_ROWS - 1) / BC_TASK_BLOCK_ROWS;
+	byte* buffer = compressed.getBuffer();
+	
+	parallelForOrdered(pool != NULL ? *pool : ThreadPool::shared(), tasks, [&](const uint task) {
+		BlockPixels block;
+		const uint endRow = std::min(rows, (task + 1) * BC_TASK_BLOCK_ROWS);
+		
+		for (uint by = task * BC_TASK_BLOCK_ROWS; by < endRow; by++) {
+			for (uint bx = 0; bx < columns; bx++) {
+				readBlock(image, bx, by, block);
+				encodeBlock(block, format, options, buffer + ((size_t)by * columns + bx) * blockBytes);
+			}
+		}
+	}, std::function<void(uint)>());
+}
+
+void decompressImage(const CompressedImage& compressed, Image& image, ThreadPool* pool) {
+	const uint width = compressed.width(), height = compressed.height();
+	
+	if (!isImageSizeSupported(width, height, 4)) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	image.setPixelDataFormat(PixelDataFormat::PDF_RGBA, 8);
+	image.createEmpty(width, height);
+	
+	const uint columns = compressed.getBlockColumns(), rows = compressed.getBlockRows();
+	const uint blockBytes = compressed.getBlockByteLength();
+	const uint tasks = (rows + BC_TASK_BLOCK_ROWS - 1) / BC_TASK_BLOCK_ROWS;
+	const size_t rowBytes = image.getPixelRowByteLength();
+	byte* buffer = image.getBuffer();
+	
+	parallelForOrdered(pool != NULL ? *pool : ThreadPool::shared(), tasks, [&](const uint task) {
+		byte pixels[16][4];
+		const uint endRow = std::min(rows, (task + 1) * BC_TASK_BLOCK_ROWS);
+		
+		for (uint by = task * BC_TASK_BLOCK_ROWS; by < endRow; by++) {
+			for (uint bx = 0; bx < columns; bx++) {
+				decodeBlock(compressed.getBuffer() + ((size_t)by * columns + bx) * blockBytes, compressed.getFormat(), pixels);
+				
+				// edge blocks are clipped to the image
+				const uint w = std::min(4u, width - bx * 4), h = std::min(4u, height - by * 4);
+				
+				for (uint y = 0; y < h; y++) {
+					memcpy(buffer + (by * 4 + y) * rowBytes + bx * 16, pixels[y * 4], w * 4);
+				}
+			}
+		}
+	}, std::function<void(uint)>());
+}
+
+// DDS
+
+static const char* getDDSFourCC(const BlockCompressionFormat format) {
+	switch (format) {
+		case BCF_BC1: return "DXT1";
+		case BCF_BC3: return "DXT5";
+		case BCF_BC4: return "ATI1";
+		case BCF_BC5: return "ATI2";
+		default: return "DX10";
+	}
+}
+
+void writeDDS(const CompressedImage& compressed, Stream& stream) {
+	if (compressed.width() == 0 || compressed.height() == 0) {
+		throw NotSupportImageCodecException();
+	}
+	
+	byte header[DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	
+	memcpy(header, "DDS ", 4);
+	writeLE32(header + 4, 124);
+	writeLE32(header + 8, 0x81007);			// caps, height, width, pixel format and linear size
+	writeLE32(header + 12, compressed.height());
+	writeLE32(header + 16, compressed.width());
+	writeLE32(header + 20, (uint)compressed.getBufferLength());
+	writeLE32(header + 76, 32);
+	writeLE32(header + 80, 0x4);				// four character code
+	memcpy(header + 84, getDDSFourCC(compressed.getFormat()), 4);
+	writeLE32(header + 108, 0x1000);		// texture
+	
+	uint headerLength = DDS_HEADER_SIZE;
+	
+	if (compressed.getFormat() == BCF_BC7) {
+		writeLE32(header + 128, 98);			// DXGI_FORMAT_BC7_UNORM
+		writeLE32(header + 132, 3);				// 2D texture
+		writeLE32(header + 140, 1);				// array size
+		headerLength += DDS_DX10_HEADER_SIZE;
+	}
+	
+	stream.write(header, headerLength);
+	stream.write(compressed.getBuffer(), (uint)compressed.getBufferLength());
+}
+
+void readDDS(CompressedImage& compressed, Stream& stream) {
+	byte header[DDS_HEADER_SIZE];
+	
+	if (stream.read(header, DDS_HEADER_SIZE) != DDS_HEADER_SIZE || memcmp(header, "DDS ", 4) != 0
+			|| readLE32(header + 4) != 124) {
+		throw ImageCodecException();
+	}
+	
+	if (!(readLE32(header + 80) & 0x4)) {
+		throw NotSupportImageCodecException();
+	}
+	
+	const char* fourCC = (const char*)header + 84;
+	BlockCompressionFormat format;
+	
+	if (memcmp(fourCC, "DXT1", 4) == 0) {
+		format = BCF_BC1;
+	} else if (memcmp(fourCC, "DXT5", 4) == 0) {
+		format = BCF_BC3;
+	} else if (memcmp(fourCC, "ATI1", 4) == 0 || memcmp(fourCC, "BC4U", 4) == 0) {
+		format = BCF_BC4;
+	} else if (memcmp(fourCC, "ATI2", 4) == 0 || memcmp(fourCC, "BC5U", 4) == 0) {
+		format = BCF_BC5;
+	} else if (memcmp(fourCC, "DX10", 4) == 0) {
+		byte extension[DDS_DX10_HEADER_SIZE];
+		if (stream.read(extension, DDS_DX10_HEADER_SIZE) != DDS_DX10_HEADER_SIZE) {
+			throw ImageCodecException();
+		}
+		
+		// typeless, unorm and srgb variants
+		const uint dxgiFormat = readLE32(extension);
+		
+		if (dxgiFormat >= 70 && dxgiFormat <= 72) {
+			format = BCF_BC1;
+		} else if (dxgiFormat >= 76 && dxgiFormat <= 78) {
+			format = BCF_BC3;
+		} else if (dxgiFormat == 79 || dxgiFormat == 80) {
+			format = BCF_BC4;
+		} else if (dxgiFormat == 82 || dxgiFormat == 83) {
+			format = BCF_BC5;
+		} else if (dxgiFormat >= 97 && dxgiFormat <= 99) {
+			format = BCF_BC7;
+		} else {
+			throw NotSupportImageCodecException();
+		}
+	} else {
+		throw NotSupportImageCodecException();
+	}
+	
+	// the Direct3D texture size limit, the blocks then stay far below what read can return
+	const uint height = readLE32(header + 12), width = readLE32(header + 16);
+	if (width == 0 || height == 0 || width > DDS_SIZE_MAX || height > DDS_SIZE_MAX) {
+		throw ImageCodecException();
+	}
+	
+	// only the top mip level is read
+	compressed.createEmpty(format, width, height);
+	
+	const size_t length = compressed.getBufferLength();
+	if ((size_t)stream.read(compressed.getBuffer(), (uint)length) != length) {
+		throw ImageCodecException();
+	}
+}
+
+uint saveCompressedImage(const CompressedImage& compressed, Archive& archive) {
+	auto* chunk = archive.newChunk(FORMAT_TAG_DDS);
+	const uint uid = chunk->uid;
+	
+	// unlike jpeg or png the blocks still deflate well
+	chunk->isCompressed = true;
+	writeDDS(compressed, *chunk->stream);
+	archive.updateAndCloseChunk(chunk);
+	
+	return uid;
+}
+
+bool loadCompressedImage(CompressedImage& compressed, Archive& archive, const uint uid) {
+	ChunkEntry* entry = archive.openChunk(uid, FORMAT_TAG_DDS);
+	if (entry == NULL) return false;
+	
+	readDDS(compressed, *entry->stream);
+	archive.closeChunk(entry);
+	
+	return true;
+}
+
+}
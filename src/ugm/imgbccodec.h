@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef imgbccodec_h
+#define imgbccodec_h
+
+#include <stdio.h>
+#include <vector>
+
+#include "ucm/file.h"
+#include "ucm/archive.h"
+#include "image.h"
+#include "parallel.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+// GPU block compressed formats, every 4x4 pixel block is stored in 8 or 16 bytes
+enum BlockCompressionFormat {
+	BCF_BC1,			// RGB with 1-bit alpha, 8 bytes
+	BCF_BC3,			// RGBA, 16 bytes
+	BCF_BC4,			// single channel from red, 8 bytes
+	BCF_BC5,			// two channels from red and green, 16 bytes
+	BCF_BC7,			// high quality RGBA, 16 bytes
+};
+
+enum BlockEncodeQuality {
+	BEQ_FAST,			// principal axis endpoints, single pass
+	BEQ_NORMAL,		// principal axis endpoints with least squares refinement
+	BEQ_HIGH,			// more refinement, BC1 3-color and BC7 two-subset partitions are tried
+};
+
+struct BlockEncodeOptions {
+	BlockEncodeQuality quality;
+	byte alphaThreshold;		// BC1 pixels with lower alpha become transparent
+	
+	BlockEncodeOptions(const BlockEncodeQuality quality = BEQ_NORMAL, const byte alphaThreshold = 128)
+	: quality(quality), alphaThreshold(alphaThreshold) { }
+	
+	static BlockEncodeOptions fastest() { return BlockEncodeOptions(BEQ_FAST); }
+	static BlockEncodeOptions best() { return BlockEncodeOptions(BEQ_HIGH); }
+};
+
+// Blocks of a compressed image in row order, ready to be uploaded as they are
+class CompressedImage {
+private:
+	BlockCompressionFormat format = BCF_BC7;
+	uint imageWidth = 0, imageHeight = 0;
+	std::vector<byte> blocks;
+
+public:
+	CompressedImage() { }
+	CompressedImage(const BlockCompressionFormat format, const uint width, const uint height) {
+		this->createEmpty(format, width, height);
+	}
+	
+	void createEmpty(const BlockCompressionFormat format, const uint width, const uint height);
+	
+	inline BlockCompressionFormat getFormat() const { return this->format; }
+	inline uint width() const { return this->imageWidth; }
+	inline uint height() const { return this->imageHeight; }
+	inline uint getBlockColumns() const { return (this->imageWidth + 3) / 4; }
+	inline uint getBlockRows() const { return (this->imageHeight + 3) / 4; }
+	inline uint getBlockByteLength() const { return getBlockByteLength(this->format); }
+	
+	inline byte* getBuffer() { return this->blocks.data(); }
+	inline const byte* getBuffer() const { return this->blocks.data(); }
+	inline size_t getBufferLength() const { return this->blocks.size(); }
+	
+	static uint getBlockByteLength(const BlockCompressionFormat format) {
+		return format == BCF_BC1 || format == BCF_BC4 ? 8 : 16;
+	}
+};
+
+// Blocks are encoded and decoded concurrently on pool, ThreadPool::shared() when NULL.
+// Any 8-bit or float image can be compressed, edge blocks repeat the last row and column.
+void compressImage(const Image& image, CompressedImage& compressed, const BlockCompressionFormat format,
+									 const BlockEncodeOptions& options = BlockEncodeOptions(), ThreadPool* pool = NULL);
+// Decoded into 8-bit RGBA, BC4 as gray and BC5 as red and green, the RGBA buffer must fit 32 bits
+void decompressImage(const CompressedImage& compressed, Image& image, ThreadPool* pool = NULL);
+
+// DDS container, BC7 uses the DX10 header extension and the others the classic FourCC.
+// Textures up to 16384 pixels a side are read.
+void readDDS(CompressedImage& compressed, Stream& stream);
+void writeDDS(const CompressedImage& compressed, Stream& stream);
+
+// Store as a DDS chunk, returns the uid of the chunk
+uint saveCompressedImage(const CompressedImage& compressed, Archive& archive);
+bool loadCompressedImage(CompressedImage& compressed, Archive& archive, const uint uid);
+
+}
+
+#endif /* imgbccodec_h */
@@ -0,0 +1,263 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "imgcache.h"
+#include "ucm/stream.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif /* _WIN32 */
+
+namespace ugm {
+
+ImageCache::ImageCache(const size_t budget) : budget(budget) {
+}
+
+std::shared_ptr<const Image> ImageCache::get(const Key& key, const Stamp& stamp,
+																						 const std::function<void(Image&)>& load) {
+	std::shared_ptr<Entry> entry;
+	std::shared_future<std::shared_ptr<const Image> > pending;
+	std::promise<std::shared_ptr<const Image> > promise;
+	
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		
+		EntryMap::iterator it = this->entries.find(key);
+		
+		if (it != this->entries.end() && it->second->stamp == stamp) {
+			entry = it->second;
+			this->hits++;
+			
+			if (entry->image) {
+				this->lru.splice(this->lru.begin(), this->lru, entry->position);
+				return entry->image;
+			}
+			
+			pending = entry->loading;
+		} else {
+			// the file changed since it was cached
+			if (it != this->entries.end()) this->remove(it);
+			
+			this->misses++;
+			
+			entry = std::make_shared<Entry>();
+			entry->key = key;
+			entry->stamp = stamp;
+			entry->loading = promise.get_future().share();
+			this->entries[key] = entry;
+		}
+	}
+	
+	if (pending.valid()) return pending.get();
+	
+	std::shared_ptr<Image> image = std::make_shared<Image>();
+	
+	try {
+		load(*image);
+	} catch (...) {
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			
+			EntryMap::iterator it = this->entries.find(key);
+			if (it != this->entries.end() && it->second == entry) this->entries.erase(it);
+		}
+		
+		promise.set_exception(std::current_exception());
+		throw;
+	}
+	
+	std::shared_ptr<const Image> result = image;
+	
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		
+		// not cached when invalidated meanwhile, the waiters still get it
+		EntryMap::iterator it = this->entries.find(key);
+		
+		if (it != this->entries.end() && it->second == entry) {
+			entry->image = result;
+			entry->bytes = sizeof(Image) + image->getBufferLength();
+			
+			// the future holds a reference too, an entry nobody waits for must look unused
+			entry->loading = std::shared_future<std::shared_ptr<const Image> >();
+			
+			this->lru.push_front(entry.get());
+			entry->position = this->lru.begin();
+			this->usedBytes += entry->bytes;
+			
+			this->evict();
+		}
+	}
+	
+	promise.set_value(result);
+	return result;
+}
+
+void ImageCache::remove(EntryMap::iterator it) {
+	Entry* entry = it->second.get();
+	
+	if (entry->image) {
+		this->lru.erase(entry->position);
+		this->usedBytes -= entry->bytes;
+	}
+	
+	this->entries.erase(it);
+}
+
+void ImageCache::evict() {
+	std::list<Entry*>::iterator it = this->lru.end();
+	
+	while (this->usedBytes > this->budget && it != this->lru.begin()) {
+		--it;
+		
+		// held by the cache only
+		if ((*it)->image.use_count() == 1) {
+			Entry* entry = *it;
+			it = this->lru.erase(it);
+			
+			// the key belongs to the entry being erased
+			this->usedBytes -= entry->bytes;
+			this->entries.erase(this->entries.find(entry->key));
+		}
+	}
+}
+
+// Modification time in nanoseconds, files rewritten within the same second differ too
+static bool getFileStamp(const string& path, long long* modified, long long* size) {
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path.getBuffer(), GetFileExInfoStandard, &attributes)) return false;
+	
+	// 100-nanosecond intervals
+	*modified = (long long)(((unsigned long long)attributes.ftLastWriteTime.dwHighDateTime << 32)
+													| attributes.ftLastWriteTime.dwLowDateTime) * 100;
+	*size = (long long)(((unsigned long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow);
+#else
+	struct stat status;
+	if (stat(path.getBuffer(), &status) != 0) return false;
+	
+#if defined(__APPLE__)
+	const struct timespec& mtime = status.st_mtimespec;
+#else
+	const struct timespec& mtime = status.st_mtim;
+#endif /* __APPLE__ */
+	
+	*modified = (long long)mtime.tv_sec * 1000000000LL + mtime.tv_nsec;
+	*size = (long long)status.st_size;
+#endif /* _WIN32 */
+	
+	return true;
+}
+
+std::shared_ptr<const Image> ImageCache::get(const string& path, const ImageCodecFormat format) {
+	Key key = { NULL, 0, std::string(path.getBuffer()) };
+	Stamp stamp = { 0, 0 };
+	
+	// a missing file is not cached, loadImage reports it
+	getFileStamp(path, &stamp.modified, &stamp.size);
+	
+	return this->get(key, stamp, [&path, format](Image& image) {
+		loadImage(image, path, format);
+	});
+}
+
+std::shared_ptr<const Image> ImageCache::get(Archive& archive, const uint uid, const ImageCodecFormat format) {
+	Key key = { &archive, uid, std::string() };
+	Stamp stamp = { 0, 0 };
+	
+	return this->get(key, stamp, [this, &archive, uid, format](Image& image) {
+		std::shared_ptr<std::vector<byte> > data = std::make_shared<std::vector<byte> >();
+		
+		{
+			std::lock_guard<std::mutex> lock(this->archiveMutex);
+			
+			ChunkEntry* entry = openImageChunk(archive, uid, format);
+			if (entry == NULL) throw ImageCodecException();
+			
+			try {
+				Stream& stream = *entry->stream;
+				data->resize(stream.getLength() - stream.getPosition());
+				
+				if (!data->empty() && stream.read(data->data(), (uint)data->size()) != (int)data->size()) {
+					throw ImageCodecException();
+				}
+			} catch (...) {
+				archive.closeChunk(entry);
+				throw;
+			}
+			
+			archive.closeChunk(entry);
+		}
+		
+		ReadonlyMemoryStream stream(data->data(), data->size());
+		ImageCodecFormat contentFormat = detectImageFormat(stream);
+		
+		// targa has no signature, trust the requested format
+		if (contentFormat == ImageCodecFormat::ICF_AUTO) contentFormat = format;
+		
+		loadImage(image, stream, contentFormat);
+	});
+}
+
+void ImageCache::invalidate(const string& path) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	
+	Key key = { NULL, 0, std::string(path.getBuffer()) };
+	EntryMap::iterator it = this->entries.find(key);
+	if (it != this->entries.end()) this->remove(it);
+}
+
+void ImageCache::invalidate(const Archive& archive, const uint uid) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	
+	Key key = { &archive, uid, std::string() };
+	EntryMap::iterator it = this->entries.find(key);
+	if (it != this->entries.end()) this->remove(it);
+}
+
+void ImageCache::clear() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	
+	this->entries.clear();
+	this->lru.clear();
+	this->usedBytes = 0;
+}
+
+void ImageCache::setBudget(const size_t budget) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	
+	this->budget = budget;
+	this->evict();
+}
+
+size_t ImageCache::getBudget() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->budget;
+}
+
+size_t ImageCache::getUsedBytes() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->usedBytes;
+}
+
+uint ImageCache::getHitCount() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->hits;
+}
+
+uint ImageCache::getMissCount() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->misses;
+}
+
+}
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef imgcache_h
+#define imgcache_h
+
+#include <memory>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <list>
+#include <map>
+
+#include "ucm/string.h"
+#include "ucm/archive.h"
+#include "image.h"
+#include "imgcodec.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+// Decoded images shared by everything that loads the same file or archive chunk.
+// Files are keyed by path and revalidated by modification time and size, chunks by
+// archive and uid. Images handed out are never evicted while a handle is held, the
+// least recently used ones nobody holds are dropped when the budget is exceeded.
+// Concurrent gets of an image not cached yet decode it once, the others wait for it.
+class ImageCache {
+private:
+	struct Key {
+		const Archive* archive;
+		uint uid;
+		std::string path;
+		
+		bool operator<(const Key& other) const {
+			if (this->archive != other.archive) return this->archive < other.archive;
+			if (this->uid != other.uid) return this->uid < other.uid;
+			return this->path < other.path;
+		}
+	};
+	
+	struct Stamp {
+		long long modified;
+		long long size;
+		
+		bool operator==(const Stamp& other) const {
+			return this->modified == other.modified && this->size == other.size;
+		}
+	};
+	
+	struct Entry {
+		Key key;
+		Stamp stamp;
+		std::shared_ptr<const Image> image;		// empty while loading
+		std::shared_future<std::shared_ptr<const Image> > loading;
+		size_t bytes = 0;
+		std::list<Entry*>::iterator position;		// in lru once loaded
+	};
+	
+	typedef std::map<Key, std::shared_ptr<Entry> > EntryMap;
+	
+	size_t budget;
+	size_t usedBytes = 0;
+	uint hits = 0, misses = 0;
+	
+	std::mutex mutex;
+	std::mutex archiveMutex;		// chunks are read one at a time, decoded concurrently
+	EntryMap entries;
+	std::list<Entry*> lru;				// most recently used first
+	
+	std::shared_ptr<const Image> get(const Key& key, const Stamp& stamp, const std::function<void(Image&)>& load);
+	void remove(EntryMap::iterator it);
+	void evict();
+
+public:
+	ImageCache(const size_t budget = 512 * 1024 * 1024);
+	
+	// Throws what loadImage throws, a failed load is not cached
+	std::shared_ptr<const Image> get(const string& path, const ImageCodecFormat format = ICF_AUTO);
+	std::shared_ptr<const Image> get(Archive& archive, const uint uid, const ImageCodecFormat format = ICF_AUTO);
+	
+	// Forget an image, e.g. after its chunk was rewritten. Held handles stay valid.
+	void invalidate(const string& path);
+	void invalidate(const Archive& archive, const uint uid);
+	void clear();
+	
+	// Images in use may keep the cache above the budget until they are released
+	void setBudget(const size_t budget);
+	size_t getBudget();
+	size_t getUsedBytes();
+	uint getHitCount();
+	uint getMissCount();
+};
+
+}
+
+#endif /* imgcache_h */
@@ -7,18 +7,30 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <cassert>
+#include <setjmp.h>
 #include "imgcodec.h"
+#include "memstream.h"
+#include "byteorder.h"
 
 #include <vector>
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
 #include "ucm/types.h"
 
 extern "C" {
 #include "jpeglib.h"
+#include "jerror.h"
 #include "png.h"
+#include "zlib.h"
 }
 
 namespace ugm {
 
+#define IMAGE_SIGNATURE_SIZE 8
+#define IMAGE_HEADER_SIZE 32
+
 bool getImageFormatByExtension(const string& path, ImageCodecFormat* format) {
 	if (path.endsWith(".jpg", StringComparingFlags::SCF_CASE_INSENSITIVE)
 			|| path.endsWith(".jpeg", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
@@ -33,12 +45,76 @@ bool getImageFormatByExtension(const string& path, ImageCodecFormat* format) {
 	} else if (path.endsWith(".bmp", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
 		*format = ImageCodecFormat::ICF_BMP;
 		return true;
+	} else if (path.endsWith(".tga", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
+		*format = ImageCodecFormat::ICF_TGA;
+		return true;
+	} else if (path.endsWith(".ppm", StringComparingFlags::SCF_CASE_INSENSITIVE)
+						 || path.endsWith(".pgm", StringComparingFlags::SCF_CASE_INSENSITIVE)
+						 || path.endsWith(".pnm", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
+		*format = ImageCodecFormat::ICF_PPM;
+		return true;
+	} else if (path.endsWith(".pfm", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
+		*format = ImageCodecFormat::ICF_PFM;
+		return true;
+	} else if (path.endsWith(".hdr", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
+		*format = ImageCodecFormat::ICF_HDR;
+		return true;
+	} else if (path.endsWith(".exr", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
+		*format = ImageCodecFormat::ICF_EXR;
+		return true;
+	} else if (path.endsWith(".qoi", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
+		*format = ImageCodecFormat::ICF_QOI;
+		return true;
+	} else if (path.endsWith(".dds", StringComparingFlags::SCF_CASE_INSENSITIVE)) {
+		*format = ImageCodecFormat::ICF_DDS;
+		return true;
 	}
 	
 	return false;
 }
 
-void loadImage(Image& image, const string& path, ImageCodecFormat format) {
+ImageCodecFormat detectImageFormat(const byte* header, const uint length) {
+	static const byte pngSignature[8] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+	
+	if (length >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF) {
+		return ImageCodecFormat::ICF_JPEG;
+	} else if (length >= 8 && memcmp(header, pngSignature, 8) == 0) {
+		return ImageCodecFormat::ICF_PNG;
+	} else if (length >= 6 && memcmp(header, "GIF8", 4) == 0) {
+		return ImageCodecFormat::ICF_GIF;
+	} else if (length >= 4 && (memcmp(header, "II*\0", 4) == 0 || memcmp(header, "MM\0*", 4) == 0)) {
+		return ImageCodecFormat::ICF_TIFF;
+	} else if (length >= 2 && header[0] == 'B' && header[1] == 'M') {
+		return ImageCodecFormat::ICF_BMP;
+	} else if (length >= 3 && header[0] == 'P' && (header[1] == '5' || header[1] == '6') && isspace(header[2])) {
+		return ImageCodecFormat::ICF_PPM;
+	} else if (length >= 3 && header[0] == 'P' && (header[1] == 'F' || header[1] == 'f') && isspace(header[2])) {
+		return ImageCodecFormat::ICF_PFM;
+	} else if (length >= 2 && header[0] == '#' && header[1] == '?') {
+		return ImageCodecFormat::ICF_HDR;
+	} else if (length >= 4 && header[0] == 0x76 && header[1] == 0x2f && header[2] == 0x31 && header[3] == 0x01) {
+		return ImageCodecFormat::ICF_EXR;
+	} else if (length >= 4 && memcmp(header, "qoif", 4) == 0) {
+		return ImageCodecFormat::ICF_QOI;
+	} else if (length >= 4 && memcmp(header, "DDS ", 4) == 0) {
+		return ImageCodecFormat::ICF_DDS;
+	}
+	
+	return ImageCodecFormat::ICF_AUTO;
+}
+
+ImageCodecFormat detectImageFormat(Stream& stream) {
+	const size_t pos = stream.getPosition();
+	
+	byte header[IMAGE_SIGNATURE_SIZE];
+	const int length = stream.read(header, IMAGE_SIGNATURE_SIZE);
+	
+	stream.setPosition(pos);
+	
+	return length > 0 ? detectImageFormat(header, length) : ImageCodecFormat::ICF_AUTO;
+}
+
+void loadImage(Image& image, const string& path, ImageCodecFormat format, const JPEGDecodeOptions& options) {
 	
 	if (format == ImageCodecFormat::ICF_AUTO) {
 		getImageFormatByExtension(path, &format);
@@ -47,55 +123,154 @@ void loadImage(Image& image, const string& path, ImageCodecFormat format) {
 	FileStream fs(path);
 	fs.openRead();
 	
-	loadImage(image, fs, format);
+	loadImage(image, fs, format, options);
 	
 	fs.close();
 }
 
-void loadImage(Image& image, Stream& stream, ImageCodecFormat format) {
+void loadImage(Image& image, Stream& stream, ImageCodecFormat format, const JPEGDecodeOptions& options) {
 	if (format == ImageCodecFormat::ICF_AUTO) {
-		throw "must specify the image format";
+		format = detectImageFormat(stream);
 	}
 	
 	switch (format) {
+		// content that is not recognized and formats without a decoder are tried as JPEG,
+		// as before detection existed, readJPEG throws when it is not one either
 		default:
 		case ImageCodecFormat::ICF_JPEG:
-			readJPEG(image, stream);
+			readJPEG(image, stream, options);
 			break;
 			
 		case ImageCodecFormat::ICF_PNG:
 			readPNG(image, stream);
 			break;
+			
+		case ImageCodecFormat::ICF_BMP:
+			readBMP(image, stream);
+			break;
+			
+		case ImageCodecFormat::ICF_TGA:
+			readTGA(image, stream);
+			break;
+			
+		case ImageCodecFormat::ICF_PPM:
+			readPPM(image, stream);
+			break;
+			
+		case ImageCodecFormat::ICF_PFM:
+			readPFM(image, stream);
+			break;
+			
+		case ImageCodecFormat::ICF_HDR:
+			readHDR(image, stream);
+			break;
+			
+		case ImageCodecFormat::ICF_EXR:
+			readEXR(image, stream);
+			break;
+			
+		case ImageCodecFormat::ICF_QOI:
+			readQOI(image, stream);
+			break;
+			
+		case ImageCodecFormat::ICF_DDS:
+		{
+			CompressedImage compressed;
+			readDDS(compressed, stream);
+			decompressImage(compressed, image);
+		}
+			break;
 	}
 }
 
-bool loadImage(Image& image, Archive& archive, const uint uid, ImageCodecFormat format) {
-	uint fmtcode = 0;
+void loadMappedImage(Image& image, const string& path, ImageCodecFormat format, const JPEGDecodeOptions& options) {
+	MappedFileStream mapped;
+	
+	if (!mapped.open(path)) {
+		loadImage(image, path, format, options);
+		return;
+	}
+	
+	if (format == ImageCodecFormat::ICF_AUTO) {
+		getImageFormatByExtension(path, &format);
+	}
+	
+	loadImage(image, mapped, format, options);
+}
 
+static uint getImageFormatTag(const ImageCodecFormat format) {
 	switch (format) {
-		case ImageCodecFormat::ICF_JPEG: fmtcode = FORMAT_TAG_JPEG; break;
-		case ImageCodecFormat::ICF_PNG: fmtcode = FORMAT_TAG_PNG; break;
-		case ImageCodecFormat::ICF_GIF: fmtcode = FORMAT_TAG_GIF; break;
-		case ImageCodecFormat::ICF_BMP: fmtcode = FORMAT_TAG_BMP; break;
-			
-		default: break;
-			
-		case ImageCodecFormat::ICF_AUTO:
-			if (loadImage(image, archive, uid, ImageCodecFormat::ICF_JPEG)) return true;
-			if (loadImage(image, archive, uid, ImageCodecFormat::ICF_PNG)) return true;
-			if (loadImage(image, archive, uid, ImageCodecFormat::ICF_BMP)) return true;
-			if (loadImage(image, archive, uid, ImageCodecFormat::ICF_GIF)) return true;
-			break;
+		case ImageCodecFormat::ICF_JPEG: return FORMAT_TAG_JPEG;
+		case ImageCodecFormat::ICF_PNG: return FORMAT_TAG_PNG;
+		case ImageCodecFormat::ICF_GIF: return FORMAT_TAG_GIF;
+		case ImageCodecFormat::ICF_BMP: return FORMAT_TAG_BMP;
+		case ImageCodecFormat::ICF_TIFF: return FORMAT_TAG_TIFF;
+		case ImageCodecFormat::ICF_TGA: return FORMAT_TAG_TGA;
+		case ImageCodecFormat::ICF_PPM: return FORMAT_TAG_PPM;
+		case ImageCodecFormat::ICF_PFM: return FORMAT_TAG_PFM;
+		case ImageCodecFormat::ICF_HDR: return FORMAT_TAG_HDR;
+		case ImageCodecFormat::ICF_EXR: return FORMAT_TAG_EXR;
+		case ImageCodecFormat::ICF_QOI: return FORMAT_TAG_QOI;
+		case ImageCodecFormat::ICF_DDS: return FORMAT_TAG_DDS;
+		default: return 0;
 	}
+}
+
+// With ICF_AUTO the chunk is looked up by uid alone and the content decides the
+// decoder, the format tags are only tried for archives that do not match untagged lookups.
+ChunkEntry* openImageChunk(Archive& archive, const uint uid, const ImageCodecFormat format) {
+	if (format != ImageCodecFormat::ICF_AUTO) {
+		return archive.openChunk(uid, getImageFormatTag(format));
+	}
+	
+	ChunkEntry* entry = archive.openChunk(uid, 0);
+	if (entry != NULL) return entry;
 	
+	static const ImageCodecFormat formats[] = {
+		ImageCodecFormat::ICF_JPEG, ImageCodecFormat::ICF_PNG, ImageCodecFormat::ICF_BMP, ImageCodecFormat::ICF_GIF,
+		ImageCodecFormat::ICF_TGA, ImageCodecFormat::ICF_PPM, ImageCodecFormat::ICF_PFM, ImageCodecFormat::ICF_HDR,
+		ImageCodecFormat::ICF_EXR, ImageCodecFormat::ICF_QOI, ImageCodecFormat::ICF_DDS,
+	};
+	
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]) && entry == NULL; i++) {
+		entry = archive.openChunk(uid, getImageFormatTag(formats[i]));
+	}
+	
+	return entry;
+}
+
+bool loadImage(Image& image, Archive& archive, const uint uid, ImageCodecFormat format) {
 	bool success = false;
 
-	ChunkEntry* entry = archive.openChunk(uid, fmtcode);
+	ChunkEntry* entry = openImageChunk(archive, uid, format);
 	if (entry != NULL) {
 
 		if (entry->stream->getLength() > 0) {
-			loadImage(image, *entry->stream, format);
-			success = true;
+			ImageCodecFormat contentFormat = detectImageFormat(*entry->stream);
+			
+			// targa has no signature, trust the requested format
+			if (contentFormat == ImageCodecFormat::ICF_AUTO && format == ImageCodecFormat::ICF_TGA) {
+				contentFormat = format;
+			}
+			
+			switch (contentFormat) {
+				default:
+					break;
+					
+				case ImageCodecFormat::ICF_JPEG:
+				case ImageCodecFormat::ICF_PNG:
+				case ImageCodecFormat::ICF_BMP:
+				case ImageCodecFormat::ICF_TGA:
+				case ImageCodecFormat::ICF_PPM:
+				case ImageCodecFormat::ICF_PFM:
+				case ImageCodecFormat::ICF_HDR:
+				case ImageCodecFormat::ICF_EXR:
+				case ImageCodecFormat::ICF_QOI:
+				case ImageCodecFormat::ICF_DDS:
+					loadImage(image, *entry->stream, contentFormat);
+					success = true;
+					break;
+			}
 		}
 		
 		archive.closeChunk(entry);
@@ -104,62 +279,174 @@ bool loadImage(Image& image, Archive& archive, const uint uid, ImageCodecFormat
 	return success;
 }
 
-void readJPEG(Image& image, FILE* file) {
-
-	struct jpeg_decompress_struct cinfo;
-	struct jpeg_error_mgr jerr;
+// libjpeg calls exit() on fatal errors by default, jump back to the
+// decoder/encoder instead so that the error can be thrown to the caller
+struct my_error_mgr {
+	struct jpeg_error_mgr pub;
+	jmp_buf setjmp_buffer;
+};
 
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_decompress(&cinfo);
-	jpeg_stdio_src(&cinfo, file);
-	jpeg_read_header(&cinfo, true);
+static void my_error_exit(j_common_ptr cinfo) {
+	my_error_mgr* err = (my_error_mgr*)cinfo->err;
+	longjmp(err->setjmp_buffer, 1);
+}
 
-	jpeg_start_decompress(&cinfo);
+static struct jpeg_error_mgr* my_std_error(my_error_mgr* err) {
+	jpeg_std_error(&err->pub);
+	err->pub.error_exit = my_error_exit;
+	return &err->pub;
+}
 
-	int row_stride = cinfo.output_width * cinfo.output_components;
+void loadImages(const std::vector<string>& paths, const std::vector<Image*>& images,
+								ImageCodecFormat format, ThreadPool* pool) {
+	if (paths.size() != images.size()) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	// the caller decodes too, so this completes when called from a task of the same pool
+	parallelForOrdered(pool != NULL ? *pool : ThreadPool::shared(), (uint)paths.size(), [&](const uint i) {
+		loadImage(*images[i], paths[i], format);
+	}, nullptr);
+}
 
-	int buffer_height = 1;
-	JSAMPARRAY buffer = (JSAMPARRAY)malloc(sizeof(JSAMPROW) * buffer_height);
-	buffer[0] = (JSAMPROW)malloc(sizeof(JSAMPLE) * row_stride);
+void loadImages(const std::vector<Stream*>& streams, const std::vector<Image*>& images,
+								ImageCodecFormat format, ThreadPool* pool) {
+	if (streams.size() != images.size()) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	parallelForOrdered(pool != NULL ? *pool : ThreadPool::shared(), (uint)streams.size(), [&](const uint i) {
+		loadImage(*images[i], *streams[i], format);
+	}, nullptr);
+}
 
-	const int bufferLength = cinfo.output_width * cinfo.output_height * cinfo.output_components;
-	byte* imageBuffer = new byte[bufferLength];
-	byte* writeBufferPointer = imageBuffer;
+#define JPEG_MAX_READ_LINES 16
 
-	while (cinfo.output_scanline < cinfo.output_height) {
-		jpeg_read_scanlines(&cinfo, buffer, 1);
-		memcpy(writeBufferPointer, buffer[0], row_stride);
-		writeBufferPointer += row_stride;
+// Read the header and start decompressing with the scaling and color options,
+// the output is always RGB after readJPEGRows.
+static void startJPEGDecompress(j_decompress_ptr cinfo, const JPEGDecodeOptions& options) {
+	jpeg_read_header(cinfo, true);
+	
+	uint scaleDenom = options.scaleDenom;
+	
+	if (options.minWidth > 0 || options.minHeight > 0) {
+		// largest reduction whose output still covers the requested size
+		for (scaleDenom = 8; scaleDenom > 1; scaleDenom /= 2) {
+			if ((cinfo->image_width + scaleDenom - 1) / scaleDenom >= options.minWidth
+					&& (cinfo->image_height + scaleDenom - 1) / scaleDenom >= options.minHeight) {
+				break;
+			}
+		}
 	}
 	
-	jpeg_finish_decompress(&cinfo);
-	jpeg_destroy_decompress(&cinfo);
-
-	image.setPixelDataFormat(PixelDataFormat::PDF_RGB, 8);
-	image.createEmpty(cinfo.output_width, cinfo.output_height);
+	cinfo->scale_num = 1;
+	cinfo->scale_denom = scaleDenom;
+	cinfo->dct_method = options.dctMethod == JDM_IFAST ? JDCT_IFAST
+		: options.dctMethod == JDM_FLOAT ? JDCT_FLOAT : JDCT_ISLOW;
+	cinfo->do_fancy_upsampling = options.fancyUpsampling;
 	
-	if (cinfo.out_color_space == JCS_RGB) {
-		image.copyBuffer(imageBuffer);
+	if (cinfo->jpeg_color_space == JCS_CMYK || cinfo->jpeg_color_space == JCS_YCCK) {
+		cinfo->out_color_space = JCS_CMYK;
+	} else if (cinfo->jpeg_color_space != JCS_GRAYSCALE) {
+		cinfo->out_color_space = JCS_RGB;
 	}
-	else if (cinfo.out_color_space == JCS_GRAYSCALE && cinfo.output_components == 1) {
-		for (JDIMENSION y = 0; y < cinfo.output_height; y++) {
-			for (JDIMENSION x = 0; x < cinfo.output_width; x++) {
-				const float gray = imageBuffer[y * cinfo.output_width + x];
-				image.setPixel(x, y, color4f(gray / 255.0f));
+	
+	jpeg_start_decompress(cinfo);
+}
+
+// CMYK rows are wider than the RGB destination rows, they go through a scratch band
+static JSAMPARRAY allocJPEGScratch(j_decompress_ptr cinfo) {
+	if (cinfo->output_components <= 3) return NULL;
+	
+	return (*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE,
+																		 cinfo->output_width * cinfo->output_components, JPEG_MAX_READ_LINES);
+}
+
+// Decode up to count scanlines straight into RGB rows stride bytes apart,
+// converting grayscale and CMYK in place. Returns the number of rows decoded.
+static JDIMENSION readJPEGRows(j_decompress_ptr cinfo, byte* buffer, const JDIMENSION count,
+															 const size_t stride, JSAMPARRAY scratch) {
+	const JDIMENSION width = cinfo->output_width;
+	const int components = cinfo->output_components;
+	
+	JSAMPROW rows[JPEG_MAX_READ_LINES];
+	JDIMENSION total = 0;
+	
+	while (total < count && cinfo->output_scanline < cinfo->output_height) {
+		const JDIMENSION lines = std::min((JDIMENSION)JPEG_MAX_READ_LINES, count - total);
+		
+		for (JDIMENSION i = 0; i < lines; i++) {
+			rows[i] = scratch != NULL ? scratch[i] : (JSAMPROW)(buffer + (total + i) * stride);
+		}
+		
+		const JDIMENSION read = jpeg_read_scanlines(cinfo, rows, lines);
+		
+		for (JDIMENSION i = 0; i < read; i++) {
+			byte* row = buffer + (total + i) * stride;
+			
+			if (components == 1) {
+				// expand from the end so that the gray samples are not overwritten
+				for (JDIMENSION x = width; x-- > 0; ) {
+					row[x * 3] = row[x * 3 + 1] = row[x * 3 + 2] = row[x];
+				}
+			} else if (components == 4) {
+				const JSAMPLE* cmyk = rows[i];
+				
+				// Adobe writes inverted CMYK
+				for (JDIMENSION x = 0; x < width; x++, cmyk += 4) {
+					const int c = cinfo->saw_Adobe_marker ? cmyk[0] : 255 - cmyk[0];
+					const int m = cinfo->saw_Adobe_marker ? cmyk[1] : 255 - cmyk[1];
+					const int y = cinfo->saw_Adobe_marker ? cmyk[2] : 255 - cmyk[2];
+					const int k = cinfo->saw_Adobe_marker ? cmyk[3] : 255 - cmyk[3];
+					
+					row[x * 3] = (byte)(c * k / 255);
+					row[x * 3 + 1] = (byte)(m * k / 255);
+					row[x * 3 + 2] = (byte)(y * k / 255);
+				}
 			}
 		}
+		
+		total += read;
 	}
 	
-	delete[] imageBuffer;
-	imageBuffer = NULL;
+	return total;
+}
+
+// Decode the scanlines of a decompress object whose source is already set up
+// straight into the rows of image.
+static void readJPEGScanlines(Image& image, j_decompress_ptr cinfo, const JPEGDecodeOptions& options) {
+	startJPEGDecompress(cinfo, options);
+	
+	image.setPixelDataFormat(PixelDataFormat::PDF_RGB, 8);
+	image.createEmpty(cinfo->output_width, cinfo->output_height);
+	
+	readJPEGRows(cinfo, image.getBuffer(), cinfo->output_height,
+							 image.getPixelRowByteLength(), allocJPEGScratch(cinfo));
+	
+	jpeg_finish_decompress(cinfo);
+}
+
+void readJPEG(Image& image, FILE* file, const JPEGDecodeOptions& options) {
+
+	struct jpeg_decompress_struct cinfo;
+	struct my_error_mgr jerr;
+
+	cinfo.err = my_std_error(&jerr);
 	
-	for (int i = 0; i < buffer_height; i++) {
-		free(buffer[i]);
+	if (setjmp(jerr.setjmp_buffer)) {
+		jpeg_destroy_decompress(&cinfo);
+		throw ImageCodecException();
 	}
-	free(buffer);
+	
+	jpeg_create_decompress(&cinfo);
+	jpeg_stdio_src(&cinfo, file);
+	
+	readJPEGScanlines(image, &cinfo, options);
+	
+	jpeg_destroy_decompress(&cinfo);
 }
 
-// FIXME: multiple thread support
+// all decoder state lives in the source manager, allocated per decompress object
 struct my_source_mgr {
 	struct jpeg_source_mgr pub;
 	Stream* is;
@@ -168,9 +455,6 @@ struct my_source_mgr {
 
 const static size_t JPEG_BUF_SIZE = 16384;
 
-static std::vector<unsigned char> my_buffer;
-#define BLOCK_SIZE 40960
-
 static void my_init_source(j_decompress_ptr cinfo) {
 }
 
@@ -179,6 +463,14 @@ static int my_fill_input_buffer(j_decompress_ptr cinfo) {
 	
 	int readBytes = src->is->read((char*)src->buffer, JPEG_BUF_SIZE);
 
+	if (readBytes <= 0) {
+		// insert a fake EOI marker for truncated streams
+		WARNMS(cinfo, JWRN_JPEG_EOF);
+		src->buffer[0] = (JOCTET)0xFF;
+		src->buffer[1] = (JOCTET)JPEG_EOI;
+		readBytes = 2;
+	}
+	
 	src->pub.next_input_byte = src->buffer;
 	src->pub.bytes_in_buffer = readBytes;
 
@@ -200,99 +492,99 @@ static void my_skip_input_data (j_decompress_ptr cinfo, long count) {
 static void my_term_source(j_decompress_ptr cinfo) {
 }
 
-void readJPEG(Image& image, Stream& stream) {
-	
-	if (stream.getLength() > 2) {
-		size_t pos = stream.getPosition();
+static const JOCTET fakeEOI[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
 
-		byte pngTag[2];
-		stream.read(pngTag, 2);
+// memory streams hand over all their bytes at once, a further fill means the data is truncated
+static int my_fill_memory_buffer(j_decompress_ptr cinfo) {
+	WARNMS(cinfo, JWRN_JPEG_EOF);
+	cinfo->src->next_input_byte = fakeEOI;
+	cinfo->src->bytes_in_buffer = 2;
+	
+	return TRUE;
+}
 
-		stream.setPosition(pos);
-		
-		if (pngTag[0] == 0x89 && pngTag[1] == 0x50) {
-			readPNG(image, stream);
-			return;
-		}
+static void my_skip_memory_data(j_decompress_ptr cinfo, long count) {
+	if (count > (long)cinfo->src->bytes_in_buffer) {
+		my_fill_memory_buffer(cinfo);
+	} else if (count > 0) {
+		cinfo->src->next_input_byte += count;
+		cinfo->src->bytes_in_buffer -= count;
 	}
-	
-	struct jpeg_decompress_struct cinfo;
-	struct jpeg_error_mgr jerr;
-	
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_decompress(&cinfo);
-	
+}
+
+// the Stream counterpart of jpeg_stdio_src
+static void jpeg_stream_src(j_decompress_ptr cinfo, Stream* stream) {
 	my_source_mgr* src;
 
-	cinfo.src = (struct jpeg_source_mgr *)(*cinfo.mem->alloc_small)
-		((j_common_ptr) &cinfo, JPOOL_PERMANENT, sizeof(my_source_mgr));
+	cinfo->src = (struct jpeg_source_mgr *)(*cinfo->mem->alloc_small)
+		((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(my_source_mgr));
 		
-	src = (my_source_mgr*) cinfo.src;
-	src->buffer = (JOCTET *)(*cinfo.mem->alloc_small)
-		((j_common_ptr) &cinfo, JPOOL_PERMANENT, JPEG_BUF_SIZE * sizeof(JOCTET));
+	src = (my_source_mgr*) cinfo->src;
 	
-	src->is = &stream;
+	src->is = stream;
 	src->pub.init_source = my_init_source;
-	src->pub.fill_input_buffer = my_fill_input_buffer;
-	src->pub.skip_input_data = my_skip_input_data;
 	src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
 	src->pub.term_source = my_term_source;
-	src->pub.bytes_in_buffer = 0;
-	src->pub.next_input_byte = 0;
-
-	jpeg_read_header(&cinfo, true);
 	
-	jpeg_start_decompress(&cinfo);
-	
-	int row_stride = cinfo.output_width * cinfo.output_components;
+	// mapped files are decoded in place, as one span without a copy buffer
+	MappedFileStream* memory = dynamic_cast<MappedFileStream*>(stream);
+	
+	if (memory != NULL) {
+		src->buffer = NULL;
+		src->pub.fill_input_buffer = my_fill_memory_buffer;
+		src->pub.skip_input_data = my_skip_memory_data;
+		src->pub.bytes_in_buffer = memory->getRemaining();
+		src->pub.next_input_byte = memory->getCurrent();
+		memory->setPosition(memory->getLength());
+		return;
+	}
 	
-	int buffer_height = 1;
-	JSAMPARRAY buffer = (JSAMPARRAY)malloc(sizeof(JSAMPROW) * buffer_height);
-	buffer[0] = (JSAMPROW)malloc(sizeof(JSAMPLE) * row_stride);
+	src->buffer = (JOCTET *)(*cinfo->mem->alloc_small)
+		((j_common_ptr) cinfo, JPOOL_PERMANENT, JPEG_BUF_SIZE * sizeof(JOCTET));
 	
-	const int bufferLength = cinfo.output_width * cinfo.output_height * cinfo.output_components;
-	byte* imageBuffer = new byte[bufferLength];
-	byte* writeBufferPointer = imageBuffer;
+	src->pub.fill_input_buffer = my_fill_input_buffer;
+	src->pub.skip_input_data = my_skip_input_data;
+	src->pub.bytes_in_buffer = 0;
+	src->pub.next_input_byte = 0;
+}
+
+void readJPEG(Image& image, Stream& stream, const JPEGDecodeOptions& options) {
 	
-	while (cinfo.output_scanline < cinfo.output_height) {
-		jpeg_read_scanlines(&cinfo, buffer, 1);
-		memcpy(writeBufferPointer, buffer[0], row_stride);
-		writeBufferPointer += row_stride;
+	if (detectImageFormat(stream) == ImageCodecFormat::ICF_PNG) {
+		readPNG(image, stream);
+		return;
 	}
 	
-	jpeg_finish_decompress(&cinfo);
-	jpeg_destroy_decompress(&cinfo);
+	struct jpeg_decompress_struct cinfo;
+	struct my_error_mgr jerr;
 	
-	image.setPixelDataFormat(PixelDataFormat::PDF_RGB, 8);
-	image.createEmpty(cinfo.output_width, cinfo.output_height);
+	cinfo.err = my_std_error(&jerr);
 	
-	if (cinfo.out_color_space == JCS_RGB) {
-		image.copyBuffer(imageBuffer);
-	}
-	else if (cinfo.out_color_space == JCS_GRAYSCALE && cinfo.output_components == 1) {
-		for (JDIMENSION y = 0; y < cinfo.output_height; y++) {
-			for (JDIMENSION x = 0; x < cinfo.output_width; x++) {
-				const float gray = imageBuffer[y * cinfo.output_width + x];
-				image.setPixel(x, y, color4f(gray / 255.0f));
-			}
-		}
+	if (setjmp(jerr.setjmp_buffer)) {
+		jpeg_destroy_decompress(&cinfo);
+		throw ImageCodecException();
 	}
 	
-	delete[] imageBuffer;
-	imageBuffer = NULL;
+	jpeg_create_decompress(&cinfo);
+	jpeg_stream_src(&cinfo, &stream);
+
+	readJPEGScanlines(image, &cinfo, options);
 	
-	for (int i = 0; i < buffer_height; i++) {
-		free(buffer[i]);
-	}
-	free(buffer);
+	jpeg_destroy_decompress(&cinfo);
 }
 
 void writeJPEG(const Image& image, FILE* file) {
 	
 	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr       jerr;
+	struct my_error_mgr         jerr;
  
-	cinfo.err = jpeg_std_error(&jerr);
+	cinfo.err = my_std_error(&jerr);
+	
+	if (setjmp(jerr.setjmp_buffer)) {
+		jpeg_destroy_compress(&cinfo);
+		throw ImageCodecException();
+	}
+	
 	jpeg_create_compress(&cinfo);
 	jpeg_stdio_dest(&cinfo, file);
 	
@@ -316,7 +608,6 @@ void writeJPEG(const Image& image, FILE* file) {
 	jpeg_destroy_compress(&cinfo);
 }
 
-// FIXME: multiple thread support
 struct my_destination_mgr {
 	struct jpeg_destination_mgr pub; /* public fields */
 	Stream* os; /* target stream */
@@ -324,21 +615,103 @@ struct my_destination_mgr {
 };
 
 static void my_init_destination(j_compress_ptr cinfo) {
-	my_buffer.resize(BLOCK_SIZE);
-	cinfo->dest->next_output_byte = &my_buffer[0];
-	cinfo->dest->free_in_buffer = my_buffer.size();
+	my_destination_mgr* dest = (my_destination_mgr*)cinfo->dest;
+	
+	dest->buffer = (JOCTET *)(*cinfo->mem->alloc_small)
+		((j_common_ptr) cinfo, JPOOL_IMAGE, JPEG_BUF_SIZE * sizeof(JOCTET));
+	
+	dest->pub.next_output_byte = dest->buffer;
+	dest->pub.free_in_buffer = JPEG_BUF_SIZE;
 }
 
 static int my_empty_output_buffer(j_compress_ptr cinfo) {
-	size_t oldsize = my_buffer.size();
-	my_buffer.resize(oldsize + BLOCK_SIZE);
-	cinfo->dest->next_output_byte = &my_buffer[oldsize];
-	cinfo->dest->free_in_buffer = my_buffer.size() - oldsize;
+	my_destination_mgr* dest = (my_destination_mgr*)cinfo->dest;
+	
+	dest->os->write(dest->buffer, (uint)JPEG_BUF_SIZE);
+	
+	dest->pub.next_output_byte = dest->buffer;
+	dest->pub.free_in_buffer = JPEG_BUF_SIZE;
 	return true;
 }
 
 static void my_term_destination(j_compress_ptr cinfo) {
-	my_buffer.resize(my_buffer.size() - cinfo->dest->free_in_buffer);
+	my_destination_mgr* dest = (my_destination_mgr*)cinfo->dest;
+	const size_t count = JPEG_BUF_SIZE - dest->pub.free_in_buffer;
+	
+	if (count > 0) {
+		dest->os->write(dest->buffer, (uint)count);
+	}
+}
+
+struct my_memory_destination_mgr {
+	struct jpeg_destination_mgr pub;
+	MemoryOutputStream* out;
+	size_t available;
+};
+
+// Growing the sink may throw, C++ exceptions must not unwind through the libjpeg
+// frames. A failure is reported by error_exit once the exception is gone.
+static void prepareMemoryDestination(j_compress_ptr cinfo, my_memory_destination_mgr* dest) {
+	byte* next = NULL;
+	
+	try {
+		next = dest->out->prepare(JPEG_BUF_SIZE, &dest->available);
+	} catch (const std::bad_alloc&) {
+	}
+	
+	if (next == NULL) ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+	
+	dest->pub.next_output_byte = next;
+	dest->pub.free_in_buffer = dest->available;
+}
+
+static void my_init_memory_destination(j_compress_ptr cinfo) {
+	prepareMemoryDestination(cinfo, (my_memory_destination_mgr*)cinfo->dest);
+}
+
+static int my_empty_memory_output_buffer(j_compress_ptr cinfo) {
+	my_memory_destination_mgr* dest = (my_memory_destination_mgr*)cinfo->dest;
+	
+	// libjpeg only calls this when the buffer is full
+	dest->out->commit(dest->available);
+	prepareMemoryDestination(cinfo, dest);
+	return true;
+}
+
+static void my_term_memory_destination(j_compress_ptr cinfo) {
+	my_memory_destination_mgr* dest = (my_memory_destination_mgr*)cinfo->dest;
+	dest->out->commit(dest->available - dest->pub.free_in_buffer);
+}
+
+// the Stream counterpart of jpeg_stdio_dest
+static void jpeg_stream_dest(j_compress_ptr cinfo, Stream* stream) {
+	// memory sinks are written in place, without the copy buffer
+	MemoryOutputStream* memory = dynamic_cast<MemoryOutputStream*>(stream);
+	
+	if (memory != NULL) {
+		my_memory_destination_mgr* dest = (my_memory_destination_mgr*)(*cinfo->mem->alloc_small)
+			((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(my_memory_destination_mgr));
+		
+		dest->out = memory;
+		dest->available = 0;
+		dest->pub.init_destination = my_init_memory_destination;
+		dest->pub.empty_output_buffer = my_empty_memory_output_buffer;
+		dest->pub.term_destination = my_term_memory_destination;
+		
+		cinfo->dest = &dest->pub;
+		return;
+	}
+	
+	my_destination_mgr* dest;
+	
+	cinfo->dest = (struct jpeg_destination_mgr *)(*cinfo->mem->alloc_small)
+		((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(my_destination_mgr));
+	
+	dest = (my_destination_mgr*) cinfo->dest;
+	dest->os = stream;
+	dest->pub.init_destination = my_init_destination;
+	dest->pub.empty_output_buffer = my_empty_output_buffer;
+	dest->pub.term_destination = my_term_destination;
 }
 
 void writeJPEG(const Image& image, Stream& stream) {
@@ -351,17 +724,17 @@ void writeJPEG(const Image& image, Stream& stream) {
 #endif /* DEBUG */
 	
 	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr       jerr;
+	struct my_error_mgr         jerr;
 	
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_compress(&cinfo);
+	cinfo.err = my_std_error(&jerr);
 	
-	jpeg_destination_mgr dest;
-	cinfo.dest = &dest;
+	if (setjmp(jerr.setjmp_buffer)) {
+		jpeg_destroy_compress(&cinfo);
+		throw ImageCodecException();
+	}
 	
-	cinfo.dest->init_destination 		= &my_init_destination;
-	cinfo.dest->empty_output_buffer = &my_empty_output_buffer;
-	cinfo.dest->term_destination 		= &my_term_destination;
+	jpeg_create_compress(&cinfo);
+	jpeg_stream_dest(&cinfo, &stream);
 
 	cinfo.image_width      = image.width();
 	cinfo.image_height     = image.height();
@@ -381,195 +754,677 @@ void writeJPEG(const Image& image, Stream& stream) {
 	
 	jpeg_finish_compress(&cinfo);
 	jpeg_destroy_compress(&cinfo);
-	
-	stream.write(my_buffer.data(), (uint)my_buffer.size());
 }
 
-void readPNG_readDataFromStream(png_structp png_ptr, png_bytep outBytes, png_size_t byteCountToRead) {
-	png_voidp io_ptr = png_get_io_ptr(png_ptr);
-	if (io_ptr == NULL) return;
-	
-	Stream& stream = *(Stream*)io_ptr;
-	stream.read((byte*)outBytes, (uint)byteCountToRead);
+struct my_vector_destination_mgr {
+	struct jpeg_destination_mgr pub;
+	std::vector<JOCTET>* out;
+};
+
+// C++ exceptions must not unwind through the libjpeg frames, callers report a failure
+// by error_exit, which longjmps back to the encoder once the exception is gone
+static bool resizeJPEGBuffer(std::vector<JOCTET>& out, const size_t size) {
+	try {
+		out.resize(size);
+		return true;
+	} catch (const std::bad_alloc&) {
+		return false;
+	}
 }
 
-bool readPNG(Image& image, Stream& stream) {
-	byte sig[8];
-	
-	stream.read(sig, 8);
-	if (!png_check_sig(sig, 8))
-		return false;   /* bad signature */
+static void my_init_vector_destination(j_compress_ptr cinfo) {
+	my_vector_destination_mgr* dest = (my_vector_destination_mgr*)cinfo->dest;
 	
-	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-	if (!png_ptr) return false;
+	if (!resizeJPEGBuffer(*dest->out, JPEG_BUF_SIZE)) ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
 	
-	png_infop info_ptr = png_create_info_struct(png_ptr);
+	dest->pub.next_output_byte = dest->out->data();
+	dest->pub.free_in_buffer = dest->out->size();
+}
 
-	if (!info_ptr) {
-		png_destroy_read_struct(&png_ptr, NULL, NULL);
-		return false;   /* out of memory */
-	}
+static int my_empty_vector_output_buffer(j_compress_ptr cinfo) {
+	my_vector_destination_mgr* dest = (my_vector_destination_mgr*)cinfo->dest;
 	
-	if (setjmp(png_jmpbuf(png_ptr)))
-		return false;  // "[read_png_file] Error during init_io");
+	// libjpeg only calls this when the buffer is full
+	const size_t used = dest->out->size();
+	if (!resizeJPEGBuffer(*dest->out, used * 2)) ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
 	
-	png_set_read_fn(png_ptr, &stream, readPNG_readDataFromStream);
+	dest->pub.next_output_byte = dest->out->data() + used;
+	dest->pub.free_in_buffer = dest->out->size() - used;
+	return true;
+}
 
-	png_set_sig_bytes(png_ptr, 8);
+static void my_term_vector_destination(j_compress_ptr cinfo) {
+	my_vector_destination_mgr* dest = (my_vector_destination_mgr*)cinfo->dest;
+	dest->out->resize(dest->out->size() - dest->pub.free_in_buffer);
+}
+
+// Encode rows [startRow, endRow) as a complete baseline JPEG with a restart marker
+// after every MCU row. Since a restart resets the DC predictors exactly like a new
+// image does, the entropy coded segments of such strips can be chained.
+static void writeJPEGStrip(const Image& image, const uint startRow, const uint endRow,
+													 const int quality, std::vector<JOCTET>& out) {
+	struct jpeg_compress_struct cinfo;
+	struct my_error_mgr         jerr;
 	
-	png_read_info(png_ptr, info_ptr);
+	cinfo.err = my_std_error(&jerr);
 	
-	uint width = png_get_image_width(png_ptr, info_ptr);
-	uint height = png_get_image_height(png_ptr, info_ptr);
-	byte color_type = png_get_color_type(png_ptr, info_ptr);
-	byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	if (setjmp(jerr.setjmp_buffer)) {
+		jpeg_destroy_compress(&cinfo);
+		throw ImageCodecException();
+	}
 	
-	//int number_of_passes =
-	png_set_interlace_handling(png_ptr);
-	png_read_update_info(png_ptr, info_ptr);
+	jpeg_create_compress(&cinfo);
 	
-	/* read file */
-	if (setjmp(png_jmpbuf(png_ptr)))
-		return false; //"[read_png_file] Error during read_image")
+	my_vector_destination_mgr dest;
+	dest.out = &out;
+	cinfo.dest = &dest.pub;
 	
+	cinfo.dest->init_destination 		= &my_init_vector_destination;
+	cinfo.dest->empty_output_buffer = &my_empty_vector_output_buffer;
+	cinfo.dest->term_destination 		= &my_term_vector_destination;
 	
-	png_bytep* row_pointers = (png_bytep*) malloc(sizeof(png_bytep) * height);
-	for (uint y = 0; y < height; y++) {
-		row_pointers[y] = (png_byte*) malloc(png_get_rowbytes(png_ptr, info_ptr));
-	}
-
-	png_read_image(png_ptr, row_pointers);
-
-	byte* buffer;
+	cinfo.image_width      = image.width();
+	cinfo.image_height     = endRow - startRow;
+	cinfo.input_components = 3;
+	cinfo.in_color_space   = JCS_RGB;
 	
-	switch (color_type) {
-		case PNG_COLOR_TYPE_RGB:
-			image.setPixelDataFormat(PixelDataFormat::PDF_RGB, bit_depth);
-			image.createEmpty(width, height);
-			buffer = (byte*)image.getBuffer();
-			for (uint y = 0; y < height; y++) {
-				memcpy(buffer + y * width * 3, row_pointers[y], width * image.getPixelByteLength());
-			}
-			break;
-			
-		case PNG_COLOR_TYPE_RGBA:
-			image.setPixelDataFormat(PixelDataFormat::PDF_RGBA, bit_depth);
-			image.createEmpty(width, height);
-			buffer = (byte*)image.getBuffer();
-			for (uint y = 0; y < height; y++) {
-				memcpy(buffer + y * width * 4, row_pointers[y], width * image.getPixelByteLength());
-			}
-			break;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, quality, true);
+	cinfo.restart_in_rows = 1;
+	jpeg_start_compress(&cinfo, true);
+	
+	const byte* imageBuffer = image.getBuffer() + (size_t)startRow * image.getPixelRowByteLength();
+	
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW row_pointer = (JSAMPROW)&(imageBuffer[(size_t)cinfo.next_scanline * image.getPixelRowByteLength()]);
+		jpeg_write_scanlines(&cinfo, &row_pointer, 1);
 	}
+	
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+}
 
-	for (uint y = 0; y < height; y++) {
-		free(row_pointers[y]);
+// Returns the offset of the entropy coded data following the SOS header,
+// optionally patching the frame height in the SOF header.
+static size_t findJPEGScanData(std::vector<JOCTET>& data, const uint patchHeight = 0) {
+	size_t pos = 2;
+	
+	while (pos + 4 <= data.size() && data[pos] == 0xFF) {
+		const byte marker = data[pos + 1];
+		const size_t length = (data[pos + 2] << 8) | data[pos + 3];
+		
+		if (marker == 0xC0 && patchHeight > 0) {
+			data[pos + 5] = (JOCTET)(patchHeight >> 8);
+			data[pos + 6] = (JOCTET)patchHeight;
+		}
+		
+		if (marker == 0xDA) return pos + 2 + length;
+		
+		pos += 2 + length;
 	}
-	free(row_pointers);
 	
-	png_destroy_read_struct(&png_ptr, &info_ptr, 0);
-
-	return true;
+	throw ImageCodecException();
 }
 
-void writePNG_writeDataIntoStream(png_structp png_ptr, png_bytep outBytes, png_size_t byteCountToRead) {
-	png_voidp io_ptr = png_get_io_ptr(png_ptr);
-	if (io_ptr == NULL) return;
+void writeJPEGParallel(const Image& image, Stream& stream, const int quality, ThreadPool* pool) {
 	
-	Stream& stream = *(Stream*)io_ptr;
-	stream.write((byte*)outBytes, (uint)byteCountToRead);
+	if (image.getPixelDataFormat() != PixelDataFormat::PDF_RGB || image.getBitDepth() != 8) {
+		throw NotSupportImageCodecException();
+	}
+	
+	if (image.width() <= 0 || image.height() <= 0 || image.width() > 65500 || image.height() > 65500) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	ThreadPool& workers = pool != NULL ? *pool : ThreadPool::shared();
+	
+	// the default 2x2 luma sampling makes MCU rows 16 pixels tall
+	const uint mcuRows = 16;
+	const uint height = image.height();
+	const uint totalMCURows = (height + mcuRows - 1) / mcuRows;
+	const uint stripMCURows = std::max(1u, (totalMCURows + workers.getThreadCount() * 4 - 1) / (workers.getThreadCount() * 4));
+	const uint stripCount = (totalMCURows + stripMCURows - 1) / stripMCURows;
+	
+	std::vector<std::vector<JOCTET> > strips(stripCount);
+	uint restartCount = 0;
+	
+	// strips are written in order as soon as they are ready. When a write throws,
+	// parallelForOrdered still waits for the strips in flight before rethrowing.
+	parallelForOrdered(workers, stripCount, [&](const uint i) {
+		const uint startRow = i * stripMCURows * mcuRows;
+		const uint endRow = std::min(height, startRow + stripMCURows * mcuRows);
+		writeJPEGStrip(image, startRow, endRow, quality, strips[i]);
+	}, [&](const uint i) {
+		std::vector<JOCTET>& data = strips[i];
+		
+		// the headers of the first strip become the headers of the whole image
+		const size_t scanStart = findJPEGScanData(data, i == 0 ? height : 0);
+		const size_t scanEnd = data.size() - 2; // EOI
+		
+		if (i == 0) {
+			stream.write(data.data(), (uint)scanStart);
+		} else {
+			const byte restart[2] = { 0xFF, (byte)(0xD0 + (restartCount++ & 7)) };
+			stream.write(restart, 2);
+		}
+		
+		// renumber the restart markers of this strip to continue the global sequence,
+		// data bytes of 0xFF are always stuffed with 0x00 so the markers are unambiguous
+		for (size_t p = scanStart; p + 1 < scanEnd; p++) {
+			if (data[p] == 0xFF && data[p + 1] >= 0xD0 && data[p + 1] <= 0xD7) {
+				data[p + 1] = (JOCTET)(0xD0 + (restartCount++ & 7));
+				p++;
+			}
+		}
+		
+		stream.write(data.data() + scanStart, (uint)(scanEnd - scanStart));
+		std::vector<JOCTET>().swap(data);
+	});
+	
+	const byte eoi[2] = { 0xFF, 0xD9 };
+	stream.write(eoi, 2);
 }
 
-void writePNG_flushDataIntoStream(png_structp png_ptr) {
+void readPNG_readDataFromStream(png_structp png_ptr, png_bytep outBytes, png_size_t byteCountToRead) {
 	png_voidp io_ptr = png_get_io_ptr(png_ptr);
 	if (io_ptr == NULL) return;
 	
 	Stream& stream = *(Stream*)io_ptr;
-	stream.flush();
+	stream.read((byte*)outBytes, (uint)byteCountToRead);
 }
 
-bool writePNG(const Image& image, Stream& stream) {
+static void readPNG_readDataFromMemory(png_structp png_ptr, png_bytep outBytes, png_size_t byteCountToRead) {
+	MappedFileStream& stream = *(MappedFileStream*)png_get_io_ptr(png_ptr);
 	
-	/* initialize stuff */
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (byteCountToRead > stream.getRemaining()) {
+		png_error(png_ptr, "unexpected end of data");
+	}
 	
-	if (!png_ptr)
-		return false; //abort_("[write_png_file] png_create_write_struct failed");
+	memcpy(outBytes, stream.getCurrent(), byteCountToRead);
+	stream.setPosition(stream.getPosition() + byteCountToRead);
+}
+
+// mapped files are copied from directly, without a virtual read per chunk
+static void setPNGReadSource(png_structp png_ptr, Stream& stream) {
+	MappedFileStream* memory = dynamic_cast<MappedFileStream*>(&stream);
+	
+	if (memory != NULL) {
+		png_set_read_fn(png_ptr, memory, readPNG_readDataFromMemory);
+	} else {
+		png_set_read_fn(png_ptr, &stream, readPNG_readDataFromStream);
+	}
+}
+
+// Row pointer arrays are kept per thread and only grow, so decoding or encoding
+// a sequence of frames does not allocate after the first one.
+static png_bytep* pngRowPointers(const Image& image) {
+	static thread_local std::vector<png_bytep> rows;
+	
+	const uint height = image.height();
+	if (rows.size() < height) rows.resize(height);
+	
+	byte* buffer = image.getBuffer();
+	const size_t stride = image.getPixelRowByteLength();
+	
+	for (uint y = 0; y < height; y++) {
+		rows[y] = (png_bytep)(buffer + y * stride);
+	}
+	
+	return rows.data();
+}
+
+// let libpng expand every color type into 8-bit RGB or RGBA
+static void setupPNGReadTransforms(png_structp png_ptr, png_infop info_ptr) {
+	const byte color_type = png_get_color_type(png_ptr, info_ptr);
+	const byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	
+	if (color_type == PNG_COLOR_TYPE_PALETTE) {
+		png_set_palette_to_rgb(png_ptr);
+	}
+	
+	if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+		png_set_expand_gray_1_2_4_to_8(png_ptr);
+	}
+	
+	if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
+		png_set_tRNS_to_alpha(png_ptr);
+	}
+	
+	if (bit_depth == 16) {
+		png_set_strip_16(png_ptr);
+	}
+	
+	if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+		png_set_gray_to_rgb(png_ptr);
+	}
+}
+
+bool readPNG(Image& image, Stream& stream) {
+	byte sig[8];
+	
+	stream.read(sig, 8);
+	if (!png_check_sig(sig, 8))
+		return false;   /* bad signature */
+	
+	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!png_ptr) return false;
 	
 	png_infop info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr)
-		return false; // abort_("[write_png_file] png_create_info_struct failed");
+
+	if (!info_ptr) {
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
+		return false;   /* out of memory */
+	}
+	
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
 	
-	if (setjmp(png_jmpbuf(png_ptr)))
-		return false; //abort_("[write_png_file] Error during init_io");
+	setPNGReadSource(png_ptr, stream);
+
+	png_set_sig_bytes(png_ptr, 8);
 	
-	//png_init_io(png_ptr, fp);
-	png_set_write_fn(png_ptr, &stream, writePNG_writeDataIntoStream, writePNG_flushDataIntoStream);
+	png_read_info(png_ptr, info_ptr);
 	
-	/* write header */
-	if (setjmp(png_jmpbuf(png_ptr)))
-		return false; // abort_("[write_png_file] Error during writing header");
+	const uint width = png_get_image_width(png_ptr, info_ptr);
+	const uint height = png_get_image_height(png_ptr, info_ptr);
 	
-	const uint width = image.width(), height = image.height();
-	const byte bitDepth = image.getBitDepth();
+	setupPNGReadTransforms(png_ptr, info_ptr);
+	png_set_interlace_handling(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
+	
+	const bool hasAlpha = png_get_channels(png_ptr, info_ptr) == 4;
+	
+	image.setPixelDataFormat(hasAlpha ? PixelDataFormat::PDF_RGBA : PixelDataFormat::PDF_RGB, 8);
+	image.createEmpty(width, height);
+	
+	png_read_image(png_ptr, pngRowPointers(image));
+	png_read_end(png_ptr, NULL);
+	
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+	return true;
+}
+
+void writePNG_writeDataIntoStream(png_structp png_ptr, png_bytep outBytes, png_size_t byteCountToRead) {
+	png_voidp io_ptr = png_get_io_ptr(png_ptr);
+	if (io_ptr == NULL) return;
+	
+	Stream& stream = *(Stream*)io_ptr;
+	stream.write((byte*)outBytes, (uint)byteCountToRead);
+}
+
+static void writePNG_writeDataIntoMemory(png_structp png_ptr, png_bytep outBytes, png_size_t byteCount) {
+	MemoryOutputStream& stream = *(MemoryOutputStream*)png_get_io_ptr(png_ptr);
+	
+	// the exception must not unwind through libpng, png_error longjmps to the writer instead
+	size_t available;
+	byte* dest = NULL;
+	
+	try {
+		dest = stream.prepare(byteCount, &available);
+	} catch (const std::bad_alloc&) {
+	}
+	
+	if (dest == NULL) png_error(png_ptr, "out of memory");
+	
+	memcpy(dest, outBytes, byteCount);
+	stream.commit(byteCount);
+}
+
+static void writePNG_flushMemory(png_structp png_ptr) {
+}
+
+void writePNG_flushDataIntoStream(png_structp png_ptr) {
+	png_voidp io_ptr = png_get_io_ptr(png_ptr);
+	if (io_ptr == NULL) return;
 	
-	int colorType = 0;
+	Stream& stream = *(Stream*)io_ptr;
+	stream.flush();
+}
+
+// memory sinks are appended to directly, without a virtual write per piece
+static void setPNGWriteTarget(png_structp png_ptr, Stream& stream) {
+	MemoryOutputStream* memory = dynamic_cast<MemoryOutputStream*>(&stream);
+	
+	if (memory != NULL) {
+		png_set_write_fn(png_ptr, memory, writePNG_writeDataIntoMemory, writePNG_flushMemory);
+	} else {
+		png_set_write_fn(png_ptr, &stream, writePNG_writeDataIntoStream, writePNG_flushDataIntoStream);
+	}
+}
+
+// 8-bit RGB(A) and BGR(A) are written as PNG RGB(A)
+static int getPNGColorType(const PixelDataFormat format, const byte bitDepth) {
+	if (bitDepth != 8) {
+		throw NotSupportImageCodecException();
+	}
 	
-	switch (image.getPixelDataFormat()) {
+	switch (format) {
 		case PixelDataFormat::PDF_RGB:
-			colorType = PNG_COLOR_TYPE_RGB;
-			break;
+		case PixelDataFormat::PDF_BGR:
+			return PNG_COLOR_TYPE_RGB;
 
 		case PixelDataFormat::PDF_RGBA:
-			colorType = PNG_COLOR_TYPE_RGBA;
-			break;
+		case PixelDataFormat::PDF_BGRA:
+			return PNG_COLOR_TYPE_RGBA;
 
 		default:
-		case PixelDataFormat::PDF_BGR:
-		case PixelDataFormat::PDF_BGRA:
 			throw NotSupportImageCodecException();
-			break;
+	}
+}
+
+// Options come from callers, reject values outside the enums before they index tables
+// or reach zlib. Throws ArgumentOutOfRangeException.
+static void checkPNGEncodeOptions(const PNGEncodeOptions& options) {
+	if ((uint)options.filter > PFM_ADAPTIVE || (uint)options.strategy > PCS_RLE) {
+		throw ArgumentOutOfRangeException();
+	}
+}
+
+static void writePNGHeader(png_structp png_ptr, png_infop info_ptr, const uint width, const uint height,
+													 const PixelDataFormat format, const PNGEncodeOptions& options) {
+	static const int filterMasks[] = {
+		PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_PAETH, PNG_ALL_FILTERS,
+	};
+	
+	png_set_compression_level(png_ptr, std::max(0, std::min(9, options.compressionLevel)));
+	png_set_compression_strategy(png_ptr, options.strategy);
+	png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filterMasks[options.filter]);
+	
+	if (options.bufferSize > 0) {
+		png_set_compression_buffer_size(png_ptr, options.bufferSize);
 	}
 	
 	png_set_IHDR(png_ptr, info_ptr, width, height,
-							 bitDepth, colorType, PNG_INTERLACE_NONE,
+							 8, getPNGColorType(format, 8), PNG_INTERLACE_NONE,
 							 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 	
 	png_write_info(png_ptr, info_ptr);
 	
+	if (format == PixelDataFormat::PDF_BGR || format == PixelDataFormat::PDF_BGRA) {
+		png_set_bgr(png_ptr);
+	}
+}
+
+bool writePNG(const Image& image, Stream& stream, const PNGEncodeOptions& options) {
 	
-	/* write bytes */
-	if (setjmp(png_jmpbuf(png_ptr)))
-		return false; // abort_("[write_png_file] Error during writing bytes");
+	// validate before libpng is set up, the exception must not cross its setjmp frame
+	getPNGColorType(image.getPixelDataFormat(), image.getBitDepth());
+	checkPNGEncodeOptions(options);
 	
-	const byte* imageBuffer = image.getBuffer();
-	const uint rowByteLength = image.getPixelRowByteLength();
+	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	
-	png_bytep* row_pointers = (png_bytep*) malloc(sizeof(png_bytep) * height);
-	for (uint y = 0; y < height; y++) {
-		row_pointers[y] = (png_byte*) malloc(png_get_rowbytes(png_ptr, info_ptr));
-		memcpy(row_pointers[y], imageBuffer + y * rowByteLength, rowByteLength);
+	if (!png_ptr)
+		return false;
+	
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	if (!info_ptr) {
+		png_destroy_write_struct(&png_ptr, NULL);
+		return false;
 	}
 	
-	png_write_image(png_ptr, row_pointers);
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return false;
+	}
 	
-	/* end write */
-	if (setjmp(png_jmpbuf(png_ptr)))
-		return false; //abort_("[write_png_file] Error during end of write");
+	setPNGWriteTarget(png_ptr, stream);
 	
-	png_write_end(png_ptr, NULL);
+	writePNGHeader(png_ptr, info_ptr, image.width(), image.height(), image.getPixelDataFormat(), options);
 	
-	/* cleanup heap allocation */
-	for (uint y = 0; y < height; y++) {
-		free(row_pointers[y]);
-	}
-	free(row_pointers);
+	// rows are handed to libpng straight from the image buffer
+	png_write_image(png_ptr, pngRowPointers(image));
+	png_write_end(png_ptr, NULL);
 	
 	png_destroy_write_struct(&png_ptr, &info_ptr);
 
 	return true;
 }
 
+#define PNG_STRIP_MIN_BYTES (256 * 1024)
+#define PNG_DEFLATE_WINDOW 32768
+
+static inline byte paethPredictor(const int a, const int b, const int c) {
+	const int p = a + b - c;
+	const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	
+	if (pa <= pb && pa <= pc) return (byte)a;
+	if (pb <= pc) return (byte)b;
+	return (byte)c;
+}
+
+// Filter one row into out (filter type byte followed by rowBytes bytes), prev is NULL for the first row.
+static void filterPNGRow(const byte* prev, const byte* row, byte* out,
+												 const uint rowBytes, const uint bpp, const PNGFilterMode filter) {
+	byte* dest = out + 1;
+	
+	switch (filter) {
+		default:
+		case PFM_NONE:
+			out[0] = 0;
+			memcpy(dest, row, rowBytes);
+			break;
+			
+		case PFM_SUB:
+			out[0] = 1;
+			for (uint i = 0; i < rowBytes; i++) {
+				dest[i] = row[i] - (i >= bpp ? row[i - bpp] : 0);
+			}
+			break;
+			
+		case PFM_UP:
+			out[0] = 2;
+			for (uint i = 0; i < rowBytes; i++) {
+				dest[i] = row[i] - (prev != NULL ? prev[i] : 0);
+			}
+			break;
+			
+		case PFM_PAETH:
+			out[0] = 4;
+			for (uint i = 0; i < rowBytes; i++) {
+				const int a = i >= bpp ? row[i - bpp] : 0;
+				const int b = prev != NULL ? prev[i] : 0;
+				const int c = prev != NULL && i >= bpp ? prev[i - bpp] : 0;
+				dest[i] = row[i] - paethPredictor(a, b, c);
+			}
+			break;
+	}
+}
+
+struct PNGStrip {
+	std::vector<byte> data;
+	uLong adler;
+	size_t length;
+};
+
+static void filterPNGRows(const Image& image, const uint startRow, const uint endRow,
+													const PNGFilterMode filter, std::vector<byte>& out) {
+	const uint rowBytes = image.getPixelRowByteLength();
+	const uint bpp = image.getPixelByteLength();
+	const byte* buffer = image.getBuffer();
+	const bool bgr = image.getPixelDataFormat() == PixelDataFormat::PDF_BGR
+		|| image.getPixelDataFormat() == PixelDataFormat::PDF_BGRA;
+	
+	out.resize((size_t)(endRow - startRow) * (rowBytes + 1));
+	
+	// BGR rows are swizzled into two scratch rows before filtering
+	std::vector<byte> swizzled;
+	if (bgr) swizzled.resize(rowBytes * 2);
+	
+	std::vector<byte> candidate;
+	if (filter == PFM_ADAPTIVE) candidate.resize(rowBytes + 1);
+	
+	for (uint y = startRow; y < endRow; y++) {
+		const byte* row = buffer + (size_t)y * rowBytes;
+		const byte* prev = y > 0 ? row - rowBytes : NULL;
+		
+		if (bgr) {
+			byte* cur = &swizzled[(y & 1) * rowBytes];
+			
+			if (y == startRow && prev != NULL) {
+				byte* p = &swizzled[((y + 1) & 1) * rowBytes];
+				for (uint i = 0; i < rowBytes; i += bpp) {
+					p[i] = prev[i + 2]; p[i + 1] = prev[i + 1]; p[i + 2] = prev[i];
+					if (bpp > 3) p[i + 3] = prev[i + 3];
+				}
+			}
+			
+			for (uint i = 0; i < rowBytes; i += bpp) {
+				cur[i] = row[i + 2]; cur[i + 1] = row[i + 1]; cur[i + 2] = row[i];
+				if (bpp > 3) cur[i + 3] = row[i + 3];
+			}
+			
+			prev = prev != NULL ? &swizzled[((y + 1) & 1) * rowBytes] : NULL;
+			row = cur;
+		}
+		
+		byte* dest = &out[(size_t)(y - startRow) * (rowBytes + 1)];
+		
+		if (filter != PFM_ADAPTIVE) {
+			filterPNGRow(prev, row, dest, rowBytes, bpp, filter);
+			continue;
+		}
+		
+		// pick the filter with the minimum sum of absolute differences, like libpng does
+		uint best = ~0u;
+		
+		for (int f = PFM_NONE; f <= PFM_PAETH; f++) {
+			filterPNGRow(prev, row, candidate.data(), rowBytes, bpp, (PNGFilterMode)f);
+			
+			uint sum = 0;
+			for (uint i = 1; i <= rowBytes; i++) {
+				sum += candidate[i] < 128 ? candidate[i] : 256 - candidate[i];
+			}
+			
+			if (sum < best) {
+				best = sum;
+				memcpy(dest, candidate.data(), rowBytes + 1);
+			}
+		}
+	}
+}
+
+// Filter and deflate rows [startRow, endRow) as raw deflate data ending on a byte
+// boundary (sync flush), or with the final block when last is set. The filtered
+// tail of the previous rows primes the dictionary so the seams compress as well.
+static void deflatePNGStrip(const Image& image, const uint startRow, const uint endRow, const bool last,
+														const PNGEncodeOptions& options, PNGStrip& strip) {
+	const uint rowBytes = image.getPixelRowByteLength();
+	
+	std::vector<byte> filtered;
+	filterPNGRows(image, startRow, endRow, options.filter, filtered);
+	
+	strip.length = filtered.size();
+	strip.adler = adler32(adler32(0L, Z_NULL, 0), filtered.data(), (uInt)filtered.size());
+	
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	
+	if (deflateInit2(&zs, std::max(0, std::min(9, options.compressionLevel)), Z_DEFLATED,
+									 -15, 8, options.strategy) != Z_OK) {
+		throw ImageCodecException();
+	}
+	
+	if (startRow > 0) {
+		const uint dictRows = std::min(startRow, (uint)(PNG_DEFLATE_WINDOW / (rowBytes + 1) + 1));
+		std::vector<byte> dict;
+		filterPNGRows(image, startRow - dictRows, startRow, options.filter, dict);
+		
+		const size_t dictLength = std::min(dict.size(), (size_t)PNG_DEFLATE_WINDOW);
+		deflateSetDictionary(&zs, &dict[dict.size() - dictLength], (uInt)dictLength);
+	}
+	
+	strip.data.resize(deflateBound(&zs, (uLong)filtered.size()) + 16);
+	
+	zs.next_in = filtered.data();
+	zs.avail_in = (uInt)filtered.size();
+	zs.next_out = strip.data.data();
+	zs.avail_out = (uInt)strip.data.size();
+	
+	const int result = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+	strip.data.resize(strip.data.size() - zs.avail_out);
+	deflateEnd(&zs);
+	
+	if (result != (last ? Z_STREAM_END : Z_OK) || zs.avail_in != 0) {
+		throw ImageCodecException();
+	}
+}
+
+static void writePNGChunk(Stream& stream, const char* type, const byte* data, const size_t length) {
+	byte header[8] = {
+		(byte)(length >> 24), (byte)(length >> 16), (byte)(length >> 8), (byte)length,
+		(byte)type[0], (byte)type[1], (byte)type[2], (byte)type[3],
+	};
+	
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, header + 4, 4);
+	if (length > 0) crc = crc32(crc, data, (uInt)length);
+	
+	const byte footer[4] = { (byte)(crc >> 24), (byte)(crc >> 16), (byte)(crc >> 8), (byte)crc };
+	
+	stream.write(header, 8);
+	if (length > 0) stream.write(data, (uint)length);
+	stream.write(footer, 4);
+}
+
+void writePNGParallel(const Image& image, Stream& stream, const PNGEncodeOptions& options, ThreadPool* pool) {
+	
+	const byte colorType = (byte)getPNGColorType(image.getPixelDataFormat(), image.getBitDepth());
+	checkPNGEncodeOptions(options);
+	
+	if (image.width() <= 0 || image.height() <= 0) {
+		throw NotSupportImageCodecException();
+	}
+	
+	ThreadPool& workers = pool != NULL ? *pool : ThreadPool::shared();
+	
+	const uint width = image.width(), height = image.height();
+	const size_t filteredRowBytes = image.getPixelRowByteLength() + 1;
+	
+	// a few strips per worker for balancing, but never so small that the seams cost ratio
+	uint stripRows = std::max((size_t)1, PNG_STRIP_MIN_BYTES / filteredRowBytes);
+	stripRows = std::max(stripRows, (height + workers.getThreadCount() * 4 - 1) / (workers.getThreadCount() * 4));
+	const uint stripCount = (height + stripRows - 1) / stripRows;
+	
+	static const byte signature[8] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+	stream.write(signature, 8);
+	
+	const byte ihdr[13] = {
+		(byte)(width >> 24), (byte)(width >> 16), (byte)(width >> 8), (byte)width,
+		(byte)(height >> 24), (byte)(height >> 16), (byte)(height >> 8), (byte)height,
+		8, colorType, 0, 0, 0,
+	};
+	writePNGChunk(stream, "IHDR", ihdr, sizeof(ihdr));
+	
+	// zlib header: 32K window, FLEVEL from the compression level, FCHECK makes it a multiple of 31
+	const int level = options.compressionLevel;
+	const byte cmf = 0x78;
+	byte flg = (byte)((level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3) << 6);
+	flg += 31 - (cmf * 256 + flg) % 31;
+	const byte zlibHeader[2] = { cmf, flg };
+	writePNGChunk(stream, "IDAT", zlibHeader, 2);
+	
+	std::vector<PNGStrip> strips(stripCount);
+	uLong adler = adler32(0L, Z_NULL, 0);
+	
+	// strips are written in order as soon as they are ready, the workers keep going meanwhile.
+	// When a write throws, parallelForOrdered still waits for the strips in flight.
+	parallelForOrdered(workers, stripCount, [&](const uint i) {
+		const uint startRow = i * stripRows, endRow = std::min(height, startRow + stripRows);
+		deflatePNGStrip(image, startRow, endRow, i == stripCount - 1, options, strips[i]);
+	}, [&](const uint i) {
+		adler = adler32_combine(adler, strips[i].adler, (z_off_t)strips[i].length);
+		writePNGChunk(stream, "IDAT", strips[i].data.data(), strips[i].data.size());
+		std::vector<byte>().swap(strips[i].data);
+	});
+	
+	const byte trailer[4] = { (byte)(adler >> 24), (byte)(adler >> 16), (byte)(adler >> 8), (byte)adler };
+	writePNGChunk(stream, "IDAT", trailer, 4);
+	writePNGChunk(stream, "IEND", NULL, 0);
+}
+
 void saveImage(const Image& image, const string& path, ImageCodecFormat format) {
 	
 	if (format == ImageCodecFormat::ICF_AUTO) {
@@ -599,6 +1454,17 @@ void saveImage(const Image& image, const string& path, ImageCodecFormat format)
 			writePNG(*saveImage, fs);
 			break;
 		
+		case ImageCodecFormat::ICF_BMP:
+		case ImageCodecFormat::ICF_TGA:
+		case ImageCodecFormat::ICF_PPM:
+		case ImageCodecFormat::ICF_PFM:
+		case ImageCodecFormat::ICF_HDR:
+		case ImageCodecFormat::ICF_EXR:
+		case ImageCodecFormat::ICF_QOI:
+		case ImageCodecFormat::ICF_DDS:
+			ugm::saveImage(image, fs, format);
+			break;
+		
 		default:
 			break;
 	}
@@ -606,6 +1472,50 @@ void saveImage(const Image& image, const string& path, ImageCodecFormat format)
 	fs.close();
 }
 
+void saveImage(const Image& image, const string& path, const PNGEncodeOptions& options) {
+	FileStream fs(path);
+	fs.openWrite();
+	
+	if (image.getBitDepth() != 8) {
+		Image image4b(PixelDataFormat::PDF_RGBA, 8);
+		Image::copy(image, image4b);
+		writePNG(image4b, fs, options);
+	} else {
+		writePNG(image, fs, options);
+	}
+	
+	fs.close();
+}
+
+void saveImage(const Image& image, const string& path, const EXREncodeOptions& options) {
+	FileStream fs(path);
+	fs.openWrite();
+	
+	writeEXR(image, fs, options);
+	
+	fs.close();
+}
+
+size_t estimateEncodedSize(const Image& image, ImageCodecFormat format) {
+	const size_t pixels = (size_t)image.width() * image.height();
+	const size_t raw = image.getBufferLength();
+	
+	switch (format) {
+		default:
+			// stored deflate blocks and filter bytes of an incompressible image, plus headers
+			return raw + raw / 1000 + image.height() + 4096;
+			
+		case ImageCodecFormat::ICF_JPEG:
+			return pixels + 4096;
+			
+		case ImageCodecFormat::ICF_QOI:
+			return pixels * 5 + 22;
+			
+		case ImageCodecFormat::ICF_DDS:
+			return pixels + 148;
+	}
+}
+
 void saveImage(const Image& image, Stream& stream, ImageCodecFormat format) {
 	switch (format) {
 		default:
@@ -636,6 +1546,45 @@ void saveImage(const Image& image, Stream& stream, ImageCodecFormat format) {
 		case ImageCodecFormat::ICF_PNG:
 			writePNG(image, stream);
 			break;
+		
+		case ImageCodecFormat::ICF_PFM:
+			writePFM(image, stream);
+			break;
+		
+		case ImageCodecFormat::ICF_HDR:
+			writeHDR(image, stream);
+			break;
+		
+		case ImageCodecFormat::ICF_EXR:
+			writeEXR(image, stream);
+			break;
+		
+		case ImageCodecFormat::ICF_DDS:
+		{
+			CompressedImage compressed;
+			compressImage(image, compressed, BlockCompressionFormat::BCF_BC7);
+			writeDDS(compressed, stream);
+		}
+			break;
+		
+		case ImageCodecFormat::ICF_BMP:
+		case ImageCodecFormat::ICF_TGA:
+		case ImageCodecFormat::ICF_PPM:
+		case ImageCodecFormat::ICF_QOI:
+			if (image.getBitDepth() != 8) {
+				Image image8b(image.getColorComponents() > 3 ? PixelDataFormat::PDF_RGBA : PixelDataFormat::PDF_RGB, 8);
+				Image::copy(image, image8b);
+				saveImage(image8b, stream, format);
+			} else if (format == ImageCodecFormat::ICF_BMP) {
+				writeBMP(image, stream);
+			} else if (format == ImageCodecFormat::ICF_TGA) {
+				writeTGA(image, stream, true);
+			} else if (format == ImageCodecFormat::ICF_QOI) {
+				writeQOI(image, stream);
+			} else {
+				writePPM(image, stream);
+			}
+			break;
 	}
 }
 
@@ -652,4 +1601,1054 @@ uint saveImage(const Image& img, Archive& archive, uint formatTag, ImageCodecFor
 	return uid;
 }
 
+
+uint ImageScanlineReader::readBand(Image& band, const uint rows) {
+	const uint count = std::min(rows, this->imageHeight - this->currentRow);
+	
+	band.setPixelDataFormat(this->format, 8);
+	band.createEmpty(this->imageWidth, count);
+	
+	if (count == 0) return 0;
+	
+	return this->readRows(band.getBuffer(), count, band.getPixelRowByteLength());
+}
+
+void ImageScanlineWriter::writeBand(const Image& band) {
+	if (band.width() != this->imageWidth || band.getPixelDataFormat() != this->format
+			|| band.getBitDepth() != 8) {
+		throw NotSupportImageCodecException();
+	}
+	
+	this->writeRows(band.getBuffer(), band.height(), band.getPixelRowByteLength());
+}
+
+struct JPEGReadState {
+	struct jpeg_decompress_struct cinfo;
+	struct my_error_mgr jerr;
+	JSAMPARRAY scratch;
+};
+
+JPEGScanlineReader::JPEGScanlineReader(Stream& stream, const JPEGDecodeOptions& options) {
+	this->state = new JPEGReadState();
+	j_decompress_ptr cinfo = &this->state->cinfo;
+	
+	cinfo->err = my_std_error(&this->state->jerr);
+	
+	if (setjmp(this->state->jerr.setjmp_buffer)) {
+		jpeg_destroy_decompress(cinfo);
+		delete this->state;
+		throw ImageCodecException();
+	}
+	
+	jpeg_create_decompress(cinfo);
+	jpeg_stream_src(cinfo, &stream);
+	
+	startJPEGDecompress(cinfo, options);
+	this->state->scratch = allocJPEGScratch(cinfo);
+	
+	this->imageWidth = cinfo->output_width;
+	this->imageHeight = cinfo->output_height;
+	this->format = PixelDataFormat::PDF_RGB;
+}
+
+JPEGScanlineReader::~JPEGScanlineReader() {
+	jpeg_destroy_decompress(&this->state->cinfo);
+	delete this->state;
+}
+
+uint JPEGScanlineReader::readRows(byte* buffer, const uint count, size_t stride) {
+	j_decompress_ptr cinfo = &this->state->cinfo;
+	
+	if (this->isFinished()) return 0;
+	if (stride == 0) stride = this->getRowByteLength();
+	
+	if (setjmp(this->state->jerr.setjmp_buffer)) {
+		throw ImageCodecException();
+	}
+	
+	const uint rows = readJPEGRows(cinfo, buffer, count, stride, this->state->scratch);
+	this->currentRow += rows;
+	
+	if (this->isFinished()) {
+		jpeg_finish_decompress(cinfo);
+	}
+	
+	return rows;
+}
+
+struct JPEGWriteState {
+	struct jpeg_compress_struct cinfo;
+	struct my_error_mgr jerr;
+};
+
+JPEGScanlineWriter::JPEGScanlineWriter(Stream& stream, const uint width, const uint height, const int quality) {
+	if (width == 0 || height == 0 || width > 65500 || height > 65500) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	this->state = new JPEGWriteState();
+	j_compress_ptr cinfo = &this->state->cinfo;
+	
+	cinfo->err = my_std_error(&this->state->jerr);
+	
+	if (setjmp(this->state->jerr.setjmp_buffer)) {
+		jpeg_destroy_compress(cinfo);
+		delete this->state;
+		throw ImageCodecException();
+	}
+	
+	jpeg_create_compress(cinfo);
+	jpeg_stream_dest(cinfo, &stream);
+	
+	cinfo->image_width      = width;
+	cinfo->image_height     = height;
+	cinfo->input_components = 3;
+	cinfo->in_color_space   = JCS_RGB;
+	
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, quality, true);
+	jpeg_start_compress(cinfo, true);
+	
+	this->imageWidth = width;
+	this->imageHeight = height;
+	this->format = PixelDataFormat::PDF_RGB;
+}
+
+JPEGScanlineWriter::~JPEGScanlineWriter() {
+	jpeg_destroy_compress(&this->state->cinfo);
+	delete this->state;
+}
+
+void JPEGScanlineWriter::writeRows(const byte* buffer, const uint count, size_t stride) {
+	j_compress_ptr cinfo = &this->state->cinfo;
+	
+	if (count > this->imageHeight - this->currentRow) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	if (stride == 0) stride = this->imageWidth * 3;
+	
+	if (setjmp(this->state->jerr.setjmp_buffer)) {
+		throw ImageCodecException();
+	}
+	
+	JSAMPROW rows[JPEG_MAX_READ_LINES];
+	
+	for (uint written = 0; written < count; ) {
+		const uint lines = std::min((uint)JPEG_MAX_READ_LINES, count - written);
+		
+		for (uint i = 0; i < lines; i++) {
+			rows[i] = (JSAMPROW)(buffer + (written + i) * stride);
+		}
+		
+		written += jpeg_write_scanlines(cinfo, rows, lines);
+	}
+	
+	this->currentRow += count;
+}
+
+void JPEGScanlineWriter::finish() {
+	if (this->currentRow != this->imageHeight) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	if (setjmp(this->state->jerr.setjmp_buffer)) {
+		throw ImageCodecException();
+	}
+	
+	jpeg_finish_compress(&this->state->cinfo);
+}
+
+struct PNGReadState {
+	png_structp png_ptr;
+	png_infop info_ptr;
+	Image* image;		// the whole decoded image of an interlaced PNG
+};
+
+PNGScanlineReader::PNGScanlineReader(Stream& stream) {
+	byte sig[8];
+	
+	if (stream.read(sig, 8) != 8 || !png_check_sig(sig, 8)) {
+		throw ImageCodecException();
+	}
+	
+	this->state = new PNGReadState();
+	this->state->image = NULL;
+	this->state->info_ptr = NULL;
+	this->state->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	
+	if (this->state->png_ptr != NULL) {
+		this->state->info_ptr = png_create_info_struct(this->state->png_ptr);
+	}
+	
+	png_structp png_ptr = this->state->png_ptr;
+	png_infop info_ptr = this->state->info_ptr;
+	
+	if (info_ptr == NULL || setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		delete this->state->image;
+		delete this->state;
+		throw ImageCodecException();
+	}
+	
+	setPNGReadSource(png_ptr, stream);
+	png_set_sig_bytes(png_ptr, 8);
+	
+	png_read_info(png_ptr, info_ptr);
+	
+	this->imageWidth = png_get_image_width(png_ptr, info_ptr);
+	this->imageHeight = png_get_image_height(png_ptr, info_ptr);
+	
+	setupPNGReadTransforms(png_ptr, info_ptr);
+	
+	const bool interlaced = png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE;
+	if (interlaced) png_set_interlace_handling(png_ptr);
+	
+	png_read_update_info(png_ptr, info_ptr);
+	
+	this->format = png_get_channels(png_ptr, info_ptr) == 4 ? PixelDataFormat::PDF_RGBA : PixelDataFormat::PDF_RGB;
+	
+	if (interlaced) {
+		this->state->image = new Image(this->format, 8, this->imageWidth, this->imageHeight);
+		png_read_image(png_ptr, pngRowPointers(*this->state->image));
+		png_read_end(png_ptr, NULL);
+	}
+}
+
+PNGScanlineReader::~PNGScanlineReader() {
+	png_destroy_read_struct(&this->state->png_ptr, &this->state->info_ptr, NULL);
+	delete this->state->image;
+	delete this->state;
+}
+
+uint PNGScanlineReader::readRows(byte* buffer, const uint count, size_t stride) {
+	png_structp png_ptr = this->state->png_ptr;
+	
+	const uint rowBytes = this->getRowByteLength();
+	const uint rows = std::min(count, this->imageHeight - this->currentRow);
+	if (stride == 0) stride = rowBytes;
+	
+	if (this->state->image != NULL) {
+		const byte* src = this->state->image->getBuffer() + (size_t)this->currentRow * rowBytes;
+		
+		for (uint i = 0; i < rows; i++) {
+			memcpy(buffer + i * stride, src + i * rowBytes, rowBytes);
+		}
+		
+		this->currentRow += rows;
+		return rows;
+	}
+	
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		throw ImageCodecException();
+	}
+	
+	for (uint i = 0; i < rows; i++) {
+		png_read_row(png_ptr, (png_bytep)(buffer + i * stride), NULL);
+	}
+	
+	this->currentRow += rows;
+	
+	if (rows > 0 && this->isFinished()) {
+		png_read_end(png_ptr, NULL);
+	}
+	
+	return rows;
+}
+
+struct PNGWriteState {
+	png_structp png_ptr;
+	png_infop info_ptr;
+};
+
+PNGScanlineWriter::PNGScanlineWriter(Stream& stream, const uint width, const uint height,
+																		 const PixelDataFormat format, const PNGEncodeOptions& options) {
+	getPNGColorType(format, 8);
+	checkPNGEncodeOptions(options);
+	
+	if (width == 0 || height == 0) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	this->state = new PNGWriteState();
+	this->state->info_ptr = NULL;
+	this->state->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	
+	if (this->state->png_ptr != NULL) {
+		this->state->info_ptr = png_create_info_struct(this->state->png_ptr);
+	}
+	
+	png_structp png_ptr = this->state->png_ptr;
+	png_infop info_ptr = this->state->info_ptr;
+	
+	if (info_ptr == NULL || setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		delete this->state;
+		throw ImageCodecException();
+	}
+	
+	setPNGWriteTarget(png_ptr, stream);
+	writePNGHeader(png_ptr, info_ptr, width, height, format, options);
+	
+	this->imageWidth = width;
+	this->imageHeight = height;
+	this->format = format;
+}
+
+PNGScanlineWriter::~PNGScanlineWriter() {
+	png_destroy_write_struct(&this->state->png_ptr, &this->state->info_ptr);
+	delete this->state;
+}
+
+void PNGScanlineWriter::writeRows(const byte* buffer, const uint count, size_t stride) {
+	png_structp png_ptr = this->state->png_ptr;
+	
+	if (count > this->imageHeight - this->currentRow) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	if (stride == 0) {
+		const bool alpha = this->format == PixelDataFormat::PDF_RGBA || this->format == PixelDataFormat::PDF_BGRA;
+		stride = this->imageWidth * (alpha ? 4 : 3);
+	}
+	
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		throw ImageCodecException();
+	}
+	
+	for (uint i = 0; i < count; i++) {
+		png_write_row(png_ptr, (png_const_bytep)(buffer + i * stride));
+	}
+	
+	this->currentRow += count;
+}
+
+void PNGScanlineWriter::finish() {
+	if (this->currentRow != this->imageHeight) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	if (setjmp(png_jmpbuf(this->state->png_ptr))) {
+		throw ImageCodecException();
+	}
+	
+	png_write_end(this->state->png_ptr, NULL);
+}
+
+
+// QOI
+
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING_SIZE 8
+#define QOI_PIXELS_MAX 400000000
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_STRIP_MIN_PIXELS 65536
+#define QOI_READ_BUFFER_SIZE 65536
+
+static const byte qoiPadding[QOI_PADDING_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+// pixels are packed as r | g << 8 | b << 16 | a << 24
+static inline uint qoiHash(const uint px) {
+	return ((px & 0xff) * 3 + ((px >> 8) & 0xff) * 5 + ((px >> 16) & 0xff) * 7 + (px >> 24) * 11) & 63;
+}
+
+static void writeQOIHeader(Stream& stream, const uint width, const uint height, const uint channels) {
+	const byte header[QOI_HEADER_SIZE] = {
+		'q', 'o', 'i', 'f',
+		(byte)(width >> 24), (byte)(width >> 16), (byte)(width >> 8), (byte)width,
+		(byte)(height >> 24), (byte)(height >> 16), (byte)(height >> 8), (byte)height,
+		(byte)channels, 0,
+	};
+	stream.write(header, QOI_HEADER_SIZE);
+}
+
+static void readQOIHeader(Stream& stream, uint* width, uint* height, uint* channels) {
+	byte header[QOI_HEADER_SIZE];
+	
+	if (stream.read(header, QOI_HEADER_SIZE) != QOI_HEADER_SIZE || memcmp(header, "qoif", 4) != 0) {
+		throw ImageCodecException();
+	}
+	
+	*width = readBE32(header + 4);
+	*height = readBE32(header + 8);
+	*channels = header[12];
+	
+	if (*width == 0 || *height == 0 || (*channels != 3 && *channels != 4)
+			|| *height >= QOI_PIXELS_MAX / *width) {
+		throw ImageCodecException();
+	}
+}
+
+static inline bool isQOIRGBAFormat(const PixelDataFormat format) {
+	return format == PixelDataFormat::PDF_RGBA || format == PixelDataFormat::PDF_BGRA;
+}
+
+struct QOIEncoder {
+	uint index[64];
+	unsigned long long knownSlots;		// index slots that are the same in the decoder
+	uint previous;
+	bool hasPrevious;
+	uint run;
+	
+	// A strip that does not start the stream neither knows the previous pixel nor the
+	// color index of the decoder, it starts with a literal pixel and only indexes its own colors.
+	QOIEncoder(const bool streamStart)
+	: knownSlots(streamStart ? ~0ull : 0), previous(0xff000000), hasPrevious(streamStart), run(0) {
+		memset(this->index, 0, sizeof(this->index));
+	}
+	
+	// at most width * (pixelBytes + 1) + 1 bytes are written to out
+	byte* encodeRow(const byte* row, const uint width, const uint pixelBytes, const bool swap, byte* out) {
+		const uint ri = swap ? 2 : 0, bi = swap ? 0 : 2;
+		
+		for (uint x = 0; x < width; x++, row += pixelBytes) {
+			const uint px = row[ri] | (row[1] << 8) | (row[bi] << 16) | ((uint)(pixelBytes == 4 ? row[3] : 255) << 24);
+			
+			if (px == this->previous && this->hasPrevious) {
+				if (++this->run == 62) {
+					*out++ = QOI_OP_RUN | 61;
+					this->run = 0;
+				}
+				continue;
+			}
+			
+			if (this->run > 0) {
+				*out++ = (byte)(QOI_OP_RUN | (this->run - 1));
+				this->run = 0;
+			}
+			
+			const uint hash = qoiHash(px);
+			
+			if (this->index[hash] == px && ((this->knownSlots >> hash) & 1)) {
+				*out++ = (byte)(QOI_OP_INDEX | hash);
+			} else {
+				this->index[hash] = px;
+				this->knownSlots |= 1ull << hash;
+				
+				if (this->hasPrevious && (px >> 24) == (this->previous >> 24)) {
+					const signed char vr = (signed char)(px - this->previous);
+					const signed char vg = (signed char)((px >> 8) - (this->previous >> 8));
+					const signed char vb = (signed char)((px >> 16) - (this->previous >> 16));
+					const signed char vgr = vr - vg, vgb = vb - vg;
+					
+					if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+						*out++ = (byte)(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+					} else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+						*out++ = (byte)(QOI_OP_LUMA | (vg + 32));
+						*out++ = (byte)(((vgr + 8) << 4) | (vgb + 8));
+					} else {
+						*out++ = QOI_OP_RGB;
+						*out++ = (byte)px;
+						*out++ = (byte)(px >> 8);
+						*out++ = (byte)(px >> 16);
+					}
+				} else if (pixelBytes == 3 && this->hasPrevious) {
+					*out++ = QOI_OP_RGB;
+					*out++ = (byte)px;
+					*out++ = (byte)(px >> 8);
+					*out++ = (byte)(px >> 16);
+				} else {
+					// the alpha of the decoder is unknown at the start of a strip
+					*out++ = QOI_OP_RGBA;
+					*out++ = (byte)px;
+					*out++ = (byte)(px >> 8);
+					*out++ = (byte)(px >> 16);
+					*out++ = (byte)(px >> 24);
+				}
+			}
+			
+			this->previous = px;
+			this->hasPrevious = true;
+		}
+		
+		return out;
+	}
+	
+	byte* finish(byte* out) {
+		if (this->run > 0) {
+			*out++ = (byte)(QOI_OP_RUN | (this->run - 1));
+			this->run = 0;
+		}
+		return out;
+	}
+};
+
+struct QOIDecoder {
+	uint index[64];
+	uint pixel;
+	uint run;
+	
+	QOIDecoder() : pixel(0xff000000), run(0) {
+		memset(this->index, 0, sizeof(this->index));
+	}
+	
+	// decode width pixels from p into row and return where the next row starts
+	const byte* decodeRow(const byte* p, const byte* end, byte* row, const uint width, const uint pixelBytes) {
+		uint px = this->pixel;
+		
+		for (uint x = 0; x < width; x++, row += pixelBytes) {
+			if (this->run > 0) {
+				this->run--;
+			} else {
+				if (p >= end) throw ImageCodecException();
+				const byte b1 = *p++;
+				
+				if (b1 == QOI_OP_RGB) {
+					if (end - p < 3) throw ImageCodecException();
+					px = (px & 0xff000000) | p[0] | (p[1] << 8) | (p[2] << 16);
+					p += 3;
+				} else if (b1 == QOI_OP_RGBA) {
+					if (end - p < 4) throw ImageCodecException();
+					px = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint)p[3] << 24);
+					p += 4;
+				} else if ((b1 & 0xc0) == QOI_OP_INDEX) {
+					px = this->index[b1];
+				} else if ((b1 & 0xc0) == QOI_OP_DIFF) {
+					const uint r = (px + ((b1 >> 4) & 3) - 2) & 0xff;
+					const uint g = ((px >> 8) + ((b1 >> 2) & 3) - 2) & 0xff;
+					const uint b = ((px >> 16) + (b1 & 3) - 2) & 0xff;
+					px = (px & 0xff000000) | r | (g << 8) | (b << 16);
+				} else if ((b1 & 0xc0) == QOI_OP_LUMA) {
+					if (p >= end) throw ImageCodecException();
+					const byte b2 = *p++;
+					const int vg = (b1 & 0x3f) - 32;
+					const uint r = (px + vg - 8 + ((b2 >> 4) & 0x0f)) & 0xff;
+					const uint g = ((px >> 8) + vg) & 0xff;
+					const uint b = ((px >> 16) + vg - 8 + (b2 & 0x0f)) & 0xff;
+					px = (px & 0xff000000) | r | (g << 8) | (b << 16);
+				} else {
+					this->run = b1 & 0x3f;
+				}
+				
+				this->index[qoiHash(px)] = px;
+			}
+			
+			row[0] = (byte)px;
+			row[1] = (byte)(px >> 8);
+			row[2] = (byte)(px >> 16);
+			if (pixelBytes == 4) row[3] = (byte)(px >> 24);
+		}
+		
+		this->pixel = px;
+		return p;
+	}
+};
+
+void readQOI(Image& image, Stream& stream) {
+	uint width, height, channels;
+	readQOIHeader(stream, &width, &height, &channels);
+	
+	const size_t position = stream.getPosition(), length = stream.getLength();
+	std::vector<byte> data(length > position ? length - position : 0);
+	
+	if (!data.empty() && stream.read(data.data(), (uint)data.size()) != (int)data.size()) {
+		throw ImageCodecException();
+	}
+	
+	image.setPixelDataFormat(channels == 4 ? PixelDataFormat::PDF_RGBA : PixelDataFormat::PDF_RGB, 8);
+	image.createEmpty(width, height);
+	
+	QOIDecoder decoder;
+	const byte* p = data.data();
+	const byte* end = p + data.size();
+	byte* row = image.getBuffer();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	
+	for (uint y = 0; y < height; y++, row += rowBytes) {
+		p = decoder.decodeRow(p, end, row, width, channels);
+	}
+}
+
+void writeQOI(const Image& image, Stream& stream) {
+	const uint width = image.width(), height = image.height();
+	
+	if (width <= 0 || height <= 0 || image.getBitDepth() != 8) {
+		throw NotSupportImageCodecException();
+	}
+	
+	const uint pixelBytes = image.getColorComponents();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	const bool swap = image.getPixelDataFormat() == PixelDataFormat::PDF_BGR
+		|| image.getPixelDataFormat() == PixelDataFormat::PDF_BGRA;
+	
+	writeQOIHeader(stream, width, height, pixelBytes);
+	
+	// encode bands of rows into one reused buffer
+	const uint bandRows = std::max(1u, (uint)(QOI_STRIP_MIN_PIXELS / width));
+	std::vector<byte> buffer(bandRows * width * (pixelBytes + 1) + 1);
+	
+	QOIEncoder encoder(true);
+	const byte* row = image.getBuffer();
+	
+	for (uint y = 0; y < height; ) {
+		const uint endRow = std::min(height, y + bandRows);
+		byte* out = buffer.data();
+		
+		for (; y < endRow; y++, row += rowBytes) {
+			out = encoder.encodeRow(row, width, pixelBytes, swap, out);
+		}
+		
+		if (y == height) out = encoder.finish(out);
+		stream.write(buffer.data(), (uint)(out - buffer.data()));
+	}
+	
+	stream.write(qoiPadding, QOI_PADDING_SIZE);
+}
+
+void writeQOIParallel(const Image& image, Stream& stream, ThreadPool* pool) {
+	const uint width = image.width(), height = image.height();
+	
+	if (width <= 0 || height <= 0 || image.getBitDepth() != 8) {
+		throw NotSupportImageCodecException();
+	}
+	
+	ThreadPool& workers = pool != NULL ? *pool : ThreadPool::shared();
+	
+	const uint pixelBytes = image.getColorComponents();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	const bool swap = image.getPixelDataFormat() == PixelDataFormat::PDF_BGR
+		|| image.getPixelDataFormat() == PixelDataFormat::PDF_BGRA;
+	
+	// a few strips per worker for balancing, large enough that the literal starts do not matter
+	uint stripRows = std::max(1u, (uint)(QOI_STRIP_MIN_PIXELS / width));
+	stripRows = std::max(stripRows, (height + workers.getThreadCount() * 4 - 1) / (workers.getThreadCount() * 4));
+	const uint stripCount = (height + stripRows - 1) / stripRows;
+	
+	std::vector<std::vector<byte> > strips(stripCount);
+	
+	writeQOIHeader(stream, width, height, pixelBytes);
+	
+	parallelForOrdered(workers, stripCount, [&](const uint i) {
+		const uint startRow = i * stripRows, endRow = std::min(height, startRow + stripRows);
+		std::vector<byte>& strip = strips[i];
+		strip.resize((size_t)(endRow - startRow) * width * (pixelBytes + 1) + 1);
+		
+		QOIEncoder encoder(i == 0);
+		byte* out = strip.data();
+		
+		for (uint y = startRow; y < endRow; y++) {
+			out = encoder.encodeRow(image.getBuffer() + y * rowBytes, width, pixelBytes, swap, out);
+		}
+		
+		strip.resize(encoder.finish(out) - strip.data());
+	}, [&](const uint i) {
+		stream.write(strips[i].data(), (uint)strips[i].size());
+		std::vector<byte>().swap(strips[i]);
+	});
+	
+	stream.write(qoiPadding, QOI_PADDING_SIZE);
+}
+
+struct QOIReadState {
+	Stream* stream;
+	QOIDecoder decoder;
+	std::vector<byte> buffer;
+	size_t begin, end;
+	bool streamEnded;
+};
+
+QOIScanlineReader::QOIScanlineReader(Stream& stream) {
+	uint channels;
+	readQOIHeader(stream, &this->imageWidth, &this->imageHeight, &channels);
+	
+	this->format = channels == 4 ? PixelDataFormat::PDF_RGBA : PixelDataFormat::PDF_RGB;
+	
+	// room for the longest possible row
+	this->state = new QOIReadState();
+	this->state->stream = &stream;
+	this->state->buffer.resize(std::max((size_t)QOI_READ_BUFFER_SIZE, (size_t)this->imageWidth * 5 * 2));
+	this->state->begin = 0;
+	this->state->end = 0;
+	this->state->streamEnded = false;
+}
+
+QOIScanlineReader::~QOIScanlineReader() {
+	delete this->state;
+}
+
+uint QOIScanlineReader::readRows(byte* buffer, const uint count, size_t stride) {
+	QOIReadState& s = *this->state;
+	
+	const uint rowBytes = this->getRowByteLength();
+	const uint pixelBytes = this->format == PixelDataFormat::PDF_RGBA ? 4 : 3;
+	const uint rows = std::min(count, this->imageHeight - this->currentRow);
+	const size_t maxRowBytes = (size_t)this->imageWidth * 5;
+	if (stride == 0) stride = rowBytes;
+	
+	for (uint i = 0; i < rows; i++) {
+		if (s.end - s.begin < maxRowBytes && !s.streamEnded) {
+			memmove(s.buffer.data(), s.buffer.data() + s.begin, s.end - s.begin);
+			s.end -= s.begin;
+			s.begin = 0;
+			
+			const int read = s.stream->read(s.buffer.data() + s.end, (uint)(s.buffer.size() - s.end));
+			if (read > 0) {
+				s.end += read;
+			} else {
+				s.streamEnded = true;
+			}
+		}
+		
+		const byte* data = s.buffer.data();
+		s.begin = s.decoder.decodeRow(data + s.begin, data + s.end, buffer + i * stride, this->imageWidth, pixelBytes) - data;
+	}
+	
+	this->currentRow += rows;
+	return rows;
+}
+
+struct QOIWriteState {
+	Stream* stream;
+	QOIEncoder encoder;
+	std::vector<byte> buffer;
+	
+	QOIWriteState() : encoder(true) { }
+};
+
+QOIScanlineWriter::QOIScanlineWriter(Stream& stream, const uint width, const uint height,
+																		 const PixelDataFormat format) {
+	if (width == 0 || height == 0 || height >= QOI_PIXELS_MAX / width) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	this->state = new QOIWriteState();
+	this->state->stream = &stream;
+	this->state->buffer.resize((size_t)width * 5 + 1);
+	
+	writeQOIHeader(stream, width, height, isQOIRGBAFormat(format) ? 4 : 3);
+	
+	this->imageWidth = width;
+	this->imageHeight = height;
+	this->format = format;
+}
+
+QOIScanlineWriter::~QOIScanlineWriter() {
+	delete this->state;
+}
+
+void QOIScanlineWriter::writeRows(const byte* buffer, const uint count, size_t stride) {
+	if (count > this->imageHeight - this->currentRow) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	const uint pixelBytes = isQOIRGBAFormat(this->format) ? 4 : 3;
+	const bool swap = this->format == PixelDataFormat::PDF_BGR || this->format == PixelDataFormat::PDF_BGRA;
+	if (stride == 0) stride = this->imageWidth * pixelBytes;
+	
+	byte* out = this->state->buffer.data();
+	
+	for (uint i = 0; i < count; i++) {
+		const byte* end = this->state->encoder.encodeRow(buffer + i * stride, this->imageWidth, pixelBytes, swap, out);
+		this->state->stream->write(out, (uint)(end - out));
+	}
+	
+	this->currentRow += count;
+}
+
+void QOIScanlineWriter::finish() {
+	if (this->currentRow != this->imageHeight) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	byte* out = this->state->buffer.data();
+	const byte* end = this->state->encoder.finish(out);
+	
+	this->state->stream->write(out, (uint)(end - out));
+	this->state->stream->write(qoiPadding, QOI_PADDING_SIZE);
+}
+
+// walk the marker segments up to the frame header, skipping their payloads
+static bool probeJPEG(ImageInfo& info, Stream& stream, const size_t start) {
+	size_t pos = start + 2;
+	byte segment[8];
+	
+	for (int i = 0; i < 1024; i++) {
+		stream.setPosition(pos);
+		if (stream.read(segment, 4) != 4 || segment[0] != 0xFF) return false;
+		
+		const byte marker = segment[1];
+		
+		if (marker == 0xFF) {
+			pos++;		// fill byte
+			continue;
+		}
+		
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+			pos += 2;	// standalone markers
+			continue;
+		}
+		
+		if (marker == 0xD9 || marker == 0xDA) return false;
+		
+		const uint length = readBE16(segment + 2);
+		
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			if (stream.read(segment, 6) != 6) return false;
+			
+			info.bitDepth = segment[0];
+			info.height = readBE16(segment + 1);
+			info.width = readBE16(segment + 3);
+			info.channels = segment[5];
+			return true;
+		}
+		
+		pos += 2 + length;
+	}
+	
+	return false;
+}
+
+static bool probeTIFF(ImageInfo& info, Stream& stream, const size_t start, const byte* header) {
+	const bool bigEndian = header[0] == 'M';
+	
+	byte entry[12];
+	stream.setPosition(start + (bigEndian ? readBE32(header + 4) : readLE32(header + 4)));
+	if (stream.read(entry, 2) != 2) return false;
+	
+	const uint count = bigEndian ? readBE16(entry) : readLE16(entry);
+	info.channels = 1;
+	info.bitDepth = 1;
+	
+	for (uint i = 0; i < count; i++) {
+		if (stream.read(entry, 12) != 12) return false;
+		
+		const uint tag = bigEndian ? readBE16(entry) : readLE16(entry);
+		const uint type = bigEndian ? readBE16(entry + 2) : readLE16(entry + 2);
+		
+		// SHORT values are left aligned in the value field, the first of several bits per sample is enough
+		uint value = type == 3 ? (bigEndian ? readBE16(entry + 8) : readLE16(entry + 8))
+			: (bigEndian ? readBE32(entry + 8) : readLE32(entry + 8));
+		
+		const uint valueCount = bigEndian ? readBE32(entry + 4) : readLE32(entry + 4);
+		
+		// values longer than the field are stored elsewhere, the field is then a 32-bit offset
+		if (tag == 258 && (unsigned long long)valueCount * (type == 3 ? 2 : 4) > 4) {
+			const size_t next = stream.getPosition();
+			byte bits[4];
+			
+			stream.setPosition(start + (bigEndian ? readBE32(entry + 8) : readLE32(entry + 8)));
+			if (stream.read(bits, 4) != 4) return false;
+			value = type == 3 ? (bigEndian ? readBE16(bits) : readLE16(bits))
+				: (bigEndian ? readBE32(bits) : readLE32(bits));
+			stream.setPosition(next);
+		}
+		
+		switch (tag) {
+			case 256: info.width = value; break;
+			case 257: info.height = value; break;
+			case 258: info.bitDepth = value; break;
+			case 277: info.channels = value; break;
+		}
+	}
+	
+	return info.width > 0 && info.height > 0;
+}
+
+// Parse the unsigned integer fields following the magic of a PNM header,
+// comments are only supported within the probed header bytes.
+static bool probePNMFields(const byte* header, const int length, uint* fields, const int count) {
+	int p = 2;
+	
+	for (int i = 0; i < count; i++) {
+		while (p < length && (isspace(header[p]) || header[p] == '#')) {
+			if (header[p] == '#') {
+				while (p < length && header[p] != '\n') p++;
+			} else {
+				p++;
+			}
+		}
+		
+		fields[i] = 0;
+		
+		const int begin = p;
+		while (p < length && isdigit(header[p])) {
+			fields[i] = fields[i] * 10 + (header[p++] - '0');
+		}
+		
+		if (p == begin || p >= length) return false;
+	}
+	
+	return true;
+}
+
+// format is the hint for formats without a signature
+static bool probeImage(ImageInfo& info, Stream& stream, const ImageCodecFormat format) {
+	const size_t start = stream.getPosition();
+	
+	byte header[IMAGE_HEADER_SIZE];
+	const int length = stream.read(header, IMAGE_HEADER_SIZE);
+	
+	info = ImageInfo();
+	info.format = length > 0 ? detectImageFormat(header, length) : ImageCodecFormat::ICF_AUTO;
+	
+	if (info.format == ImageCodecFormat::ICF_AUTO && format == ImageCodecFormat::ICF_TGA) {
+		info.format = format;
+	}
+	
+	bool success = false;
+	
+	switch (info.format) {
+		default:
+			break;
+			
+		case ImageCodecFormat::ICF_JPEG:
+			success = probeJPEG(info, stream, start);
+			break;
+			
+		case ImageCodecFormat::ICF_PNG:
+			if (length >= 26 && memcmp(header + 12, "IHDR", 4) == 0) {
+				static const byte channels[7] = { 1, 0, 3, 3, 2, 0, 4 };
+				
+				info.width = readBE32(header + 16);
+				info.height = readBE32(header + 20);
+				info.bitDepth = header[24];
+				info.channels = header[25] < 7 ? channels[header[25]] : 0;
+				success = info.channels > 0;
+			}
+			break;
+			
+		case ImageCodecFormat::ICF_BMP:
+			if (length >= 30) {
+				if (readLE32(header + 14) == 12) {
+					info.width = readLE16(header + 18);
+					info.height = readLE16(header + 20);
+					info.bitDepth = readLE16(header + 24);
+				} else {
+					// negative height means top-down rows
+					info.width = readLE32(header + 18);
+					info.height = (uint)std::abs((int)readLE32(header + 22));
+					info.bitDepth = readLE16(header + 28);
+				}
+				
+				info.channels = info.bitDepth == 32 ? 4 : 3;
+				info.bitDepth = info.bitDepth == 16 ? 5 : 8;
+				success = true;
+			}
+			break;
+			
+		case ImageCodecFormat::ICF_GIF:
+			if (length >= 10) {
+				info.width = readLE16(header + 6);
+				info.height = readLE16(header + 8);
+				info.channels = 3;
+				info.bitDepth = 8;
+				success = true;
+			}
+			break;
+			
+		case ImageCodecFormat::ICF_TIFF:
+			success = length >= 8 && probeTIFF(info, stream, start, header);
+			break;
+			
+		case ImageCodecFormat::ICF_TGA:
+			if (length >= 18 && (header[16] == 8 || header[16] == 24 || header[16] == 32)) {
+				info.width = readLE16(header + 12);
+				info.height = readLE16(header + 14);
+				info.channels = header[16] / 8;
+				info.bitDepth = 8;
+				success = true;
+			}
+			break;
+			
+		case ImageCodecFormat::ICF_PPM:
+		{
+			uint fields[3];
+			if (probePNMFields(header, length, fields, 3)) {
+				info.width = fields[0];
+				info.height = fields[1];
+				info.channels = header[1] == '6' ? 3 : 1;
+				info.bitDepth = fields[2] > 255 ? 16 : 8;
+				success = true;
+			}
+		}
+			break;
+			
+		case ImageCodecFormat::ICF_PFM:
+		{
+			uint fields[2];
+			if (probePNMFields(header, length, fields, 2)) {
+				info.width = fields[0];
+				info.height = fields[1];
+				info.channels = header[1] == 'F' ? 3 : 1;
+				info.bitDepth = 32;
+				success = true;
+			}
+		}
+			break;
+			
+		case ImageCodecFormat::ICF_HDR:
+			stream.setPosition(start);
+			if (readHDRHeader(stream, &info.width, &info.height)) {
+				info.channels = 3;
+				info.bitDepth = 32;
+				success = true;
+			}
+			break;
+			
+		case ImageCodecFormat::ICF_EXR:
+			stream.setPosition(start);
+			success = readEXRHeader(stream, &info.width, &info.height, &info.channels, &info.bitDepth);
+			break;
+			
+		case ImageCodecFormat::ICF_QOI:
+			if (length >= QOI_HEADER_SIZE) {
+				info.width = readBE32(header + 4);
+				info.height = readBE32(header + 8);
+				info.channels = header[12];
+				info.bitDepth = 8;
+				success = info.channels == 3 || info.channels == 4;
+			}
+			break;
+			
+		case ImageCodecFormat::ICF_DDS:
+			if (length >= 20) {
+				info.height = readLE32(header + 12);
+				info.width = readLE32(header + 16);
+				info.channels = 4;
+				info.bitDepth = 8;
+				success = true;
+			}
+			break;
+	}
+	
+	stream.setPosition(start);
+	
+	return success;
+}
+
+bool probeImage(ImageInfo& info, Stream& stream) {
+	return probeImage(info, stream, ImageCodecFormat::ICF_AUTO);
+}
+
+bool probeImage(ImageInfo& info, const string& path) {
+	ImageCodecFormat format = ImageCodecFormat::ICF_AUTO;
+	getImageFormatByExtension(path, &format);
+	
+	FileStream fs(path);
+	fs.openRead();
+	
+	const bool success = probeImage(info, fs, format);
+	
+	fs.close();
+	
+	return success;
+}
+
+bool probeImage(ImageInfo& info, Archive& archive, const uint uid, ImageCodecFormat format) {
+	bool success = false;
+	
+	ChunkEntry* entry = openImageChunk(archive, uid, format);
+	if (entry != NULL) {
+		success = entry->stream->getLength() > 0 && probeImage(info, *entry->stream, format);
+		archive.closeChunk(entry);
+	}
+	
+	return success;
+}
+
 }
@@ -10,17 +10,29 @@
 #define imgcodec_h
 
 #include <stdio.h>
+#include <vector>
 
 #include "ucm/string.h"
 #include "ucm/file.h"
 #include "ucm/archive.h"
 #include "image.h"
+#include "parallel.h"
+#include "imgrawcodec.h"
+#include "imghdrcodec.h"
+#include "imgbccodec.h"
 
 #define FORMAT_TAG_JPEG 0x6765706a
 #define FORMAT_TAG_PNG  0x20676e70
 #define FORMAT_TAG_BMP  0x20706d62
 #define FORMAT_TAG_GIF  0x20666967
 #define FORMAT_TAG_TIFF 0x66666974
+#define FORMAT_TAG_TGA  0x20616774
+#define FORMAT_TAG_PPM  0x206d7070
+#define FORMAT_TAG_PFM  0x206d6670
+#define FORMAT_TAG_HDR  0x20726468
+#define FORMAT_TAG_EXR  0x20727865
+#define FORMAT_TAG_QOI  0x20696f71
+#define FORMAT_TAG_DDS  0x20736464
 
 namespace ugm {
 
@@ -33,28 +45,286 @@ enum ImageCodecFormat {
 	ICF_GIF,
 	ICF_BMP,
 	ICF_TIFF,
+	ICF_TGA,
+	ICF_PPM,
+	ICF_PFM,
+	ICF_HDR,
+	ICF_EXR,
+	ICF_QOI,
+	ICF_DDS,
+};
+
+enum PNGFilterMode {
+	PFM_NONE,
+	PFM_SUB,
+	PFM_UP,
+	PFM_PAETH,
+	PFM_ADAPTIVE,
+};
+
+// values match the zlib strategies
+enum PNGCompressStrategy {
+	PCS_DEFAULT = 0,
+	PCS_FILTERED = 1,
+	PCS_HUFFMAN_ONLY = 2,
+	PCS_RLE = 3,
+};
+
+struct PNGEncodeOptions {
+	int compressionLevel;		// zlib level 0 ~ 9
+	PNGFilterMode filter;
+	PNGCompressStrategy strategy;
+	uint bufferSize;				// zlib output buffer in bytes
+	
+	explicit PNGEncodeOptions(const int compressionLevel = 6,
+														const PNGFilterMode filter = PFM_ADAPTIVE,
+														const PNGCompressStrategy strategy = PCS_DEFAULT,
+														const uint bufferSize = 8192)
+	: compressionLevel(compressionLevel), filter(filter), strategy(strategy), bufferSize(bufferSize) { }
+	
+	// intermediate frames, several times faster than the defaults
+	static PNGEncodeOptions fastest() { return PNGEncodeOptions(1, PFM_SUB, PCS_DEFAULT, 65536); }
+	// final assets
+	static PNGEncodeOptions smallest() { return PNGEncodeOptions(9, PFM_ADAPTIVE, PCS_DEFAULT, 65536); }
+};
+
+enum JPEGDCTMethod {
+	JDM_ISLOW,
+	JDM_IFAST,
+	JDM_FLOAT,
+};
+
+struct JPEGDecodeOptions {
+	uint scaleDenom;				// decode at 1/1, 1/2, 1/4 or 1/8 size in the DCT domain
+	JPEGDCTMethod dctMethod;
+	bool fancyUpsampling;
+	uint minWidth, minHeight;	// when not zero, overrides scaleDenom with the smallest size covering them
+	
+	explicit JPEGDecodeOptions(const uint scaleDenom = 1,
+														 const JPEGDCTMethod dctMethod = JDM_ISLOW,
+														 const bool fancyUpsampling = true)
+	: scaleDenom(scaleDenom), dctMethod(dctMethod), fancyUpsampling(fancyUpsampling),
+		minWidth(0), minHeight(0) { }
+	
+	// decode to at least width x height, for thumbnails
+	static JPEGDecodeOptions atLeast(const uint width, const uint height) {
+		JPEGDecodeOptions options(1, JDM_IFAST);
+		options.minWidth = width;
+		options.minHeight = height;
+		return options;
+	}
 };
 
 bool readPNG(Image& image, Stream& stream);
-void readJPEG(Image& image, Stream& stream);
-void readJPEG(Image& image, FILE* file);
+void readJPEG(Image& image, Stream& stream, const JPEGDecodeOptions& options = JPEGDecodeOptions());
+void readJPEG(Image& image, FILE* file, const JPEGDecodeOptions& options = JPEGDecodeOptions());
 
-bool writePNG(const Image& image, Stream& stream);
+bool writePNG(const Image& image, Stream& stream, const PNGEncodeOptions& options = PNGEncodeOptions());
+// Filter and deflate horizontal strips concurrently on pool (ThreadPool::shared() when NULL)
+// and stitch them into one standard zlib stream, for large 8-bit images.
+void writePNGParallel(const Image& image, Stream& stream,
+											const PNGEncodeOptions& options = PNGEncodeOptions(), ThreadPool* pool = NULL);
 void writeJPEG(const Image& image, Stream& stream);
 void writeJPEG(const Image& image, FILE* file);
+// Encode strips of MCU rows concurrently on pool (ThreadPool::shared() when NULL) and
+// chain them with restart markers into one baseline JPEG, RGB 8-bit images only.
+void writeJPEGParallel(const Image& image, Stream& stream, const int quality = 90, ThreadPool* pool = NULL);
+
+// QOI lossless 8-bit RGB/RGBA, fast single pass encoding and decoding
+void readQOI(Image& image, Stream& stream);
+void writeQOI(const Image& image, Stream& stream);
+// Encode strips concurrently on pool (ThreadPool::shared() when NULL) into one standard
+// QOI stream, slightly larger since every strip starts without the previous colors.
+void writeQOIParallel(const Image& image, Stream& stream, ThreadPool* pool = NULL);
 
 bool getImageFormatByExtension(const string& path, ImageCodecFormat* format);
+// Detect the format from the magic bytes, ICF_AUTO when unknown.
+// The stream overload peeks at the current position and restores it.
+ImageCodecFormat detectImageFormat(const byte* header, const uint length);
+ImageCodecFormat detectImageFormat(Stream& stream);
 
-void loadImage(Image& image, const string& path, ImageCodecFormat format = ICF_AUTO);
-void loadImage(Image& image, Stream& stream, ImageCodecFormat format);
+// options only apply to JPEG images, ICF_AUTO detects the format from the content.
+// Unrecognized content and formats without a decoder, e.g. GIF, are decoded as JPEG.
+void loadImage(Image& image, const string& path, ImageCodecFormat format = ICF_AUTO,
+							 const JPEGDecodeOptions& options = JPEGDecodeOptions());
+void loadImage(Image& image, Stream& stream, ImageCodecFormat format,
+							 const JPEGDecodeOptions& options = JPEGDecodeOptions());
+// Same as loadImage(path), decoding from a read-only mapping of the whole file so large
+// files are taken as one span. Falls back to reading when the file cannot be mapped.
+// The file must not be truncated while it is decoded, the access would fault (SIGBUS).
+void loadMappedImage(Image& image, const string& path, ImageCodecFormat format = ICF_AUTO,
+										 const JPEGDecodeOptions& options = JPEGDecodeOptions());
 bool loadImage(Image& image, Archive& archive, const uint uid, ImageCodecFormat format = ICF_AUTO);
+// Open the chunk of an image for reading, NULL when not found. Close it with archive.closeChunk.
+ChunkEntry* openImageChunk(Archive& archive, const uint uid, const ImageCodecFormat format = ICF_AUTO);
+
+// Decode images[i] from paths[i] or streams[i] concurrently on pool, ThreadPool::shared()
+// when pool is NULL, and the calling thread. Every image is attempted, the first error is
+// rethrown afterwards. Safe to call from a task of the same pool.
+void loadImages(const std::vector<string>& paths, const std::vector<Image*>& images,
+								ImageCodecFormat format = ICF_AUTO, ThreadPool* pool = NULL);
+void loadImages(const std::vector<Stream*>& streams, const std::vector<Image*>& images,
+								ImageCodecFormat format, ThreadPool* pool = NULL);
+
+// Image properties as stored in the file
+struct ImageInfo {
+	ImageCodecFormat format = ICF_AUTO;
+	uint width = 0, height = 0;
+	uint channels = 0;
+	uint bitDepth = 0;		// bits per channel
+};
+
+// Read only the header of an image, without decoding or allocating pixels.
+// The stream overload reads from the current position and restores it.
+bool probeImage(ImageInfo& info, const string& path);
+bool probeImage(ImageInfo& info, Stream& stream);
+bool probeImage(ImageInfo& info, Archive& archive, const uint uid, ImageCodecFormat format = ICF_AUTO);
 
+// TGA is written run-length encoded, call writeTGA for raw pixels
 void saveImage(const Image& image, const string& path, ImageCodecFormat format = ICF_AUTO);
 void saveImage(const Image& image, Stream& stream, ImageCodecFormat format);
+void saveImage(const Image& image, const string& path, const PNGEncodeOptions& options);
+void saveImage(const Image& image, const string& path, const EXREncodeOptions& options);
 uint saveImage(const Image& image, Archive& archive, ImageCodecFormat format);
 uint saveImage(const Image& image, Archive& archive, uint formatTag, ImageCodecFormat format);
+// Rough encoded size, to reserve a MemoryOutputStream before the first frame. It is not
+// a bound, the stream still grows for images that compress worse.
+size_t estimateEncodedSize(const Image& image, ImageCodecFormat format);
+
+// Row streaming decoders, memory stays proportional to the band being read.
+// Rows are always 8-bit RGB or RGBA, see getPixelDataFormat.
+class ImageScanlineReader {
+protected:
+	uint imageWidth = 0, imageHeight = 0;
+	PixelDataFormat format = PixelDataFormat::PDF_RGB;
+	uint currentRow = 0;
+	
+public:
+	virtual ~ImageScanlineReader() { }
+	
+	inline uint width() const { return this->imageWidth; }
+	inline uint height() const { return this->imageHeight; }
+	inline PixelDataFormat getPixelDataFormat() const { return this->format; }
+	inline uint getRowByteLength() const { return this->imageWidth * (this->format == PixelDataFormat::PDF_RGBA ? 4 : 3); }
+	inline uint getCurrentRow() const { return this->currentRow; }
+	inline bool isFinished() const { return this->currentRow >= this->imageHeight; }
+	
+	// Decode up to count rows into buffer, rows are stride bytes apart (0 for packed rows).
+	// Returns the number of rows decoded, 0 once every row is read.
+	virtual uint readRows(byte* buffer, const uint count, size_t stride = 0) = 0;
+	
+	// Decode the next band of up to rows rows, band is resized to the rows read.
+	uint readBand(Image& band, const uint rows);
+};
+
+struct JPEGReadState;
+struct PNGReadState;
+struct QOIReadState;
+
+class JPEGScanlineReader : public ImageScanlineReader {
+private:
+	JPEGReadState* state;
+	
+public:
+	JPEGScanlineReader(Stream& stream, const JPEGDecodeOptions& options = JPEGDecodeOptions());
+	~JPEGScanlineReader();
+	
+	uint readRows(byte* buffer, const uint count, size_t stride = 0);
+};
+
+// Interlaced PNGs can not be read row by row, they are decoded entirely on open.
+class PNGScanlineReader : public ImageScanlineReader {
+private:
+	PNGReadState* state;
+	
+public:
+	PNGScanlineReader(Stream& stream);
+	~PNGScanlineReader();
+	
+	uint readRows(byte* buffer, const uint count, size_t stride = 0);
+};
+
+class QOIScanlineReader : public ImageScanlineReader {
+private:
+	QOIReadState* state;
+	
+public:
+	QOIScanlineReader(Stream& stream);
+	~QOIScanlineReader();
+	
+	uint readRows(byte* buffer, const uint count, size_t stride = 0);
+};
+
+// Row streaming encoders, rows are pushed from top to bottom and the
+// image is complete after finish. An unfinished image is abandoned.
+class ImageScanlineWriter {
+protected:
+	uint imageWidth = 0, imageHeight = 0;
+	PixelDataFormat format = PixelDataFormat::PDF_RGB;
+	uint currentRow = 0;
+	
+public:
+	virtual ~ImageScanlineWriter() { }
+	
+	inline uint width() const { return this->imageWidth; }
+	inline uint height() const { return this->imageHeight; }
+	inline PixelDataFormat getPixelDataFormat() const { return this->format; }
+	inline uint getCurrentRow() const { return this->currentRow; }
+	
+	// Encode count rows from buffer, rows are stride bytes apart (0 for packed rows).
+	virtual void writeRows(const byte* buffer, const uint count, size_t stride = 0) = 0;
+	virtual void finish() = 0;
+	
+	// Encode every row of band, its width and format must match the writer.
+	void writeBand(const Image& band);
+};
+
+struct JPEGWriteState;
+struct PNGWriteState;
+struct QOIWriteState;
+
+// RGB rows only
+class JPEGScanlineWriter : public ImageScanlineWriter {
+private:
+	JPEGWriteState* state;
+	
+public:
+	JPEGScanlineWriter(Stream& stream, const uint width, const uint height, const int quality = 90);
+	~JPEGScanlineWriter();
+	
+	void writeRows(const byte* buffer, const uint count, size_t stride = 0);
+	void finish();
+};
+
+class PNGScanlineWriter : public ImageScanlineWriter {
+private:
+	PNGWriteState* state;
+	
+public:
+	PNGScanlineWriter(Stream& stream, const uint width, const uint height,
+										const PixelDataFormat format = PixelDataFormat::PDF_RGBA,
+										const PNGEncodeOptions& options = PNGEncodeOptions());
+	~PNGScanlineWriter();
+	
+	void writeRows(const byte* buffer, const uint count, size_t stride = 0);
+	void finish();
+};
+
+class QOIScanlineWriter : public ImageScanlineWriter {
+private:
+	QOIWriteState* state;
+	
+public:
+	QOIScanlineWriter(Stream& stream, const uint width, const uint height,
+										const PixelDataFormat format = PixelDataFormat::PDF_RGBA);
+	~QOIScanlineWriter();
+	
+	void writeRows(const byte* buffer, const uint count, size_t stride = 0);
+	void finish();
+};
 
 class NotSupportImageCodecException : public Exception { };
+class ImageCodecException : public Exception { };
 
 }
 
@@ -0,0 +1,296 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef imgexpr_h
+#define imgexpr_h
+
+#include <math.h>
+
+#include "image.h"
+#include "parallel.h"
+
+// Lazy pointwise image expressions, for example:
+//
+//   img::evaluate(dest, img::gamma(exposure * (img::expr(a) + 0.3f * img::expr(b)), 2.2f));
+//
+// Nothing is computed until evaluate(), which runs the whole chain in a single
+// parallel pass over the destination, a chunk of pixels at a time.
+// Float operands apply to rgb only and keep alpha, operators between two expressions
+// and lerp combine alpha too. RGB images read as alpha 1.
+
+#define IMAGE_EXPR_CHUNK_SIZE 64
+
+namespace ugm {
+namespace img {
+
+template<typename E>
+struct ImageExpr {
+	inline const E& self() const { return *static_cast<const E*>(this); }
+};
+
+template<typename T, int C>
+inline void readPixelRun(const Image& image, const size_t offset, const int count, color4f* out) {
+	const T* p = (const T*)image.getBuffer() + offset * C;
+	
+	for (int i = 0; i < count; i++, p += C) {
+		out[i] = PixelAccessor<T, C>::read(p);
+	}
+}
+
+struct ImageTerm : public ImageExpr<ImageTerm> {
+	const Image& image;
+	
+	ImageTerm(const Image& image) : image(image) { }
+	
+	inline sizei size() const { return this->image.getSize(); }
+	
+	inline void evalRow(const int x, const int y, const int count, color4f* out) const {
+		const size_t offset = (size_t)y * this->image.width() + x;
+		DISPATCH_IMAGE_PIXEL_TYPE(this->image, readPixelRun, this->image, offset, count, out);
+	}
+};
+
+struct ScalarTerm : public ImageExpr<ScalarTerm> {
+	color4f value;
+	
+	ScalarTerm(const color4f& value) : value(value) { }
+	
+	inline sizei size() const { return sizei(0, 0); }
+	
+	inline void evalRow(const int x, const int y, const int count, color4f* out) const {
+		std::fill(out, out + count, this->value);
+	}
+};
+
+inline sizei mergeExprSize(const sizei& a, const sizei& b) {
+	if (a.width == 0 && a.height == 0) return b;
+	if ((b.width != 0 || b.height != 0) && !(a == b)) {
+		throw ArgumentOutOfRangeException();
+	}
+	return a;
+}
+
+struct AddOp { static inline float apply(const float a, const float b) { return a + b; } };
+struct SubOp { static inline float apply(const float a, const float b) { return a - b; } };
+struct MulOp { static inline float apply(const float a, const float b) { return a * b; } };
+struct DivOp { static inline float apply(const float a, const float b) { return a / b; } };
+struct MaxOp { static inline float apply(const float a, const float b) { return a > b ? a : b; } };
+struct MinOp { static inline float apply(const float a, const float b) { return a < b ? a : b; } };
+
+template<typename A, typename B, typename Op>
+struct BinaryExpr : public ImageExpr<BinaryExpr<A, B, Op> > {
+	A a;
+	B b;
+	
+	BinaryExpr(const A& a, const B& b) : a(a), b(b) { }
+	
+	inline sizei size() const { return mergeExprSize(this->a.size(), this->b.size()); }
+	
+	inline void evalRow(const int x, const int y, const int count, color4f* out) const {
+		color4f tmp[IMAGE_EXPR_CHUNK_SIZE];
+		
+		this->a.evalRow(x, y, count, out);
+		this->b.evalRow(x, y, count, tmp);
+		
+		float* o = (float*)out;
+		const float* t = (const float*)tmp;
+		
+		for (int i = 0; i < count * 4; i++) {
+			o[i] = Op::apply(o[i], t[i]);
+		}
+	}
+};
+
+// a op s or s op a on rgb, the alpha of a is kept
+template<typename A, typename Op, bool ScalarFirst>
+struct ScalarExpr : public ImageExpr<ScalarExpr<A, Op, ScalarFirst> > {
+	A a;
+	float s;
+	
+	ScalarExpr(const A& a, const float s) : a(a), s(s) { }
+	
+	inline sizei size() const { return this->a.size(); }
+	
+	inline void evalRow(const int x, const int y, const int count, color4f* out) const {
+		this->a.evalRow(x, y, count, out);
+		
+		for (int i = 0; i < count; i++) {
+			for (int k = 0; k < 3; k++) {
+				out[i].arr[k] = ScalarFirst ? Op::apply(this->s, out[i].arr[k]) : Op::apply(out[i].arr[k], this->s);
+			}
+		}
+	}
+};
+
+template<typename A, typename Func>
+struct UnaryExpr : public ImageExpr<UnaryExpr<A, Func> > {
+	A a;
+	Func func;
+	
+	UnaryExpr(const A& a, const Func& func) : a(a), func(func) { }
+	
+	inline sizei size() const { return this->a.size(); }
+	
+	inline void evalRow(const int x, const int y, const int count, color4f* out) const {
+		this->a.evalRow(x, y, count, out);
+		
+		for (int i = 0; i < count; i++) {
+			out[i] = this->func(out[i]);
+		}
+	}
+};
+
+// a * (1 - t) + b * t on all components, t is a constant or the alpha of a mask expression
+template<typename A, typename B, typename M>
+struct LerpExpr : public ImageExpr<LerpExpr<A, B, M> > {
+	A a;
+	B b;
+	M mask;
+	
+	LerpExpr(const A& a, const B& b, const M& mask) : a(a), b(b), mask(mask) { }
+	
+	inline sizei size() const { return mergeExprSize(mergeExprSize(this->a.size(), this->b.size()), this->mask.size()); }
+	
+	inline void evalRow(const int x, const int y, const int count, color4f* out) const {
+		color4f tb[IMAGE_EXPR_CHUNK_SIZE], tm[IMAGE_EXPR_CHUNK_SIZE];
+		
+		this->a.evalRow(x, y, count, out);
+		this->b.evalRow(x, y, count, tb);
+		this->mask.evalRow(x, y, count, tm);
+		
+		for (int i = 0; i < count; i++) {
+			const float t = tm[i].a;
+			for (int k = 0; k < 4; k++) {
+				out[i].arr[k] += (tb[i].arr[k] - out[i].arr[k]) * t;
+			}
+		}
+	}
+};
+
+struct GammaFunc {
+	float power;
+	inline color4f operator()(const color4f& c) const { return ugm::pow(c, this->power); }
+};
+
+struct SaturateFunc {
+	inline color4f operator()(const color4f& c) const { return ugm::clamp(c, 0.0f, 1.0f); }
+};
+
+inline ImageTerm expr(const Image& image) {
+	return ImageTerm(image);
+}
+
+// Two expressions combine all components, alpha included. A float operand applies to rgb
+// only, on either side, and the alpha of the expression is kept.
+#define IMAGE_EXPR_BINARY_OPERATOR(op, Op) \
+	template<typename A, typename B> \
+	inline BinaryExpr<A, B, Op> operator op(const ImageExpr<A>& a, const ImageExpr<B>& b) { \
+		return BinaryExpr<A, B, Op>(a.self(), b.self()); \
+	} \
+	template<typename A> \
+	inline ScalarExpr<A, Op, false> operator op(const ImageExpr<A>& a, const float s) { \
+		return ScalarExpr<A, Op, false>(a.self(), s); \
+	} \
+	template<typename B> \
+	inline ScalarExpr<B, Op, true> operator op(const float s, const ImageExpr<B>& b) { \
+		return ScalarExpr<B, Op, true>(b.self(), s); \
+	}
+
+IMAGE_EXPR_BINARY_OPERATOR(+, AddOp)
+IMAGE_EXPR_BINARY_OPERATOR(-, SubOp)
+IMAGE_EXPR_BINARY_OPERATOR(*, MulOp)
+IMAGE_EXPR_BINARY_OPERATOR(/, DivOp)
+
+#undef IMAGE_EXPR_BINARY_OPERATOR
+
+// componentwise maximum and minimum, alpha included
+template<typename A, typename B>
+inline BinaryExpr<A, B, MaxOp> lighter(const ImageExpr<A>& a, const ImageExpr<B>& b) {
+	return BinaryExpr<A, B, MaxOp>(a.self(), b.self());
+}
+
+template<typename A, typename B>
+inline BinaryExpr<A, B, MinOp> darker(const ImageExpr<A>& a, const ImageExpr<B>& b) {
+	return BinaryExpr<A, B, MinOp>(a.self(), b.self());
+}
+
+template<typename A, typename B>
+inline LerpExpr<A, B, ScalarTerm> lerp(const ImageExpr<A>& a, const ImageExpr<B>& b, const float t) {
+	return LerpExpr<A, B, ScalarTerm>(a.self(), b.self(), ScalarTerm(color4f(t, t)));
+}
+
+template<typename A, typename B, typename M>
+inline LerpExpr<A, B, M> lerp(const ImageExpr<A>& a, const ImageExpr<B>& b, const ImageExpr<M>& mask) {
+	return LerpExpr<A, B, M>(a.self(), b.self(), mask.self());
+}
+
+// rgb raised to 1 / gamma, alpha is kept
+template<typename A>
+inline UnaryExpr<A, GammaFunc> gamma(const ImageExpr<A>& a, const float gamma) {
+	const GammaFunc func = { 1.0f / gamma };
+	return UnaryExpr<A, GammaFunc>(a.self(), func);
+}
+
+// clamp all components to [0, 1]
+template<typename A>
+inline UnaryExpr<A, SaturateFunc> saturate(const ImageExpr<A>& a) {
+	return UnaryExpr<A, SaturateFunc>(a.self(), SaturateFunc());
+}
+
+// func is called as color4f func(const color4f&) for every pixel
+template<typename A, typename Func>
+inline UnaryExpr<A, Func> map(const ImageExpr<A>& a, const Func& func) {
+	return UnaryExpr<A, Func>(a.self(), func);
+}
+
+template<typename T, int C, typename E>
+inline void evaluateInto(Image& dest, const E& e) {
+	const int width = dest.width();
+	
+	parallelFor(0, dest.height(), [&](const int y0, const int y1) {
+		color4f chunk[IMAGE_EXPR_CHUNK_SIZE];
+		
+		for (int y = y0; y < y1; y++) {
+			T* row = (T*)dest.getBuffer() + (size_t)y * width * C;
+			
+			for (int x = 0; x < width; x += IMAGE_EXPR_CHUNK_SIZE) {
+				const int count = std::min(IMAGE_EXPR_CHUNK_SIZE, width - x);
+				
+				e.evalRow(x, y, count, chunk);
+				
+				T* p = row + x * C;
+				for (int i = 0; i < count; i++, p += C) {
+					PixelAccessor<T, C>::write(p, chunk[i]);
+				}
+			}
+		}
+	}, 4);
+}
+
+// Evaluate expression into dest in one pass, dest may also be used in the expression.
+// An empty dest is created with the size of the images in the expression.
+template<typename E>
+void evaluate(Image& dest, const ImageExpr<E>& expr) {
+	const E& e = expr.self();
+	const sizei size = e.size();
+	
+	if (dest.getBuffer() == NULL || dest.width() == 0 || dest.height() == 0) {
+		dest.createEmpty(size.width, size.height);
+	} else if ((size.width != 0 || size.height != 0) && !(size == dest.getSize())) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	if (dest.getBuffer() == NULL) return;
+	
+	DISPATCH_IMAGE_PIXEL_TYPE(dest, evaluateInto, dest, e);
+}
+
+}
+}
+
+#endif /* imgexpr_h */
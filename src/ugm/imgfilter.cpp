@@ -9,6 +9,14 @@
 #include "imgfilter.h"
 #include "functions.h"
 
+#include <vector>
+#include <limits>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
 #define BLUR_GAUSS_KERNEL_SIZE 5
 
 namespace ugm {
@@ -118,40 +126,172 @@ namespace img {
 	}
 
 	
-	void flipImageHorizontally(Image& image) {
-		Image tmpImage(image.getPixelDataFormat(), image.getBitDepth());
-		tmpImage.createEmpty(image.width(), image.height());
+	template<int N>
+	struct PixelBytes {
+		byte v[N];
+	};
+	
+	#define DISPATCH_PIXEL_BYTES(pixelBytes, func, ...) \
+		switch (pixelBytes) { \
+			case 3: func<PixelBytes<3> >(__VA_ARGS__); break; \
+			case 4: func<PixelBytes<4> >(__VA_ARGS__); break; \
+			case 6: func<PixelBytes<6> >(__VA_ARGS__); break; \
+			case 8: func<PixelBytes<8> >(__VA_ARGS__); break; \
+			case 12: func<PixelBytes<12> >(__VA_ARGS__); break; \
+			case 16: func<PixelBytes<16> >(__VA_ARGS__); break; \
+			default: throw NotSupportPixelColorTypeException(); \
+		}
+	
+	template<typename P>
+	static void reversePixels(byte* p, const size_t count) {
+		std::reverse((P*)p, (P*)p + count);
+	}
+	
+#if defined(__SSE2__) || defined(_M_X64)
+	template<>
+	void reversePixels<PixelBytes<4> >(byte* p, const size_t count) {
+		uint32_t* l = (uint32_t*)p;
+		uint32_t* r = l + count;
 		
-		const int width = image.width();
-		const int height = image.height();
+		// swap four pixels from each end per step
+		while (r - l >= 8) {
+			r -= 4;
+			const __m128i a = _mm_loadu_si128((const __m128i*)l);
+			const __m128i b = _mm_loadu_si128((const __m128i*)r);
+			_mm_storeu_si128((__m128i*)l, _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3)));
+			_mm_storeu_si128((__m128i*)r, _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 1, 2, 3)));
+			l += 4;
+		}
 		
-		for (int y = 0; y < height; y++) {
-			for (int x = 0; x < width; x++) {
-				const color4f& c = image.getPixel(x, y);
-				tmpImage.setPixel(width - x - 1, y, c);
+		std::reverse(l, r);
+	}
+#endif /* __SSE2__ */
+	
+	template<typename P>
+	static void flipRowsHorizontally(byte* buffer, const uint width, const uint height, const size_t rowBytes) {
+		for (uint y = 0; y < height; y++) {
+			reversePixels<P>(buffer + y * rowBytes, width);
+		}
+	}
+	
+	#define TRANSPOSE_TILE_SIZE 32
+	
+	// dest is height pixels wide and width pixels tall
+	template<typename P>
+	static void transposeTiles(const byte* src, byte* dest, const int width, const int height) {
+		const P* s = (const P*)src;
+		P* d = (P*)dest;
+		
+		for (int by = 0; by < height; by += TRANSPOSE_TILE_SIZE) {
+			const int ey = std::min(by + TRANSPOSE_TILE_SIZE, height);
+			
+			for (int bx = 0; bx < width; bx += TRANSPOSE_TILE_SIZE) {
+				const int ex = std::min(bx + TRANSPOSE_TILE_SIZE, width);
+				
+				for (int y = by; y < ey; y++) {
+					for (int x = bx; x < ex; x++) {
+						d[(size_t)x * height + y] = s[(size_t)y * width + x];
+					}
+				}
+			}
+		}
+	}
+	
+	template<typename P>
+	static void transposeSquareInPlace(byte* buffer, const int size) {
+		P* p = (P*)buffer;
+		
+		for (int by = 0; by < size; by += TRANSPOSE_TILE_SIZE) {
+			const int ey = std::min(by + TRANSPOSE_TILE_SIZE, size);
+			
+			for (int bx = by; bx < size; bx += TRANSPOSE_TILE_SIZE) {
+				const int ex = std::min(bx + TRANSPOSE_TILE_SIZE, size);
+				
+				for (int y = by; y < ey; y++) {
+					// diagonal tiles swap only their upper triangle
+					for (int x = (bx == by ? y + 1 : bx); x < ex; x++) {
+						std::swap(p[(size_t)y * size + x], p[(size_t)x * size + y]);
+					}
+				}
 			}
 		}
+	}
+	
+	void flipImageHorizontally(Image& image) {
+		if (image.getBuffer() == NULL) return;
 		
-		image.copyBuffer(tmpImage.getBuffer());
+		DISPATCH_PIXEL_BYTES(image.getPixelByteLength(), flipRowsHorizontally,
+												 image.getBuffer(), image.width(), image.height(), image.getPixelRowByteLength());
 	}
 	
 	void flipImageVertically(Image& image) {
-		Image tmpImage(image.getPixelDataFormat(), image.getBitDepth());
-		tmpImage.createEmpty(image.width(), image.height());
+		if (image.getBuffer() == NULL) return;
 		
-		const int width = image.width();
-		const int height = image.height();
+		const size_t rowBytes = image.getPixelRowByteLength();
+		byte* top = image.getBuffer();
+		byte* bottom = top + (image.height() - 1) * rowBytes;
 		
-		for (int y = 0; y < height; y++) {
-			for (int x = 0; x < width; x++) {
-				const color4f& c = image.getPixel(x, y);
-				tmpImage.setPixel(x, height - y - 1, c);
-			}
+		for (; top < bottom; top += rowBytes, bottom -= rowBytes) {
+			std::swap_ranges(top, top + rowBytes, bottom);
 		}
+	}
+	
+	void transposeImage(const Image& src, Image& dest) {
+		dest.setPixelDataFormat(src.getPixelDataFormat(), src.getBitDepth());
+		dest.createEmpty(src.height(), src.width());
+		
+		if (src.getBuffer() == NULL) return;
 		
-		image.copyBuffer(tmpImage.getBuffer());
+		DISPATCH_PIXEL_BYTES(src.getPixelByteLength(), transposeTiles,
+												 src.getBuffer(), dest.getBuffer(), src.width(), src.height());
 	}
-
+	
+	void transposeImage(Image& image) {
+		if (image.getBuffer() == NULL) return;
+		
+		if (image.width() == image.height()) {
+			DISPATCH_PIXEL_BYTES(image.getPixelByteLength(), transposeSquareInPlace,
+													 image.getBuffer(), image.width());
+			return;
+		}
+		
+		// non-square images need the source pixels while the buffer is rewritten
+		const int width = image.width(), height = image.height();
+		std::vector<byte> src(image.getBuffer(), image.getBuffer() + image.getBufferLength());
+		
+		image.createEmpty(height, width);
+		
+		DISPATCH_PIXEL_BYTES(image.getPixelByteLength(), transposeTiles,
+												 src.data(), image.getBuffer(), width, height);
+	}
+	
+	void rotateImage(Image& image, const int degree) {
+		if (degree % 90 != 0) {
+			throw ArgumentOutOfRangeException();
+		}
+		
+		switch (modulo(degree, 360)) {
+			case 90:
+				transposeImage(image);
+				flipImageHorizontally(image);
+				break;
+				
+			case 180:
+				if (image.getBuffer() == NULL) return;
+				DISPATCH_PIXEL_BYTES(image.getPixelByteLength(), reversePixels,
+														 image.getBuffer(), (size_t)image.getPixelCount());
+				break;
+				
+			case 270:
+				transposeImage(image);
+				flipImageVertically(image);
+				break;
+				
+			default:
+				break;
+		}
+	}
+	
 	void calc(Image& imga, Image& imgb, const CalcMethods method, const float factor) {
 		const int width = imga.width();
 		const int height = imga.height();
@@ -194,5 +334,343 @@ namespace img {
 		}
 	}
 
+	template<typename T>
+	struct MorphMax {
+		static inline T identity() { return std::numeric_limits<T>::lowest(); }
+		static inline T apply(const T a, const T b) { return a > b ? a : b; }
+	};
+	
+	template<typename T>
+	struct MorphMin {
+		static inline T identity() { return std::numeric_limits<T>::max(); }
+		static inline T apply(const T a, const T b) { return a < b ? a : b; }
+	};
+	
+	// van Herk/Gil-Werman running min/max of window 2 * radius + 1 over `lanes` lines,
+	// element i of lane l is src[i * stride + l], src and dst may be the same buffer
+	template<typename T, typename Op>
+	static void vhgwLanes(const T* src, T* dst, const int n, const size_t stride, const int lanes,
+												const int radius, std::vector<T>& g, std::vector<T>& h) {
+		const int w = 2 * radius + 1;
+		const int blocks = (n + 2 * radius + w - 1) / w;
+		const int m = blocks * w;
+		const T id = Op::identity();
+		
+		g.resize((size_t)m * lanes);
+		h.resize((size_t)m * lanes);
+		
+		for (int i = 0; i < m; i++) {
+			T* gi = &g[(size_t)i * lanes];
+			const int si = i - radius;
+			
+			if (si >= 0 && si < n) {
+				const T* s = src + (size_t)si * stride;
+				for (int l = 0; l < lanes; l++) gi[l] = s[l];
+			} else {
+				for (int l = 0; l < lanes; l++) gi[l] = id;
+			}
+		}
+		
+		for (int b = 0; b < blocks; b++) {
+			const int start = b * w, end = start + w - 1;
+			
+			// suffix max within the block, must run before g becomes the prefix max
+			T* he = &h[(size_t)end * lanes];
+			const T* ge = &g[(size_t)end * lanes];
+			for (int l = 0; l < lanes; l++) he[l] = ge[l];
+			
+			for (int i = end - 1; i >= start; i--) {
+				T* hi = &h[(size_t)i * lanes];
+				const T* hn = hi + lanes;
+				const T* gi = &g[(size_t)i * lanes];
+				for (int l = 0; l < lanes; l++) hi[l] = Op::apply(gi[l], hn[l]);
+			}
+			
+			for (int i = start + 1; i <= end; i++) {
+				T* gi = &g[(size_t)i * lanes];
+				const T* gp = gi - lanes;
+				for (int l = 0; l < lanes; l++) gi[l] = Op::apply(gp[l], gi[l]);
+			}
+		}
+		
+		for (int x = 0; x < n; x++) {
+			const T* hx = &h[(size_t)x * lanes];
+			const T* gx = &g[(size_t)(x + 2 * radius) * lanes];
+			T* d = dst + (size_t)x * stride;
+			for (int l = 0; l < lanes; l++) d[l] = Op::apply(hx[l], gx[l]);
+		}
+	}
+	
+	#define MORPH_STRIP_ELEMENTS 256
+	
+	template<typename T, typename Op>
+	static void morphHorizontal(const T* src, T* dst, const int width, const int height, const int comps,
+															const int radius, std::vector<T>& g, std::vector<T>& h) {
+		const size_t rowElems = (size_t)width * comps;
+		
+		for (int y = 0; y < height; y++) {
+			vhgwLanes<T, Op>(src + y * rowElems, dst + y * rowElems, width, comps, comps, radius, g, h);
+		}
+	}
+	
+	template<typename T, typename Op>
+	static void morphVertical(T* buf, const int width, const int height, const int comps,
+														const int radius, std::vector<T>& g, std::vector<T>& h) {
+		const int rowElems = width * comps;
+		
+		// process column strips so that the scratch lines stay in cache
+		for (int x = 0; x < rowElems; x += MORPH_STRIP_ELEMENTS) {
+			const int lanes = std::min(MORPH_STRIP_ELEMENTS, rowElems - x);
+			vhgwLanes<T, Op>(buf + x, buf + x, height, rowElems, lanes, radius, g, h);
+		}
+	}
+	
+	template<typename T, typename Op>
+	static void morphBuffer(T* buf, const int width, const int height, const int comps,
+													const int radius, const MorphShapes shape) {
+		std::vector<T> g, h;
+		
+		if (shape == MS_RECT) {
+			morphHorizontal<T, Op>(buf, buf, width, height, comps, radius, g, h);
+			morphVertical<T, Op>(buf, width, height, comps, radius, g, h);
+			return;
+		}
+		
+		// disk: union of horizontal spans, one horizontal pass per distinct span width
+		const size_t rowElems = (size_t)width * comps;
+		const size_t total = rowElems * height;
+		
+		std::vector<T> src(buf, buf + total), spans(total);
+		std::fill(buf, buf + total, Op::identity());
+		
+		int prevSpan = -1;
+		
+		for (int dy = 0; dy <= radius; dy++) {
+			const int span = (int)sqrtf((float)(radius * radius - dy * dy));
+			
+			if (span != prevSpan) {
+				morphHorizontal<T, Op>(src.data(), spans.data(), width, height, comps, span, g, h);
+				prevSpan = span;
+			}
+			
+			for (int y = 0; y < height; y++) {
+				T* d = buf + y * rowElems;
+				
+				if (y + dy < height) {
+					const T* s = &spans[(y + dy) * rowElems];
+					for (size_t i = 0; i < rowElems; i++) d[i] = Op::apply(d[i], s[i]);
+				}
+				
+				if (dy > 0 && y - dy >= 0) {
+					const T* s = &spans[(y - dy) * rowElems];
+					for (size_t i = 0; i < rowElems; i++) d[i] = Op::apply(d[i], s[i]);
+				}
+			}
+		}
+	}
+	
+	template<template<typename> class Op>
+	static void morph(Image& img, const uint radius, const MorphShapes shape) {
+		if (img.getBuffer() == NULL || radius == 0) return;
+		
+		const int width = img.width(), height = img.height(), comps = img.getColorComponents();
+		
+		switch (img.getBitDepth()) {
+			case 8:
+				morphBuffer<byte, Op<byte> >(img.getBuffer(), width, height, comps, radius, shape);
+				break;
+				
+			case 32:
+				morphBuffer<float, Op<float> >((float*)img.getBuffer(), width, height, comps, radius, shape);
+				break;
+				
+			default:
+				throw NotSupportPixelColorTypeException();
+		}
+	}
+	
+	void dilate(Image& img, const uint radius, const MorphShapes shape) {
+		morph<MorphMax>(img, radius, shape);
+	}
+	
+	void erode(Image& img, const uint radius, const MorphShapes shape) {
+		morph<MorphMin>(img, radius, shape);
+	}
+	
+	void opening(Image& img, const uint radius, const MorphShapes shape) {
+		erode(img, radius, shape);
+		dilate(img, radius, shape);
+	}
+	
+	void closing(Image& img, const uint radius, const MorphShapes shape) {
+		dilate(img, radius, shape);
+		erode(img, radius, shape);
+	}
+	
+	static void loadRGBA(const Image& img, std::vector<color4f>& colors) {
+		if (img.getColorComponents() != 4) {
+			throw NotSupportPixelColorTypeException();
+		}
+		
+		const size_t count = img.getPixelCount();
+		colors.resize(count);
+		
+		if (img.getBitDepth() == 8) {
+			const color4b* p = (const color4b*)img.getBuffer();
+			for (size_t i = 0; i < count; i++) colors[i] = tocolor4f(p[i]);
+		} else if (img.getBitDepth() == 32) {
+			memcpy(colors.data(), img.getBuffer(), count * sizeof(color4f));
+		} else {
+			throw NotSupportPixelColorTypeException();
+		}
+	}
+	
+	static inline void storeRGB(Image& img, const size_t index, const color3f& c) {
+		if (img.getBitDepth() == 8) {
+			((color4b*)img.getBuffer())[index].rgb = tocolor3b(c);
+		} else {
+			((color4f*)img.getBuffer())[index].rgb = c;
+		}
+	}
+	
+	void pushPullFill(Image& img) {
+		std::vector<color4f> base;
+		loadRGBA(img, base);
+		
+		if (base.empty()) return;
+		
+		// each level keeps the average color in rgb and the coverage weight in alpha
+		std::vector<std::vector<color4f> > levels;
+		std::vector<sizei> sizes;
+		
+		levels.push_back(std::vector<color4f>(base.size()));
+		sizes.push_back(img.getSize());
+		
+		for (size_t i = 0; i < base.size(); i++) {
+			levels[0][i] = color4f(base[i].rgb, base[i].a > 0 ? 1.0f : 0.0f);
+		}
+		
+		// pull: average the covered texels down to a single texel
+		while (sizes.back().width > 1 || sizes.back().height > 1) {
+			const sizei fs = sizes.back();
+			const sizei cs((fs.width + 1) / 2, (fs.height + 1) / 2);
+			
+			std::vector<color4f> coarse(cs.width * cs.height);
+			const std::vector<color4f>& fine = levels.back();
+			
+			for (int y = 0; y < cs.height; y++) {
+				for (int x = 0; x < cs.width; x++) {
+					color3f sum;
+					float weight = 0;
+					
+					for (int fy = y * 2; fy < std::min(y * 2 + 2, fs.height); fy++) {
+						for (int fx = x * 2; fx < std::min(x * 2 + 2, fs.width); fx++) {
+							const color4f& c = fine[fy * fs.width + fx];
+							sum += c.rgb * c.a;
+							weight += c.a;
+						}
+					}
+					
+					coarse[y * cs.width + x] = weight > 0
+						? color4f(sum / weight, std::min(weight, 1.0f)) : color4f(0.0f, 0.0f);
+				}
+			}
+			
+			levels.push_back(coarse);
+			sizes.push_back(cs);
+		}
+		
+		// push: blend partially covered texels with their parent
+		for (int l = (int)levels.size() - 2; l >= 0; l--) {
+			const sizei fs = sizes[l], cs = sizes[l + 1];
+			std::vector<color4f>& fine = levels[l];
+			const std::vector<color4f>& coarse = levels[l + 1];
+			
+			for (int y = 0; y < fs.height; y++) {
+				for (int x = 0; x < fs.width; x++) {
+					color4f& c = fine[y * fs.width + x];
+					const color4f& p = coarse[(y / 2) * cs.width + (x / 2)];
+					
+					c = color4f(c.rgb * c.a + p.rgb * (1.0f - c.a), 1.0f);
+				}
+			}
+		}
+		
+		for (size_t i = 0; i < base.size(); i++) {
+			if (base[i].a <= 0) {
+				storeRGB(img, i, levels[0][i].rgb);
+			}
+		}
+	}
+	
+	void dilateEdges(Image& img, const uint iterations) {
+		std::vector<color4f> colors;
+		loadRGBA(img, colors);
+		
+		const int width = img.width(), height = img.height();
+		
+		enum { Empty = 0, Valid = 1, Queued = 2 };
+		std::vector<byte> state(colors.size());
+		std::vector<int> ring, next;
+		std::vector<color3f> values;
+		
+		for (size_t i = 0; i < colors.size(); i++) {
+			state[i] = colors[i].a > 0 ? Valid : Empty;
+		}
+		
+		// queue the empty neighbours of texel i
+		auto enqueueNeighbours = [&](const int i, std::vector<int>& out) {
+			const int x = i % width, y = i / width;
+			
+			for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+				for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+					const int n = ny * width + nx;
+					if (state[n] == Empty) {
+						state[n] = Queued;
+						out.push_back(n);
+					}
+				}
+			}
+		};
+		
+		for (int i = 0; i < (int)state.size(); i++) {
+			if (state[i] == Valid) enqueueNeighbours(i, ring);
+		}
+		
+		for (uint iter = 0; iter < iterations && !ring.empty(); iter++) {
+			values.resize(ring.size());
+			
+			for (size_t r = 0; r < ring.size(); r++) {
+				const int i = ring[r], x = i % width, y = i / width;
+				color3f sum;
+				int count = 0;
+				
+				for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+					for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+						const int n = ny * width + nx;
+						if (state[n] == Valid) {
+							sum += colors[n].rgb;
+							count++;
+						}
+					}
+				}
+				
+				values[r] = sum / (float)count;
+			}
+			
+			for (size_t r = 0; r < ring.size(); r++) {
+				colors[ring[r]].rgb = values[r];
+				state[ring[r]] = Valid;
+				storeRGB(img, ring[r], values[r]);
+			}
+			
+			next.clear();
+			for (size_t r = 0; r < ring.size(); r++) {
+				enqueueNeighbours(ring[r], next);
+			}
+			ring.swap(next);
+		}
+	}
+
 }
 }
@@ -21,7 +21,12 @@ namespace img {
         Sub,
 		Lighter,
 	};
-	
+
+	enum MorphShapes {
+		MS_RECT,
+		MS_DISK,
+	};
+
 	void blur(Image& img);
 	void gaussBlur(Image& img, const uint range);
     void threshold(Image& img, float thresholdValue);
@@ -30,11 +35,27 @@ namespace img {
 
 	void flipImageHorizontally(Image& image);
 	void flipImageVertically(Image& image);
+	void transposeImage(Image& image);
+	void transposeImage(const Image& src, Image& dest);
+	// rotate clockwise by a multiple of 90 degrees
+	void rotateImage(Image& image, const int degree);
 
 	void calc(Image& imga, Image& imgb,
 						const CalcMethods method = CalcMethods::Lighter,
 						const float factor = 1.0f);
 
+	// Morphology on every channel of 8-bit or float images. MS_RECT windows cost
+	// constant time per pixel (van Herk/Gil-Werman), disk windows cost O(radius).
+	void dilate(Image& img, const uint radius, const MorphShapes shape = MS_RECT);
+	void erode(Image& img, const uint radius, const MorphShapes shape = MS_RECT);
+	void opening(Image& img, const uint radius, const MorphShapes shape = MS_RECT);
+	void closing(Image& img, const uint radius, const MorphShapes shape = MS_RECT);
+
+	// Fill texels whose alpha is zero from the surrounding valid texels,
+	// alpha channel is kept unchanged.
+	void pushPullFill(Image& img);
+	void dilateEdges(Image& img, const uint iterations);
+
 }
 }
 
@@ -0,0 +1,940 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "imghdrcodec.h"
+#include "imgcodec.h"
+#include "byteorder.h"
+
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+extern "C" {
+#include "zlib.h"
+}
+
+namespace ugm {
+
+#define HDR_BLOCK_ROWS 32
+#define HDR_MAX_LINE 1024
+#define EXR_MAGIC 20000630
+#define EXR_ZIP_BLOCK_ROWS 16
+#define EXR_MAX_NAME 256
+#define EXR_PIXELS_MAX 400000000
+
+static void readBytes(Stream& stream, void* buffer, const size_t length) {
+	if (length > 0 && stream.read(buffer, (uint)length) != (int)length) {
+		throw ImageCodecException();
+	}
+}
+
+// the rest of the stream, blocks are decoded from memory by several threads
+static void readRemaining(Stream& stream, std::vector<byte>& data) {
+	const size_t position = stream.getPosition(), length = stream.getLength();
+	
+	data.resize(length > position ? length - position : 0);
+	readBytes(stream, data.data(), data.size());
+}
+
+static inline float readPixelComponent(const Image& image, const byte* pixel, const uint c) {
+	return image.getBitDepth() == 32 ? ((const float*)pixel)[c] : pixel[c] / 255.0f;
+}
+
+static void checkImageHDR(const Image& image) {
+	if (image.width() <= 0 || image.height() <= 0 || (image.getBitDepth() != 8 && image.getBitDepth() != 32)) {
+		throw NotSupportImageCodecException();
+	}
+}
+
+// Radiance HDR
+
+// Parse the header and resolution line, only the standard -Y/+Y H +X W orientations
+static bool readHDRHeader(Stream& stream, uint* width, uint* height, bool* bottomUp) {
+	char line[HDR_MAX_LINE];
+	bool first = true;
+	
+	for (;;) {
+		uint length = 0;
+		char c = 0;
+		
+		while (stream.read(&c, 1) == 1 && c != '\n') {
+			if (length < HDR_MAX_LINE - 1) line[length++] = c;
+		}
+		
+		if (c != '\n') return false;
+		line[length] = '\0';
+		
+		if (first) {
+			if (line[0] != '#' || line[1] != '?') return false;
+			first = false;
+		} else if (length == 0) {
+			break;
+		} else if (strncmp(line, "FORMAT=", 7) == 0 && strcmp(line + 7, "32-bit_rle_rgbe") != 0) {
+			return false;
+		}
+	}
+	
+	char ySign, yAxis, xSign, xAxis;
+	int h, w;
+	uint length = 0;
+	char c = 0;
+	
+	while (stream.read(&c, 1) == 1 && c != '\n' && length < HDR_MAX_LINE - 1) {
+		line[length++] = c;
+	}
+	line[length] = '\0';
+	
+	if (sscanf(line, "%c%c %d %c%c %d", &ySign, &yAxis, &h, &xSign, &xAxis, &w) != 6
+			|| yAxis != 'Y' || xAxis != 'X' || xSign != '+' || (ySign != '-' && ySign != '+')
+			|| w <= 0 || h <= 0 || !isImageSizeSupported(w, h, 12)) {
+		return false;
+	}
+	
+	*width = (uint)w;
+	*height = (uint)h;
+	if (bottomUp != NULL) *bottomUp = ySign == '+';
+	
+	return true;
+}
+
+bool readHDRHeader(Stream& stream, uint* width, uint* height) {
+	return readHDRHeader(stream, width, height, NULL);
+}
+
+static inline bool isHDRRunLengthRow(const byte* p, const byte* end, const uint width) {
+	return width >= 8 && width < 0x8000 && end - p >= 4 && p[0] == 2 && p[1] == 2 && (p[2] & 0x80) == 0
+		&& (uint)((p[2] << 8) | p[3]) == width;
+}
+
+// end of a run-length row, runs are walked without being expanded
+static const byte* skipHDRRunLengthRow(const byte* p, const byte* end, const uint width) {
+	p += 4;
+	
+	for (uint c = 0; c < 4; c++) {
+		for (uint x = 0; x < width; ) {
+			if (p >= end) throw ImageCodecException();
+			
+			uint count = *p++;
+			if (count > 128) {
+				count -= 128;
+				p++;
+			} else {
+				p += count;
+			}
+			
+			if (count == 0 || (x += count) > width) throw ImageCodecException();
+		}
+	}
+	
+	if (p > end) throw ImageCodecException();
+	return p;
+}
+
+// planar run-length channels into interleaved RGBE
+static void decodeHDRRunLengthRow(const byte* p, byte* rgbe, const uint width) {
+	p += 4;
+	
+	for (uint c = 0; c < 4; c++) {
+		for (uint x = 0; x < width; ) {
+			uint count = *p++;
+			
+			if (count > 128) {
+				count -= 128;
+				const byte value = *p++;
+				for (uint i = 0; i < count; i++, x++) rgbe[x * 4 + c] = value;
+			} else {
+				for (uint i = 0; i < count; i++, x++) rgbe[x * 4 + c] = *p++;
+			}
+		}
+	}
+}
+
+// flat RGBE pixels, where 1 1 1 n repeats the previous pixel
+static const byte* decodeHDRFlatRow(const byte* p, const byte* end, byte* rgbe, const uint width) {
+	uint shift = 0;
+	
+	for (uint x = 0; x < width; ) {
+		if (end - p < 4) throw ImageCodecException();
+		
+		if (p[0] == 1 && p[1] == 1 && p[2] == 1) {
+			const uint count = (uint)p[3] << shift;
+			if (x == 0 || x + count > width) throw ImageCodecException();
+			
+			for (uint i = 0; i < count; i++, x++) memcpy(rgbe + x * 4, rgbe + (x - 1) * 4, 4);
+			shift += 8;
+		} else {
+			memcpy(rgbe + x * 4, p, 4);
+			x++;
+			shift = 0;
+		}
+		
+		p += 4;
+	}
+	
+	return p;
+}
+
+static std::vector<float> createRGBEScaleTable() {
+	std::vector<float> table(256, 0.0f);
+	for (int e = 1; e < 256; e++) table[e] = (float)ldexp(1.0, e - 136);
+	return table;
+}
+
+// RGBE stored in the last third of a float RGB row, converted forward in place
+static void convertRGBERow(float* row, const uint width) {
+	static const std::vector<float> scale = createRGBEScaleTable();
+	const byte* rgbe = (const byte*)(row + width * 2);
+	
+	for (uint x = 0; x < width; x++, rgbe += 4) {
+		const byte r = rgbe[0], g = rgbe[1], b = rgbe[2];
+		const float f = scale[rgbe[3]];
+		
+		row[x * 3] = (r + 0.5f) * f;
+		row[x * 3 + 1] = (g + 0.5f) * f;
+		row[x * 3 + 2] = (b + 0.5f) * f;
+	}
+}
+
+void readHDR(Image& image, Stream& stream, ThreadPool* pool) {
+	uint width, height;
+	bool bottomUp;
+	
+	if (!readHDRHeader(stream, &width, &height, &bottomUp)) {
+		throw ImageCodecException();
+	}
+	
+	std::vector<byte> data;
+	readRemaining(stream, data);
+	
+	image.setPixelDataFormat(PixelDataFormat::PDF_RGB, 32);
+	image.createEmpty(width, height);
+	
+	byte* buffer = image.getBuffer();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	const byte* p = data.data();
+	const byte* end = p + data.size();
+	
+	// find where every run-length row starts, other rows are decoded here since
+	// their length is only known by decoding them
+	std::vector<const byte*> rows(height, (const byte*)NULL);
+	
+	for (uint i = 0; i < height; i++) {
+		const uint y = bottomUp ? height - 1 - i : i;
+		
+		if (isHDRRunLengthRow(p, end, width)) {
+			rows[y] = p;
+			p = skipHDRRunLengthRow(p, end, width);
+		} else {
+			p = decodeHDRFlatRow(p, end, buffer + y * rowBytes + width * 8, width);
+		}
+	}
+	
+	const uint blockCount = (height + HDR_BLOCK_ROWS - 1) / HDR_BLOCK_ROWS;
+	
+	parallelForOrdered(pool != NULL ? *pool : ThreadPool::shared(), blockCount, [&](const uint block) {
+		const uint endRow = std::min(height, (block + 1) * HDR_BLOCK_ROWS);
+		
+		for (uint y = block * HDR_BLOCK_ROWS; y < endRow; y++) {
+			float* row = (float*)(buffer + y * rowBytes);
+			if (rows[y] != NULL) decodeHDRRunLengthRow(rows[y], (byte*)(row + width * 2), width);
+			convertRGBERow(row, width);
+		}
+	}, std::function<void(uint)>());
+}
+
+static inline void floatToRGBE(float r, float g, float b, byte* rgbe) {
+	r = std::max(r, 0.0f);
+	g = std::max(g, 0.0f);
+	b = std::max(b, 0.0f);
+	
+	const float v = std::max(r, std::max(g, b));
+	
+	if (v < 1e-32f) {
+		rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+	} else {
+		int e;
+		const float m = (float)(frexp(v, &e) * 255.9999 / v);
+		
+		rgbe[0] = (byte)(r * m);
+		rgbe[1] = (byte)(g * m);
+		rgbe[2] = (byte)(b * m);
+		rgbe[3] = (byte)(e + 128);
+	}
+}
+
+// run-length encode one channel of interleaved RGBE, runs shorter than 4 are kept literal
+static void encodeHDRChannel(const byte* rgbe, const uint width, std::vector<byte>& out) {
+	uint cur = 0;
+	
+	while (cur < width) {
+		uint runStart = cur, runCount = 0, oldRunCount = 0;
+		
+		while (runCount < 4 && runStart < width) {
+			runStart += runCount;
+			oldRunCount = runCount;
+			runCount = 1;
+			
+			while (runStart + runCount < width && runCount < 127
+						 && rgbe[runStart * 4] == rgbe[(runStart + runCount) * 4]) {
+				runCount++;
+			}
+		}
+		
+		// a short run right before the long one
+		if (oldRunCount > 1 && oldRunCount == runStart - cur) {
+			out.push_back((byte)(128 + oldRunCount));
+			out.push_back(rgbe[cur * 4]);
+			cur = runStart;
+		}
+		
+		while (cur < runStart) {
+			const uint count = std::min(128u, runStart - cur);
+			out.push_back((byte)count);
+			for (uint i = 0; i < count; i++, cur++) out.push_back(rgbe[cur * 4]);
+		}
+		
+		if (runCount >= 4) {
+			out.push_back((byte)(128 + runCount));
+			out.push_back(rgbe[runStart * 4]);
+			cur += runCount;
+		}
+	}
+}
+
+void writeHDR(const Image& image, Stream& stream, ThreadPool* pool) {
+	checkImageHDR(image);
+	
+	const uint width = image.width(), height = image.height();
+	
+	char header[128];
+	const int headerLength = snprintf(header, sizeof(header),
+																		"#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %u +X %u\n", height, width);
+	stream.write(header, headerLength);
+	
+	const bool swap = image.getPixelDataFormat() == PixelDataFormat::PDF_BGR
+		|| image.getPixelDataFormat() == PixelDataFormat::PDF_BGRA;
+	const size_t pixelBytes = image.getPixelByteLength(), rowBytes = image.getPixelRowByteLength();
+	const byte* buffer = image.getBuffer();
+	
+	const bool runLength = width >= 8 && width < 0x8000;
+	const uint blockCount = (height + HDR_BLOCK_ROWS - 1) / HDR_BLOCK_ROWS;
+	std::vector<std::vector<byte> > blocks(blockCount);
+	
+	parallelForOrdered(pool != NULL ? *pool : ThreadPool::shared(), blockCount, [&](const uint block) {
+		std::vector<byte> rgbe(width * 4);
+		std::vector<byte>& out = blocks[block];
+		const uint endRow = std::min(height, (block + 1) * HDR_BLOCK_ROWS);
+		
+		for (uint y = block * HDR_BLOCK_ROWS; y < endRow; y++) {
+			const byte* row = buffer + y * rowBytes;
+			
+			for (uint x = 0; x < width; x++) {
+				const byte* pixel = row + x * pixelBytes;
+				floatToRGBE(readPixelComponent(image, pixel, swap ? 2 : 0), readPixelComponent(image, pixel, 1),
+										readPixelComponent(image, pixel, swap ? 0 : 2), &rgbe[x * 4]);
+			}
+			
+			if (runLength) {
+				const byte start[4] = { 2, 2, (byte)(width >> 8), (byte)width };
+				out.insert(out.end(), start, start + 4);
+				
+				for (uint c = 0; c < 4; c++) encodeHDRChannel(&rgbe[c], width, out);
+			} else {
+				out.insert(out.end(), rgbe.begin(), rgbe.end());
+			}
+		}
+	}, [&](const uint block) {
+		stream.write(blocks[block].data(), (uint)blocks[block].size());
+		std::vector<byte>().swap(blocks[block]);
+	});
+}
+
+// OpenEXR
+
+struct EXRChannel {
+	EXRPixelType type;
+	int target;				// R, G, B, A component index, 4 for Y and -1 for skipped channels
+	uint sampleBytes;
+};
+
+struct EXRHeader {
+	uint flags = 0;
+	std::vector<EXRChannel> channels;
+	int compression = -1;
+	int xMin = 0, yMin = 0, xMax = -1, yMax = -1;
+	bool subsampled = false;
+	
+	inline uint width() const { return (uint)(this->xMax - this->xMin + 1); }
+	inline uint height() const { return (uint)(this->yMax - this->yMin + 1); }
+	
+	bool hasChannel(const int target) const {
+		for (size_t i = 0; i < this->channels.size(); i++) {
+			if (this->channels[i].target == target) return true;
+		}
+		return false;
+	}
+};
+
+static bool readEXRString(Stream& stream, char* text) {
+	for (uint i = 0; i < EXR_MAX_NAME; i++) {
+		if (stream.read(text + i, 1) != 1) return false;
+		if (text[i] == '\0') return true;
+	}
+	return false;
+}
+
+static bool parseEXRChannels(const byte* p, const byte* end, EXRHeader& header) {
+	while (p < end && *p != '\0') {
+		const byte* name = p;
+		while (p < end && *p != '\0') p++;
+		if (end - p < 17) return false;
+		
+		const size_t nameLength = p - name;
+		p++;
+		
+		EXRChannel channel;
+		const uint type = readLE32(p);
+		if (type > EPT_FLOAT) return false;
+		
+		channel.type = (EXRPixelType)type;
+		channel.sampleBytes = channel.type == EPT_HALF ? 2 : 4;
+		channel.target = -1;
+		
+		if (nameLength == 1) {
+			switch (name[0]) {
+				case 'R': channel.target = 0; break;
+				case 'G': channel.target = 1; break;
+				case 'B': channel.target = 2; break;
+				case 'A': channel.target = 3; break;
+				case 'Y': channel.target = 4; break;
+			}
+		}
+		
+		if (readLE32(p + 8) != 1 || readLE32(p + 12) != 1) header.subsampled = true;
+		
+		header.channels.push_back(channel);
+		p += 16;
+	}
+	
+	return !header.channels.empty();
+}
+
+static bool readEXRHeader(Stream& stream, EXRHeader& header) {
+	byte magic[8];
+	if (stream.read(magic, 8) != 8 || readLE32(magic) != EXR_MAGIC || magic[4] != 2) {
+		return false;
+	}
+	
+	header.flags = readLE32(magic + 4) & 0xffffff00;
+	
+	char name[EXR_MAX_NAME], type[EXR_MAX_NAME];
+	std::vector<byte> value;
+	
+	for (;;) {
+		if (!readEXRString(stream, name)) return false;
+		if (name[0] == '\0') break;
+		
+		byte sizeBytes[4];
+		if (!readEXRString(stream, type) || stream.read(sizeBytes, 4) != 4) return false;
+		
+		const uint size = readLE32(sizeBytes);
+		
+		if (strcmp(name, "channels") == 0 || strcmp(name, "compression") == 0 || strcmp(name, "dataWindow") == 0) {
+			value.resize(size);
+			if (size > 0 && stream.read(value.data(), size) != (int)size) return false;
+			
+			if (strcmp(name, "channels") == 0) {
+				if (!parseEXRChannels(value.data(), value.data() + size, header)) return false;
+			} else if (strcmp(name, "compression") == 0) {
+				if (size != 1) return false;
+				header.compression = value[0];
+			} else {
+				if (size != 16) return false;
+				header.xMin = (int)readLE32(&value[0]);
+				header.yMin = (int)readLE32(&value[4]);
+				header.xMax = (int)readLE32(&value[8]);
+				header.yMax = (int)readLE32(&value[12]);
+			}
+		} else {
+			stream.setPosition(stream.getPosition() + size);
+		}
+	}
+	
+	// 64-bit math, the window may span the whole int range
+	const long long width = (long long)header.xMax - header.xMin + 1;
+	const long long height = (long long)header.yMax - header.yMin + 1;
+	
+	// decoded as float RGB or RGBA
+	return !header.channels.empty() && header.compression >= 0
+		&& width > 0 && height > 0 && width * height <= EXR_PIXELS_MAX
+		&& isImageSizeSupported(width, height, header.hasChannel(3) ? 16 : 12);
+}
+
+bool readEXRHeader(Stream& stream, uint* width, uint* height, uint* channels, uint* bitDepth) {
+	EXRHeader header;
+	if (!readEXRHeader(stream, header)) return false;
+	
+	bool allHalf = true;
+	for (size_t i = 0; i < header.channels.size(); i++) {
+		if (header.channels[i].type != EPT_HALF) allHalf = false;
+	}
+	
+	*width = header.width();
+	*height = header.height();
+	*channels = (header.hasChannel(4) ? 1 : 0) + (header.hasChannel(0) || header.hasChannel(1) || header.hasChannel(2) ? 3 : 0)
+		+ (header.hasChannel(3) ? 1 : 0);
+	*bitDepth = allHalf ? 16 : 32;
+	
+	return true;
+}
+
+static std::vector<float> createHalfToFloatTable() {
+	std::vector<float> table(65536);
+	
+	for (uint h = 0; h < 65536; h++) {
+		const uint sign = (h & 0x8000) << 16;
+		uint exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff, bits;
+		
+		if (exponent == 0) {
+			if (mantissa == 0) {
+				bits = sign;
+			} else {
+				// subnormal, normalize the mantissa
+				exponent = 113;
+				while ((mantissa & 0x400) == 0) {
+					mantissa <<= 1;
+					exponent--;
+				}
+				bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+			}
+		} else if (exponent == 31) {
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		} else {
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		
+		memcpy(&table[h], &bits, 4);
+	}
+	
+	return table;
+}
+
+// round to nearest even, overflow becomes infinity
+static inline unsigned short floatToHalf(const float value) {
+	uint bits;
+	memcpy(&bits, &value, 4);
+	
+	const uint sign = (bits >> 16) & 0x8000;
+	const uint magnitude = bits & 0x7fffffff;
+	
+	if (magnitude >= 0x7f800000) {
+		return (unsigned short)(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+	} else if (magnitude >= 0x47800000) {
+		return (unsigned short)(sign | 0x7c00);
+	} else if (magnitude < 0x38800000) {
+		if (magnitude <= 0x33000000) return (unsigned short)sign;
+		
+		const uint shift = 126 - (magnitude >> 23);
+		const uint mantissa = (magnitude & 0x7fffff) | 0x800000;
+		const uint rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+		uint h = mantissa >> shift;
+		
+		if (rest > halfway || (rest == halfway && (h & 1))) h++;
+		return (unsigned short)(sign | h);
+	}
+	
+	uint h = (magnitude - 0x38000000) >> 13;
+	const uint rest = magnitude & 0x1fff;
+	
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+	return (unsigned short)(sign | h);
+}
+
+static inline uint getEXRBlockRows(const int compression) {
+	return compression == ECM_ZIP ? EXR_ZIP_BLOCK_ROWS : 1;
+}
+
+// ZIP and RLE store the bytes split into even and odd halves, as deltas
+static void predictEXRBlock(const byte* in, byte* out, const size_t length) {
+	byte* t1 = out;
+	byte* t2 = out + (length + 1) / 2;
+	
+	for (size_t i = 0; i < length; i += 2) {
+		*t1++ = in[i];
+		if (i + 1 < length) *t2++ = in[i + 1];
+	}
+	
+	int previous = out[0];
+	for (size_t i = 1; i < length; i++) {
+		const int d = (int)out[i] - previous + (128 + 256);
+		previous = out[i];
+		out[i] = (byte)d;
+	}
+}
+
+static void unpredictEXRBlock(byte* in, byte* out, const size_t length) {
+	for (size_t i = 1; i < length; i++) {
+		in[i] = (byte)(in[i - 1] + in[i] - 128);
+	}
+	
+	const byte* t1 = in;
+	const byte* t2 = in + (length + 1) / 2;
+	
+	for (size_t i = 0; i < length; i += 2) {
+		out[i] = *t1++;
+		if (i + 1 < length) out[i + 1] = *t2++;
+	}
+}
+
+static void encodeEXRRunLength(const byte* in, const size_t length, std::vector<byte>& out) {
+	const signed char* data = (const signed char*)in;
+	const signed char* end = data + length;
+	const signed char* runStart = data;
+	const signed char* runEnd = data + 1;
+	
+	while (runStart < end) {
+		while (runEnd < end && *runStart == *runEnd && runEnd - runStart - 1 < 127) runEnd++;
+		
+		if (runEnd - runStart >= 3) {
+			out.push_back((byte)(runEnd - runStart - 1));
+			out.push_back((byte)*runStart);
+			runStart = runEnd;
+		} else {
+			while (runEnd < end && ((runEnd + 1 >= end || *runEnd != *(runEnd + 1))
+															|| (runEnd + 2 >= end || *(runEnd + 1) != *(runEnd + 2)))
+						 && runEnd - runStart < 127) {
+				runEnd++;
+			}
+			
+			out.push_back((byte)(runStart - runEnd));
+			while (runStart < runEnd) out.push_back((byte)*runStart++);
+		}
+		
+		runEnd++;
+	}
+}
+
+static bool decodeEXRRunLength(const byte* in, size_t length, byte* out, size_t outLength) {
+	while (length > 0) {
+		const signed char count = (signed char)*in++;
+		
+		if (count < 0) {
+			const size_t n = -(int)count;
+			if (length < n + 1 || outLength < n) return false;
+			
+			memcpy(out, in, n);
+			in += n;
+			out += n;
+			length -= n + 1;
+			outLength -= n;
+		} else {
+			const size_t n = (size_t)count + 1;
+			if (length < 2 || outLength < n) return false;
+			
+			memset(out, *in++, n);
+			out += n;
+			length -= 2;
+			outLength -= n;
+		}
+	}
+	
+	return outLength == 0;
+}
+
+static thread_local std::vector<byte> exrScratch;
+
+static void decodeEXRBlock(const EXRHeader& header, const byte* data, const size_t length,
+													 byte* raw, const size_t rawLength) {
+	if (header.compression == ECM_NONE || length == rawLength) {
+		if (length != rawLength) throw ImageCodecException();
+		memcpy(raw, data, length);
+		return;
+	}
+	
+	exrScratch.resize(rawLength);
+	
+	if (header.compression == ECM_RLE) {
+		if (!decodeEXRRunLength(data, length, exrScratch.data(), rawLength)) throw ImageCodecException();
+	} else {
+		uLongf inflated = (uLongf)rawLength;
+		if (uncompress(exrScratch.data(), &inflated, data, (uLong)length) != Z_OK || inflated != rawLength) {
+			throw ImageCodecException();
+		}
+	}
+	
+	unpredictEXRBlock(exrScratch.data(), raw, rawLength);
+}
+
+void readEXR(Image& image, Stream& stream, ThreadPool* pool) {
+	const size_t start = stream.getPosition();
+	
+	EXRHeader header;
+	if (!readEXRHeader(stream, header)) {
+		throw ImageCodecException();
+	}
+	
+	// tiled, deep and multi-part files and the wavelet/lossy compressions are not supported
+	if ((header.flags & 0x1a00) != 0 || header.compression > ECM_ZIP || header.subsampled) {
+		throw NotSupportImageCodecException();
+	}
+	
+	const uint width = header.width(), height = header.height();
+	const uint blockRows = getEXRBlockRows(header.compression);
+	const uint blockCount = (height + blockRows - 1) / blockRows;
+	
+	std::vector<byte> table(blockCount * 8);
+	readBytes(stream, table.data(), table.size());
+	
+	const size_t dataStart = stream.getPosition();
+	std::vector<byte> data;
+	readRemaining(stream, data);
+	
+	size_t lineBytes = 0;
+	for (size_t i = 0; i < header.channels.size(); i++) {
+		lineBytes += width * header.channels[i].sampleBytes;
+	}
+	
+	const bool alpha = header.hasChannel(3);
+	image.setPixelDataFormat(alpha ? PixelDataFormat::PDF_RGBA : PixelDataFormat::PDF_RGB, 32);
+	image.createEmpty(width, height);
+	
+	byte* buffer = image.getBuffer();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	const uint components = alpha ? 4 : 3;
+	static const std::vector<float> halfTable = createHalfToFloatTable();
+	
+	parallelForOrdered(pool != NULL ? *pool : ThreadPool::shared(), blockCount, [&](const uint block) {
+		// offsets are from the start of the file, blocks may be stored in any order
+		const size_t offset = start + ((size_t)readLE32(&table[block * 8]) | ((size_t)readLE32(&table[block * 8 + 4]) << 16 << 16));
+		if (offset < dataStart || offset - dataStart + 8 > data.size()) {
+			throw ImageCodecException();
+		}
+		
+		const byte* chunk = &data[offset - dataStart];
+		const int y = (int)readLE32(chunk);
+		const uint length = readLE32(chunk + 4);
+		
+		if (y < header.yMin || y > header.yMax || length > data.size() - (offset - dataStart) - 8) {
+			throw ImageCodecException();
+		}
+		
+		const uint firstRow = (uint)(y - header.yMin);
+		const uint rows = std::min(blockRows, height - firstRow);
+		
+		std::vector<byte> raw(lineBytes * rows);
+		decodeEXRBlock(header, chunk + 8, length, raw.data(), raw.size());
+		
+		const byte* p = raw.data();
+		
+		for (uint r = 0; r < rows; r++) {
+			float* row = (float*)(buffer + (firstRow + r) * rowBytes);
+			
+			for (size_t i = 0; i < header.channels.size(); i++) {
+				const EXRChannel& channel = header.channels[i];
+				
+				if (channel.target >= 0) {
+					const uint first = channel.target == 4 ? 0 : channel.target;
+					const uint last = channel.target == 4 ? 2 : channel.target;
+					
+					for (uint x = 0; x < width; x++) {
+						float value;
+						
+						if (channel.type == EPT_HALF) {
+							value = halfTable[p[x * 2] | (p[x * 2 + 1] << 8)];
+						} else if (channel.type == EPT_FLOAT) {
+							const uint bits = readLE32(p + x * 4);
+							memcpy(&value, &bits, 4);
+						} else {
+							value = (float)readLE32(p + x * 4);
+						}
+						
+						for (uint c = first; c <= last; c++) row[x * components + c] = value;
+					}
+				}
+				
+				p += width * channel.sampleBytes;
+			}
+		}
+	}, std::function<void(uint)>());
+}
+
+static void writeEXRAttribute(std::vector<byte>& out, const char* name, const char* type,
+															const void* value, const uint size) {
+	out.insert(out.end(), name, name + strlen(name) + 1);
+	out.insert(out.end(), type, type + strlen(type) + 1);
+	
+	byte sizeBytes[4];
+	writeLE32(sizeBytes, size);
+	out.insert(out.end(), sizeBytes, sizeBytes + 4);
+	out.insert(out.end(), (const byte*)value, (const byte*)value + size);
+}
+
+static inline void appendLE32(std::vector<byte>& out, const uint value) {
+	byte bytes[4];
+	writeLE32(bytes, value);
+	out.insert(out.end(), bytes, bytes + 4);
+}
+
+static inline void appendLE32(std::vector<byte>& out, const float value) {
+	uint bits;
+	memcpy(&bits, &value, 4);
+	appendLE32(out, bits);
+}
+
+void writeEXR(const Image& image, Stream& stream, const EXREncodeOptions& options, ThreadPool* pool) {
+	checkImageHDR(image);
+	
+	if ((options.pixelType != EPT_HALF && options.pixelType != EPT_FLOAT)
+			|| options.compression < ECM_NONE || options.compression > ECM_ZIP) {
+		throw NotSupportImageCodecException();
+	}
+	
+	const size_t start = stream.getPosition();
+	const uint width = image.width(), height = image.height();
+	const bool swap = image.getPixelDataFormat() == PixelDataFormat::PDF_BGR
+		|| image.getPixelDataFormat() == PixelDataFormat::PDF_BGRA;
+	
+	// channels are stored in alphabetical order, channels[i] is the image component of names[i]
+	static const char* names[4] = { "A", "B", "G", "R" };
+	const uint components[4] = { 3, (uint)(swap ? 0 : 2), 1, (uint)(swap ? 2 : 0) };
+	const uint firstChannel = image.getColorComponents() > 3 ? 0 : 1;
+	const std::vector<uint> channels(components + firstChannel, components + 4);
+	
+	const uint sampleBytes = options.pixelType == EPT_HALF ? 2 : 4;
+	
+	std::vector<byte> header, list;
+	appendLE32(header, (uint)EXR_MAGIC);
+	appendLE32(header, (uint)2);
+	
+	for (uint i = firstChannel; i < 4; i++) {
+		list.insert(list.end(), names[i], names[i] + 2);
+		appendLE32(list, (uint)options.pixelType);
+		appendLE32(list, (uint)0);
+		appendLE32(list, (uint)1);
+		appendLE32(list, (uint)1);
+	}
+	list.push_back(0);
+	
+	std::vector<byte> window;
+	appendLE32(window, (uint)0);
+	appendLE32(window, (uint)0);
+	appendLE32(window, width - 1);
+	appendLE32(window, height - 1);
+	
+	std::vector<byte> center;
+	appendLE32(center, 0.0f);
+	appendLE32(center, 0.0f);
+	
+	const byte compression = (byte)options.compression, lineOrder = 0;
+	const float one = 1.0f;
+	
+	writeEXRAttribute(header, "channels", "chlist", list.data(), (uint)list.size());
+	writeEXRAttribute(header, "compression", "compression", &compression, 1);
+	writeEXRAttribute(header, "dataWindow", "box2i", window.data(), 16);
+	writeEXRAttribute(header, "displayWindow", "box2i", window.data(), 16);
+	writeEXRAttribute(header, "lineOrder", "lineOrder", &lineOrder, 1);
+	writeEXRAttribute(header, "pixelAspectRatio", "float", &one, 4);
+	writeEXRAttribute(header, "screenWindowCenter", "v2f", center.data(), 8);
+	writeEXRAttribute(header, "screenWindowWidth", "float", &one, 4);
+	header.push_back(0);
+	
+	const uint blockRows = getEXRBlockRows(options.compression);
+	const uint blockCount = (height + blockRows - 1) / blockRows;
+	
+	// the offset table is written once every block size is known
+	stream.write(header.data(), (uint)header.size());
+	const size_t tablePosition = stream.getPosition();
+	
+	std::vector<byte> table(blockCount * 8);
+	stream.write(table.data(), (uint)table.size());
+	
+	size_t offset = tablePosition + table.size() - start;
+	
+	const byte* buffer = image.getBuffer();
+	const size_t pixelBytes = image.getPixelByteLength(), rowBytes = image.getPixelRowByteLength();
+	const size_t lineBytes = (size_t)width * channels.size() * sampleBytes;
+	std::vector<std::vector<byte> > blocks(blockCount);
+	
+	parallelForOrdered(pool != NULL ? *pool : ThreadPool::shared(), blockCount, [&](const uint block) {
+		const uint firstRow = block * blockRows;
+		const uint rows = std::min(blockRows, height - firstRow);
+		const size_t rawLength = lineBytes * rows;
+		
+		std::vector<byte> raw(rawLength);
+		byte* p = raw.data();
+		
+		for (uint r = 0; r < rows; r++) {
+			const byte* row = buffer + (firstRow + r) * rowBytes;
+			
+			for (size_t i = 0; i < channels.size(); i++) {
+				const uint c = channels[i];
+				
+				for (uint x = 0; x < width; x++, p += sampleBytes) {
+					const float value = readPixelComponent(image, row + x * pixelBytes, c);
+					
+					if (options.pixelType == EPT_HALF) {
+						const unsigned short h = floatToHalf(value);
+						p[0] = (byte)h;
+						p[1] = (byte)(h >> 8);
+					} else {
+						uint bits;
+						memcpy(&bits, &value, 4);
+						writeLE32(p, bits);
+					}
+				}
+			}
+		}
+		
+		std::vector<byte>& out = blocks[block];
+		out.resize(8);
+		writeLE32(&out[0], firstRow);
+		
+		if (options.compression != ECM_NONE) {
+			std::vector<byte> predicted(rawLength);
+			predictEXRBlock(raw.data(), predicted.data(), rawLength);
+			
+			if (options.compression == ECM_RLE) {
+				encodeEXRRunLength(predicted.data(), rawLength, out);
+			} else {
+				uLongf compressedLength = compressBound((uLong)rawLength);
+				out.resize(8 + compressedLength);
+				
+				if (compress2(&out[8], &compressedLength, predicted.data(), (uLong)rawLength,
+											options.compressionLevel) != Z_OK) {
+					throw ImageCodecException();
+				}
+				
+				out.resize(8 + compressedLength);
+			}
+		}
+		
+		// blocks that do not get smaller are stored as they are
+		if (options.compression == ECM_NONE || out.size() - 8 >= rawLength) {
+			out.resize(8);
+			out.insert(out.end(), raw.begin(), raw.end());
+		}
+		
+		writeLE32(&out[4], (uint)(out.size() - 8));
+	}, [&](const uint block) {
+		writeLE32(&table[block * 8], (uint)offset);
+		writeLE32(&table[block * 8 + 4], (uint)((unsigned long long)offset >> 32));
+		
+		stream.write(blocks[block].data(), (uint)blocks[block].size());
+		offset += blocks[block].size();
+		std::vector<byte>().swap(blocks[block]);
+	});
+	
+	const size_t end = stream.getPosition();
+	stream.setPosition(tablePosition);
+	stream.write(table.data(), (uint)table.size());
+	stream.setPosition(end);
+}
+
+}
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef imghdrcodec_h
+#define imghdrcodec_h
+
+#include <stdio.h>
+
+#include "ucm/file.h"
+#include "image.h"
+#include "parallel.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+// High dynamic range codecs. Images are decoded as 32-bit float RGB or RGBA,
+// 8-bit images are written as values in [0, 1]. Scanline blocks are encoded
+// and decoded concurrently on pool, ThreadPool::shared() when pool is NULL.
+
+// Radiance RGBE (.hdr), run-length encoded scanlines
+void readHDR(Image& image, Stream& stream, ThreadPool* pool = NULL);
+void writeHDR(const Image& image, Stream& stream, ThreadPool* pool = NULL);
+
+// OpenEXR single part scanline files (.exr), channels R, G, B, A and Y
+enum EXRPixelType {
+	EPT_UINT = 0,
+	EPT_HALF = 1,
+	EPT_FLOAT = 2,
+};
+
+enum EXRCompression {
+	ECM_NONE = 0,
+	ECM_RLE = 1,
+	ECM_ZIPS = 2,			// zlib per scanline
+	ECM_ZIP = 3,			// zlib per block of 16 scanlines
+};
+
+struct EXREncodeOptions {
+	EXRPixelType pixelType;
+	EXRCompression compression;
+	int compressionLevel;		// zlib level for ZIP and ZIPS
+	
+	EXREncodeOptions(const EXRPixelType pixelType = EPT_HALF,
+									 const EXRCompression compression = ECM_ZIP, const int compressionLevel = 4)
+	: pixelType(pixelType), compression(compression), compressionLevel(compressionLevel) { }
+	
+	// full float precision with fast compression, e.g. for render checkpoints
+	static EXREncodeOptions lossless() { return EXREncodeOptions(EPT_FLOAT, ECM_ZIP, 1); }
+};
+
+void readEXR(Image& image, Stream& stream, ThreadPool* pool = NULL);
+void writeEXR(const Image& image, Stream& stream,
+							const EXREncodeOptions& options = EXREncodeOptions(), ThreadPool* pool = NULL);
+
+// Parse only the file header, the stream is left after the header. False for
+// malformed headers, EXR data windows over 400M pixels and sizes whose decoded
+// float image would not fit isImageSizeSupported.
+bool readHDRHeader(Stream& stream, uint* width, uint* height);
+bool readEXRHeader(Stream& stream, uint* width, uint* height, uint* channels, uint* bitDepth);
+
+}
+
+#endif /* imghdrcodec_h */
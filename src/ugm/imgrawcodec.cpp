@@ -0,0 +1,642 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "imgrawcodec.h"
+#include "imgcodec.h"
+#include "byteorder.h"
+
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace ugm {
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_V4_HEADER_SIZE 108
+#define TGA_HEADER_SIZE 18
+#define TGA_RLE_BUFFER_SIZE 65536
+
+static inline bool isLittleEndianHost() {
+	const unsigned short value = 1;
+	return *(const byte*)&value == 1;
+}
+
+static void readBytes(Stream& stream, void* buffer, const size_t length) {
+	if (length > 0 && stream.read(buffer, (uint)length) != (int)length) {
+		throw ImageCodecException();
+	}
+}
+
+static inline void swapRedBlue(byte* row, const uint width, const uint pixelBytes) {
+	for (uint x = 0; x < width; x++, row += pixelBytes) {
+		const byte t = row[0];
+		row[0] = row[2];
+		row[2] = t;
+	}
+}
+
+// expand samples packed at the start of row into RGB, from the end so nothing is overwritten
+template<typename T>
+static inline void expandGrayRow(T* row, const uint width) {
+	for (uint x = width; x-- > 0; ) {
+		row[x * 3] = row[x * 3 + 1] = row[x * 3 + 2] = row[x];
+	}
+}
+
+static inline bool isSwappedFormat(const PixelDataFormat format) {
+	return format == PixelDataFormat::PDF_BGR || format == PixelDataFormat::PDF_BGRA;
+}
+
+static void checkImage8Bit(const Image& image) {
+	if (image.getBitDepth() != 8 || image.width() <= 0 || image.height() <= 0) {
+		throw NotSupportImageCodecException();
+	}
+}
+
+// BMP
+
+void readBMP(Image& image, Stream& stream) {
+	const size_t start = stream.getPosition();
+	
+	byte header[BMP_FILE_HEADER_SIZE + BMP_V4_HEADER_SIZE];
+	readBytes(stream, header, BMP_FILE_HEADER_SIZE + 4);
+	
+	if (header[0] != 'B' || header[1] != 'M') {
+		throw ImageCodecException();
+	}
+	
+	const uint dataOffset = readLE32(header + 10);
+	const uint infoSize = readLE32(header + 14);
+	const byte* info = header + BMP_FILE_HEADER_SIZE;
+	
+	int width, height;
+	uint bitCount, compression = 0;
+	
+	if (infoSize == 12) {
+		readBytes(stream, header + BMP_FILE_HEADER_SIZE + 4, 8);
+		width = readLE16(info + 4);
+		height = readLE16(info + 6);
+		bitCount = readLE16(info + 10);
+	} else if (infoSize >= BMP_INFO_HEADER_SIZE) {
+		readBytes(stream, header + BMP_FILE_HEADER_SIZE + 4, std::min(infoSize, (uint)BMP_V4_HEADER_SIZE) - 4);
+		width = (int)readLE32(info + 4);
+		height = (int)readLE32(info + 8);
+		bitCount = readLE16(info + 14);
+		compression = readLE32(info + 16);
+	} else {
+		throw ImageCodecException();
+	}
+	
+	// bit fields are accepted in the usual BGRA layout, following the info header or inside a V4/V5 header
+	if (compression == 3 && bitCount == 32) {
+		byte masks[12];
+		
+		if (infoSize >= 52) {
+			memcpy(masks, info + 40, 12);
+		} else {
+			readBytes(stream, masks, 12);
+		}
+		
+		if (readLE32(masks) != 0x00FF0000 || readLE32(masks + 4) != 0x0000FF00 || readLE32(masks + 8) != 0x000000FF) {
+			throw NotSupportImageCodecException();
+		}
+	} else if (compression != 0 || (bitCount != 24 && bitCount != 32)) {
+		throw NotSupportImageCodecException();
+	}
+	
+	// negative height means top-down rows
+	const bool topDown = height < 0;
+	height = std::abs(height);
+	
+	const uint pixelBytes = bitCount / 8;
+	
+	if (width <= 0 || !isImageSizeSupported(width, height, pixelBytes)) {
+		throw ImageCodecException();
+	}
+	
+	const uint rowBytes = width * pixelBytes;
+	const uint padding = ((width * bitCount + 31) / 32) * 4 - rowBytes;
+	
+	image.setPixelDataFormat(pixelBytes == 4 ? PixelDataFormat::PDF_RGBA : PixelDataFormat::PDF_RGB, 8);
+	image.createEmpty(width, height);
+	
+	stream.setPosition(start + dataOffset);
+	
+	byte* buffer = image.getBuffer();
+	byte pad[4];
+	bool hasAlpha = false;
+	
+	for (int i = 0; i < height; i++) {
+		byte* row = buffer + (size_t)(topDown ? i : height - 1 - i) * rowBytes;
+		
+		readBytes(stream, row, rowBytes);
+		readBytes(stream, pad, padding);
+		
+		swapRedBlue(row, width, pixelBytes);
+		
+		if (pixelBytes == 4 && !hasAlpha) {
+			for (int x = 0; x < width; x++) {
+				if (row[x * 4 + 3] != 0) {
+					hasAlpha = true;
+					break;
+				}
+			}
+		}
+	}
+	
+	// most 32-bit bitmaps leave the fourth byte unused
+	if (pixelBytes == 4 && !hasAlpha) {
+		for (size_t i = 3; i < image.getBufferLength(); i += 4) {
+			buffer[i] = 255;
+		}
+	}
+}
+
+void writeBMP(const Image& image, Stream& stream) {
+	checkImage8Bit(image);
+	
+	const uint width = image.width(), height = image.height();
+	const uint pixelBytes = image.getPixelByteLength();
+	const uint rowBytes = image.getPixelRowByteLength();
+	const uint stride = (rowBytes + 3) & ~3u;
+	
+	// alpha needs the V4 header to describe the channel masks
+	const uint infoSize = pixelBytes == 4 ? BMP_V4_HEADER_SIZE : BMP_INFO_HEADER_SIZE;
+	const uint dataOffset = BMP_FILE_HEADER_SIZE + infoSize;
+	
+	byte header[BMP_FILE_HEADER_SIZE + BMP_V4_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	
+	header[0] = 'B';
+	header[1] = 'M';
+	writeLE32(header + 2, dataOffset + stride * height);
+	writeLE32(header + 10, dataOffset);
+	
+	byte* info = header + BMP_FILE_HEADER_SIZE;
+	writeLE32(info, infoSize);
+	writeLE32(info + 4, width);
+	writeLE32(info + 8, height);
+	writeLE16(info + 12, 1);
+	writeLE16(info + 14, pixelBytes * 8);
+	writeLE32(info + 16, pixelBytes == 4 ? 3 : 0);
+	writeLE32(info + 20, stride * height);
+	writeLE32(info + 24, 2835);		// 72 DPI
+	writeLE32(info + 28, 2835);
+	
+	if (pixelBytes == 4) {
+		writeLE32(info + 40, 0x00FF0000);
+		writeLE32(info + 44, 0x0000FF00);
+		writeLE32(info + 48, 0x000000FF);
+		writeLE32(info + 52, 0xFF000000);
+		memcpy(info + 56, "BGRs", 4);		// LCS_sRGB
+	}
+	
+	stream.write(header, dataOffset);
+	
+	const bool swap = !isSwappedFormat(image.getPixelDataFormat());
+	const byte* buffer = image.getBuffer();
+	std::vector<byte> row(stride, 0);
+	
+	for (uint y = height; y-- > 0; ) {
+		memcpy(row.data(), buffer + (size_t)y * rowBytes, rowBytes);
+		if (swap) swapRedBlue(row.data(), width, pixelBytes);
+		
+		stream.write(row.data(), stride);
+	}
+}
+
+// TGA
+
+// buffered byte source for run-length packets
+struct TGAPacketReader {
+	Stream& stream;
+	std::vector<byte> buffer;
+	size_t position = 0, length = 0;
+	
+	TGAPacketReader(Stream& stream) : stream(stream), buffer(TGA_RLE_BUFFER_SIZE) { }
+	
+	void read(byte* dest, uint count) {
+		while (count > 0) {
+			if (this->position == this->length) {
+				const int read = this->stream.read(this->buffer.data(), TGA_RLE_BUFFER_SIZE);
+				if (read <= 0) throw ImageCodecException();
+				
+				this->position = 0;
+				this->length = read;
+			}
+			
+			const uint n = std::min(count, (uint)(this->length - this->position));
+			memcpy(dest, &this->buffer[this->position], n);
+			this->position += n;
+			dest += n;
+			count -= n;
+		}
+	}
+	
+	// Move the stream back to the first byte not consumed, the read ahead may run past the pixels
+	void finish() {
+		this->stream.setPosition(this->stream.getPosition() - (this->length - this->position));
+		this->position = this->length = 0;
+	}
+};
+
+void readTGA(Image& image, Stream& stream) {
+	byte header[TGA_HEADER_SIZE];
+	readBytes(stream, header, TGA_HEADER_SIZE);
+	
+	const uint idLength = header[0];
+	const uint colorMapType = header[1];
+	const uint imageType = header[2];
+	const uint colorMapLength = readLE16(header + 5);
+	const uint colorMapEntryBits = header[7];
+	const uint width = readLE16(header + 12);
+	const uint height = readLE16(header + 14);
+	const uint bitCount = header[16];
+	const uint descriptor = header[17];
+	
+	const bool gray = imageType == 3 || imageType == 11;
+	const bool rle = imageType == 10 || imageType == 11;
+	
+	if ((imageType != 2 && imageType != 3 && imageType != 10 && imageType != 11)
+			|| (gray && bitCount != 8) || (!gray && bitCount != 24 && bitCount != 32)
+			|| (descriptor & 0x10) != 0) {
+		throw NotSupportImageCodecException();
+	}
+	
+	const uint pixelBytes = bitCount / 8;
+	
+	if (!isImageSizeSupported(width, height, pixelBytes)) {
+		throw ImageCodecException();
+	}
+	
+	stream.setPosition(stream.getPosition() + idLength
+										 + (colorMapType == 1 ? colorMapLength * ((colorMapEntryBits + 7) / 8) : 0));
+	
+	const bool topDown = (descriptor & 0x20) != 0;
+	
+	image.setPixelDataFormat(pixelBytes == 4 ? PixelDataFormat::PDF_RGBA : PixelDataFormat::PDF_RGB, 8);
+	image.createEmpty(width, height);
+	
+	byte* buffer = image.getBuffer();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	
+	TGAPacketReader packets(stream);
+	byte pixel[4];
+	uint runLength = 0;
+	bool runRepeat = false;
+	
+	for (uint i = 0; i < height; i++) {
+		byte* row = buffer + (size_t)(topDown ? i : height - 1 - i) * rowBytes;
+		
+		// samples are stored at the start of the row in file layout and converted afterwards
+		if (!rle) {
+			readBytes(stream, row, width * pixelBytes);
+		} else {
+			// packets may run across rows
+			for (uint x = 0; x < width; ) {
+				if (runLength == 0) {
+					byte packet;
+					packets.read(&packet, 1);
+					
+					runLength = (packet & 0x7f) + 1;
+					runRepeat = (packet & 0x80) != 0;
+					
+					if (runRepeat) packets.read(pixel, pixelBytes);
+				}
+				
+				const uint count = std::min(runLength, width - x);
+				byte* p = row + x * pixelBytes;
+				
+				if (runRepeat) {
+					for (uint k = 0; k < count; k++, p += pixelBytes) {
+						memcpy(p, pixel, pixelBytes);
+					}
+				} else {
+					packets.read(p, count * pixelBytes);
+				}
+				
+				x += count;
+				runLength -= count;
+			}
+		}
+		
+		if (gray) {
+			expandGrayRow(row, width);
+		} else {
+			swapRedBlue(row, width, pixelBytes);
+		}
+	}
+	
+	if (rle) packets.finish();
+}
+
+// Run-length encode one row of pixels, packets do not cross rows.
+static void encodeTGARow(const byte* row, const uint width, const uint pixelBytes, std::vector<byte>& out) {
+	out.clear();
+	
+	uint x = 0;
+	while (x < width) {
+		uint run = 1;
+		while (x + run < width && run < 128
+					 && memcmp(row + (x + run) * pixelBytes, row + x * pixelBytes, pixelBytes) == 0) {
+			run++;
+		}
+		
+		if (run > 1) {
+			out.push_back((byte)(0x80 | (run - 1)));
+			out.insert(out.end(), row + x * pixelBytes, row + (x + 1) * pixelBytes);
+			x += run;
+			continue;
+		}
+		
+		// raw packet up to the start of the next run
+		uint count = 1;
+		while (x + count < width && count < 128
+					 && (x + count + 1 >= width
+							 || memcmp(row + (x + count) * pixelBytes, row + (x + count + 1) * pixelBytes, pixelBytes) != 0)) {
+			count++;
+		}
+		
+		out.push_back((byte)(count - 1));
+		out.insert(out.end(), row + x * pixelBytes, row + (x + count) * pixelBytes);
+		x += count;
+	}
+}
+
+void writeTGA(const Image& image, Stream& stream, const bool rle) {
+	checkImage8Bit(image);
+	
+	const uint width = image.width(), height = image.height();
+	const uint pixelBytes = image.getPixelByteLength();
+	const uint rowBytes = image.getPixelRowByteLength();
+	
+	if (width > 65535 || height > 65535) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	byte header[TGA_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	
+	header[2] = rle ? 10 : 2;
+	writeLE16(header + 12, width);
+	writeLE16(header + 14, height);
+	header[16] = (byte)(pixelBytes * 8);
+	header[17] = (byte)(0x20 | (pixelBytes == 4 ? 8 : 0));		// top-down, alpha bits
+	
+	stream.write(header, TGA_HEADER_SIZE);
+	
+	const bool swap = !isSwappedFormat(image.getPixelDataFormat());
+	const byte* buffer = image.getBuffer();
+	std::vector<byte> row(swap ? rowBytes : 0), packets;
+	
+	for (uint y = 0; y < height; y++) {
+		const byte* pixels = buffer + (size_t)y * rowBytes;
+		
+		if (swap) {
+			memcpy(row.data(), pixels, rowBytes);
+			swapRedBlue(row.data(), width, pixelBytes);
+			pixels = row.data();
+		}
+		
+		if (rle) {
+			encodeTGARow(pixels, width, pixelBytes, packets);
+			stream.write(packets.data(), (uint)packets.size());
+		} else {
+			stream.write(pixels, rowBytes);
+		}
+	}
+}
+
+// PPM, PGM and PFM
+
+// Read the next whitespace separated header token, skipping comments.
+// The single whitespace byte following the token is consumed as well.
+static void readPNMToken(Stream& stream, char* token, const uint size) {
+	char c = 0;
+	uint length = 0;
+	
+	for (;;) {
+		readBytes(stream, &c, 1);
+		
+		if (c == '#') {
+			while (c != '\n' && c != '\r') readBytes(stream, &c, 1);
+		} else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+			break;
+		}
+	}
+	
+	while (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+		if (length + 1 >= size) throw ImageCodecException();
+		
+		token[length++] = c;
+		readBytes(stream, &c, 1);
+	}
+	
+	token[length] = '\0';
+}
+
+static uint readPNMUInt(Stream& stream) {
+	char token[32];
+	readPNMToken(stream, token, sizeof(token));
+	
+	char* end = NULL;
+	const unsigned long value = strtoul(token, &end, 10);
+	
+	if (*end != '\0' || value == 0) {
+		throw ImageCodecException();
+	}
+	
+	return (uint)value;
+}
+
+void readPPM(Image& image, Stream& stream) {
+	char magic[2];
+	readBytes(stream, magic, 2);
+	
+	if (magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6')) {
+		throw NotSupportImageCodecException();
+	}
+	
+	const bool gray = magic[1] == '5';
+	const uint width = readPNMUInt(stream);
+	const uint height = readPNMUInt(stream);
+	const uint maxValue = readPNMUInt(stream);
+	
+	// decodes to 8-bit RGB, 16-bit rows are read through a buffer twice as wide
+	if (maxValue > 65535 || !isImageSizeSupported(width, height, maxValue > 255 ? 6 : 3)) {
+		throw ImageCodecException();
+	}
+	
+	const uint samples = width * (gray ? 1 : 3);
+	
+	image.setPixelDataFormat(PixelDataFormat::PDF_RGB, 8);
+	image.createEmpty(width, height);
+	
+	byte* buffer = image.getBuffer();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	
+	// 16-bit samples are big-endian
+	std::vector<byte> wide(maxValue > 255 ? samples * 2 : 0);
+	
+	for (uint y = 0; y < height; y++) {
+		byte* row = buffer + y * rowBytes;
+		
+		if (maxValue > 255) {
+			readBytes(stream, wide.data(), wide.size());
+			
+			for (uint i = 0; i < samples; i++) {
+				row[i] = (byte)((((wide[i * 2] << 8) | wide[i * 2 + 1]) * 255 + maxValue / 2) / maxValue);
+			}
+		} else {
+			readBytes(stream, row, samples);
+			
+			if (maxValue < 255) {
+				for (uint i = 0; i < samples; i++) {
+					row[i] = (byte)((row[i] * 255 + maxValue / 2) / maxValue);
+				}
+			}
+		}
+		
+		if (gray) expandGrayRow(row, width);
+	}
+}
+
+void writePPM(const Image& image, Stream& stream) {
+	checkImage8Bit(image);
+	
+	const uint width = image.width(), height = image.height();
+	const uint pixelBytes = image.getPixelByteLength();
+	const uint rowBytes = image.getPixelRowByteLength();
+	
+	char header[64];
+	const int headerLength = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+	stream.write(header, headerLength);
+	
+	const PixelDataFormat format = image.getPixelDataFormat();
+	const byte* buffer = image.getBuffer();
+	
+	// RGB rows are written as they are
+	if (format == PixelDataFormat::PDF_RGB) {
+		for (uint y = 0; y < height; y++) {
+			stream.write(buffer + (size_t)y * rowBytes, rowBytes);
+		}
+		return;
+	}
+	
+	const bool swap = isSwappedFormat(format);
+	std::vector<byte> row(width * 3);
+	
+	for (uint y = 0; y < height; y++) {
+		const byte* p = buffer + (size_t)y * rowBytes;
+		
+		for (uint x = 0; x < width; x++, p += pixelBytes) {
+			row[x * 3] = p[swap ? 2 : 0];
+			row[x * 3 + 1] = p[1];
+			row[x * 3 + 2] = p[swap ? 0 : 2];
+		}
+		
+		stream.write(row.data(), width * 3);
+	}
+}
+
+void readPFM(Image& image, Stream& stream) {
+	char magic[2];
+	readBytes(stream, magic, 2);
+	
+	if (magic[0] != 'P' || (magic[1] != 'F' && magic[1] != 'f')) {
+		throw NotSupportImageCodecException();
+	}
+	
+	const bool gray = magic[1] == 'f';
+	const uint width = readPNMUInt(stream);
+	const uint height = readPNMUInt(stream);
+	
+	// decodes to 32-bit float RGB
+	if (!isImageSizeSupported(width, height, 12)) {
+		throw ImageCodecException();
+	}
+	
+	char token[32];
+	readPNMToken(stream, token, sizeof(token));
+	
+	// the sign of the scale gives the byte order, negative is little-endian
+	const float scale = (float)atof(token);
+	const bool swapBytes = (scale < 0) != isLittleEndianHost();
+	
+	const uint samples = width * (gray ? 1 : 3);
+	
+	image.setPixelDataFormat(PixelDataFormat::PDF_RGB, 32);
+	image.createEmpty(width, height);
+	
+	byte* buffer = image.getBuffer();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	
+	// rows are stored bottom-up
+	for (uint i = 0; i < height; i++) {
+		byte* row = buffer + (size_t)(height - 1 - i) * rowBytes;
+		
+		readBytes(stream, row, samples * sizeof(float));
+		
+		if (swapBytes) {
+			for (uint k = 0; k < samples; k++) {
+				byte* b = row + k * 4;
+				std::swap(b[0], b[3]);
+				std::swap(b[1], b[2]);
+			}
+		}
+		
+		if (gray) expandGrayRow((float*)row, width);
+	}
+}
+
+void writePFM(const Image& image, Stream& stream) {
+	const uint width = image.width(), height = image.height();
+	
+	if (width <= 0 || height <= 0 || (image.getBitDepth() != 8 && image.getBitDepth() != 32)) {
+		throw NotSupportImageCodecException();
+	}
+	
+	char header[64];
+	const int headerLength = snprintf(header, sizeof(header), "PF\n%u %u\n%s\n",
+																		width, height, isLittleEndianHost() ? "-1.0" : "1.0");
+	stream.write(header, headerLength);
+	
+	const PixelDataFormat format = image.getPixelDataFormat();
+	const uint components = image.getColorComponents();
+	const size_t rowBytes = image.getPixelRowByteLength();
+	const byte* buffer = image.getBuffer();
+	
+	// float RGB rows are written as they are, bottom-up
+	if (format == PixelDataFormat::PDF_RGB && image.getBitDepth() == 32) {
+		for (uint y = height; y-- > 0; ) {
+			stream.write(buffer + y * rowBytes, (uint)rowBytes);
+		}
+		return;
+	}
+	
+	const bool swap = isSwappedFormat(format);
+	std::vector<float> row(width * 3);
+	
+	for (uint y = height; y-- > 0; ) {
+		const byte* bp = buffer + y * rowBytes;
+		const float* fp = (const float*)bp;
+		
+		for (uint x = 0; x < width; x++) {
+			for (uint c = 0; c < 3; c++) {
+				const uint k = x * components + (swap ? 2 - c : c);
+				row[x * 3 + c] = image.getBitDepth() == 32 ? fp[k] : bp[k] / 255.0f;
+			}
+		}
+		
+		stream.write(row.data(), width * 3 * sizeof(float));
+	}
+}
+
+}
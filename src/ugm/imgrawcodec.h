@@ -0,0 +1,43 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef imgrawcodec_h
+#define imgrawcodec_h
+
+#include <stdio.h>
+
+#include "ucm/file.h"
+#include "image.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+// Uncompressed and run-length codecs, rows are read and written straight
+// from and into the image buffer. 8-bit images are decoded as RGB or RGBA,
+// PFM as 32-bit float RGB.
+
+// 24-bit and 32-bit uncompressed bitmaps
+void readBMP(Image& image, Stream& stream);
+void writeBMP(const Image& image, Stream& stream);
+
+// true color and grayscale targa, raw or run-length encoded
+void readTGA(Image& image, Stream& stream);
+void writeTGA(const Image& image, Stream& stream, const bool rle = false);
+
+// binary PPM (P6) and PGM (P5)
+void readPPM(Image& image, Stream& stream);
+void writePPM(const Image& image, Stream& stream);
+
+// float PFM, color (PF) and grayscale (Pf)
+void readPFM(Image& image, Stream& stream);
+void writePFM(const Image& image, Stream& stream);
+
+}
+
+#endif /* imgrawcodec_h */
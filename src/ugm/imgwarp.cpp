@@ -0,0 +1,272 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "imgwarp.h"
+#include "parallel.h"
+
+#include <stdint.h>
+
+// the AVX2 path is compiled for every x86 build and only taken when the CPU supports it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WARP_AVX2
+#define WARP_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define WARP_AVX2
+#define WARP_TARGET_AVX2
+#include <intrin.h>
+#endif
+
+#if defined(WARP_AVX2)
+#include <immintrin.h>
+#endif /* WARP_AVX2 */
+
+namespace ugm {
+namespace img {
+	
+	template<typename T, int C>
+	struct SourceImage {
+		const T* buffer;
+		int width, height;
+		
+		inline color4f texel(const int x, const int y) const {
+			return PixelAccessor<T, C>::read(this->buffer + ((size_t)y * this->width + x) * C);
+		}
+	};
+	
+	static inline void cubicWeights(const float t, float* w) {
+		// Catmull-Rom
+		w[0] = ((-0.5f * t + 1.0f) * t - 0.5f) * t;
+		w[1] = (1.5f * t - 2.5f) * t * t + 1.0f;
+		w[2] = ((-1.5f * t + 2.0f) * t + 0.5f) * t;
+		w[3] = (0.5f * t - 0.5f) * t * t;
+	}
+	
+	// fx, fy are continuous source coordinates, pixel centers are at .5
+	template<typename T, int C, int Filter>
+	static inline bool sample(const SourceImage<T, C>& s, const float fx, const float fy, color4f& out) {
+		if (!(fx >= 0 && fy >= 0 && fx < s.width && fy < s.height)) {
+			return false;
+		}
+		
+		if (Filter == SF_NEAREST) {
+			out = s.texel((int)fx, (int)fy);
+			return true;
+		}
+		
+		const float sx = fx - 0.5f, sy = fy - 0.5f;
+		const int x0 = (int)floorf(sx), y0 = (int)floorf(sy);
+		const float tx = sx - x0, ty = sy - y0;
+		
+		if (Filter == SF_BILINEAR) {
+			const int xa = std::max(x0, 0), xb = std::min(x0 + 1, s.width - 1);
+			const int ya = std::max(y0, 0), yb = std::min(y0 + 1, s.height - 1);
+			
+			const color4f c1 = s.texel(xa, ya) * (1.0f - tx) + s.texel(xb, ya) * tx;
+			const color4f c2 = s.texel(xa, yb) * (1.0f - tx) + s.texel(xb, yb) * tx;
+			out = c1 * (1.0f - ty) + c2 * ty;
+			return true;
+		}
+		
+		float wx[4], wy[4];
+		int xs[4];
+		cubicWeights(tx, wx);
+		cubicWeights(ty, wy);
+		
+		for (int i = 0; i < 4; i++) {
+			xs[i] = clamp(x0 - 1 + i, 0, s.width - 1);
+		}
+		
+		color4f sum(0.0f, 0.0f);
+		for (int j = 0; j < 4; j++) {
+			const int y = clamp(y0 - 1 + j, 0, s.height - 1);
+			color4f row(0.0f, 0.0f);
+			for (int i = 0; i < 4; i++) {
+				row += s.texel(xs[i], y) * wx[i];
+			}
+			sum += row * wy[j];
+		}
+		
+		out = sum;
+		return true;
+	}
+	
+#if defined(WARP_AVX2)
+	static bool detectAVX2() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		
+		// the OS must save the YMM registers
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false;
+		if ((_xgetbv(0) & 6) != 6) return false;
+		
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+	
+	static const bool hasAVX2 = detectAVX2();
+	
+	// nearest sampling of 4-byte pixels through an affine matrix, 8 pixels per gather,
+	// returns the number of pixels written
+	WARP_TARGET_AVX2 static int warpNearestRowAVX2(const uint32_t* src, const int srcWidth, const int srcHeight,
+																uint32_t* row, const int width, const float rx, const float ry,
+																const float dx, const float dy, const uint32_t border) {
+		const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 sw = _mm256_set1_ps((float)srcWidth), sh = _mm256_set1_ps((float)srcHeight);
+		const __m256i stride = _mm256_set1_epi32(srcWidth);
+		const __m256i fill = _mm256_set1_epi32((int)border);
+		
+		int x = 0;
+		for (; x + 8 <= width; x += 8) {
+			const __m256 xs = _mm256_add_ps(_mm256_set1_ps((float)x), lane);
+			const __m256 fx = _mm256_add_ps(_mm256_set1_ps(rx), _mm256_mul_ps(xs, _mm256_set1_ps(dx)));
+			const __m256 fy = _mm256_add_ps(_mm256_set1_ps(ry), _mm256_mul_ps(xs, _mm256_set1_ps(dy)));
+			
+			const __m256 valid = _mm256_and_ps(
+				_mm256_and_ps(_mm256_cmp_ps(fx, zero, _CMP_GE_OQ), _mm256_cmp_ps(fx, sw, _CMP_LT_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(fy, zero, _CMP_GE_OQ), _mm256_cmp_ps(fy, sh, _CMP_LT_OQ)));
+			
+			const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(fy), stride),
+																						 _mm256_cvttps_epi32(fx));
+			
+			const __m256i c = _mm256_mask_i32gather_epi32(fill, (const int*)src, index,
+																										_mm256_castps_si256(valid), 4);
+			_mm256_storeu_si256((__m256i*)(row + x), c);
+		}
+		
+		return x;
+	}
+#endif /* WARP_AVX2 */
+	
+	template<typename T, int C, int Filter, bool Perspective>
+	static void warpRows(const Image& src, Image& dest, const Matrix3& inv, const color4f& border,
+											 const int y0, const int y1) {
+		const SourceImage<T, C> s = { (const T*)src.getBuffer(), (int)src.width(), (int)src.height() };
+		const int width = dest.width();
+		
+		for (int y = y0; y < y1; y++) {
+			T* row = (T*)dest.getBuffer() + (size_t)y * width * C;
+			
+			// the matrix is linear along a row, step from the first pixel center
+			const float py = y + 0.5f;
+			const float rx = inv.a1 * 0.5f + inv.a2 * py + inv.a3;
+			const float ry = inv.b1 * 0.5f + inv.b2 * py + inv.b3;
+			const float rw = inv.c1 * 0.5f + inv.c2 * py + inv.c3;
+			
+			int x = 0;
+			
+#if defined(WARP_AVX2)
+			if (Filter == SF_NEAREST && !Perspective && C == 4 && sizeof(T) == 1 && hasAVX2) {
+				uint32_t packedBorder;
+				PixelAccessor<byte, 4>::write((byte*)&packedBorder, border);
+				x = warpNearestRowAVX2((const uint32_t*)s.buffer, s.width, s.height, (uint32_t*)row, width,
+															 rx, ry, inv.a1, inv.b1, packedBorder);
+			}
+#endif /* WARP_AVX2 */
+			
+			for (; x < width; x++) {
+				float fx = rx + inv.a1 * x, fy = ry + inv.b1 * x;
+				color4f c;
+				
+				if (Perspective) {
+					const float w = rw + inv.c1 * x;
+					
+					if (w <= 0) {
+						PixelAccessor<T, C>::write(row + x * C, border);
+						continue;
+					}
+					
+					fx /= w;
+					fy /= w;
+				}
+				
+				if (!sample<T, C, Filter>(s, fx, fy, c)) {
+					c = border;
+				}
+				
+				PixelAccessor<T, C>::write(row + x * C, c);
+			}
+		}
+	}
+	
+	template<typename T, int C>
+	static void warpImage(const Image& src, Image& dest, const Matrix3& inv, const bool perspective,
+												const SampleFilters filter, const color4f& border) {
+		parallelFor(0, dest.height(), [&](const int y0, const int y1) {
+			switch (filter) {
+				case SF_NEAREST:
+					if (perspective) warpRows<T, C, SF_NEAREST, true>(src, dest, inv, border, y0, y1);
+					else warpRows<T, C, SF_NEAREST, false>(src, dest, inv, border, y0, y1);
+					break;
+					
+				default:
+				case SF_BILINEAR:
+					if (perspective) warpRows<T, C, SF_BILINEAR, true>(src, dest, inv, border, y0, y1);
+					else warpRows<T, C, SF_BILINEAR, false>(src, dest, inv, border, y0, y1);
+					break;
+					
+				case SF_BICUBIC:
+					if (perspective) warpRows<T, C, SF_BICUBIC, true>(src, dest, inv, border, y0, y1);
+					else warpRows<T, C, SF_BICUBIC, false>(src, dest, inv, border, y0, y1);
+					break;
+			}
+		}, 8);
+	}
+	
+	static void warp(const Image& src, Image& dest, const Matrix3& matrix, const bool perspective,
+									 const SampleFilters filter, const color4f& border) {
+		if (&src == &dest) {
+			Image tmp;
+			Image::clone(src, tmp);
+			warp(tmp, dest, matrix, perspective, filter, border);
+			return;
+		}
+		
+		if (!matrix.canInverse()) {
+			throw ArgumentOutOfRangeException();
+		}
+		
+		Matrix3 inv = matrix;
+		inv.inverse();
+		
+		dest.setPixelDataFormat(src.getPixelDataFormat(), src.getBitDepth());
+		
+		if (dest.width() == 0 || dest.height() == 0 || dest.getBuffer() == NULL) {
+			dest.createEmpty(src.width(), src.height());
+		}
+		
+		if (src.getBuffer() == NULL || dest.getBuffer() == NULL) return;
+		
+		// pixels are accessed in memory order, the border color must be too
+		color4f fill = border;
+		const PixelDataFormat format = src.getPixelDataFormat();
+		if (format == PixelDataFormat::PDF_BGR || format == PixelDataFormat::PDF_BGRA) {
+			std::swap(fill.r, fill.b);
+		}
+		
+		DISPATCH_IMAGE_PIXEL_TYPE(src, warpImage, src, dest, inv, perspective, filter, fill);
+	}
+	
+	void warpAffine(const Image& src, Image& dest, const Matrix3& matrix,
+									const SampleFilters filter, const color4f& border) {
+		warp(src, dest, matrix, false, filter, border);
+	}
+	
+	void warpPerspective(const Image& src, Image& dest, const Matrix3& matrix,
+											 const SampleFilters filter, const color4f& border) {
+		warp(src, dest, matrix, true, filter, border);
+	}
+	
+}
+}
@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef imgwarp_h
+#define imgwarp_h
+
+#include <stdio.h>
+
+#include "image.h"
+#include "matrix.h"
+
+namespace ugm {
+
+namespace img {
+	enum SampleFilters {
+		SF_NEAREST,
+		SF_BILINEAR,
+		SF_BICUBIC,
+	};
+	
+	// Resample src into dest through matrix, which maps source pixel coordinates
+	// to destination pixel coordinates. dest takes the pixel format of src and keeps
+	// its size, or takes the size of src when it is empty. Destination pixels that
+	// map outside of src are filled by border.
+	void warpAffine(const Image& src, Image& dest, const Matrix3& matrix,
+									const SampleFilters filter = SF_BILINEAR,
+									const color4f& border = colors::transparent);
+	
+	// Same as warpAffine, but matrix is a homography and divided by w per pixel.
+	void warpPerspective(const Image& src, Image& dest, const Matrix3& matrix,
+											 const SampleFilters filter = SF_BILINEAR,
+											 const color4f& border = colors::transparent);
+}
+}
+
+#endif /* imgwarp_h */
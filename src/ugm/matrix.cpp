@@ -471,6 +471,41 @@ void Matrix3::transpose()
 	this->a3 = a3; this->b3 = b3;
 }
 
+float Matrix3::determinant() const
+{
+	return this->a1 * (this->b2 * this->c3 - this->b3 * this->c2)
+		- this->a2 * (this->b1 * this->c3 - this->b3 * this->c1)
+		+ this->a3 * (this->b1 * this->c2 - this->b2 * this->c1);
+}
+
+bool Matrix3::canInverse() const
+{
+	return (this->determinant() != 0);
+}
+
+void Matrix3::inverse()
+{
+	const float delta = this->determinant();
+	
+	if (delta == 0) return;
+	
+	const float detM = 1 / delta;
+	
+	const float m[] = {
+		(this->b2 * this->c3 - this->b3 * this->c2) * detM,
+		(this->b3 * this->c1 - this->b1 * this->c3) * detM,
+		(this->b1 * this->c2 - this->b2 * this->c1) * detM,
+		(this->a3 * this->c2 - this->a2 * this->c3) * detM,
+		(this->a1 * this->c3 - this->a3 * this->c1) * detM,
+		(this->a2 * this->c1 - this->a1 * this->c2) * detM,
+		(this->a2 * this->b3 - this->a3 * this->b2) * detM,
+		(this->a3 * this->b1 - this->a1 * this->b3) * detM,
+		(this->a1 * this->b2 - this->a2 * this->b1) * detM,
+	};
+	
+	memcpy(this->arr, m, sizeof(float) * 9);
+}
+
 Matrix3 Matrix3::operator*(const Matrix3& m2) const
 {
 	float m[] = {
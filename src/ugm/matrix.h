@@ -179,6 +179,10 @@ public:
 	void translate(const float x, const float y);
 	void transpose();
 	
+	float determinant() const;
+	bool canInverse() const;
+	void inverse();
+	
 	Matrix3 operator*(const Matrix3& m2) const;
 	vec3 operator*(const vec3& v) const;
 };
@@ -0,0 +1,250 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "memstream.h"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#endif /* _WIN32 */
+
+namespace ugm {
+
+MemoryOutputStream::MemoryOutputStream(const size_t capacity) {
+	this->reserve(capacity);
+}
+
+void MemoryOutputStream::reserve(const size_t capacity) {
+	if (capacity > this->buffer.size()) {
+		this->buffer.resize(capacity);
+	}
+}
+
+void MemoryOutputStream::grow(const size_t minimum) {
+	this->reserve(std::max(minimum, this->buffer.size() * 2));
+}
+
+byte* MemoryOutputStream::prepare(const size_t minimum, size_t* available) {
+	if (this->buffer.size() - this->position < minimum) {
+		this->grow(this->position + minimum);
+	}
+	
+	*available = this->buffer.size() - this->position;
+	return this->buffer.data() + this->position;
+}
+
+void MemoryOutputStream::commit(const size_t count) {
+	this->position += count;
+	this->length = std::max(this->length, this->position);
+}
+
+void MemoryOutputStream::swap(std::vector<byte>& bytes) {
+	// shrinking keeps the storage, growing back to the capacity does not allocate
+	this->buffer.resize(this->length);
+	this->buffer.swap(bytes);
+	this->buffer.resize(this->buffer.capacity());
+	
+	this->reset();
+}
+
+int MemoryOutputStream::read(void* buffer, uint length) {
+	const size_t count = std::min((size_t)length, this->length - this->position);
+	
+	memcpy(buffer, this->buffer.data() + this->position, count);
+	this->position += count;
+	
+	return (int)count;
+}
+
+size_t MemoryOutputStream::write(const void* buffer, size_t length) {
+	size_t available;
+	memcpy(this->prepare(length, &available), buffer, length);
+	this->commit(length);
+	
+	return length;
+}
+
+void MemoryOutputStream::setPosition(size_t position) {
+	this->position = std::min(position, this->length);
+}
+
+MappedFileStream::~MappedFileStream() {
+	this->close();
+}
+
+int MappedFileStream::read(void* buffer, uint length) {
+	const size_t count = std::min((size_t)length, this->length - this->position);
+	
+	memcpy(buffer, this->data + this->position, count);
+	this->position += count;
+	
+	return (int)count;
+}
+
+size_t MappedFileStream::write(const void* buffer, size_t length) {
+	throw StreamReadonlyException();
+}
+
+void MappedFileStream::setPosition(size_t position) {
+	this->position = std::min(position, this->length);
+}
+
+bool MappedFileStream::open(const string& path) {
+	this->close();
+	
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.getBuffer(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+														FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && (unsigned long long)size.QuadPart <= (size_t)-1) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	
+	CloseHandle(file);
+	if (mapping == NULL) return false;
+	
+	// the view keeps the file mapped after the handles are closed
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == NULL) return false;
+	
+	this->data = (const byte*)view;
+	this->length = (size_t)size.QuadPart;
+#else
+	const int fd = ::open(path.getBuffer(), O_RDONLY);
+	if (fd < 0) return false;
+	
+	struct stat status;
+	void* view = MAP_FAILED;
+	
+	if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+		view = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	
+	::close(fd);
+	if (view == MAP_FAILED) return false;
+	
+	madvise(view, (size_t)status.st_size, MADV_SEQUENTIAL);
+	
+	this->data = (const byte*)view;
+	this->length = (size_t)status.st_size;
+#endif /* _WIN32 */
+	
+	this->position = 0;
+	return true;
+}
+
+void MappedFileStream::close() {
+	if (this->data == NULL) return;
+	
+#if defined(_WIN32)
+	UnmapViewOfFile(this->data);
+#else
+	munmap((void*)this->data, this->length);
+#endif /* _WIN32 */
+	
+	this->data = NULL;
+	this->length = 0;
+	this->position = 0;
+}
+
+RandomAccessFile::~RandomAccessFile() {
+	this->close();
+}
+
+bool RandomAccessFile::open(const string& path) {
+	this->close();
+	
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.getBuffer(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+														FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	
+	LARGE_INTEGER size;
+	
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+	
+	this->handle = file;
+	this->length = (unsigned long long)size.QuadPart;
+#else
+	const int fd = ::open(path.getBuffer(), O_RDONLY);
+	if (fd < 0) return false;
+	
+	struct stat status;
+	
+	if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+		::close(fd);
+		return false;
+	}
+	
+	this->fd = fd;
+	this->length = (unsigned long long)status.st_size;
+#endif /* _WIN32 */
+	
+	return true;
+}
+
+void RandomAccessFile::close() {
+#if defined(_WIN32)
+	if (this->handle != NULL) CloseHandle(this->handle);
+	this->handle = NULL;
+#else
+	if (this->fd >= 0) ::close(this->fd);
+	this->fd = -1;
+#endif /* _WIN32 */
+	
+	this->length = 0;
+}
+
+bool RandomAccessFile::read(unsigned long long offset, void* buffer, size_t length) const {
+	byte* p = (byte*)buffer;
+	
+	while (length > 0) {
+#if defined(_WIN32)
+		// the offset of every call is its own, concurrent reads do not move each other
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		
+		DWORD count = 0;
+		if (!ReadFile(this->handle, p, (DWORD)std::min(length, (size_t)0x40000000), &count, &overlapped)
+				|| count == 0) return false;
+#else
+		const ssize_t count = pread(this->fd, p, length, (off_t)offset);
+		
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) return false;
+#endif /* _WIN32 */
+		
+		p += count;
+		offset += count;
+		length -= count;
+	}
+	
+	return true;
+}
+
+}
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef memstream_h
+#define memstream_h
+
+#include <stdio.h>
+#include <vector>
+#include <memory>
+
+#include "ucm/types.h"
+#include "ucm/string.h"
+#include "ucm/stream.h"
+#include "ucm/exception.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+// Growable in-memory output, e.g. to encode frames sent to another process. reset() keeps
+// the capacity, so encoding frames of the same size allocates only for the first one.
+class MemoryOutputStream : public Stream {
+private:
+	std::vector<byte> buffer;		// the whole capacity, [0, length) is written
+	size_t length = 0;
+	size_t position = 0;
+	
+	void grow(const size_t minimum);
+	
+public:
+	MemoryOutputStream(const size_t capacity = 0);
+	
+	void reserve(const size_t capacity);
+	inline void reset() { this->length = 0; this->position = 0; }
+	
+	inline const byte* getData() const { return this->buffer.data(); }
+	inline size_t getCapacity() const { return this->buffer.size(); }
+	
+	// Room for at least minimum bytes at the position, for encoders writing in place.
+	// Returns the first byte and the room available, commit(count) takes count bytes written there.
+	byte* prepare(const size_t minimum, size_t* available);
+	void commit(const size_t count);
+	
+	// Hand the written bytes over without copying, bytes receives exactly them and its
+	// previous storage becomes the capacity of this stream, e.g. the buffer of the last frame
+	void swap(std::vector<byte>& bytes);
+	
+	int read(void* buffer, uint length);
+	size_t write(const void* buffer, size_t length);
+	
+	size_t getLength() const { return this->length; }
+	size_t getPosition() const { return this->position; }
+	void setPosition(size_t position);
+	bool isEnd() const { return this->position >= this->length; }
+};
+
+// Whole file mapped read-only into memory, decoders take it as one span instead of
+// pulling chunks through read calls. Sequential access is advised so the system reads ahead.
+class MappedFileStream : public Stream {
+private:
+	const byte* data = NULL;
+	size_t length = 0;
+	size_t position = 0;
+	
+public:
+	MappedFileStream() { }
+	~MappedFileStream();
+	
+	// false when the file cannot be mapped, e.g. it is empty or not a regular file
+	bool open(const string& path);
+	void close();
+	
+	inline bool isOpened() const { return this->data != NULL; }
+	
+	// Bytes from the current position, decoders may consume them directly and then skip
+	inline const byte* getCurrent() const { return this->data + this->position; }
+	inline size_t getRemaining() const { return this->length - this->position; }
+	
+	int read(void* buffer, uint length);
+	size_t write(const void* buffer, size_t length);
+	
+	size_t getLength() const { return this->length; }
+	size_t getPosition() const { return this->position; }
+	void setPosition(size_t position);
+	bool isEnd() const { return this->position >= this->length; }
+};
+
+// File read at explicit offsets without a shared position, so any number of threads
+// may read from one opened file at once, e.g. tiles of a texture sampled in parallel.
+class RandomAccessFile {
+private:
+#if defined(_WIN32)
+	void* handle = NULL;
+#else
+	int fd = -1;
+#endif /* _WIN32 */
+	unsigned long long length = 0;
+	
+public:
+	RandomAccessFile() { }
+	~RandomAccessFile();
+	
+	// false when the file cannot be opened for reading
+	bool open(const string& path);
+	void close();
+	
+	inline unsigned long long getLength() const { return this->length; }
+	
+	// false when fewer than length bytes are there at offset
+	bool read(unsigned long long offset, void* buffer, size_t length) const;
+};
+
+}
+
+#endif /* memstream_h */
@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "parallel.h"
+
+#include <thread>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+
+namespace ugm {
+
+uint getConcurrency() {
+	const uint count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+void parallelFor(const int begin, const int end, const std::function<void(int, int)>& func,
+								 const int minRange) {
+	const int count = end - begin;
+	if (count <= 0) return;
+	
+	// a few ranges per thread, so that uneven rows are balanced across the workers
+	ThreadPool& pool = ThreadPool::shared();
+	const int maxRanges = (int)(pool.getThreadCount() + 1) * 4;
+	const int ranges = std::max(1, std::min(maxRanges, count / std::max(minRange, 1)));
+	
+	if (ranges == 1) {
+		func(begin, end);
+		return;
+	}
+	
+	parallelForOrdered(pool, (uint)ranges, [&](uint i) {
+		const int rb = begin + (int)((long long)count * i / ranges);
+		const int re = begin + (int)((long long)count * (i + 1) / ranges);
+		func(rb, re);
+	}, std::function<void(uint)>());
+}
+
+struct OrderedBlocks {
+	std::atomic<uint> next;
+	uint count;
+	const std::function<void(uint)>* process;
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::vector<char> done;
+	std::vector<std::exception_ptr> errors;
+	
+	OrderedBlocks(const uint count, const std::function<void(uint)>& process)
+	: next(0), count(count), process(&process), done(count, 0), errors(count) { }
+	
+	// claim and process the next index, false when every index is taken. process belongs to
+	// the caller, it is only used for a claimed index since the caller then still waits for it.
+	bool runNext() {
+		const uint i = this->next.fetch_add(1);
+		if (i >= this->count) return false;
+		
+		try {
+			(*this->process)(i);
+		} catch (...) {
+			this->errors[i] = std::current_exception();
+		}
+		
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->done[i] = 1;
+		}
+		
+		this->finished.notify_all();
+		return true;
+	}
+};
+
+void parallelForOrdered(ThreadPool& pool, const uint count, const std::function<void(uint)>& process,
+												const std::function<void(uint)>& consume) {
+	if (count == 0) return;
+	
+	// workers may start after this call returned, they only touch the shared state then
+	std::shared_ptr<OrderedBlocks> blocks = std::make_shared<OrderedBlocks>(count, process);
+	
+	const uint helpers = std::min(pool.getThreadCount(), count - 1);
+	for (uint i = 0; i < helpers; i++) {
+		pool.enqueue([blocks]() {
+			while (blocks->runNext()) { }
+		});
+	}
+	
+	std::exception_ptr error;
+	
+	for (uint i = 0; i < count; i++) {
+		for (;;) {
+			{
+				std::lock_guard<std::mutex> lock(blocks->mutex);
+				if (blocks->done[i]) break;
+			}
+			
+			// help while the index is pending, otherwise wait for the thread processing it
+			if (!blocks->runNext()) {
+				std::unique_lock<std::mutex> lock(blocks->mutex);
+				blocks->finished.wait(lock, [&blocks, i]() { return blocks->done[i] != 0; });
+				break;
+			}
+		}
+		
+		if (!error && blocks->errors[i]) error = blocks->errors[i];
+		
+		if (!error && consume) {
+			try {
+				consume(i);
+			} catch (...) {
+				error = std::current_exception();
+			}
+		}
+	}
+	
+	if (error) std::rethrow_exception(error);
+}
+
+ThreadPool::ThreadPool(const uint threads) {
+	const uint count = threads > 0 ? threads : getConcurrency();
+	
+	for (uint i = 0; i < count; i++) {
+		this->workers.push_back(std::thread(&ThreadPool::run, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	
+	this->available.notify_all();
+	
+	for (size_t i = 0; i < this->workers.size(); i++) {
+		this->workers[i].join();
+	}
+}
+
+void ThreadPool::run() {
+	for (;;) {
+		std::function<void()> task;
+		
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->available.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+			
+			// queued tasks still run when the pool is being destroyed
+			if (this->tasks.empty()) return;
+			
+			task = std::move(this->tasks.front());
+			this->tasks.pop();
+		}
+		
+		task();
+	}
+}
+
+std::future<void> ThreadPool::enqueue(const std::function<void()>& task) {
+	std::shared_ptr<std::packaged_task<void()> > packaged = std::make_shared<std::packaged_task<void()> >(task);
+	std::future<void> future = packaged->get_future();
+	
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->tasks.push([packaged]() { (*packaged)(); });
+	}
+	
+	this->available.notify_one();
+	return future;
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+}
@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef parallel_h
+#define parallel_h
+
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+
+#include "ucm/types.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+uint getConcurrency();
+
+// Split [begin, end) into contiguous ranges of at least minRange items and call
+// func(rangeBegin, rangeEnd) for each range on ThreadPool::shared() and the calling
+// thread. Returns after all ranges are done, an exception thrown by any range is
+// rethrown on the caller. Safe to call from a task of the shared pool.
+void parallelFor(const int begin, const int end, const std::function<void(int, int)>& func,
+								 const int minRange = 1);
+
+class ThreadPool;
+
+// Call process(i) for every i in [0, count) on the pool workers and the calling thread,
+// and consume(i) on the calling thread in index order as soon as i is processed. Indices
+// are claimed by whichever thread is free, so this also completes when called from a task
+// of the same pool. consume may be empty, the first exception is rethrown after all finish.
+void parallelForOrdered(ThreadPool& pool, const uint count, const std::function<void(uint)>& process,
+												const std::function<void(uint)>& consume);
+
+// Fixed set of worker threads running queued tasks in FIFO order.
+class ThreadPool {
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable available;
+	bool stopping = false;
+	
+	void run();
+	
+public:
+	// threads = 0 uses one worker per hardware thread
+	ThreadPool(const uint threads = 0);
+	~ThreadPool();
+	
+	inline uint getThreadCount() const { return (uint)this->workers.size(); }
+	
+	// The returned future becomes ready when task finished, and rethrows its exception on get()
+	std::future<void> enqueue(const std::function<void()>& task);
+	
+	// Pool shared by the library functions that take an optional ThreadPool
+	static ThreadPool& shared();
+};
+
+}
+
+#endif /* parallel_h */
@@ -0,0 +1,294 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "sampler.h"
+
+namespace ugm {
+
+template<typename T>
+struct MipmapTexel;
+
+template<>
+struct MipmapTexel<byte> {
+	static inline color4f read(const byte* p) { return PixelAccessor<byte, 4>::read(p); }
+	static inline byte fromSum(const float sum) { return (byte)(sum + 0.5f); }
+};
+
+template<>
+struct MipmapTexel<float> {
+	static inline color4f read(const float* p) { return PixelAccessor<float, 4>::read(p); }
+	static inline float fromSum(const float sum) { return sum; }
+};
+
+template<typename T, int C>
+static void convertToLevel(const Image& image, MipmapImage::Level& level) {
+	const T one = std::is_same<T, byte>::value ? (T)255 : (T)1;
+	const T* p = (const T*)image.getBuffer();
+	T* out = (T*)level.texels.data();
+	
+	for (size_t i = 0, count = (size_t)level.width * level.height; i < count; i++, p += C, out += 4) {
+		out[0] = p[0]; out[1] = p[1]; out[2] = p[2];
+		out[3] = C == 4 ? p[3] : one;
+	}
+}
+
+void MipmapImage::create(const Image& image, const bool mipmaps) {
+	this->levels.resize(1);
+	this->format = image.getBitDepth() == 8 ? MTF_RGBA8 : MTF_RGBA32F;
+	
+	Level& base = this->levels[0];
+	base.width = image.width();
+	base.height = image.height();
+	base.texels.resize((size_t)base.width * base.height * this->getTexelByteLength());
+	
+	if (image.getBuffer() == NULL || base.texels.empty()) {
+		this->levels.clear();
+		return;
+	}
+	
+	DISPATCH_IMAGE_PIXEL_TYPE(image, convertToLevel, image, base);
+	
+	if (mipmaps) {
+		this->generateMipmaps();
+	}
+}
+
+// Source texels of destination texel i along one axis and their weights
+struct MipmapTaps {
+	int count;
+	int index[3];
+	float weight[3];
+};
+
+static inline MipmapTaps getMipmapTaps(const int i, const int srcSize, const int destSize) {
+	MipmapTaps taps;
+	
+	if (srcSize == 1) {
+		taps.count = 1;
+		taps.index[0] = 0;
+		taps.weight[0] = 1.0f;
+	} else if ((srcSize & 1) == 0) {
+		taps.count = 2;
+		taps.index[0] = i * 2;
+		taps.index[1] = i * 2 + 1;
+		taps.weight[0] = taps.weight[1] = 0.5f;
+	} else {
+		// srcSize = 2 * destSize + 1, every destination texel covers 2 + 1 / destSize source texels
+		const float scale = 1.0f / (2 * destSize + 1);
+		taps.count = 3;
+		taps.index[0] = i * 2;
+		taps.index[1] = i * 2 + 1;
+		taps.index[2] = i * 2 + 2;
+		taps.weight[0] = (destSize - i) * scale;
+		taps.weight[1] = destSize * scale;
+		taps.weight[2] = (i + 1) * scale;
+	}
+	
+	return taps;
+}
+
+template<typename T>
+static void downsampleRow(const byte* src, const int srcWidth, const int srcHeight,
+													byte* dest, const int destWidth, const int destHeight, const int y) {
+	const MipmapTaps ty = getMipmapTaps(y, srcHeight, destHeight);
+	T* out = (T*)dest;
+	
+	for (int x = 0; x < destWidth; x++, out += 4) {
+		const MipmapTaps tx = getMipmapTaps(x, srcWidth, destWidth);
+		float sum[4] = { 0, 0, 0, 0 };
+		
+		for (int j = 0; j < ty.count; j++) {
+			const T* row = (const T*)src + (size_t)ty.index[j] * srcWidth * 4;
+			
+			for (int i = 0; i < tx.count; i++) {
+				const T* p = row + tx.index[i] * 4;
+				const float w = ty.weight[j] * tx.weight[i];
+				
+				sum[0] += p[0] * w; sum[1] += p[1] * w; sum[2] += p[2] * w; sum[3] += p[3] * w;
+			}
+		}
+		
+		for (int c = 0; c < 4; c++) {
+			out[c] = MipmapTexel<T>::fromSum(sum[c]);
+		}
+	}
+}
+
+void downsampleMipmapRow(const MipmapTexelFormat format, const byte* src, const int srcWidth, const int srcHeight,
+												 byte* dest, const int destWidth, const int destHeight, const int y) {
+	if (format == MTF_RGBA8) {
+		downsampleRow<byte>(src, srcWidth, srcHeight, dest, destWidth, destHeight, y);
+	} else {
+		downsampleRow<float>(src, srcWidth, srcHeight, dest, destWidth, destHeight, y);
+	}
+}
+
+void MipmapImage::generateMipmaps() {
+	if (this->levels.empty()) return;
+	
+	this->levels.resize(1);
+	
+	const size_t texelBytes = this->getTexelByteLength();
+	
+	while (this->levels.back().width > 1 || this->levels.back().height > 1) {
+		const Level& src = this->levels.back();
+		
+		Level dest;
+		dest.width = std::max(src.width / 2, 1);
+		dest.height = std::max(src.height / 2, 1);
+		dest.texels.resize((size_t)dest.width * dest.height * texelBytes);
+		
+		for (int y = 0; y < dest.height; y++) {
+			downsampleMipmapRow(this->format, src.texels.data(), src.width, src.height,
+													&dest.texels[(size_t)y * dest.width * texelBytes], dest.width, dest.height, y);
+		}
+		
+		this->levels.push_back(std::move(dest));
+	}
+}
+
+color4f MipmapImage::getTexel(const uint level, const int x, const int y) const {
+	const Level& l = this->levels[level];
+	const size_t index = ((size_t)y * l.width + x) * 4;
+	
+	if (this->format == MTF_RGBA8) {
+		return MipmapTexel<byte>::read(l.texels.data() + index);
+	} else {
+		return MipmapTexel<float>::read((const float*)l.texels.data() + index);
+	}
+}
+
+template<typename T, int WrapU, int WrapV>
+static inline color4f sampleNearest(const MipmapImage::Level& l, const float u, const float v) {
+	const int x = wrapCoord<WrapU>((int)floorf(clampTexelCoord(u * l.width)), l.width);
+	const int y = wrapCoord<WrapV>((int)floorf(clampTexelCoord(v * l.height)), l.height);
+	
+	return MipmapTexel<T>::read((const T*)l.texels.data() + ((size_t)y * l.width + x) * 4);
+}
+
+template<typename T, int WrapU, int WrapV>
+static inline color4f sampleBilinear(const MipmapImage::Level& l, const float u, const float v) {
+	const float fx = clampTexelCoord(u * l.width - 0.5f), fy = clampTexelCoord(v * l.height - 0.5f);
+	const float ix = floorf(fx), iy = floorf(fy);
+	const float tx = fx - ix, ty = fy - iy;
+	
+	const int x0 = wrapCoord<WrapU>((int)ix, l.width) * 4, x1 = wrapCoord<WrapU>((int)ix + 1, l.width) * 4;
+	const int y0 = wrapCoord<WrapV>((int)iy, l.height), y1 = wrapCoord<WrapV>((int)iy + 1, l.height);
+	
+	const T* r0 = (const T*)l.texels.data() + (size_t)y0 * l.width * 4;
+	const T* r1 = (const T*)l.texels.data() + (size_t)y1 * l.width * 4;
+	
+	const color4f c0 = MipmapTexel<T>::read(r0 + x0) * (1.0f - tx) + MipmapTexel<T>::read(r0 + x1) * tx;
+	const color4f c1 = MipmapTexel<T>::read(r1 + x0) * (1.0f - tx) + MipmapTexel<T>::read(r1 + x1) * tx;
+	
+	return c0 * (1.0f - ty) + c1 * ty;
+}
+
+// The filter is a template argument, so that sampling takes no branch on it
+template<typename T, int WrapU, int WrapV, int Filter>
+static color4f sampleLod(const MipmapImage& texture, const float u, const float v, const float lod) {
+	const int maxLevel = (int)texture.getLevelCount() - 1;
+	const float l = clampLod(lod, maxLevel);
+	
+	if (Filter == TFM_NEAREST) {
+		return sampleNearest<T, WrapU, WrapV>(texture.getLevel((int)(l + 0.5f)), u, v);
+	}
+	
+	if (Filter == TFM_BILINEAR) {
+		return sampleBilinear<T, WrapU, WrapV>(texture.getLevel((int)(l + 0.5f)), u, v);
+	}
+	
+	const int l0 = (int)l, l1 = std::min(l0 + 1, maxLevel);
+	const float t = l - l0;
+	
+	const color4f c0 = sampleBilinear<T, WrapU, WrapV>(texture.getLevel(l0), u, v);
+	const color4f c1 = sampleBilinear<T, WrapU, WrapV>(texture.getLevel(l1), u, v);
+	return c0 * (1.0f - t) + c1 * t;
+}
+
+static inline float lodFromGrad(const MipmapImage& texture, const vec2& dUVdx, const vec2& dUVdy, const float bias) {
+	const float w = (float)texture.width(), h = (float)texture.height();
+	
+	const float dx = (dUVdx.x * w) * (dUVdx.x * w) + (dUVdx.y * h) * (dUVdx.y * h);
+	const float dy = (dUVdy.x * w) * (dUVdy.x * w) + (dUVdy.y * h) * (dUVdy.y * h);
+	
+	// log2(sqrt(d)), a zero footprint gives -inf, clampLod takes it and NaN to level 0
+	return 0.5f * log2f(std::max(dx, dy)) + bias;
+}
+
+template<typename T, int WrapU, int WrapV, int Filter>
+static void sampleBatch(const MipmapImage& texture, const vec2* uvs, const vec2* dUVdx, const vec2* dUVdy,
+												const float lod, const float bias, color4f* results, const uint count) {
+	for (uint i = 0; i < count; i++) {
+		const float l = dUVdx != NULL ? lodFromGrad(texture, dUVdx[i], dUVdy[i], bias) : lod;
+		results[i] = sampleLod<T, WrapU, WrapV, Filter>(texture, uvs[i].x, uvs[i].y, l);
+	}
+}
+
+typedef color4f (*SampleLodFunc)(const MipmapImage&, const float, const float, const float);
+typedef void (*SampleBatchFunc)(const MipmapImage&, const vec2*, const vec2*, const vec2*,
+																const float, const float, color4f*, const uint);
+
+// [texel format][wrapU][wrapV][filter]
+#define SAMPLER_FILTERS(func, T, U, V) \
+	{ func<T, U, V, TFM_NEAREST>, func<T, U, V, TFM_BILINEAR>, func<T, U, V, TFM_TRILINEAR> }
+#define SAMPLER_WRAP_V(func, T, U) \
+	{ SAMPLER_FILTERS(func, T, U, TWM_REPEAT), SAMPLER_FILTERS(func, T, U, TWM_CLAMP), SAMPLER_FILTERS(func, T, U, TWM_MIRROR) }
+#define SAMPLER_WRAP_U(func, T) \
+	{ SAMPLER_WRAP_V(func, T, TWM_REPEAT), SAMPLER_WRAP_V(func, T, TWM_CLAMP), SAMPLER_WRAP_V(func, T, TWM_MIRROR) }
+
+static const SampleLodFunc sampleLodFuncs[2][3][3][3] = {
+	SAMPLER_WRAP_U(sampleLod, byte), SAMPLER_WRAP_U(sampleLod, float),
+};
+
+static const SampleBatchFunc sampleBatchFuncs[2][3][3][3] = {
+	SAMPLER_WRAP_U(sampleBatch, byte), SAMPLER_WRAP_U(sampleBatch, float),
+};
+
+float Sampler::calcLod(const MipmapImage& texture, const vec2& dUVdx, const vec2& dUVdy) const {
+	return lodFromGrad(texture, dUVdx, dUVdy, this->lodBias);
+}
+
+color4f Sampler::sample(const MipmapImage& texture, const vec2& uv, const float lod) const {
+	if (texture.getLevelCount() == 0) return colors::transparent;
+	
+	return sampleLodFuncs[texture.getTexelFormat()][this->wrapU][this->wrapV][this->filter](
+		texture, uv.x, uv.y, lod + this->lodBias);
+}
+
+color4f Sampler::sampleGrad(const MipmapImage& texture, const vec2& uv,
+														const vec2& dUVdx, const vec2& dUVdy) const {
+	if (texture.getLevelCount() == 0) return colors::transparent;
+	
+	return sampleLodFuncs[texture.getTexelFormat()][this->wrapU][this->wrapV][this->filter](
+		texture, uv.x, uv.y, this->calcLod(texture, dUVdx, dUVdy));
+}
+
+void Sampler::sample(const MipmapImage& texture, const vec2* uvs, color4f* results,
+										 const uint count, const float lod) const {
+	if (texture.getLevelCount() == 0) {
+		std::fill(results, results + count, colors::transparent);
+		return;
+	}
+	
+	sampleBatchFuncs[texture.getTexelFormat()][this->wrapU][this->wrapV][this->filter](
+		texture, uvs, NULL, NULL, lod + this->lodBias, this->lodBias, results, count);
+}
+
+void Sampler::sampleGrad(const MipmapImage& texture, const vec2* uvs, const vec2* dUVdx, const vec2* dUVdy,
+												 color4f* results, const uint count) const {
+	if (texture.getLevelCount() == 0) {
+		std::fill(results, results + count, colors::transparent);
+		return;
+	}
+	
+	sampleBatchFuncs[texture.getTexelFormat()][this->wrapU][this->wrapV][this->filter](
+		texture, uvs, dUVdx, dUVdy, 0.0f, this->lodBias, results, count);
+}
+
+}
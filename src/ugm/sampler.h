@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef sampler_h
+#define sampler_h
+
+#include <vector>
+
+#include "image.h"
+#include "vector.h"
+
+namespace ugm {
+
+enum TextureWrapMode {
+	TWM_REPEAT,
+	TWM_CLAMP,
+	TWM_MIRROR,
+};
+
+enum TextureFilterMode {
+	TFM_NEAREST,
+	TFM_BILINEAR,
+	TFM_TRILINEAR,
+};
+
+// Texel index i wrapped into [0, size) by a TextureWrapMode
+template<int Mode>
+inline int wrapCoord(const int i, const int size);
+
+template<>
+inline int wrapCoord<TWM_REPEAT>(const int i, const int size) {
+	const int m = i % size;
+	return m + (m < 0 ? size : 0);
+}
+
+template<>
+inline int wrapCoord<TWM_CLAMP>(const int i, const int size) {
+	return std::min(std::max(i, 0), size - 1);
+}
+
+template<>
+inline int wrapCoord<TWM_MIRROR>(const int i, const int size) {
+	const int period = size * 2;
+	int m = i % period;
+	m += (m < 0 ? period : 0);
+	return m < size ? m : period - 1 - m;
+}
+
+// Texel coordinate limited to where the int conversion of its floor, and of the next
+// texel for bilinear filtering, is defined. NaN gives 0.
+inline float clampTexelCoord(const float x) {
+	return x >= -1073741824.0f ? std::min(x, 1073741824.0f) : (x < 0 ? -1073741824.0f : 0.0f);
+}
+
+// lod clamped to the mip levels [0, maxLevel], NaN gives 0
+inline float clampLod(const float lod, const int maxLevel) {
+	return lod > 0 ? std::min(lod, (float)maxLevel) : 0.0f;
+}
+
+// Texels of the mip levels, 8-bit images keep 8-bit RGBA, float images float RGBA
+enum MipmapTexelFormat {
+	MTF_RGBA8,
+	MTF_RGBA32F,
+};
+
+// RGBA copy of an image and its box-filtered mip levels. Pixels are converted to
+// RGBA once here, so that sampling reads every texel the same way.
+class MipmapImage {
+public:
+	struct Level {
+		int width = 0, height = 0;
+		std::vector<byte> texels;		// rows of RGBA texels in the texel format
+	};
+	
+private:
+	MipmapTexelFormat format = MTF_RGBA8;
+	std::vector<Level> levels;
+	
+public:
+	MipmapImage() { }
+	MipmapImage(const Image& image, const bool mipmaps = true) {
+		this->create(image, mipmaps);
+	}
+	
+	void create(const Image& image, const bool mipmaps = true);
+	void generateMipmaps();
+	
+	inline MipmapTexelFormat getTexelFormat() const { return this->format; }
+	inline uint getTexelByteLength() const { return this->format == MTF_RGBA8 ? 4 : 16; }
+	inline uint getLevelCount() const { return (uint)this->levels.size(); }
+	inline const Level& getLevel(const uint level) const { return this->levels[level]; }
+	
+	color4f getTexel(const uint level, const int x, const int y) const;
+	
+	inline int width() const { return this->levels.empty() ? 0 : this->levels[0].width; }
+	inline int height() const { return this->levels.empty() ? 0 : this->levels[0].height; }
+};
+
+// Box filter row y of the next mip level, destWidth and destHeight are half the source
+// size rounded down and at least 1. Odd source sizes are filtered with 3 weighted taps,
+// so the last row and column count as much as the others. 8-bit texels are rounded.
+void downsampleMipmapRow(const MipmapTexelFormat format, const byte* src, const int srcWidth, const int srcHeight,
+												 byte* dest, const int destWidth, const int destHeight, const int y);
+
+class Sampler {
+public:
+	TextureWrapMode wrapU = TWM_REPEAT;
+	TextureWrapMode wrapV = TWM_REPEAT;
+	TextureFilterMode filter = TFM_BILINEAR;
+	float lodBias = 0.0f;
+	
+	Sampler(const TextureWrapMode wrap = TWM_REPEAT, const TextureFilterMode filter = TFM_BILINEAR)
+	: wrapU(wrap), wrapV(wrap), filter(filter) { }
+	
+	// Mip level covering the screen-space UV derivatives, including lodBias
+	float calcLod(const MipmapImage& texture, const vec2& dUVdx, const vec2& dUVdy) const;
+	
+	color4f sample(const MipmapImage& texture, const vec2& uv, const float lod = 0.0f) const;
+	color4f sampleGrad(const MipmapImage& texture, const vec2& uv,
+										 const vec2& dUVdx, const vec2& dUVdy) const;
+	
+	// Batch versions, the texel format, wrap and filter modes are resolved once per call
+	void sample(const MipmapImage& texture, const vec2* uvs, color4f* results,
+							const uint count, const float lod = 0.0f) const;
+	void sampleGrad(const MipmapImage& texture, const vec2* uvs, const vec2* dUVdx, const vec2* dUVdy,
+									color4f* results, const uint count) const;
+};
+
+}
+
+#endif /* sampler_h */
@@ -0,0 +1,544 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "texcache.h"
+#include "byteorder.h"
+
+#include <cmath>
+#include <type_traits>
+#include "zlib.h"
+
+namespace ugm {
+
+// magic, version, width, height, tile size, level count, texel format and a reserved word,
+// followed by the tiles, the tile table and the offset of the table as the last 8 bytes
+#define TILED_TEXTURE_VERSION 1
+#define TILED_TEXTURE_HEADER_SIZE 32
+#define TILED_TEXTURE_RECORD_SIZE 16
+#define TILED_TEXTURE_MAX_TILE_SIZE 4096
+
+#define TILE_RECORD_COMPRESSED 0x1
+
+// Tiles are indexed in 32 bits, false when the levels hold more tiles than that
+static bool calcLevels(const uint width, const uint height, const uint tileShift,
+											 std::vector<TiledTexture::Level>& levels) {
+	const unsigned long long tileMask = (1ull << tileShift) - 1;
+	unsigned long long firstTile = 0;
+	uint w = width, h = height;
+	
+	for (;;) {
+		TiledTexture::Level level;
+		level.width = w;
+		level.height = h;
+		level.tilesX = (uint)((w + tileMask) >> tileShift);
+		level.tilesY = (uint)((h + tileMask) >> tileShift);
+		level.firstTile = (uint)firstTile;
+		levels.push_back(level);
+		
+		firstTile += (unsigned long long)level.tilesX * level.tilesY;
+		if (firstTile > 0xffffffffull) return false;
+		
+		if (w == 1 && h == 1) break;
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+	}
+	
+	return true;
+}
+
+template<typename T, int C>
+static void convertToRGBA(const Image& image, std::vector<byte>& level) {
+	const T one = std::is_same<T, byte>::value ? (T)255 : (T)1;
+	const T* p = (const T*)image.getBuffer();
+	T* out = (T*)level.data();
+	
+	for (size_t i = 0, count = (size_t)image.width() * image.height(); i < count; i++, p += C, out += 4) {
+		out[0] = p[0]; out[1] = p[1]; out[2] = p[2];
+		out[3] = C == 4 ? p[3] : one;
+	}
+}
+
+struct EncodedTile {
+	std::vector<byte> data;
+	bool compressed;
+};
+
+static void encodeTile(const std::vector<byte>& texels, const TiledTexture::Level& level, const uint tileX, const uint tileY,
+											 const uint tileSize, const uint texelBytes, const bool compress, EncodedTile& tile) {
+	std::vector<byte> raw((size_t)tileSize * tileSize * texelBytes);
+	const size_t rowBytes = (size_t)tileSize * texelBytes;
+	
+	for (uint y = 0; y < tileSize; y++) {
+		const uint sy = std::min(tileY * tileSize + y, level.height - 1);
+		const byte* row = texels.data() + (size_t)sy * level.width * texelBytes;
+		byte* out = raw.data() + y * rowBytes;
+		
+		const uint startX = tileX * tileSize;
+		const uint copyWidth = std::min(tileSize, level.width - startX);
+		memcpy(out, row + (size_t)startX * texelBytes, (size_t)copyWidth * texelBytes);
+		
+		// repeat the last column
+		for (uint x = copyWidth; x < tileSize; x++) {
+			memcpy(out + x * texelBytes, row + (size_t)(level.width - 1) * texelBytes, texelBytes);
+		}
+	}
+	
+	tile.compressed = false;
+	
+	if (compress) {
+		uLongf length = compressBound((uLong)raw.size());
+		tile.data.resize(length);
+		
+		if (compress2(tile.data.data(), &length, raw.data(), (uLong)raw.size(), Z_DEFAULT_COMPRESSION) == Z_OK
+				&& length < raw.size()) {
+			tile.data.resize(length);
+			tile.compressed = true;
+			return;
+		}
+	}
+	
+	tile.data.swap(raw);
+}
+
+void writeTiledTexture(const Image& image, Stream& stream, const TiledTextureOptions& options, ThreadPool* pool) {
+	if (image.getBuffer() == NULL || image.width() == 0 || image.height() == 0) {
+		throw NotSupportImageCodecException();
+	}
+	
+	const uint tileSize = options.tileSize;
+	
+	if (tileSize < 4 || tileSize > TILED_TEXTURE_MAX_TILE_SIZE || (tileSize & (tileSize - 1)) != 0) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	uint tileShift = 0;
+	while ((1u << tileShift) < tileSize) tileShift++;
+	
+	const TileTexelFormat format = image.getBitDepth() == 8 ? TTF_RGBA8 : TTF_RGBA32F;
+	const MipmapTexelFormat mipmapFormat = format == TTF_RGBA8 ? MTF_RGBA8 : MTF_RGBA32F;
+	const uint texelBytes = format == TTF_RGBA8 ? 4 : 16;
+	
+	std::vector<TiledTexture::Level> levels;
+	
+	if (!calcLevels(image.width(), image.height(), tileShift, levels)) {
+		throw ArgumentOutOfRangeException();
+	}
+	
+	byte header[TILED_TEXTURE_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	
+	memcpy(header, "UGMT", 4);
+	writeLE32(header + 4, TILED_TEXTURE_VERSION);
+	writeLE32(header + 8, image.width());
+	writeLE32(header + 12, image.height());
+	writeLE32(header + 16, tileSize);
+	writeLE32(header + 20, (uint)levels.size());
+	writeLE32(header + 24, (uint)format);
+	
+	stream.write(header, TILED_TEXTURE_HEADER_SIZE);
+	
+	const uint tileCount = levels.back().firstTile + levels.back().tilesX * levels.back().tilesY;
+	std::vector<byte> table((size_t)tileCount * TILED_TEXTURE_RECORD_SIZE);
+	unsigned long long offset = TILED_TEXTURE_HEADER_SIZE;
+	
+	std::vector<byte> current((size_t)image.width() * image.height() * texelBytes), next;
+	DISPATCH_IMAGE_PIXEL_TYPE(image, convertToRGBA, image, current);
+	
+	ThreadPool& threads = pool != NULL ? *pool : ThreadPool::shared();
+	
+	for (size_t l = 0; l < levels.size(); l++) {
+		const TiledTexture::Level& level = levels[l];
+		std::vector<EncodedTile> tiles(level.tilesX * level.tilesY);
+		
+		parallelForOrdered(threads, (uint)tiles.size(), [&](uint i) {
+			encodeTile(current, level, i % level.tilesX, i / level.tilesX, tileSize, texelBytes, options.compress, tiles[i]);
+		}, [&](uint i) {
+			byte* record = table.data() + (size_t)(level.firstTile + i) * TILED_TEXTURE_RECORD_SIZE;
+			writeLE64(record, offset);
+			writeLE32(record + 8, (uint)tiles[i].data.size());
+			writeLE32(record + 12, tiles[i].compressed ? TILE_RECORD_COMPRESSED : 0);
+			
+			stream.write(tiles[i].data.data(), tiles[i].data.size());
+			offset += tiles[i].data.size();
+			
+			std::vector<byte>().swap(tiles[i].data);
+		});
+		
+		if (l + 1 < levels.size()) {
+			const TiledTexture::Level& nextLevel = levels[l + 1];
+			next.resize((size_t)nextLevel.width * nextLevel.height * texelBytes);
+			
+			parallelForOrdered(threads, nextLevel.height, [&](uint y) {
+				downsampleMipmapRow(mipmapFormat, current.data(), level.width, level.height,
+														&next[(size_t)y * nextLevel.width * texelBytes], nextLevel.width, nextLevel.height, y);
+			}, std::function<void(uint)>());
+			
+			current.swap(next);
+		}
+	}
+	
+	stream.write(table.data(), table.size());
+	
+	byte footer[8];
+	writeLE64(footer, offset);
+	stream.write(footer, sizeof(footer));
+}
+
+void writeTiledTexture(const Image& image, const string& path, const TiledTextureOptions& options, ThreadPool* pool) {
+	FileStream fs(path);
+	fs.openWrite();
+	writeTiledTexture(image, fs, options, pool);
+	fs.close();
+}
+
+TiledTexture::TiledTexture(const uint id, const string& path) : id(id) {
+	if (!this->file.open(path)) {
+		throw ImageCodecException();
+	}
+	
+	byte header[TILED_TEXTURE_HEADER_SIZE];
+	
+	if (!this->file.read(0, header, TILED_TEXTURE_HEADER_SIZE)
+			|| memcmp(header, "UGMT", 4) != 0 || readLE32(header + 4) != TILED_TEXTURE_VERSION) {
+		throw ImageCodecException();
+	}
+	
+	const uint width = readLE32(header + 8), height = readLE32(header + 12);
+	this->tileSize = readLE32(header + 16);
+	this->format = (TileTexelFormat)readLE32(header + 24);
+	
+	// sides an Image can have, as written by writeTiledTexture
+	if (width == 0 || height == 0 || width > 0x7fffffff || height > 0x7fffffff
+			|| this->tileSize < 4 || this->tileSize > TILED_TEXTURE_MAX_TILE_SIZE
+			|| (this->tileSize & (this->tileSize - 1)) != 0 || this->format > TTF_RGBA32F) {
+		throw ImageCodecException();
+	}
+	
+	this->tileShift = 0;
+	while ((1u << this->tileShift) < this->tileSize) this->tileShift++;
+	
+	if (!calcLevels(width, height, this->tileShift, this->levels) || readLE32(header + 20) != this->levels.size()) {
+		throw ImageCodecException();
+	}
+	
+	const Level& last = this->levels.back();
+	const size_t tileCount = (size_t)last.firstTile + (size_t)last.tilesX * last.tilesY;
+	const size_t tableLength = tileCount * TILED_TEXTURE_RECORD_SIZE;
+	const unsigned long long fileLength = this->file.getLength();
+	
+	if (fileLength < TILED_TEXTURE_HEADER_SIZE + tableLength + 8) {
+		throw ImageCodecException();
+	}
+	
+	byte footer[8];
+	
+	if (!this->file.read(fileLength - 8, footer, 8) || readLE64(footer) != fileLength - 8 - tableLength) {
+		throw ImageCodecException();
+	}
+	
+	std::vector<byte> table(tableLength);
+	
+	if (!this->file.read(fileLength - 8 - tableLength, table.data(), tableLength)) {
+		throw ImageCodecException();
+	}
+	
+	const unsigned long long tilesEnd = fileLength - 8 - tableLength;
+	this->tiles.resize(tileCount);
+	
+	for (size_t i = 0; i < tileCount; i++) {
+		const byte* record = table.data() + i * TILED_TEXTURE_RECORD_SIZE;
+		TileRecord& tile = this->tiles[i];
+		
+		tile.offset = readLE64(record);
+		tile.length = readLE32(record + 8);
+		tile.compressed = (readLE32(record + 12) & TILE_RECORD_COMPRESSED) != 0;
+		
+		if (tile.offset < TILED_TEXTURE_HEADER_SIZE || tile.offset + tile.length > tilesEnd
+				|| (!tile.compressed && tile.length != this->getTileByteLength())) {
+			throw ImageCodecException();
+		}
+	}
+}
+
+void TiledTexture::readTile(const uint index, byte* texels) {
+	const TileRecord& tile = this->tiles[index];
+	std::vector<byte> compressed;
+	byte* target = texels;
+	
+	if (tile.compressed) {
+		compressed.resize(tile.length);
+		target = compressed.data();
+	}
+	
+	if (!this->file.read(tile.offset, target, tile.length)) {
+		throw ImageCodecException();
+	}
+	
+	if (tile.compressed) {
+		uLongf length = (uLongf)this->getTileByteLength();
+		
+		if (uncompress(texels, &length, compressed.data(), tile.length) != Z_OK
+				|| length != this->getTileByteLength()) {
+			throw ImageCodecException();
+		}
+	}
+}
+
+TextureTileCache::TextureTileCache(const size_t budget) : budget(budget), usedBytes(0) {
+}
+
+TiledTexture* TextureTileCache::openTexture(const string& path) {
+	std::lock_guard<std::mutex> lock(this->textureMutex);
+	
+	std::unique_ptr<TiledTexture>& texture = this->textures[std::string(path.getBuffer())];
+	
+	if (!texture) {
+		try {
+			texture.reset(new TiledTexture(this->nextTextureId, path));
+		} catch (...) {
+			this->textures.erase(std::string(path.getBuffer()));
+			throw;
+		}
+		
+		this->nextTextureId++;
+	}
+	
+	return texture.get();
+}
+
+static inline uint getTileHash(const unsigned long long key) {
+	return (uint)((key * 0x9E3779B97F4A7C15ull) >> 40);
+}
+
+std::shared_ptr<const TextureTileCache::Tile> TextureTileCache::acquire(TiledTexture& texture,
+																																				const unsigned long long key, const uint tile) {
+	const uint shardIndex = getTileHash(key) % SHARD_COUNT;
+	Shard& shard = this->shards[shardIndex];
+	
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		
+		std::unordered_map<unsigned long long, Entry>::iterator it = shard.entries.find(key);
+		
+		if (it != shard.entries.end()) {
+			it->second.referenced = true;
+			return it->second.tile;
+		}
+	}
+	
+	// read without the lock, a tile loaded by two threads at once is kept once
+	std::shared_ptr<Tile> loaded = std::make_shared<Tile>();
+	loaded->texels.resize(texture.getTileByteLength());
+	texture.readTile(tile, loaded->texels.data());
+	
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.loads++;
+		
+		Entry entry = { loaded, true };
+		std::pair<std::unordered_map<unsigned long long, Entry>::iterator, bool> inserted = shard.entries.insert(std::make_pair(key, entry));
+		
+		if (!inserted.second) {
+			inserted.first->second.referenced = true;
+			return inserted.first->second.tile;
+		}
+		
+		shard.clock.push_back(key);
+		this->usedBytes += loaded->texels.size();
+		
+		// the shard is locked already, most inserts are balanced by one of its own tiles
+		if (this->evict(shard)) return loaded;
+	}
+	
+	this->evictShards(shardIndex + 1);
+	
+	return loaded;
+}
+
+// Evict tiles of shard while the cache is over the budget, true when it is within the budget
+bool TextureTileCache::evict(Shard& shard) {
+	while (this->usedBytes > this->budget && !shard.clock.empty()) {
+		if (shard.hand >= shard.clock.size()) shard.hand = 0;
+		
+		std::unordered_map<unsigned long long, Entry>::iterator it = shard.entries.find(shard.clock[shard.hand]);
+		
+		// second chance for tiles used since the hand passed
+		if (it->second.referenced) {
+			it->second.referenced = false;
+			shard.hand++;
+			continue;
+		}
+		
+		this->usedBytes -= it->second.tile->texels.size();
+		shard.entries.erase(it);
+		
+		shard.clock[shard.hand] = shard.clock.back();
+		shard.clock.pop_back();
+	}
+	
+	return this->usedBytes <= this->budget;
+}
+
+// Evict from the shards in turn starting at first, one lock at a time
+void TextureTileCache::evictShards(const uint first) {
+	for (uint i = 0; i < SHARD_COUNT; i++) {
+		Shard& shard = this->shards[(first + i) % SHARD_COUNT];
+		
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if (this->evict(shard)) break;
+	}
+}
+
+const TextureTileCache::Tile& TextureTileCache::ThreadCache::getTile(TiledTexture& texture, const uint level,
+																																		 const uint tileX, const uint tileY) {
+	const TiledTexture::Level& l = texture.levels[level];
+	const uint tile = l.firstTile + tileY * l.tilesX + tileX;
+	const unsigned long long key = ((unsigned long long)texture.id << 32) | tile;
+	
+	Slot& slot = this->slots[getTileHash(key) % SLOT_COUNT];
+	
+	if (slot.key != key) {
+		slot.tile = this->cache.acquire(texture, key, tile);
+		slot.key = key;
+	}
+	
+	return *slot.tile;
+}
+
+void TextureTileCache::ThreadCache::clear() {
+	for (uint i = 0; i < SLOT_COUNT; i++) {
+		this->slots[i].key = ~0ull;
+		this->slots[i].tile.reset();
+	}
+}
+
+static inline color4f fetchTexel(TextureTileCache::ThreadCache& thread, TiledTexture& texture,
+																 const uint level, const uint x, const uint y) {
+	const uint shift = texture.getTileShift(), mask = texture.getTileSize() - 1;
+	const TextureTileCache::Tile& tile = thread.getTile(texture, level, x >> shift, y >> shift);
+	const size_t index = ((size_t)(y & mask) << shift) + (x & mask);
+	
+	if (texture.getTexelFormat() == TTF_RGBA8) {
+		return PixelAccessor<byte, 4>::read(tile.texels.data() + index * 4);
+	} else {
+		return PixelAccessor<float, 4>::read((const float*)tile.texels.data() + index * 4);
+	}
+}
+
+color4f TextureTileCache::getTexel(ThreadCache& thread, TiledTexture& texture, const uint level, const uint x, const uint y) {
+	return fetchTexel(thread, texture, level, x, y);
+}
+
+template<int WrapU, int WrapV>
+static inline color4f sampleTiledNearest(TextureTileCache::ThreadCache& thread, TiledTexture& texture,
+																				 const uint level, const float u, const float v) {
+	const TiledTexture::Level& l = texture.getLevel(level);
+	const int x = wrapCoord<WrapU>((int)floorf(clampTexelCoord(u * l.width)), l.width);
+	const int y = wrapCoord<WrapV>((int)floorf(clampTexelCoord(v * l.height)), l.height);
+	
+	return fetchTexel(thread, texture, level, x, y);
+}
+
+template<int WrapU, int WrapV>
+static inline color4f sampleTiledBilinear(TextureTileCache::ThreadCache& thread, TiledTexture& texture,
+																					const uint level, const float u, const float v) {
+	const TiledTexture::Level& l = texture.getLevel(level);
+	const float fx = clampTexelCoord(u * l.width - 0.5f), fy = clampTexelCoord(v * l.height - 0.5f);
+	const float ix = floorf(fx), iy = floorf(fy);
+	const float tx = fx - ix, ty = fy - iy;
+	
+	const int x0 = wrapCoord<WrapU>((int)ix, l.width), x1 = wrapCoord<WrapU>((int)ix + 1, l.width);
+	const int y0 = wrapCoord<WrapV>((int)iy, l.height), y1 = wrapCoord<WrapV>((int)iy + 1, l.height);
+	
+	const color4f c0 = fetchTexel(thread, texture, level, x0, y0) * (1.0f - tx) + fetchTexel(thread, texture, level, x1, y0) * tx;
+	const color4f c1 = fetchTexel(thread, texture, level, x0, y1) * (1.0f - tx) + fetchTexel(thread, texture, level, x1, y1) * tx;
+	
+	return c0 * (1.0f - ty) + c1 * ty;
+}
+
+template<int WrapU, int WrapV>
+static color4f sampleTiledLod(TextureTileCache::ThreadCache& thread, TiledTexture& texture,
+															const TextureFilterMode filter, const float u, const float v, const float lod) {
+	const int maxLevel = (int)texture.getLevelCount() - 1;
+	const float l = clampLod(lod, maxLevel);
+	
+	switch (filter) {
+		case TFM_NEAREST:
+			return sampleTiledNearest<WrapU, WrapV>(thread, texture, (int)(l + 0.5f), u, v);
+		
+		default:
+		case TFM_BILINEAR:
+			return sampleTiledBilinear<WrapU, WrapV>(thread, texture, (int)(l + 0.5f), u, v);
+		
+		case TFM_TRILINEAR:
+		{
+			const int l0 = (int)l, l1 = std::min(l0 + 1, maxLevel);
+			const float t = l - l0;
+			
+			const color4f c0 = sampleTiledBilinear<WrapU, WrapV>(thread, texture, l0, u, v);
+			if (t <= 0) return c0;
+			
+			const color4f c1 = sampleTiledBilinear<WrapU, WrapV>(thread, texture, l1, u, v);
+			return c0 * (1.0f - t) + c1 * t;
+		}
+	}
+}
+
+typedef color4f (*SampleTiledLodFunc)(TextureTileCache::ThreadCache&, TiledTexture&, const TextureFilterMode,
+																			const float, const float, const float);
+
+static const SampleTiledLodFunc sampleTiledLodFuncs[3][3] = {
+	{ sampleTiledLod<TWM_REPEAT, TWM_REPEAT>, sampleTiledLod<TWM_REPEAT, TWM_CLAMP>, sampleTiledLod<TWM_REPEAT, TWM_MIRROR> },
+	{ sampleTiledLod<TWM_CLAMP, TWM_REPEAT>, sampleTiledLod<TWM_CLAMP, TWM_CLAMP>, sampleTiledLod<TWM_CLAMP, TWM_MIRROR> },
+	{ sampleTiledLod<TWM_MIRROR, TWM_REPEAT>, sampleTiledLod<TWM_MIRROR, TWM_CLAMP>, sampleTiledLod<TWM_MIRROR, TWM_MIRROR> },
+};
+
+color4f TextureTileCache::sample(ThreadCache& thread, TiledTexture& texture, const Sampler& sampler,
+																 const vec2& uv, const float lod) {
+	return sampleTiledLodFuncs[sampler.wrapU][sampler.wrapV](thread, texture, sampler.filter,
+																													 uv.x, uv.y, lod + sampler.lodBias);
+}
+
+color4f TextureTileCache::sampleGrad(ThreadCache& thread, TiledTexture& texture, const Sampler& sampler,
+																		 const vec2& uv, const vec2& dUVdx, const vec2& dUVdy) {
+	const float w = (float)texture.width(), h = (float)texture.height();
+	
+	const float dx = (dUVdx.x * w) * (dUVdx.x * w) + (dUVdx.y * h) * (dUVdx.y * h);
+	const float dy = (dUVdy.x * w) * (dUVdy.x * w) + (dUVdy.y * h) * (dUVdy.y * h);
+	
+	// log2(sqrt(d)), a zero footprint gives -inf which clamps to level 0
+	const float lod = 0.5f * log2f(std::max(dx, dy)) + sampler.lodBias;
+	
+	return sampleTiledLodFuncs[sampler.wrapU][sampler.wrapV](thread, texture, sampler.filter, uv.x, uv.y, lod);
+}
+
+void TextureTileCache::setBudget(const size_t budget) {
+	this->budget = budget;
+	this->evictShards(0);
+}
+
+size_t TextureTileCache::getBudget() {
+	return this->budget;
+}
+
+size_t TextureTileCache::getUsedBytes() {
+	return this->usedBytes;
+}
+
+uint TextureTileCache::getTileLoadCount() {
+	uint loads = 0;
+	
+	for (uint i = 0; i < SHARD_COUNT; i++) {
+		std::lock_guard<std::mutex> lock(this->shards[i].mutex);
+		loads += this->shards[i].loads;
+	}
+	
+	return loads;
+}
+
+}
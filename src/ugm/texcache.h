@@ -0,0 +1,188 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef texcache_h
+#define texcache_h
+
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#include "ucm/types.h"
+#include "ucm/string.h"
+#include "ucm/file.h"
+#include "image.h"
+#include "imgcodec.h"
+#include "memstream.h"
+#include "sampler.h"
+#include "parallel.h"
+
+namespace ugm {
+
+using namespace ucm;
+
+// Texels of the tiles, 8-bit images are stored as 8-bit RGBA, float images as float RGBA
+enum TileTexelFormat {
+	TTF_RGBA8,
+	TTF_RGBA32F,
+};
+
+struct TiledTextureOptions {
+	uint tileSize;			// power of two
+	bool compress;			// deflate every tile
+	
+	TiledTextureOptions(const uint tileSize = 64, const bool compress = true)
+	: tileSize(tileSize), compress(compress) { }
+	
+	static TiledTextureOptions fastest() { return TiledTextureOptions(64, false); }
+};
+
+// Write image and its mip levels as square tiles, edge tiles repeat the last row and column.
+// Levels are filtered by downsampleMipmapRow, the same as MipmapImage::generateMipmaps. Tiles are compressed concurrently on pool, ThreadPool::shared() when NULL.
+// Only two levels are held at once, the stream is written front to back.
+void writeTiledTexture(const Image& image, Stream& stream,
+											 const TiledTextureOptions& options = TiledTextureOptions(), ThreadPool* pool = NULL);
+void writeTiledTexture(const Image& image, const string& path,
+											 const TiledTextureOptions& options = TiledTextureOptions(), ThreadPool* pool = NULL);
+
+// A tiled texture opened by TextureTileCache, only its header and tile table are in memory
+class TiledTexture {
+public:
+	struct Level {
+		uint width, height;
+		uint tilesX, tilesY;
+		uint firstTile;				// index of the first tile in the tile table
+	};
+
+private:
+	struct TileRecord {
+		unsigned long long offset;
+		uint length;
+		bool compressed;
+	};
+	
+	uint id;
+	uint tileSize, tileShift;
+	TileTexelFormat format;
+	std::vector<Level> levels;
+	std::vector<TileRecord> tiles;
+	
+	RandomAccessFile file;
+	
+	TiledTexture(const uint id, const string& path);
+	// Safe to call from any number of threads, every read is at the offset of its tile
+	void readTile(const uint index, byte* texels);
+	
+	friend class TextureTileCache;
+
+public:
+	inline uint width() const { return this->levels[0].width; }
+	inline uint height() const { return this->levels[0].height; }
+	inline uint getTileSize() const { return this->tileSize; }
+	inline uint getTileShift() const { return this->tileShift; }
+	inline TileTexelFormat getTexelFormat() const { return this->format; }
+	inline uint getLevelCount() const { return (uint)this->levels.size(); }
+	inline const Level& getLevel(const uint level) const { return this->levels[level]; }
+	
+	inline uint getTexelByteLength() const { return this->format == TTF_RGBA8 ? 4 : 16; }
+	inline size_t getTileByteLength() const { return (size_t)this->tileSize * this->tileSize * this->getTexelByteLength(); }
+};
+
+// Tiles of tiled textures loaded on demand when sampled, texture sets larger than the
+// memory can be rendered within a fixed budget. Tiles are kept in shards with their own
+// lock and evicted by the CLOCK algorithm, every sampling thread keeps its recently used
+// tiles in a ThreadCache so that most lookups take no lock at all. The budget is shared
+// by all shards, a shard over it evicts its own tiles first and then those of the others.
+class TextureTileCache {
+public:
+	struct Tile {
+		std::vector<byte> texels;
+	};
+	
+	// Recently used tiles of one thread. Do not share it between threads or keep it longer
+	// than the cache, tiles it holds stay valid until replaced even when evicted meanwhile.
+	class ThreadCache {
+	private:
+		static const uint SLOT_COUNT = 64;
+		
+		struct Slot {
+			unsigned long long key = ~0ull;
+			std::shared_ptr<const Tile> tile;
+		};
+		
+		TextureTileCache& cache;
+		Slot slots[SLOT_COUNT];
+	
+	public:
+		ThreadCache(TextureTileCache& cache) : cache(cache) { }
+		
+		const Tile& getTile(TiledTexture& texture, const uint level, const uint tileX, const uint tileY);
+		void clear();
+	};
+
+private:
+	static const uint SHARD_COUNT = 32;
+	
+	struct Entry {
+		std::shared_ptr<const Tile> tile;
+		bool referenced;
+	};
+	
+	struct Shard {
+		std::mutex mutex;
+		std::unordered_map<unsigned long long, Entry> entries;
+		std::vector<unsigned long long> clock;
+		size_t hand = 0;
+		uint loads = 0;
+	};
+	
+	std::atomic<size_t> budget;
+	std::atomic<size_t> usedBytes;
+	Shard shards[SHARD_COUNT];
+	
+	std::mutex textureMutex;
+	std::map<std::string, std::unique_ptr<TiledTexture> > textures;
+	uint nextTextureId = 0;
+	
+	std::shared_ptr<const Tile> acquire(TiledTexture& texture, const unsigned long long key, const uint tile);
+	bool evict(Shard& shard);
+	void evictShards(const uint first);
+
+public:
+	TextureTileCache(const size_t budget = 1024 * 1024 * 1024);
+	
+	// Open a file written by writeTiledTexture, the same path gives the same texture.
+	// Textures stay open until the cache is destroyed. Throws ImageCodecException when
+	// the file is not a tiled texture.
+	TiledTexture* openTexture(const string& path);
+	
+	// Texel of a level, x and y must be inside the level
+	color4f getTexel(ThreadCache& thread, TiledTexture& texture, const uint level, const uint x, const uint y);
+	
+	// Same as Sampler::sample and Sampler::sampleGrad on a MipmapImage of the image the
+	// texture was written from, the levels hold the same texels
+	color4f sample(ThreadCache& thread, TiledTexture& texture, const Sampler& sampler,
+								 const vec2& uv, const float lod = 0.0f);
+	color4f sampleGrad(ThreadCache& thread, TiledTexture& texture, const Sampler& sampler,
+										 const vec2& uv, const vec2& dUVdx, const vec2& dUVdy);
+	
+	// Tiles held by thread caches are not counted and may keep the memory above the budget
+	void setBudget(const size_t budget);
+	size_t getBudget();
+	size_t getUsedBytes();
+	// Number of tiles read from the files
+	uint getTileLoadCount();
+};
+
+}
+
+#endif /* texcache_h */
@@ -8,15 +8,27 @@
 
 #include "basefun.h"
 #include "boxtree.h"
+#include "byteorder.h"
 #include "color.h"
 #include "functions.h"
 #include "image.h"
+#include "imgasync.h"
+#include "imgcache.h"
+#include "imgbccodec.h"
 #include "imgcodec.h"
+#include "imgexpr.h"
 #include "imgfilter.h"
+#include "imghdrcodec.h"
+#include "imgrawcodec.h"
+#include "imgwarp.h"
 #include "kdtree.h"
 #include "matrix.h"
+#include "memstream.h"
 #include "octree.h"
+#include "parallel.h"
+#include "sampler.h"
 #include "spacetree.h"
+#include "texcache.h"
 #include "types2d.h"
 #include "types3d.h"
 #include "vector.h"
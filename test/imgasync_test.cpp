@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "ugm/imgasync.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static string getTestPath(const char* name, const int index) {
+	char path[64];
+	sprintf(path, "imgasync_test_%s%d.png", name, index);
+	return string(path);
+}
+
+static void testSaveQueue() {
+	ThreadPool pool(2);
+	std::atomic<int> saved(0), failed(0);
+	
+	{
+		ImageSaveQueue queue(2, &pool);
+		Image frame(PDF_RGBA, 8, 320, 200);
+		std::vector<std::future<void> > futures;
+		
+		// the frame is reused as soon as saveCopy returns
+		for (int i = 0; i < 8; i++) {
+			memset(frame.getBuffer(), i * 30, frame.getBufferLength());
+			
+			futures.push_back(queue.saveCopy(frame, getTestPath("save", i), ICF_AUTO, [&](std::exception_ptr error) {
+				if (error) failed++; else saved++;
+			}));
+			
+			// 2 saves hold the capacity, finished ones may still run their callbacks
+			TEST_CHECK(queue.getPendingCount() <= 2 + pool.getThreadCount());
+		}
+		
+		std::future<void> missing = queue.saveCopy(frame, "imgasync_test_missing/x.png", ICF_PNG,
+																							 [&](std::exception_ptr error) { if (error) failed++; });
+		bool thrown = false;
+		try { missing.get(); } catch (...) { thrown = true; }
+		TEST_CHECK(thrown);
+		
+		queue.waitAll();
+		TEST_CHECK(queue.getPendingCount() == 0);
+		TEST_CHECK(saved == 8 && failed == 1);
+		
+		for (std::future<void>& future : futures) future.get();
+	}
+	
+	for (int i = 0; i < 8; i++) {
+		Image image;
+		loadImage(image, getTestPath("save", i));
+		TEST_CHECK(image.width() == 320 && image.height() == 200 && image.getBuffer()[0] == (byte)(i * 30));
+		remove(getTestPath("save", i).getBuffer());
+	}
+}
+
+static void testSaveCallbacks() {
+	std::shared_ptr<Image> image = std::make_shared<Image>(PDF_RGB, 8, 16, 16);
+	std::atomic<int> finished(0);
+	
+	// the destructor waits for the callbacks too, not only for the writers
+	for (int i = 0; i < 20; i++) {
+		ImageSaveQueue queue(2);
+		
+		queue.enqueue(image, [](const Image&) { }, [&finished](std::exception_ptr) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			finished++;
+		});
+	}
+	
+	TEST_CHECK(finished == 20);
+	
+	ImageSaveQueue queue(1);
+	
+	// what a callback throws goes to the future
+	std::future<void> future = queue.enqueue(image, [](const Image&) { }, [](std::exception_ptr) {
+		throw ImageCodecException();
+	});
+	
+	TEST_THROWS(future.get(), ImageCodecException);
+	queue.waitAll();
+	TEST_CHECK(queue.getPendingCount() == 0);
+	
+	// callbacks may queue further saves
+	std::atomic<int> chained(0);
+	
+	queue.enqueue(image, [](const Image&) { }, [&](std::exception_ptr) {
+		queue.enqueue(image, [](const Image&) { }, [&](std::exception_ptr) { chained++; });
+	});
+	
+	queue.waitAll();
+	TEST_CHECK(chained == 1);
+}
+
+// Images of width 100 + index in several formats, the index is the pixel value too
+static std::vector<string> createLoadImages(const int count) {
+	static const char* extensions[] = { "png", "qoi", "bmp" };
+	std::vector<string> paths;
+	
+	for (int i = 0; i < count; i++) {
+		Image image(PDF_RGB, 8, 100 + i, 50);
+		memset(image.getBuffer(), i, image.getBufferLength());
+		
+		char path[64];
+		sprintf(path, "imgasync_test_load%d.%s", i, extensions[i % 3]);
+		saveImage(image, path);
+		paths.push_back(path);
+	}
+	
+	return paths;
+}
+
+static void checkLoadResult(const ImageLoadResult& result, const std::vector<uint>& ids) {
+	const size_t index = std::find(ids.begin(), ids.end(), result.id) - ids.begin();
+	TEST_CHECK(index < ids.size());
+	
+	if (index + 1 == ids.size()) {
+		// the missing file
+		TEST_CHECK(result.error && !result.image);
+	} else {
+		TEST_CHECK(!result.error && result.image);
+		TEST_CHECK(result.image->width() == 100 + (int)index && result.image->getBuffer()[0] == (byte)index);
+	}
+}
+
+static void testBatchLoader(const std::vector<string>& files) {
+	ThreadPool pool(2);
+	std::vector<string> paths(files);
+	paths.push_back("imgasync_test_missing.png");
+	
+	std::mutex mutex;
+	std::vector<uint> delivered;
+	std::vector<uint> ids;
+	
+	{
+		// a small read-ahead budget pauses the reader while the decoders catch up
+		ImageBatchLoader loader([&](ImageLoadResult& result) {
+			std::lock_guard<std::mutex> lock(mutex);
+			delivered.push_back(result.id);
+			checkLoadResult(result, ids);
+		}, &pool, 20000);
+		
+		{
+			// ids are known before the callback checks them
+			std::lock_guard<std::mutex> lock(mutex);
+			ids = loader.add(paths);
+		}
+		
+		loader.setPriority(ids[20], 5);
+		loader.wait();
+		
+		TEST_CHECK(loader.getPendingCount() == 0);
+		TEST_CHECK(!loader.setPriority(ids[20], 10));
+	}
+	
+	std::sort(delivered.begin(), delivered.end());
+	TEST_CHECK(delivered == ids);
+	
+	// without a callback the results are pulled
+	{
+		ImageBatchLoader loader(ImageBatchLoader::Callback(), &pool);
+		std::vector<uint> pullIds = loader.add(paths, 1);
+		
+		ImageLoadResult result;
+		uint count = 0;
+		
+		while (loader.next(result)) {
+			checkLoadResult(result, pullIds);
+			count++;
+		}
+		
+		TEST_CHECK(count == pullIds.size());
+	}
+	
+	// requests not read yet are dropped by the destructor
+	for (int i = 0; i < 10; i++) {
+		ImageBatchLoader loader(ImageBatchLoader::Callback(), &pool);
+		loader.add(paths);
+	}
+}
+
+int main() {
+	testSaveQueue();
+	testSaveCallbacks();
+	
+	const std::vector<string> files = createLoadImages(30);
+	testBatchLoader(files);
+	for (const string& path : files) remove(path.getBuffer());
+	
+	return 0;
+}
@@ -0,0 +1,208 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include "ugm/imgbccodec.h"
+#include "ugm/imgcodec.h"
+#include "ugm/memstream.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static byte clampByte(const double v) {
+	return (byte)std::max(0.0, std::min(255.0, v));
+}
+
+// Gradients with noise, and hard edges in blue that BC7 two-subset partitions split.
+// The left third is opaque, then an alpha gradient, then a cutout checkerboard.
+static void fillImage(Image& image) {
+	uint seed = 3;
+	const int w = image.width(), h = image.height();
+	
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			byte* p = image.getBuffer() + ((size_t)y * w + x) * 4;
+			p[0] = clampByte(128 + 100 * sin(x * 0.05 + y * 0.03) + (int)(testRandom(seed) % 21) - 10);
+			p[1] = clampByte(128 + 90 * cos(x * 0.02 - y * 0.07) + (int)(testRandom(seed) % 11) - 5);
+			p[2] = (byte)(((x / 3) ^ (y / 5)) & 255);
+			p[3] = x < w / 3 ? 255 : x < w * 2 / 3 ? (byte)(y * 255 / h) : ((x / 8 + y / 8) % 2 ? 255 : 0);
+		}
+	}
+}
+
+// PSNR of channels [first, first + count) in the columns [0, columns)
+static double getPSNR(const Image& expected, const Image& actual, const int first, const int count, const int columns) {
+	double squares = 0;
+	size_t samples = 0;
+	
+	for (int y = 0; y < expected.height(); y++) {
+		for (int x = 0; x < columns; x++) {
+			const size_t i = ((size_t)y * expected.width() + x) * 4;
+			
+			for (int c = first; c < first + count; c++, samples++) {
+				const double d = (double)expected.getBuffer()[i + c] - actual.getBuffer()[i + c];
+				squares += d * d;
+			}
+		}
+	}
+	
+	return squares == 0 ? 1000 : 10 * log10(255.0 * 255.0 * samples / squares);
+}
+
+static void testQuality(ThreadPool& pool) {
+	Image image(PDF_RGBA, 8, 128, 128);
+	fillImage(image);
+	
+	const int opaque = image.width() / 3;
+	const BlockCompressionFormat formats[] = { BCF_BC1, BCF_BC3, BCF_BC4, BCF_BC5, BCF_BC7 };
+	
+	// minimum PSNR of the color channels of the opaque part, and of alpha everywhere
+	const double minColor[] = { 33, 33, 42, 42, 35 };
+	const double minAlpha[] = { 0, 45, 0, 0, 45 };
+	
+	for (int f = 0; f < 5; f++) {
+		double lastColor = 0;
+		
+		// BC7 at BEQ_HIGH tries the two-subset partitions, run make test SANITIZE=1 to
+		// check that their index reads stay inside the block
+		for (int q = BEQ_FAST; q <= BEQ_HIGH; q++) {
+			CompressedImage compressed;
+			compressImage(image, compressed, formats[f], BlockEncodeOptions((BlockEncodeQuality)q), &pool);
+			TEST_CHECK(compressed.getBufferLength() == 32 * 32 * CompressedImage::getBlockByteLength(formats[f]));
+			
+			Image decoded;
+			decompressImage(compressed, decoded, &pool);
+			TEST_CHECK(decoded.width() == 128 && decoded.height() == 128 && decoded.getBitDepth() == 8);
+			
+			const int channels = formats[f] == BCF_BC4 ? 1 : formats[f] == BCF_BC5 ? 2 : 3;
+			const double color = getPSNR(image, decoded, 0, channels, opaque);
+			TEST_CHECK(color >= minColor[f]);
+			TEST_CHECK(color >= lastColor - 0.1);
+			lastColor = color;
+			
+			if (minAlpha[f] > 0) TEST_CHECK(getPSNR(image, decoded, 3, 1, image.width()) >= minAlpha[f]);
+		}
+	}
+}
+
+static void testSolidBlocks() {
+	// the upper half opaque, the lower half transparent
+	Image image(PDF_RGBA, 8, 8, 8);
+	
+	for (int i = 0; i < 64; i++) {
+		byte* p = image.getBuffer() + i * 4;
+		p[0] = 200; p[1] = 10; p[2] = 77; p[3] = i < 32 ? 255 : 0;
+	}
+	
+	const BlockCompressionFormat formats[] = { BCF_BC1, BCF_BC3, BCF_BC4, BCF_BC5, BCF_BC7 };
+	const int tolerance[] = { 4, 4, 0, 0, 2 };
+	
+	for (int f = 0; f < 5; f++) {
+		CompressedImage compressed;
+		compressImage(image, compressed, formats[f], BlockEncodeOptions::best());
+		
+		Image decoded;
+		decompressImage(compressed, decoded);
+		const byte* p = decoded.getBuffer();
+		
+		TEST_CHECK(abs(p[0] - 200) <= tolerance[f]);
+		
+		if (formats[f] == BCF_BC4) {
+			TEST_CHECK(p[1] == p[0] && p[2] == p[0]);
+		} else {
+			TEST_CHECK(abs(p[1] - 10) <= tolerance[f]);
+			if (formats[f] != BCF_BC5) TEST_CHECK(abs(p[2] - 77) <= tolerance[f]);
+		}
+		
+		const bool alpha = formats[f] == BCF_BC1 || formats[f] == BCF_BC3 || formats[f] == BCF_BC7;
+		TEST_CHECK(p[3] >= 255 - tolerance[f]);
+		TEST_CHECK(p[63 * 4 + 3] == (alpha ? 0 : 255));
+	}
+}
+
+static void testDDS() {
+	Image image(PDF_RGBA, 8, 36, 20);
+	fillImage(image);
+	
+	const BlockCompressionFormat formats[] = { BCF_BC1, BCF_BC3, BCF_BC4, BCF_BC5, BCF_BC7 };
+	
+	for (const BlockCompressionFormat format : formats) {
+		CompressedImage compressed;
+		compressImage(image, compressed, format, BlockEncodeOptions::fastest());
+		
+		MemoryOutputStream output;
+		writeDDS(compressed, output);
+		
+		CompressedImage read;
+		ReadonlyMemoryStream input(output.getData(), output.getLength());
+		readDDS(read, input);
+		
+		TEST_CHECK(read.getFormat() == format && read.width() == 36 && read.height() == 20);
+		TEST_CHECK(read.getBufferLength() == compressed.getBufferLength());
+		TEST_CHECK(memcmp(read.getBuffer(), compressed.getBuffer(), compressed.getBufferLength()) == 0);
+		
+		ReadonlyMemoryStream truncated(output.getData(), output.getLength() - 1);
+		TEST_THROWS(readDDS(read, truncated), ImageCodecException);
+		
+		// above the Direct3D limit, 65536 x 65536 of BC7 would be 2^32 bytes of blocks
+		std::vector<byte> file(output.getData(), output.getData() + output.getLength());
+		const uint sizes[][2] = { { 65536, 65536 }, { 16385, 4 }, { 4, 16385 } };
+		
+		for (const auto& size : sizes) {
+			for (int i = 0; i < 4; i++) {
+				file[12 + i] = (byte)(size[1] >> (i * 8));
+				file[16 + i] = (byte)(size[0] >> (i * 8));
+			}
+			
+			ReadonlyMemoryStream huge(file.data(), file.size());
+			TEST_THROWS(readDDS(read, huge), ImageCodecException);
+		}
+	}
+}
+
+static void testOddSizes() {
+	// float BGR with colors on one line, edge blocks repeat the last row and column
+	Image image(PDF_BGR, 32, 13, 7);
+	float* p = (float*)image.getBuffer();
+	
+	for (int i = 0; i < 13 * 7; i++) {
+		p[i * 3] = 0.25f;
+		p[i * 3 + 1] = (i % 13) / 24.0f;
+		p[i * 3 + 2] = (i % 13) / 12.0f;
+	}
+	
+	CompressedImage compressed;
+	compressImage(image, compressed, BCF_BC7);
+	TEST_CHECK(compressed.getBlockColumns() == 4 && compressed.getBlockRows() == 2);
+	
+	Image decoded;
+	decompressImage(compressed, decoded);
+	TEST_CHECK(decoded.width() == 13 && decoded.height() == 7);
+	
+	// decoded as RGBA
+	for (int i = 0; i < 13 * 7; i++) {
+		for (int c = 0; c < 3; c++) {
+			TEST_CHECK(abs(decoded.getBuffer()[i * 4 + c] - (int)(p[i * 3 + 2 - c] * 255 + 0.5f)) <= 4);
+		}
+	}
+}
+
+int main() {
+	ThreadPool pool(3);
+	
+	testQuality(pool);
+	testSolidBlocks();
+	testDDS();
+	testOddSizes();
+	
+	return 0;
+}
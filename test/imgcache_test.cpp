@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <sys/time.h>
+
+#include "ugm/imgcache.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static string getTestPath(const int index) {
+	char path[64];
+	sprintf(path, "imgcache_test_%d.bmp", index);
+	return string(path);
+}
+
+// BMP files of the same image size have the same length whatever the pixels
+static void writeImage(const string& path, const byte value) {
+	Image image(PDF_RGB, 8, 256, 256);
+	memset(image.getBuffer(), value, image.getBufferLength());
+	saveImage(image, path);
+}
+
+static void setModifiedTime(const string& path, const long seconds, const long microseconds) {
+	struct timeval times[2] = { { seconds, microseconds }, { seconds, microseconds } };
+	TEST_CHECK(utimes(path.getBuffer(), times) == 0);
+}
+
+int main() {
+	const size_t imageBytes = 256 * 256 * 3;
+	for (int i = 0; i < 4; i++) writeImage(getTestPath(i), (byte)i);
+	
+	ImageCache cache(3 * imageBytes);
+	
+	// concurrent requests for one path load it once
+	std::vector<std::thread> threads;
+	std::vector<std::shared_ptr<const Image> > images(8);
+	
+	for (int i = 0; i < 8; i++) {
+		threads.push_back(std::thread([&, i] { images[i] = cache.get(getTestPath(0)); }));
+	}
+	
+	for (std::thread& thread : threads) thread.join();
+	
+	for (int i = 0; i < 8; i++) TEST_CHECK(images[i] && images[i] == images[0]);
+	TEST_CHECK(cache.getMissCount() == 1 && cache.getHitCount() == 7);
+	
+	std::shared_ptr<const Image> held = images[0];
+	images.clear();
+	
+	// least recently used first, images held by the caller stay valid
+	for (int i = 1; i < 4; i++) cache.get(getTestPath(i));
+	TEST_CHECK(cache.getUsedBytes() <= 3 * imageBytes);
+	TEST_CHECK(held->getBuffer()[0] == 0);
+	
+	uint misses = cache.getMissCount();
+	cache.get(getTestPath(3));
+	TEST_CHECK(cache.getMissCount() == misses);
+	cache.get(getTestPath(1));
+	TEST_CHECK(cache.getMissCount() == misses + 1);
+	
+	// a rewrite of the same length within the same second is seen too
+	setModifiedTime(getTestPath(2), 1500000000, 100000);
+	std::shared_ptr<const Image> before = cache.get(getTestPath(2));
+	writeImage(getTestPath(2), 200);
+	setModifiedTime(getTestPath(2), 1500000000, 600000);
+	
+	std::shared_ptr<const Image> after = cache.get(getTestPath(2));
+	TEST_CHECK(after != before && after->getBuffer()[0] == 200);
+	
+	cache.invalidate(getTestPath(2));
+	TEST_CHECK(cache.get(getTestPath(2)) != after);
+	
+	// failed loads are not cached
+	for (int i = 0; i < 2; i++) {
+		bool thrown = false;
+		try { cache.get(string("imgcache_test_missing.bmp")); } catch (...) { thrown = true; }
+		TEST_CHECK(thrown);
+	}
+	
+	held.reset();
+	before.reset();
+	after.reset();
+	cache.setBudget(0);
+	TEST_CHECK(cache.getUsedBytes() == 0);
+	
+	for (int i = 0; i < 4; i++) remove(getTestPath(i).getBuffer());
+	
+	return 0;
+}
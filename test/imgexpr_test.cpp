@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+
+#include "ucm/exception.h"
+#include "ugm/imgexpr.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+// Wider than a chunk, so rows are evaluated in several runs
+static const int WIDTH = 150, HEIGHT = 7;
+
+static color4f getColor(const int x, const int y, const int seed) {
+	return color4f(((x * 7 + seed) % 100) / 100.0f, ((y * 13 + x + seed) % 50) / 50.0f,
+								 (x % 10) / 10.0f + 0.05f, ((x + y + seed) % 20) / 20.0f + 0.05f);
+}
+
+static void createImage(Image& image, const PixelDataFormat format, const int seed) {
+	image.setPixelDataFormat(format, 32);
+	image.createEmpty(WIDTH, HEIGHT);
+	
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++) {
+			image.setPixel(x, y, getColor(x, y, seed));
+		}
+	}
+}
+
+static bool isNear(const color4f& a, const color4f& b, const float tolerance = 1e-5f) {
+	return fabsf(a.r - b.r) <= tolerance && fabsf(a.g - b.g) <= tolerance
+		&& fabsf(a.b - b.b) <= tolerance && fabsf(a.a - b.a) <= tolerance;
+}
+
+// Every pixel of dest is func(x, y)
+template<typename Func>
+static void checkPixels(const Image& dest, const Func& func, const float tolerance = 1e-5f) {
+	TEST_CHECK(dest.width() == WIDTH && dest.height() == HEIGHT);
+	
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++) {
+			TEST_CHECK(isNear(dest.getPixel(x, y), func(x, y), tolerance));
+		}
+	}
+}
+
+int main() {
+	Image a, b, mask;
+	createImage(a, PDF_RGBA, 1);
+	createImage(b, PDF_RGBA, 2);
+	createImage(mask, PDF_RGBA, 3);
+	
+	// image operators combine alpha too
+	Image dest(PDF_RGBA, 32, 0, 0);
+	img::evaluate(dest, img::expr(a) + img::expr(b) * img::expr(mask));
+	checkPixels(dest, [](const int x, const int y) {
+		return getColor(x, y, 1) + getColor(x, y, 2) * getColor(x, y, 3);
+	});
+	
+	img::evaluate(dest, img::lighter(img::expr(a), img::expr(b)) - img::darker(img::expr(a), img::expr(b)));
+	checkPixels(dest, [](const int x, const int y) {
+		const color4f p = getColor(x, y, 1), q = getColor(x, y, 2);
+		return color4f(fabsf(p.r - q.r), fabsf(p.g - q.g), fabsf(p.b - q.b), fabsf(p.a - q.a));
+	});
+	
+	// float operands on either side apply to rgb and keep alpha
+	img::evaluate(dest, 1.0f - img::expr(a));
+	checkPixels(dest, [](const int x, const int y) {
+		const color4f p = getColor(x, y, 1);
+		return color4f(1 - p.r, 1 - p.g, 1 - p.b, p.a);
+	});
+	
+	img::evaluate(dest, (img::expr(a) * 2.0f + 0.25f) / 4.0f);
+	checkPixels(dest, [](const int x, const int y) {
+		const color4f p = getColor(x, y, 1);
+		return color4f((p.r * 2 + 0.25f) / 4, (p.g * 2 + 0.25f) / 4, (p.b * 2 + 0.25f) / 4, p.a);
+	});
+	
+	img::evaluate(dest, 0.5f / (img::expr(b) + 0.5f));
+	checkPixels(dest, [](const int x, const int y) {
+		const color4f p = getColor(x, y, 2);
+		return color4f(0.5f / (p.r + 0.5f), 0.5f / (p.g + 0.5f), 0.5f / (p.b + 0.5f), p.a);
+	});
+	
+	// the weight is the alpha of the mask, alpha is blended too
+	img::evaluate(dest, img::lerp(img::expr(a), img::expr(b), img::expr(mask)));
+	checkPixels(dest, [](const int x, const int y) {
+		const float t = getColor(x, y, 3).a;
+		return getColor(x, y, 1) * (1 - t) + getColor(x, y, 2) * t;
+	});
+	
+	img::evaluate(dest, img::saturate(img::gamma(img::lerp(img::expr(a), img::expr(b), 0.25f), 2.2f) * 3.0f));
+	checkPixels(dest, [](const int x, const int y) {
+		const color4f p = getColor(x, y, 1) * 0.75f + getColor(x, y, 2) * 0.25f;
+		return clamp(color4f(powf(p.r, 1 / 2.2f) * 3, powf(p.g, 1 / 2.2f) * 3, powf(p.b, 1 / 2.2f) * 3, p.a), 0.0f, 1.0f);
+	}, 1e-4f);
+	
+	// dest may be an operand, every pixel is read before it is written
+	img::evaluate(a, img::map(img::expr(a) + img::expr(a), [](const color4f& c) {
+		return color4f(c.g, c.r, c.b, c.a * 0.5f);
+	}));
+	checkPixels(a, [](const int x, const int y) {
+		const color4f p = getColor(x, y, 1);
+		return color4f(p.g * 2, p.r * 2, p.b * 2, p.a);
+	});
+	
+	// RGB images read as alpha 1, 8-bit destinations round
+	Image rgb, bytes(PDF_RGBA, 8, WIDTH, HEIGHT);
+	createImage(rgb, PDF_RGB, 4);
+	img::evaluate(bytes, img::expr(rgb) * 0.5f);
+	checkPixels(bytes, [](const int x, const int y) {
+		const color4f p = getColor(x, y, 4);
+		return color4f(p.r * 0.5f, p.g * 0.5f, p.b * 0.5f, 1.0f);
+	}, 0.5f / 255 + 1e-5f);
+	
+	Image small(PDF_RGBA, 32, 4, 4);
+	TEST_THROWS(img::evaluate(dest, img::expr(small) + img::expr(b)), ArgumentOutOfRangeException);
+	TEST_THROWS(img::evaluate(small, img::expr(b) * 2.0f), ArgumentOutOfRangeException);
+	
+	return 0;
+}
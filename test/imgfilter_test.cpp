@@ -0,0 +1,210 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "ucm/exception.h"
+#include "ugm/imgfilter.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+template<typename T>
+static void fillRandom(Image& image, uint seed) {
+	T* p = (T*)image.getBuffer();
+	const size_t count = (size_t)image.width() * image.height() * image.getColorComponents();
+	
+	for (size_t i = 0; i < count; i++) {
+		p[i] = (T)(testRandom(seed) % 256);
+	}
+}
+
+// Brute-force maximum or minimum over the window, texels outside the image are skipped
+template<typename T>
+static void morphReference(const Image& src, Image& dest, const int radius, const img::MorphShapes shape,
+													 const bool dilate) {
+	const int width = src.width(), height = src.height(), comps = src.getColorComponents();
+	const T* s = (const T*)src.getBuffer();
+	T* d = (T*)dest.getBuffer();
+	
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < comps; c++) {
+				T value = s[((size_t)y * width + x) * comps + c];
+				
+				for (int dy = -radius; dy <= radius; dy++) {
+					const int span = shape == img::MS_RECT ? radius : (int)sqrtf((float)(radius * radius - dy * dy));
+					if (y + dy < 0 || y + dy >= height) continue;
+					
+					for (int dx = -span; dx <= span; dx++) {
+						if (x + dx < 0 || x + dx >= width) continue;
+						
+						const T t = s[((size_t)(y + dy) * width + x + dx) * comps + c];
+						value = dilate ? std::max(value, t) : std::min(value, t);
+					}
+				}
+				
+				d[((size_t)y * width + x) * comps + c] = value;
+			}
+		}
+	}
+}
+
+template<typename T>
+static void testMorphology(const PixelDataFormat format, const uint bitDepth) {
+	// wider than a column strip of the vertical pass, radii past the image size
+	const int sizes[][2] = { { 1, 1 }, { 7, 5 }, { 97, 23 } };
+	const int radii[] = { 1, 2, 3, 6, 40 };
+	const img::MorphShapes shapes[] = { img::MS_RECT, img::MS_DISK };
+	
+	for (const auto& size : sizes) {
+		Image src(format, bitDepth, size[0], size[1]);
+		fillRandom<T>(src, size[0] * 31 + size[1]);
+		
+		const size_t length = src.getBufferLength();
+		
+		for (const int radius : radii) {
+			for (const img::MorphShapes shape : shapes) {
+				Image image(format, bitDepth, size[0], size[1]), expected(format, bitDepth, size[0], size[1]);
+				
+				memcpy(image.getBuffer(), src.getBuffer(), length);
+				img::dilate(image, radius, shape);
+				morphReference<T>(src, expected, radius, shape, true);
+				TEST_CHECK(memcmp(image.getBuffer(), expected.getBuffer(), length) == 0);
+				
+				memcpy(image.getBuffer(), src.getBuffer(), length);
+				img::erode(image, radius, shape);
+				morphReference<T>(src, expected, radius, shape, false);
+				TEST_CHECK(memcmp(image.getBuffer(), expected.getBuffer(), length) == 0);
+				
+				// opening is erosion then dilation, closing the reverse
+				Image eroded(format, bitDepth, size[0], size[1]);
+				morphReference<T>(src, eroded, radius, shape, false);
+				morphReference<T>(eroded, expected, radius, shape, true);
+				memcpy(image.getBuffer(), src.getBuffer(), length);
+				img::opening(image, radius, shape);
+				TEST_CHECK(memcmp(image.getBuffer(), expected.getBuffer(), length) == 0);
+				
+				morphReference<T>(src, eroded, radius, shape, true);
+				morphReference<T>(eroded, expected, radius, shape, false);
+				memcpy(image.getBuffer(), src.getBuffer(), length);
+				img::closing(image, radius, shape);
+				TEST_CHECK(memcmp(image.getBuffer(), expected.getBuffer(), length) == 0);
+			}
+		}
+	}
+}
+
+static const byte* getPixel(const Image& image, const int x, const int y) {
+	return image.getBuffer() + (size_t)y * image.getPixelRowByteLength() + (size_t)x * image.getPixelByteLength();
+}
+
+// dest(map(x, y)) is src(x, y) for every pixel of src
+template<typename Map>
+static void checkMapped(const Image& src, const Image& dest, const int destWidth, const int destHeight, const Map& map) {
+	TEST_CHECK(dest.width() == destWidth && dest.height() == destHeight);
+	TEST_CHECK(dest.getPixelDataFormat() == src.getPixelDataFormat() && dest.getBitDepth() == src.getBitDepth());
+	
+	for (int y = 0; y < src.height(); y++) {
+		for (int x = 0; x < src.width(); x++) {
+			int dx, dy;
+			map(x, y, dx, dy);
+			TEST_CHECK(memcmp(getPixel(dest, dx, dy), getPixel(src, x, y), src.getPixelByteLength()) == 0);
+		}
+	}
+}
+
+static void copyImage(const Image& src, Image& dest) {
+	dest.setPixelDataFormat(src.getPixelDataFormat(), src.getBitDepth());
+	dest.createEmpty(src.width(), src.height());
+	memcpy(dest.getBuffer(), src.getBuffer(), src.getBufferLength());
+}
+
+static void testGeometry(const PixelDataFormat format, const uint bitDepth) {
+	// square and not, across several transpose tiles and odd
+	const int sizes[][2] = { { 1, 1 }, { 1, 9 }, { 70, 70 }, { 70, 45 }, { 33, 101 } };
+	
+	for (const auto& size : sizes) {
+		const int w = size[0], h = size[1];
+		Image src(format, bitDepth, w, h), image;
+		uint seed = w * 7 + h;
+		
+		// random bytes, so a pixel moved by the wrong byte length shows
+		for (size_t i = 0; i < src.getBufferLength(); i++) {
+			src.getBuffer()[i] = (byte)testRandom(seed);
+		}
+		
+		copyImage(src, image);
+		img::flipImageHorizontally(image);
+		checkMapped(src, image, w, h, [&](const int x, const int y, int& dx, int& dy) { dx = w - 1 - x; dy = y; });
+		
+		copyImage(src, image);
+		img::flipImageVertically(image);
+		checkMapped(src, image, w, h, [&](const int x, const int y, int& dx, int& dy) { dx = x; dy = h - 1 - y; });
+		
+		copyImage(src, image);
+		img::transposeImage(image);
+		checkMapped(src, image, h, w, [](const int x, const int y, int& dx, int& dy) { dx = y; dy = x; });
+		
+		Image transposed;
+		img::transposeImage(src, transposed);
+		checkMapped(src, transposed, h, w, [](const int x, const int y, int& dx, int& dy) { dx = y; dy = x; });
+		
+		// clockwise, negative degrees turn the other way
+		const int degrees[] = { 90, 180, 270, -90, 360, 450 };
+		
+		for (const int degree : degrees) {
+			copyImage(src, image);
+			img::rotateImage(image, degree);
+			
+			switch ((degree % 360 + 360) % 360) {
+				case 90:
+					checkMapped(src, image, h, w, [&](const int x, const int y, int& dx, int& dy) { dx = h - 1 - y; dy = x; });
+					break;
+				
+				case 180:
+					checkMapped(src, image, w, h, [&](const int x, const int y, int& dx, int& dy) { dx = w - 1 - x; dy = h - 1 - y; });
+					break;
+				
+				case 270:
+					checkMapped(src, image, h, w, [&](const int x, const int y, int& dx, int& dy) { dx = y; dy = w - 1 - x; });
+					break;
+				
+				default:
+					checkMapped(src, image, w, h, [](const int x, const int y, int& dx, int& dy) { dx = x; dy = y; });
+					break;
+			}
+		}
+	}
+	
+	Image image(format, bitDepth, 4, 3);
+	TEST_THROWS(img::rotateImage(image, 45), ArgumentOutOfRangeException);
+}
+
+int main() {
+	testMorphology<byte>(PDF_RGB, 8);
+	testMorphology<byte>(PDF_RGBA, 8);
+	testMorphology<float>(PDF_RGBA, 32);
+	
+	// 3, 4, 12 and 16 bytes per pixel
+	testGeometry(PDF_RGB, 8);
+	testGeometry(PDF_BGRA, 8);
+	testGeometry(PDF_RGB, 32);
+	testGeometry(PDF_RGBA, 32);
+	
+	// a radius of 0 keeps the image
+	Image image(PDF_RGB, 8, 5, 3), copy(PDF_RGB, 8, 5, 3);
+	fillRandom<byte>(image, 7);
+	memcpy(copy.getBuffer(), image.getBuffer(), image.getBufferLength());
+	img::dilate(image, 0, img::MS_DISK);
+	TEST_CHECK(memcmp(image.getBuffer(), copy.getBuffer(), image.getBufferLength()) == 0);
+	
+	return 0;
+}
@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <cmath>
+
+#include "ugm/imghdrcodec.h"
+#include "ugm/imgcodec.h"
+#include "ugm/memstream.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static const float HALF_MIN_NORMAL = 6.103515625e-5f;
+
+// Values from 2^-20 to 2^15, within the half range, and runs of 1.0 for the run-length encoders
+static void fillImage(Image& image) {
+	float* p = (float*)image.getBuffer();
+	const uint components = image.getColorComponents();
+	
+	for (int y = 0; y < image.height(); y++) {
+		for (int x = 0; x < image.width(); x++) {
+			for (uint c = 0; c < components; c++, p++) {
+				*p = x % 37 < 10 ? 1.0f : (float)(pow(2.0, x % 36 - 20) * (1 + 0.3 * sin(y * 0.1 + c)));
+			}
+		}
+	}
+}
+
+// Error relative to the expected value, but at least to minimum
+static float getMaxRelativeError(const Image& expected, const Image& actual, const float minimum = 0) {
+	TEST_CHECK(actual.width() == expected.width() && actual.height() == expected.height());
+	TEST_CHECK(actual.getColorComponents() == expected.getColorComponents() && actual.getBitDepth() == 32);
+	
+	const float* p = (const float*)expected.getBuffer(), * q = (const float*)actual.getBuffer();
+	float error = 0;
+	
+	for (size_t i = 0, count = (size_t)expected.width() * expected.height() * expected.getColorComponents(); i < count; i++) {
+		error = std::max(error, fabsf(p[i] - q[i]) / std::max(fabsf(p[i]), minimum));
+	}
+	
+	return error;
+}
+
+static void setEXRDataWindow(std::vector<byte>& file, const int xmin, const int ymin, const int xmax, const int ymax) {
+	// name, type "box2i" and size precede the value
+	for (size_t i = 0; i + 10 < file.size(); i++) {
+		if (memcmp(&file[i], "dataWindow", 11) == 0) {
+			const int box[4] = { xmin, ymin, xmax, ymax };
+			memcpy(&file[i + 11 + 6 + 4], box, sizeof(box));
+			return;
+		}
+	}
+	
+	TEST_CHECK(false);
+}
+
+static void testHDR(ThreadPool& pool) {
+	Image image(PDF_RGB, 32, 1000, 517);
+	fillImage(image);
+	
+	MemoryOutputStream output;
+	writeHDR(image, output, &pool);
+	
+	// the shared exponent keeps 8 bits of the largest component
+	Image decoded;
+	ReadonlyMemoryStream input(output.getData(), output.getLength());
+	readHDR(decoded, input, &pool);
+	TEST_CHECK(getMaxRelativeError(image, decoded) < 1.0f / 64);
+	
+	uint width, height;
+	ReadonlyMemoryStream header(output.getData(), output.getLength());
+	TEST_CHECK(readHDRHeader(header, &width, &height) && width == 1000 && height == 517);
+	
+	ReadonlyMemoryStream truncated(output.getData(), output.getLength() / 2);
+	TEST_THROWS(readHDR(decoded, truncated, &pool), ImageCodecException);
+	
+	// 20000 x 20000 float RGB does not fit the 32-bit image size, rejected before allocating
+	const char huge[] = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 20000 +X 20000\n\x01\x01\x01\x01";
+	ReadonlyMemoryStream hugeHeader((const byte*)huge, sizeof(huge) - 1);
+	TEST_CHECK(!readHDRHeader(hugeHeader, &width, &height));
+	
+	ReadonlyMemoryStream hugeInput((const byte*)huge, sizeof(huge) - 1);
+	TEST_THROWS(readHDR(decoded, hugeInput, &pool), ImageCodecException);
+}
+
+static void testEXR(ThreadPool& pool) {
+	Image image(PDF_RGBA, 32, 777, 301);
+	fillImage(image);
+	
+	const EXRCompression compressions[] = { ECM_NONE, ECM_RLE, ECM_ZIPS, ECM_ZIP };
+	
+	for (const EXRCompression compression : compressions) {
+		MemoryOutputStream output;
+		writeEXR(image, output, EXREncodeOptions(EPT_FLOAT, compression), &pool);
+		
+		Image decoded;
+		ReadonlyMemoryStream input(output.getData(), output.getLength());
+		readEXR(decoded, input, &pool);
+		TEST_CHECK(getMaxRelativeError(image, decoded) == 0);
+		
+		output.reset();
+		writeEXR(image, output, EXREncodeOptions(EPT_HALF, compression), &pool);
+		
+		// half floats keep 11 significant bits, subnormals below 2^-14 a fixed step
+		ReadonlyMemoryStream halfInput(output.getData(), output.getLength());
+		readEXR(decoded, halfInput, &pool);
+		TEST_CHECK(getMaxRelativeError(image, decoded, HALF_MIN_NORMAL) <= 1.0f / 2048);
+	}
+	
+	// 8-bit images are written as [0, 1]
+	Image image8(PDF_RGB, 8, 16, 16);
+	for (size_t i = 0; i < image8.getBufferLength(); i++) image8.getBuffer()[i] = (byte)i;
+	
+	MemoryOutputStream output;
+	writeEXR(image8, output, EXREncodeOptions::lossless(), &pool);
+	
+	Image decoded;
+	ReadonlyMemoryStream input(output.getData(), output.getLength());
+	readEXR(decoded, input, &pool);
+	
+	for (size_t i = 0; i < image8.getBufferLength(); i++) {
+		TEST_CHECK(fabsf(((const float*)decoded.getBuffer())[i] - image8.getBuffer()[i] / 255.0f) < 1e-6f);
+	}
+}
+
+static void testEXRDataWindow(ThreadPool& pool) {
+	Image image(PDF_RGB, 32, 16, 8);
+	fillImage(image);
+	
+	MemoryOutputStream output;
+	writeEXR(image, output);
+	
+	std::vector<byte> file;
+	output.swap(file);
+	
+	const int windows[][4] = {
+		{ 0, 0, 15, 7 },
+		{ -2147483647 - 1, 0, 2147483647, 7 },		// width overflows 32 bits
+		{ 0, 0, 2147483647, 2147483647 },
+		{ 0, 0, 99999, 9999 },										// a billion pixels
+		{ 5, 0, 4, 7 },														// empty
+		{ 0, 0, 19999, 19999 },										// 400M pixels, but 4.8GB of float RGB
+	};
+	
+	for (int i = 0; i < 6; i++) {
+		std::vector<byte> patched(file);
+		setEXRDataWindow(patched, windows[i][0], windows[i][1], windows[i][2], windows[i][3]);
+		
+		uint width, height, channels, bitDepth;
+		ReadonlyMemoryStream header(patched.data(), patched.size());
+		const bool valid = readEXRHeader(header, &width, &height, &channels, &bitDepth);
+		TEST_CHECK(valid == (i == 0));
+		
+		Image decoded;
+		ReadonlyMemoryStream input(patched.data(), patched.size());
+		
+		if (valid) {
+			readEXR(decoded, input, &pool);
+			TEST_CHECK(getMaxRelativeError(image, decoded, HALF_MIN_NORMAL) <= 1.0f / 2048);
+		} else {
+			TEST_THROWS(readEXR(decoded, input, &pool), ImageCodecException);
+		}
+	}
+}
+
+int main() {
+	ThreadPool pool(3);
+	
+	testHDR(pool);
+	testEXR(pool);
+	testEXRDataWindow(pool);
+	
+	return 0;
+}
@@ -0,0 +1,106 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <vector>
+
+#include "ugm/imgcodec.h"
+#include "ugm/imgrawcodec.h"
+#include "ugm/memstream.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static void put(std::vector<byte>& file, const size_t offset, const uint value, const uint bytes,
+								const bool bigEndian) {
+	for (uint i = 0; i < bytes; i++) {
+		file[offset + (bigEndian ? bytes - 1 - i : i)] = (byte)(value >> (i * 8));
+	}
+}
+
+// An RGB strip TIFF header whose three bits per sample are stored at bitsOffset
+static std::vector<byte> makeTIFF(const bool bigEndian, const uint width, const uint height,
+																	const uint bitsOffset, const uint bits) {
+	std::vector<byte> file(bitsOffset + 6);
+	file[0] = file[1] = bigEndian ? 'M' : 'I';
+	put(file, 2, 42, 2, bigEndian);
+	put(file, 4, 8, 4, bigEndian);
+	
+	// tag, type, count and value of each entry, SHORT is 3 and LONG is 4
+	const uint entries[][4] = {
+		{ 256, 3, 1, width }, { 257, 4, 1, height }, { 258, 3, 3, bitsOffset }, { 277, 3, 1, 3 },
+	};
+	
+	put(file, 8, 4, 2, bigEndian);
+	
+	for (uint i = 0; i < 4; i++) {
+		const size_t p = 10 + i * 12;
+		put(file, p, entries[i][0], 2, bigEndian);
+		put(file, p + 2, entries[i][1], 2, bigEndian);
+		put(file, p + 4, entries[i][2], 4, bigEndian);
+		
+		// a single SHORT is left aligned in the value field
+		if (entries[i][1] == 3 && entries[i][2] == 1) {
+			put(file, p + 8, entries[i][3], 2, bigEndian);
+		} else {
+			put(file, p + 8, entries[i][3], 4, bigEndian);
+		}
+	}
+	
+	for (uint c = 0; c < 3; c++) {
+		put(file, bitsOffset + c * 2, bits, 2, bigEndian);
+	}
+	
+	return file;
+}
+
+static void checkTIFF(const bool bigEndian, const uint bitsOffset) {
+	const std::vector<byte> file = makeTIFF(bigEndian, 300, 70000, bitsOffset, 16);
+	ReadonlyMemoryStream stream(file.data(), file.size());
+	
+	ImageInfo info;
+	TEST_CHECK(probeImage(info, stream));
+	TEST_CHECK(info.format == ICF_TIFF);
+	TEST_CHECK(info.width == 300 && info.height == 70000);
+	TEST_CHECK(info.channels == 3 && info.bitDepth == 16);
+	TEST_CHECK(stream.getPosition() == 0);
+}
+
+static void checkWritten(void (*write)(const Image&, Stream&), const ImageCodecFormat format,
+												 const uint channels) {
+	Image image(channels == 4 ? PDF_RGBA : PDF_RGB, 8, 21, 13);
+	memset(image.getBuffer(), 90, image.getBufferLength());
+	
+	MemoryOutputStream output;
+	write(image, output);
+	ReadonlyMemoryStream stream(output.getData(), output.getLength());
+	
+	ImageInfo info;
+	TEST_CHECK(probeImage(info, stream));
+	TEST_CHECK(info.format == format && info.width == 21 && info.height == 13);
+	TEST_CHECK(info.channels == channels && info.bitDepth == 8);
+}
+
+int main() {
+	// bits per sample right after the directory and its next offset, and past 16 bits
+	checkTIFF(true, 62);
+	checkTIFF(false, 62);
+	checkTIFF(true, 0x10008);
+	checkTIFF(false, 0x10008);
+	
+	checkWritten(writeBMP, ICF_BMP, 3);
+	checkWritten(writeBMP, ICF_BMP, 4);
+	checkWritten(writePPM, ICF_PPM, 3);
+	
+	const byte garbage[16] = { 1, 2, 3 };
+	ReadonlyMemoryStream stream(garbage, sizeof(garbage));
+	ImageInfo info;
+	TEST_CHECK(!probeImage(info, stream));
+	
+	return 0;
+}
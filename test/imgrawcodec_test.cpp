@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ugm/imgcodec.h"
+#include "ugm/imgrawcodec.h"
+#include "ugm/memstream.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static void fillImage(Image& image) {
+	uint seed = image.width() * 13 + image.height();
+	byte* p = image.getBuffer();
+	
+	for (size_t i = 0; i < image.getBufferLength(); i++) {
+		p[i] = (byte)testRandom(seed);
+	}
+}
+
+static void checkDecoded(const Image& image, const MemoryOutputStream& output,
+												 void (*read)(Image&, Stream&)) {
+	ReadonlyMemoryStream input(output.getData(), output.getLength());
+	Image decoded;
+	read(decoded, input);
+	
+	TEST_CHECK(decoded.width() == image.width() && decoded.height() == image.height());
+	TEST_CHECK(decoded.getPixelDataFormat() == image.getPixelDataFormat());
+	TEST_CHECK(decoded.getBufferLength() == image.getBufferLength());
+	TEST_CHECK(memcmp(decoded.getBuffer(), image.getBuffer(), image.getBufferLength()) == 0);
+}
+
+// A header followed by zeros, enough for the first rows of the declared size
+static void checkRejected(std::vector<byte> file, const size_t dataLength,
+													void (*read)(Image&, Stream&)) {
+	file.resize(file.size() + dataLength);
+	ReadonlyMemoryStream input(file.data(), file.size());
+	Image decoded;
+	TEST_THROWS(read(decoded, input), ImageCodecException);
+}
+
+static std::vector<byte> textHeader(const char* text) {
+	return std::vector<byte>(text, text + strlen(text));
+}
+
+static void putLE(std::vector<byte>& file, const size_t offset, const uint value, const uint bytes) {
+	for (uint i = 0; i < bytes; i++) {
+		file[offset + i] = (byte)(value >> (i * 8));
+	}
+}
+
+int main() {
+	const PixelDataFormat formats[] = { PDF_RGB, PDF_RGBA };
+	
+	for (const PixelDataFormat format : formats) {
+		Image image(format, 8, 37, 19);
+		fillImage(image);
+		
+		MemoryOutputStream bmp, tga, rle;
+		writeBMP(image, bmp);
+		writeTGA(image, tga);
+		writeTGA(image, rle, true);
+		
+		checkDecoded(image, bmp, readBMP);
+		checkDecoded(image, tga, readTGA);
+		checkDecoded(image, rle, readTGA);
+	}
+	
+	Image rgb(PDF_RGB, 8, 37, 19);
+	fillImage(rgb);
+	MemoryOutputStream ppm;
+	writePPM(rgb, ppm);
+	checkDecoded(rgb, ppm, readPPM);
+	
+	Image floats(PDF_RGB, 32, 37, 19);
+	float* f = (float*)floats.getBuffer();
+	
+	for (size_t i = 0; i < floats.getBufferLength() / sizeof(float); i++) {
+		f[i] = (float)i * 0.25f - 100.0f;
+	}
+	
+	MemoryOutputStream pfm;
+	writePFM(floats, pfm);
+	checkDecoded(floats, pfm, readPFM);
+	
+	// sizes whose buffer does not fit 32 bits, a wrapped size would be smaller than one row
+	std::vector<byte> tgaHeader(18);
+	tgaHeader[2] = 2;
+	putLE(tgaHeader, 12, 65535, 2);
+	putLE(tgaHeader, 14, 16385, 2);
+	tgaHeader[16] = 32;
+	checkRejected(tgaHeader, 65535 * 4, readTGA);
+	
+	std::vector<byte> bmpHeader(54);
+	bmpHeader[0] = 'B';
+	bmpHeader[1] = 'M';
+	putLE(bmpHeader, 10, 54, 4);
+	putLE(bmpHeader, 14, 40, 4);
+	putLE(bmpHeader, 18, 0x40000001, 4);
+	putLE(bmpHeader, 22, 1, 4);
+	putLE(bmpHeader, 28, 32, 2);
+	checkRejected(bmpHeader, 4096, readBMP);
+	
+	putLE(bmpHeader, 18, 65536, 4);
+	putLE(bmpHeader, 22, (uint)-65536, 4);
+	checkRejected(bmpHeader, 65536 * 4, readBMP);
+	
+	checkRejected(textHeader("PF\n20000 19999\n-1.0\n"), 20000 * 12, readPFM);
+	checkRejected(textHeader("P6\n40000 40000\n255\n"), 40000 * 3, readPPM);
+	checkRejected(textHeader("P6\n30000 30000\n65535\n"), 30000 * 6, readPPM);
+	
+	return 0;
+}
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstring>
+
+#include "ucm/exception.h"
+#include "ugm/imgwarp.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static void fillImage(Image& image) {
+	uint seed = image.width() * 5 + image.height();
+	
+	for (int y = 0; y < image.height(); y++) {
+		for (int x = 0; x < image.width(); x++) {
+			image.setPixel(x, y, color4f((testRandom(seed) % 256) / 255.0f, (testRandom(seed) % 256) / 255.0f,
+																	 (testRandom(seed) % 256) / 255.0f, (testRandom(seed) % 256) / 255.0f));
+		}
+	}
+}
+
+// Maps source pixel coordinates to destination ones, the elements are stored by column
+static Matrix3 makeMatrix(const float a1, const float a2, const float a3,
+													const float b1, const float b2, const float b3,
+													const float c1 = 0, const float c2 = 0, const float c3 = 1) {
+	const float arr[9] = { a1, b1, c1, a2, b2, c2, a3, b3, c3 };
+	return Matrix3(arr);
+}
+
+static bool isSame(const Image& a, const Image& b) {
+	return a.width() == b.width() && a.height() == b.height() && a.getPixelDataFormat() == b.getPixelDataFormat()
+		&& a.getBitDepth() == b.getBitDepth() && memcmp(a.getBuffer(), b.getBuffer(), a.getBufferLength()) == 0;
+}
+
+static void testIdentity() {
+	const img::SampleFilters filters[] = { img::SF_NEAREST, img::SF_BILINEAR, img::SF_BICUBIC };
+	const PixelDataFormat formats[] = { PDF_RGB, PDF_RGBA, PDF_BGRA };
+	
+	// pixel centers map to pixel centers, every filter gives the source back
+	for (const PixelDataFormat format : formats) {
+		Image src(format, 8, 37, 21);
+		fillImage(src);
+		
+		for (const img::SampleFilters filter : filters) {
+			Image dest;
+			img::warpAffine(src, dest, Matrix3(), filter);
+			TEST_CHECK(isSame(src, dest));
+			
+			Image projected;
+			img::warpPerspective(src, projected, Matrix3(), filter);
+			TEST_CHECK(isSame(src, projected));
+		}
+	}
+}
+
+static void testTranslate() {
+	const color4f border(1.0f, 0.0f, 0.0f, 1.0f);
+	const PixelDataFormat formats[] = { PDF_RGBA, PDF_BGRA };
+	
+	for (const PixelDataFormat format : formats) {
+		Image src(format, 8, 40, 17);
+		fillImage(src);
+		
+		Image dest;
+		img::warpAffine(src, dest, makeMatrix(1, 0, 3, 0, 1, -2), img::SF_NEAREST, border);
+		TEST_CHECK(dest.width() == 40 && dest.height() == 17);
+		
+		for (int y = 0; y < 17; y++) {
+			for (int x = 0; x < 40; x++) {
+				const int sx = x - 3, sy = y + 2;
+				const bool inside = sx >= 0 && sy < 17;
+				
+				// getPixel reads BGRA in memory order, the border is stored swapped
+				const color4f expected = inside ? src.getPixel(sx, sy)
+					: (format == PDF_BGRA ? color4f(0.0f, 0.0f, 1.0f, 1.0f) : border);
+				const color4f actual = dest.getPixel(x, y);
+				TEST_CHECK(fabsf(actual.r - expected.r) < 1e-6f && fabsf(actual.g - expected.g) < 1e-6f
+									 && fabsf(actual.b - expected.b) < 1e-6f && fabsf(actual.a - expected.a) < 1e-6f);
+			}
+		}
+		
+		// the source may be the destination
+		Image inPlace(format, 8, 40, 17);
+		memcpy(inPlace.getBuffer(), src.getBuffer(), src.getBufferLength());
+		img::warpAffine(inPlace, inPlace, makeMatrix(1, 0, 3, 0, 1, -2), img::SF_NEAREST, border);
+		TEST_CHECK(isSame(inPlace, dest));
+	}
+}
+
+// The vector path of nearest 8-bit RGBA samples the same pixels as the float path
+static void testNearest() {
+	Image bytes(PDF_RGBA, 8, 61, 45), floats(PDF_RGBA, 32, 61, 45);
+	fillImage(bytes);
+	
+	for (int y = 0; y < 45; y++) {
+		for (int x = 0; x < 61; x++) {
+			floats.setPixel(x, y, bytes.getPixel(x, y));
+		}
+	}
+	
+	const float angle = 0.3f, c = cosf(angle) * 0.8f, s = sinf(angle) * 0.8f;
+	const Matrix3 matrix = makeMatrix(c, -s, 12.5f, s, c, -7.25f);
+	const color4f border(0.0f, 1.0f, 0.0f, 1.0f);
+	
+	Image destBytes(PDF_RGBA, 8, 70, 50), destFloats(PDF_RGBA, 32, 70, 50);
+	img::warpAffine(bytes, destBytes, matrix, img::SF_NEAREST, border);
+	img::warpAffine(floats, destFloats, matrix, img::SF_NEAREST, border);
+	
+	uint borders = 0;
+	
+	for (int y = 0; y < 50; y++) {
+		for (int x = 0; x < 70; x++) {
+			const color4f a = destBytes.getPixel(x, y), b = destFloats.getPixel(x, y);
+			TEST_CHECK(fabsf(a.r - b.r) < 1e-6f && fabsf(a.g - b.g) < 1e-6f && fabsf(a.b - b.b) < 1e-6f && fabsf(a.a - b.a) < 1e-6f);
+			if (b.r == 0 && b.g == 1 && b.b == 0) borders++;
+		}
+	}
+	
+	// both the border and the source are sampled
+	TEST_CHECK(borders > 100 && borders < 70 * 50 - 100);
+}
+
+static void testPerspective() {
+	Image src(PDF_RGBA, 32, 32, 32);
+	fillImage(src);
+	
+	// the inverse has w = 1 - x / 16, the right half of the destination is behind the eye
+	const color4f border(0.25f, 0.5f, 0.75f, 1.0f);
+	Image dest;
+	img::warpPerspective(src, dest, makeMatrix(1, 0, 0, 0, 1, 0, 1.0f / 16, 0, 1), img::SF_BILINEAR, border);
+	
+	for (int y = 0; y < 32; y++) {
+		for (int x = 16; x < 32; x++) {
+			const color4f p = dest.getPixel(x, y);
+			TEST_CHECK(p.r == border.r && p.g == border.g && p.b == border.b && p.a == border.a);
+		}
+	}
+	
+	TEST_THROWS(img::warpAffine(src, dest, makeMatrix(1, 2, 0, 2, 4, 0)), ArgumentOutOfRangeException);
+}
+
+int main() {
+	testIdentity();
+	testTranslate();
+	testNearest();
+	testPerspective();
+	
+	return 0;
+}
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <cmath>
+#include <new>
+
+#include "ugm/imgcodec.h"
+#include "ugm/memstream.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+// Allocations of at least 64KB fail while set, to run out of memory growing the strips
+static volatile bool failLargeAllocations = false;
+
+void* operator new(size_t size) {
+	void* p = NULL;
+	if (!failLargeAllocations || size < 64 * 1024) p = malloc(size != 0 ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+	free(p);
+}
+
+static void fillImage(Image& image, uint seed) {
+	byte* p = image.getBuffer();
+	
+	for (size_t i = 0; i < image.getBufferLength(); i++) {
+		p[i] = (byte)(128 + 100 * sin(i * 0.001 + (i % 3)) + (testRandom(seed) & 7));
+	}
+}
+
+static void decode(const MemoryOutputStream& output, Image& image) {
+	ReadonlyMemoryStream input(output.getData(), output.getLength());
+	readJPEG(image, input);
+}
+
+int main() {
+	ThreadPool pool(3);
+	
+	// restart intervals do not change the coefficients, both decode to the same pixels
+	const uint sizes[][2] = { { 1, 1 }, { 17, 15 }, { 33, 49 }, { 1001, 777 } };
+	
+	for (const auto& size : sizes) {
+		Image image(PDF_RGB, 8, size[0], size[1]);
+		fillImage(image, size[0] + size[1]);
+		
+		MemoryOutputStream serial, parallel;
+		writeJPEG(image, serial);
+		writeJPEGParallel(image, parallel, 90, &pool);
+		
+		Image expected, decoded;
+		decode(serial, expected);
+		decode(parallel, decoded);
+		
+		TEST_CHECK(decoded.width() == image.width() && decoded.height() == image.height());
+		TEST_CHECK(decoded.getBufferLength() == expected.getBufferLength());
+		TEST_CHECK(memcmp(decoded.getBuffer(), expected.getBuffer(), expected.getBufferLength()) == 0);
+	}
+	
+	Image image(PDF_RGB, 8, 1024, 1024);
+	fillImage(image, 1);
+	
+	// a failing stream is rethrown only after every strip finished
+	for (size_t limit = 100; limit < 100000; limit += 9000) {
+		FailingStream stream(limit);
+		TEST_THROWS(writeJPEGParallel(image, stream, 90, &pool), FailingStream::WriteFailed);
+	}
+	
+	// strips growing their buffers out of memory fail the encoding instead of aborting
+	{
+		Image noise(PDF_RGB, 8, 1024, 1024);
+		uint seed = 7;
+		for (size_t i = 0; i < noise.getBufferLength(); i++) noise.getBuffer()[i] = (byte)testRandom(seed);
+		
+		FailingStream output((size_t)-1);		// discards the output without allocating
+		failLargeAllocations = true;
+		bool failed = false;
+		
+		try {
+			writeJPEGParallel(noise, output, 95, &pool);
+		} catch (ImageCodecException&) {
+			failed = true;
+		}
+		
+		failLargeAllocations = false;
+		TEST_CHECK(failed);
+	}
+	
+	MemoryOutputStream output;
+	writeJPEGParallel(image, output, 90, &pool);
+	
+	Image decoded;
+	decode(output, decoded);
+	TEST_CHECK(decoded.width() == 1024 && decoded.height() == 1024);
+	
+	Image rgba(PDF_RGBA, 8, 16, 16);
+	TEST_THROWS(writeJPEGParallel(rgba, output, 90, &pool), NotSupportImageCodecException);
+	
+	return 0;
+}
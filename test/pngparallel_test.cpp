@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+
+#include "ucm/exception.h"
+#include "ugm/imgcodec.h"
+#include "ugm/memstream.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static void fillImage(Image& image, uint seed) {
+	byte* p = image.getBuffer();
+	
+	// smooth gradients with noise, so every filter and strip boundary gets exercised
+	for (size_t i = 0; i < image.getBufferLength(); i++) {
+		p[i] = (byte)(i / 7 + (i % 4) * 40 + (testRandom(seed) & 3));
+	}
+}
+
+static void checkRoundTrip(const Image& image, const PNGEncodeOptions& options, ThreadPool* pool) {
+	MemoryOutputStream output;
+	writePNGParallel(image, output, options, pool);
+	
+	Image decoded;
+	ReadonlyMemoryStream input(output.getData(), output.getLength());
+	TEST_CHECK(readPNG(decoded, input));
+	TEST_CHECK(decoded.width() == image.width() && decoded.height() == image.height());
+	TEST_CHECK(decoded.getBufferLength() == image.getBufferLength());
+	
+	if (image.getPixelDataFormat() == PDF_BGRA) {
+		// decoded as RGBA
+		const byte* p = image.getBuffer(), * q = decoded.getBuffer();
+		
+		for (size_t i = 0; i < image.getBufferLength(); i += 4) {
+			TEST_CHECK(p[i] == q[i + 2] && p[i + 1] == q[i + 1] && p[i + 2] == q[i] && p[i + 3] == q[i + 3]);
+		}
+	} else {
+		TEST_CHECK(memcmp(decoded.getBuffer(), image.getBuffer(), image.getBufferLength()) == 0);
+	}
+}
+
+int main() {
+	ThreadPool pool(3);
+	
+	const PNGEncodeOptions options[] = {
+		PNGEncodeOptions(), PNGEncodeOptions::fastest(), PNGEncodeOptions(0, PFM_PAETH), PNGEncodeOptions(9, PFM_UP, PCS_RLE),
+	};
+	
+	const PixelDataFormat formats[] = { PDF_RGBA, PDF_RGB, PDF_BGRA };
+	const uint sizes[][2] = { { 1, 1 }, { 3, 1 }, { 1, 513 }, { 1001, 777 } };
+	
+	for (const PixelDataFormat format : formats) {
+		for (const auto& size : sizes) {
+			Image image(format, 8, size[0], size[1]);
+			fillImage(image, size[0] * 31 + size[1]);
+			
+			for (const PNGEncodeOptions& o : options) {
+				checkRoundTrip(image, o, &pool);
+			}
+		}
+	}
+	
+	Image image(PDF_RGBA, 8, 512, 512);
+	fillImage(image, 1);
+	
+	// a failing stream is rethrown only after every strip finished, the pool keeps working
+	for (size_t limit = 100; limit < 60000; limit += 7000) {
+		FailingStream stream(limit);
+		TEST_THROWS(writePNGParallel(image, stream, PNGEncodeOptions::fastest(), &pool), FailingStream::WriteFailed);
+	}
+	
+	checkRoundTrip(image, PNGEncodeOptions(), &pool);
+	
+	// 7 is within the value range of the enum but not a filter
+	MemoryOutputStream output;
+	TEST_THROWS(writePNGParallel(image, output, PNGEncodeOptions(6, (PNGFilterMode)7), &pool), ArgumentOutOfRangeException);
+	
+	return 0;
+}
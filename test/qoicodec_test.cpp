@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <algorithm>
+
+#include "ugm/imgcodec.h"
+#include "ugm/memstream.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+// Runs, small and large differences and repeated colors, so every QOI op is written
+static void fillImage(Image& image) {
+	const uint components = image.getColorComponents();
+	uint seed = image.width() * 7 + image.height();
+	
+	for (int y = 0; y < image.height(); y++) {
+		byte* p = image.getBuffer() + (size_t)y * image.width() * components;
+		
+		for (int x = 0; x < image.width(); x++, p += components) {
+			p[0] = (byte)(x / 7);
+			p[1] = (byte)(y / 3 + x / 50);
+			p[2] = (byte)(x * y / 1000);
+			if (testRandom(seed) % 20 == 0) p[0] = (byte)testRandom(seed);
+			if (components == 4) p[3] = x % 300 < 100 ? 255 : (byte)(x / 5);
+		}
+	}
+}
+
+// Decoded images are RGB or RGBA
+static void checkPixels(const Image& image, const Image& decoded) {
+	const uint components = image.getColorComponents();
+	const bool bgr = image.getPixelDataFormat() == PDF_BGR || image.getPixelDataFormat() == PDF_BGRA;
+	
+	TEST_CHECK(decoded.width() == image.width() && decoded.height() == image.height());
+	TEST_CHECK(decoded.getColorComponents() == components);
+	
+	const byte* p = image.getBuffer(), * q = decoded.getBuffer();
+	
+	for (size_t i = 0; i < image.getBufferLength(); i += components) {
+		TEST_CHECK(q[i] == p[bgr ? i + 2 : i] && q[i + 1] == p[i + 1] && q[i + 2] == p[bgr ? i : i + 2]);
+		if (components == 4) TEST_CHECK(q[i + 3] == p[i + 3]);
+	}
+}
+
+static void decode(const MemoryOutputStream& output, Image& image) {
+	ReadonlyMemoryStream input(output.getData(), output.getLength());
+	readQOI(image, input);
+}
+
+int main() {
+	ThreadPool pool(3);
+	
+	const PixelDataFormat formats[] = { PDF_RGB, PDF_RGBA, PDF_BGR, PDF_BGRA };
+	const uint sizes[][2] = { { 1, 1 }, { 2, 3 }, { 1, 700 }, { 641, 480 } };
+	
+	for (const PixelDataFormat format : formats) {
+		for (const auto& size : sizes) {
+			Image image(format, 8, size[0], size[1]);
+			fillImage(image);
+			
+			MemoryOutputStream serial;
+			writeQOI(image, serial);
+			
+			Image decoded;
+			decode(serial, decoded);
+			checkPixels(image, decoded);
+			
+			MemoryOutputStream parallel;
+			writeQOIParallel(image, parallel, &pool);
+			decode(parallel, decoded);
+			checkPixels(image, decoded);
+			
+			// streaming in bands gives the same file and the same rows
+			MemoryOutputStream streamed;
+			QOIScanlineWriter writer(streamed, image.width(), image.height(), format);
+			const size_t rowLength = (size_t)image.width() * image.getColorComponents();
+			
+			for (uint y = 0; y < (uint)image.height(); y += 100) {
+				writer.writeRows(image.getBuffer() + y * rowLength, std::min(100u, image.height() - y));
+			}
+			
+			writer.finish();
+			TEST_CHECK(streamed.getLength() == serial.getLength());
+			TEST_CHECK(memcmp(streamed.getData(), serial.getData(), serial.getLength()) == 0);
+			
+			ReadonlyMemoryStream input(serial.getData(), serial.getLength());
+			QOIScanlineReader reader(input);
+			Image rows(reader.getPixelDataFormat(), 8, reader.width(), reader.height());
+			uint read = 0;
+			
+			while (!reader.isFinished()) {
+				read += reader.readRows(rows.getBuffer() + (size_t)read * reader.getRowByteLength(), 7);
+			}
+			
+			TEST_CHECK(read == (uint)image.height());
+			checkPixels(image, rows);
+		}
+	}
+	
+	Image image(PDF_RGBA, 8, 64, 64);
+	fillImage(image);
+	
+	MemoryOutputStream output;
+	writeQOI(image, output);
+	
+	Image decoded;
+	ReadonlyMemoryStream truncated(output.getData(), output.getLength() / 2);
+	TEST_THROWS(readQOI(decoded, truncated), ImageCodecException);
+	
+	Image image16(PDF_RGBA, 16, 4, 4);
+	TEST_THROWS(writeQOI(image16, output), NotSupportImageCodecException);
+	
+	return 0;
+}
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <limits>
+
+#include "ugm/sampler.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static bool isSame(const color4f& a, const color4f& b) {
+	return fabsf(a.r - b.r) < 1e-5f && fabsf(a.g - b.g) < 1e-5f && fabsf(a.b - b.b) < 1e-5f && fabsf(a.a - b.a) < 1e-5f;
+}
+
+// Every texel of the 8 x 4 base level differs
+static void createImage(Image& image, const uint bitDepth) {
+	image.setPixelDataFormat(PDF_RGBA, bitDepth);
+	image.createEmpty(8, 4);
+	
+	for (int y = 0; y < 4; y++) {
+		for (int x = 0; x < 8; x++) {
+			image.setPixel(x, y, color4f(x / 8.0f, y / 4.0f, (x + y) / 16.0f, 1.0f));
+		}
+	}
+}
+
+static void testTexelCenters(const MipmapImage& texture) {
+	const TextureWrapMode wraps[] = { TWM_REPEAT, TWM_CLAMP, TWM_MIRROR };
+	const TextureFilterMode filters[] = { TFM_NEAREST, TFM_BILINEAR, TFM_TRILINEAR };
+	
+	for (const TextureWrapMode wrap : wraps) {
+		for (const TextureFilterMode filter : filters) {
+			const Sampler sampler(wrap, filter);
+			
+			for (uint l = 0; l < texture.getLevelCount(); l++) {
+				const MipmapImage::Level& level = texture.getLevel(l);
+				
+				for (int y = 0; y < level.height; y++) {
+					for (int x = 0; x < level.width; x++) {
+						const vec2 uv((x + 0.5f) / level.width, (y + 0.5f) / level.height);
+						TEST_CHECK(isSame(sampler.sample(texture, uv, (float)l), texture.getTexel(l, x, y)));
+					}
+				}
+			}
+		}
+	}
+	
+	// one texture width further, and mirrored back
+	TEST_CHECK(isSame(Sampler(TWM_REPEAT, TFM_NEAREST).sample(texture, vec2(1 + 2.5f / 8, 0.1f)), texture.getTexel(0, 2, 0)));
+	TEST_CHECK(isSame(Sampler(TWM_MIRROR, TFM_NEAREST).sample(texture, vec2(1 + 2.5f / 8, 0.1f)), texture.getTexel(0, 5, 0)));
+	TEST_CHECK(isSame(Sampler(TWM_CLAMP, TFM_NEAREST).sample(texture, vec2(1 + 2.5f / 8, 0.1f)), texture.getTexel(0, 7, 0)));
+}
+
+// Coordinates and lods whose int conversion would be undefined clamp to the edge texels and levels
+static void testNonFinite(const MipmapImage& texture) {
+	const float nan = std::numeric_limits<float>::quiet_NaN(), inf = std::numeric_limits<float>::infinity();
+	const uint last = texture.getLevelCount() - 1;
+	const TextureFilterMode filters[] = { TFM_NEAREST, TFM_BILINEAR, TFM_TRILINEAR };
+	const vec2 center(0.5f / 8, 0.5f / 4);
+	
+	for (const TextureFilterMode filter : filters) {
+		const Sampler sampler(TWM_CLAMP, filter);
+		
+		TEST_CHECK(isSame(sampler.sample(texture, vec2(1e30f, 0.1f)), texture.getTexel(0, 7, 0)));
+		TEST_CHECK(isSame(sampler.sample(texture, vec2(inf, -inf)), texture.getTexel(0, 7, 0)));
+		TEST_CHECK(isSame(sampler.sample(texture, vec2(-1e30f, 1e30f)), texture.getTexel(0, 0, 3)));
+		TEST_CHECK(isSame(sampler.sample(texture, vec2(nan, nan)), texture.getTexel(0, 0, 0)));
+		
+		TEST_CHECK(isSame(sampler.sample(texture, center, nan), texture.getTexel(0, 0, 0)));
+		TEST_CHECK(isSame(sampler.sample(texture, center, -inf), texture.getTexel(0, 0, 0)));
+		TEST_CHECK(isSame(sampler.sample(texture, center, inf), texture.getTexel(last, 0, 0)));
+		TEST_CHECK(isSame(sampler.sample(texture, center, 1e30f), texture.getTexel(last, 0, 0)));
+		
+		// zero and non-finite footprints
+		TEST_CHECK(isSame(sampler.sampleGrad(texture, center, vec2(0, 0), vec2(0, 0)), texture.getTexel(0, 0, 0)));
+		TEST_CHECK(isSame(sampler.sampleGrad(texture, center, vec2(nan, 0), vec2(0, nan)), texture.getTexel(0, 0, 0)));
+		TEST_CHECK(isSame(sampler.sampleGrad(texture, center, vec2(inf, 0), vec2(0, 0)), texture.getTexel(last, 0, 0)));
+		
+		// the other wraps stay inside the texture
+		const TextureWrapMode wraps[] = { TWM_REPEAT, TWM_MIRROR };
+		
+		for (const TextureWrapMode wrap : wraps) {
+			const Sampler wrapped(wrap, filter);
+			const color4f c = wrapped.sample(texture, vec2(1e30f, -inf), nan);
+			TEST_CHECK(c.r >= 0 && c.r <= 1 && c.g >= 0 && c.g <= 1 && c.a == 1);
+		}
+	}
+}
+
+int main() {
+	Image image;
+	createImage(image, 8);
+	
+	MipmapImage texture(image);
+	TEST_CHECK(texture.getLevelCount() == 4);
+	testTexelCenters(texture);
+	testNonFinite(texture);
+	
+	createImage(image, 32);
+	texture.create(image);
+	testTexelCenters(texture);
+	testNonFinite(texture);
+	
+	return 0;
+}
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef testutil_h
+#define testutil_h
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "ucm/types.h"
+#include "ucm/stream.h"
+
+// Every test is a program of its own, a failed check prints where it failed and exits with 1
+
+#define TEST_CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			exit(1); \
+		} \
+	} while (0)
+
+#define TEST_THROWS(statement, exception) \
+	do { \
+		bool thrown = false; \
+		try { statement; } catch (exception&) { thrown = true; } \
+		if (!thrown) { \
+			fprintf(stderr, "%s:%d: %s not thrown: %s\n", __FILE__, __LINE__, #exception, #statement); \
+			exit(1); \
+		} \
+	} while (0)
+
+namespace ugm {
+
+using namespace ucm;
+
+// Deterministic noise, tests do not depend on the rand() of the platform
+inline uint testRandom(uint& state) {
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// Stream whose writes fail once limit bytes are written, e.g. a full disk
+class FailingStream : public Stream {
+private:
+	size_t position = 0;
+	const size_t limit;
+	
+public:
+	struct WriteFailed { };
+	
+	FailingStream(const size_t limit) : limit(limit) { }
+	
+	int read(void* buffer, uint length) { return 0; }
+	size_t write(const void* buffer, size_t length) {
+		if (this->position + length > this->limit) throw WriteFailed();
+		this->position += length;
+		return length;
+	}
+	
+	size_t getLength() const { return this->position; }
+	size_t getPosition() const { return this->position; }
+	void setPosition(size_t position) { this->position = position; }
+	bool isEnd() const { return true; }
+};
+
+}
+
+#endif /* testutil_h */
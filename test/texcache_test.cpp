@@ -0,0 +1,216 @@
+///////////////////////////////////////////////////////////////////////////////
+//  unvell Common Graphics Module (libugm.a)
+//  Common classes for cross-platform C++ 2D/3D graphics application.
+//
+//  MIT License
+//  Copyright 2016-2019 Jingwood, unvell.com, all rights reserved.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#include "ucm/exception.h"
+#include "ugm/texcache.h"
+#include "testutil.h"
+
+using namespace ugm;
+
+static const char* TEXTURE_PATH = "texcache_test.ugmt";
+
+// Odd sizes down the mip chain, so the 3-tap filter of odd levels is compared too
+static void createImage(Image& image, const uint bitDepth) {
+	image.setPixelDataFormat(PDF_RGBA, bitDepth);
+	image.createEmpty(301, 157);
+	
+	for (int y = 0; y < image.height(); y++) {
+		for (int x = 0; x < image.width(); x++) {
+			image.setPixel(x, y, color4f(((x * 7 + y * 3) % 256) / 255.0f, ((x ^ y) & 255) / 255.0f,
+																	 (y % 256) / 255.0f, ((x + y) % 128 + 128) / 255.0f));
+		}
+	}
+}
+
+static uint getTileCount(const TiledTexture& texture) {
+	uint count = 0;
+	
+	for (uint l = 0; l < texture.getLevelCount(); l++) {
+		count += texture.getLevel(l).tilesX * texture.getLevel(l).tilesY;
+	}
+	
+	return count;
+}
+
+static float getDifference(const color4f& a, const color4f& b) {
+	return std::max(std::max(fabsf(a.r - b.r), fabsf(a.g - b.g)), std::max(fabsf(a.b - b.b), fabsf(a.a - b.a)));
+}
+
+// Every texel of every level is the texel of MipmapImage
+static void testLevels(const uint bitDepth, const TiledTextureOptions& options) {
+	Image image;
+	createImage(image, bitDepth);
+	writeTiledTexture(image, string(TEXTURE_PATH), options);
+	
+	const MipmapImage mipmaps(image);
+	TextureTileCache cache;
+	TiledTexture* texture = cache.openTexture(string(TEXTURE_PATH));
+	TEST_CHECK(texture == cache.openTexture(string(TEXTURE_PATH)));
+	TEST_CHECK(texture->getLevelCount() == mipmaps.getLevelCount());
+	TEST_CHECK(texture->getTexelFormat() == (bitDepth == 8 ? TTF_RGBA8 : TTF_RGBA32F));
+	
+	TextureTileCache::ThreadCache thread(cache);
+	
+	for (uint l = 0; l < texture->getLevelCount(); l++) {
+		const TiledTexture::Level& level = texture->getLevel(l);
+		TEST_CHECK((int)level.width == mipmaps.getLevel(l).width && (int)level.height == mipmaps.getLevel(l).height);
+		
+		for (uint y = 0; y < level.height; y++) {
+			for (uint x = 0; x < level.width; x++) {
+				TEST_CHECK(getDifference(cache.getTexel(thread, *texture, l, x, y), mipmaps.getTexel(l, x, y)) == 0);
+			}
+		}
+	}
+	
+	TEST_CHECK(cache.getTileLoadCount() == getTileCount(*texture));
+}
+
+// Sampled from several threads the same as Sampler on MipmapImage
+static void testSampling() {
+	Image image;
+	createImage(image, 8);
+	writeTiledTexture(image, string(TEXTURE_PATH), TiledTextureOptions(16));
+	
+	const MipmapImage mipmaps(image);
+	TextureTileCache cache(280000);
+	TiledTexture* texture = cache.openTexture(string(TEXTURE_PATH));
+	
+	// the whole texture fits, every tile is read once however the shards fill up
+	const uint tileCount = getTileCount(*texture);
+	TEST_CHECK(tileCount * texture->getTileByteLength() <= 280000);
+	
+	{
+		TextureTileCache::ThreadCache thread(cache);
+		
+		for (int pass = 0; pass < 2; pass++) {
+			for (uint l = 0; l < texture->getLevelCount(); l++) {
+				for (uint y = 0; y < texture->getLevel(l).height; y++) {
+					for (uint x = 0; x < texture->getLevel(l).width; x++) {
+						cache.getTexel(thread, *texture, l, x, y);
+					}
+				}
+			}
+			
+			thread.clear();
+		}
+		
+		TEST_CHECK(cache.getTileLoadCount() == tileCount);
+	}
+	
+	cache.setBudget(0);
+	cache.setBudget(280000);
+	
+	const uint loads = cache.getTileLoadCount();
+	std::vector<std::thread> threads;
+	std::vector<float> differences(4, 0.0f);
+	
+	for (int t = 0; t < 4; t++) {
+		threads.push_back(std::thread([&, t] {
+			TextureTileCache::ThreadCache thread(cache);
+			const Sampler samplers[] = {
+				Sampler(TWM_REPEAT, TFM_TRILINEAR), Sampler(TWM_MIRROR, TFM_BILINEAR), Sampler(TWM_CLAMP, TFM_NEAREST),
+			};
+			
+			for (int i = 0; i < 20000; i++) {
+				const Sampler& sampler = samplers[(i + t) % 3];
+				const vec2 uv((i * 0.37f + t) / 97.0f - 1, (i * 0.61f) / 53.0f - 2);
+				const float lod = (i % 50) / 6.0f;
+				
+				differences[t] = std::max(differences[t], getDifference(cache.sample(thread, *texture, sampler, uv, lod),
+																																sampler.sample(mipmaps, uv, lod)));
+				
+				const vec2 dUVdx(lod / 301.0f, 0), dUVdy(0, lod / 157.0f);
+				differences[t] = std::max(differences[t], getDifference(cache.sampleGrad(thread, *texture, sampler, uv, dUVdx, dUVdy),
+																																sampler.sampleGrad(mipmaps, uv, dUVdx, dUVdy)));
+			}
+		}));
+	}
+	
+	for (std::thread& thread : threads) thread.join();
+	for (const float difference : differences) TEST_CHECK(difference < 1e-5f);
+	
+	// threads may read a tile at once, but the tiles are not read over and over
+	TEST_CHECK(cache.getTileLoadCount() - loads < tileCount * 2);
+	TEST_CHECK(cache.getUsedBytes() <= cache.getBudget());
+	
+	// a smaller budget evicts across the shards and keeps sampling right
+	cache.setBudget(40000);
+	TEST_CHECK(cache.getUsedBytes() <= 40000);
+	
+	TextureTileCache::ThreadCache thread(cache);
+	const Sampler sampler(TWM_REPEAT, TFM_TRILINEAR);
+	
+	for (int i = 0; i < 20000; i++) {
+		const vec2 uv(i * 0.013f, i * 0.029f);
+		TEST_CHECK(getDifference(cache.sample(thread, *texture, sampler, uv, 1.5f), sampler.sample(mipmaps, uv, 1.5f)) < 1e-5f);
+	}
+	
+	// non-finite and huge coordinates and lods sample the same edge texels and levels
+	const float nan = std::numeric_limits<float>::quiet_NaN(), inf = std::numeric_limits<float>::infinity();
+	const float values[] = { nan, inf, -inf, 1e30f, -1e30f, 0.3f };
+	const Sampler samplers[] = { Sampler(TWM_CLAMP, TFM_NEAREST), Sampler(TWM_MIRROR, TFM_BILINEAR), sampler };
+	
+	for (const Sampler& s : samplers) {
+		for (const float u : values) {
+			for (const float v : values) {
+				for (const float lod : values) {
+					const vec2 uv(u, v);
+					TEST_CHECK(getDifference(cache.sample(thread, *texture, s, uv, lod), s.sample(mipmaps, uv, lod)) < 1e-5f);
+				}
+			}
+		}
+	}
+	
+	TEST_CHECK(cache.getUsedBytes() <= 40000);
+}
+
+int main() {
+	testLevels(8, TiledTextureOptions(16, true));
+	testLevels(8, TiledTextureOptions(32, false));
+	testLevels(32, TiledTextureOptions(16, true));
+	testSampling();
+	
+	Image image;
+	createImage(image, 8);
+	TEST_THROWS(writeTiledTexture(image, string(TEXTURE_PATH), TiledTextureOptions(24)), ArgumentOutOfRangeException);
+	
+	// not a tiled texture
+	image.createEmpty(4, 4);
+	saveImage(image, string(TEXTURE_PATH), ICF_BMP);
+	
+	TextureTileCache cache;
+	TEST_THROWS(cache.openTexture(string(TEXTURE_PATH)), ImageCodecException);
+	TEST_THROWS(cache.openTexture(string("texcache_test_missing.ugmt")), ImageCodecException);
+	
+	// 4-texel tiles of the largest sides, the tile count of the levels does not fit 32 bits
+	const uint sizes[][3] = { { 0x7fffffff, 0x7fffffff, 32 }, { 0xffffffff, 1, 33 } };
+	
+	for (const auto& size : sizes) {
+		const uint fields[] = { 1, size[0], size[1], 4, size[2], 0 };
+		byte file[40] = { 'U', 'G', 'M', 'T' };
+		
+		for (int i = 0; i < 6 * 4; i++) {
+			file[4 + i] = (byte)(fields[i / 4] >> (i % 4 * 8));
+		}
+		
+		FILE* fp = fopen(TEXTURE_PATH, "wb");
+		fwrite(file, 1, sizeof(file), fp);
+		fclose(fp);
+		
+		TEST_THROWS(cache.openTexture(string(TEXTURE_PATH)), ImageCodecException);
+	}
+	
+	remove(TEXTURE_PATH);
+	
+	return 0;
+}